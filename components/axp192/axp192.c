@@ -74,52 +74,76 @@ axp192_err_t axp192_init(const axp192_t *axp)
     return AXP192_OK;
 }
 
-axp192_err_t axp192_read(const axp192_t *axp, uint8_t reg, float *buffer)
+/* Scale of a plain 12 bit ADC register. Anything unknown is passed through. */
+static void adc_scale(uint8_t reg, float *sensitivity, float *offset)
 {
-    uint8_t tmp[4];
-    float sensitivity = 1.0;
-    float offset = 0.0;
-    axp192_err_t status;
+    *sensitivity = 1.0;
+    *offset = 0.0;
 
     switch (reg) {
     case AXP192_ACIN_VOLTAGE:
     case AXP192_VBUS_VOLTAGE:
         /* 1.7mV per LSB */
-        sensitivity = 1.7 / 1000;
+        *sensitivity = 1.7 / 1000;
         break;
     case AXP192_ACIN_CURRENT:
         /* 0.375mA per LSB */
-        sensitivity = 0.625 / 1000;
+        *sensitivity = 0.625 / 1000;
         break;
     case AXP192_VBUS_CURRENT:
         /* 0.375mA per LSB */
-        sensitivity = 0.375 / 1000;
+        *sensitivity = 0.375 / 1000;
         break;
     case AXP192_TEMP:
         /* 0.1C per LSB, 0x00 = -144.7C */
-        sensitivity = 0.1;
-        offset = -144.7;
+        *sensitivity = 0.1;
+        *offset = -144.7;
         break;
     case AXP192_TS_INPUT:
         /* 0.8mV per LSB */
-        sensitivity = 0.8 / 1000;
-        break;
-    case AXP192_BATTERY_POWER:
-        /* 1.1mV * 0.5mA per LSB */
-        return read_battery_power(axp, buffer);
+        *sensitivity = 0.8 / 1000;
         break;
     case AXP192_BATTERY_VOLTAGE:
         /* 1.1mV per LSB */
-        sensitivity = 1.1 / 1000;
+        *sensitivity = 1.1 / 1000;
         break;
     case AXP192_CHARGE_CURRENT:
     case AXP192_DISCHARGE_CURRENT:
         /* 0.5mV per LSB */
-        sensitivity = 0.5 / 1000;
+        *sensitivity = 0.5 / 1000;
         break;
     case AXP192_APS_VOLTAGE:
         /* 1.4mV per LSB */
-        sensitivity = 1.4 / 1000;
+        *sensitivity = 1.4 / 1000;
+        break;
+    }
+}
+
+static float adc_decode(uint8_t reg, const uint8_t *tmp)
+{
+    float sensitivity;
+    float offset;
+
+    adc_scale(reg, &sensitivity, &offset);
+    return (((tmp[0] << 4) + tmp[1]) * sensitivity) + offset;
+}
+
+static float battery_power_decode(const uint8_t *tmp)
+{
+    /* 1.1mV * 0.5mA per LSB */
+    float sensitivity = 1.1 * 0.5 / 1000;
+    return (((tmp[0] << 16) + (tmp[1] << 8) + tmp[2]) * sensitivity);
+}
+
+axp192_err_t axp192_read(const axp192_t *axp, uint8_t reg, float *buffer)
+{
+    uint8_t tmp[4];
+    axp192_err_t status;
+
+    switch (reg) {
+    case AXP192_BATTERY_POWER:
+        /* 1.1mV * 0.5mA per LSB */
+        return read_battery_power(axp, buffer);
         break;
     case AXP192_COULOMB_COUNTER:
         /* This is currently untested. */
@@ -131,7 +155,29 @@ axp192_err_t axp192_read(const axp192_t *axp, uint8_t reg, float *buffer)
     if (AXP192_OK != status) {
         return status;
     }
-    *buffer = (((tmp[0] << 4) + tmp[1]) * sensitivity) + offset;
+    *buffer = adc_decode(reg, tmp);
+
+    return AXP192_OK;
+}
+
+axp192_err_t axp192_read_adc_block(const axp192_t *axp, axp192_adc_block_t *block)
+{
+    /* The register address auto-increments, so one read covers every channel. */
+    return axp->read(axp->handle, AXP192_ADDRESS, AXP192_ADC_BLOCK_START, block->raw, AXP192_ADC_BLOCK_SIZE);
+}
+
+axp192_err_t axp192_adc_value(const axp192_adc_block_t *block, uint8_t reg, float *buffer)
+{
+    if (reg < AXP192_ADC_BLOCK_START || reg >= AXP192_ADC_BLOCK_END) {
+        return AXP192_ERROR_EINVAL;
+    }
+    const uint8_t *tmp = &block->raw[reg - AXP192_ADC_BLOCK_START];
+
+    if (AXP192_BATTERY_POWER == reg) {
+        *buffer = battery_power_decode(tmp);
+    } else {
+        *buffer = adc_decode(reg, tmp);
+    }
 
     return AXP192_OK;
 }
@@ -167,26 +213,41 @@ axp192_err_t axp192_ioctl(const axp192_t *axp, uint16_t command, uint8_t *buffer
     return AXP192_ERROR_NOTTY;
 }
 
-static axp192_err_t read_coloumb_counter(const axp192_t *axp, float *buffer)
+axp192_err_t axp192_read_coulomb(const axp192_t *axp, uint32_t *charge, uint32_t *discharge)
 {
-    uint8_t tmp[4];
-    int32_t coin, coout;
+    uint8_t tmp[8];
     axp192_err_t status;
 
-    status = axp->read(axp->handle, AXP192_ADDRESS, AXP192_CHARGE_COULOMB, tmp, sizeof(coin));
+    /* Charge and discharge counters are adjacent, so read both at once. */
+    status = axp->read(axp->handle, AXP192_ADDRESS, AXP192_CHARGE_COULOMB, tmp, sizeof(tmp));
     if (AXP192_OK != status) {
         return status;
     }
-    coin = (tmp[0] << 24) + (tmp[1] << 16) + (tmp[2] << 8) + tmp[3];
+    axp192_coulomb_decode(tmp, charge, discharge);
+
+    return AXP192_OK;
+}
+
+void axp192_coulomb_decode(const uint8_t *raw, uint32_t *charge, uint32_t *discharge)
+{
+    *charge = ((uint32_t)raw[0] << 24) + (raw[1] << 16) + (raw[2] << 8) + raw[3];
+    *discharge = ((uint32_t)raw[4] << 24) + (raw[5] << 16) + (raw[6] << 8) + raw[7];
+}
 
-    status = axp->read(axp->handle, AXP192_ADDRESS, AXP192_DISCHARGE_COULOMB, tmp, sizeof(coout));
+static axp192_err_t read_coloumb_counter(const axp192_t *axp, float *buffer)
+{
+    uint32_t coin, coout;
+    axp192_err_t status;
+
+    status = axp192_read_coulomb(axp, &coin, &coout);
     if (AXP192_OK != status) {
         return status;
     }
-    coout = (tmp[0] << 24) + (tmp[1] << 16) + (tmp[2] << 8) + tmp[3];
 
     /* CmAh = 65536 * 0.5mA *（coin - cout) / 3600 / ADC sample rate */
-    *buffer = 32768 * (coin - coout) / 3600 / 25;
+    /* Difference taken as signed 64 bits and scaled before dividing, so */
+    /* neither the subtraction nor the division throws anything away. */
+    *buffer = 32768.0f * (float)((int64_t)coin - (int64_t)coout) / 3600.0f / 25.0f;
 
     return AXP192_OK;
 }
@@ -194,15 +255,12 @@ static axp192_err_t read_coloumb_counter(const axp192_t *axp, float *buffer)
 static axp192_err_t read_battery_power(const axp192_t *axp, float *buffer)
 {
     uint8_t tmp[4];
-    float sensitivity;
     axp192_err_t status;
 
-    /* 1.1mV * 0.5mA per LSB */
-    sensitivity = 1.1 * 0.5 / 1000;
     status = axp->read(axp->handle, AXP192_ADDRESS, AXP192_BATTERY_POWER, tmp, 3);
     if (AXP192_OK != status) {
         return status;
     }
-    *buffer = (((tmp[0] << 16) + (tmp[1] << 8) + tmp[2]) * sensitivity);
+    *buffer = battery_power_decode(tmp);
     return AXP192_OK;
 }
\ No newline at end of file
@@ -132,6 +132,10 @@ extern "C" {
 #define AXP192_CHARGE_CURRENT           (0x7a)
 #define AXP192_DISCHARGE_CURRENT        (0x7c)
 #define AXP192_APS_VOLTAGE              (0x7e)
+/* The ADC data registers above are contiguous and can be read in one burst */
+#define AXP192_ADC_BLOCK_START          (0x56)
+#define AXP192_ADC_BLOCK_END            (0x7f)
+#define AXP192_ADC_BLOCK_SIZE           (AXP192_ADC_BLOCK_END - AXP192_ADC_BLOCK_START + 1)
 #define AXP192_CHARGE_COULOMB           (0xb0)
 #define AXP192_DISCHARGE_COULOMB        (0xb4)
 #define AXP192_COULOMB_COUNTER_CONTROL  (0xb8)
@@ -151,6 +155,7 @@ extern "C" {
 /* Error codes */
 #define AXP192_OK                       (0)
 #define AXP192_ERROR_NOTTY              (-1)
+#define AXP192_ERROR_EINVAL             (-2)
 
 typedef struct {
     uint8_t command;
@@ -167,9 +172,21 @@ typedef struct {
 
 typedef int32_t axp192_err_t;
 
+/* Snapshot of all ADC data registers, taken in a single I2C transaction. */
+typedef struct {
+    uint8_t raw[AXP192_ADC_BLOCK_SIZE];
+} axp192_adc_block_t;
+
 axp192_err_t axp192_init(const axp192_t *axp);
 axp192_err_t axp192_read(const axp192_t *axp, uint8_t reg, float *buffer);
 axp192_err_t axp192_ioctl(const axp192_t *axp, uint16_t command, uint8_t *buffer);
+axp192_err_t axp192_read_adc_block(const axp192_t *axp, axp192_adc_block_t *block);
+/* Same units as axp192_read(), for any ADC register in the block. */
+axp192_err_t axp192_adc_value(const axp192_adc_block_t *block, uint8_t reg, float *buffer);
+/* Raw coulomb counters. One count is 65536 * 0.5mA for one ADC sample period. */
+axp192_err_t axp192_read_coulomb(const axp192_t *axp, uint32_t *charge, uint32_t *discharge);
+/* For callers that read the 8 counter bytes (from AXP192_CHARGE_COULOMB) themselves. */
+void axp192_coulomb_decode(const uint8_t *raw, uint32_t *charge, uint32_t *discharge);
 
 #ifdef __cplusplus
 }
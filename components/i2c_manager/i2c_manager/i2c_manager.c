@@ -34,6 +34,7 @@ SOFTWARE.
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include <driver/i2c.h>
 
 #include "sdkconfig.h"
@@ -47,6 +48,9 @@ SOFTWARE.
 		#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
 			#define HAS_CLK_FLAGS
 		#endif
+		#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+			#define HAS_STATIC_CMD_LINK
+		#endif
 	#endif
 #endif
 
@@ -56,8 +60,15 @@ static const char* TAG = I2C_TAG;
 static SemaphoreHandle_t I2C_FN(_local_mutex)[2] = { NULL, NULL };
 static SemaphoreHandle_t* I2C_FN(_mutex) = &I2C_FN(_local_mutex)[0];
 
+static QueueHandle_t I2C_FN(_queue)[2] = { NULL, NULL };
+static TaskHandle_t I2C_FN(_worker)[2] = { NULL, NULL };
+
 static const uint8_t ACK_CHECK_EN = 1;
 
+// I2C_LINK_RECOMMENDED_SIZE() counts transactions, not commands: a register
+// read is two (set the pointer, then read), anything else is one
+#define I2C_CMD_LINK_TRANSACTIONS 2
+
 #if defined (CONFIG_I2C_MANAGER_0_ENABLED)
 	#if defined (CONFIG_I2C_MANAGER_0_PULLUPS)
 		#define I2C_MANAGER_0_PULLUPS 	true
@@ -98,6 +109,117 @@ static void i2c_send_register(i2c_cmd_handle_t cmd, uint32_t reg) {
     i2c_master_write_byte(cmd, reg & 0xFF, ACK_CHECK_EN);
 }
 
+static TickType_t i2c_timeout(i2c_port_t port) {
+	TickType_t timeout = 0;
+	#if defined (CONFIG_I2C_MANAGER_0_ENABLED)
+		if (port == I2C_NUM_0) {
+			timeout = (CONFIG_I2C_MANAGER_0_TIMEOUT) / portTICK_RATE_MS;
+		}
+	#endif
+	#if defined (CONFIG_I2C_MANAGER_1_ENABLED)
+		if (port == I2C_NUM_1) {
+			timeout = (CONFIG_I2C_MANAGER_1_TIMEOUT) / portTICK_RATE_MS;
+		}
+	#endif
+	return timeout;
+}
+
+// One transfer. The caller holds the port lock.
+static esp_err_t i2c_run(i2c_port_t port, uint16_t addr, uint32_t reg, uint8_t *buffer, uint16_t size, bool write) {
+
+	#ifdef HAS_STATIC_CMD_LINK
+		// Built on the stack rather than the heap
+		uint8_t link_buf[I2C_LINK_RECOMMENDED_SIZE(I2C_CMD_LINK_TRANSACTIONS)] = {0};
+		i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(link_buf, sizeof(link_buf));
+	#else
+		i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+	#endif
+
+	if (write) {
+		i2c_master_start(cmd);
+		i2c_send_address(cmd, addr, I2C_MASTER_WRITE);
+		if (reg != 0) {
+			i2c_send_register(cmd, reg);
+		}
+		i2c_master_write(cmd, buffer, size, ACK_CHECK_EN);
+	} else {
+		if (reg != 0) {
+			/* When reading specific register set the addr pointer first. */
+			i2c_master_start(cmd);
+			i2c_send_address(cmd, addr, I2C_MASTER_WRITE);
+			i2c_send_register(cmd, reg);
+		}
+		/* Read size bytes from the current pointer. */
+		i2c_master_start(cmd);
+		i2c_send_address(cmd, addr, I2C_MASTER_READ);
+		i2c_master_read(cmd, buffer, size, I2C_MASTER_LAST_NACK);
+	}
+	i2c_master_stop(cmd);
+	esp_err_t result = i2c_master_cmd_begin(port, cmd, i2c_timeout(port));
+
+	#ifdef HAS_STATIC_CMD_LINK
+		i2c_cmd_link_delete_static(cmd);
+	#else
+		i2c_cmd_link_delete(cmd);
+	#endif
+
+	return result;
+}
+
+static void i2c_complete(i2c_manager_trans_t *trans) {
+	if (trans->done_cb) {
+		trans->done_cb(trans);
+	}
+	if (trans->notify_task) {
+		xTaskNotifyGive((TaskHandle_t)trans->notify_task);
+	}
+}
+
+static void i2c_worker_task(void *arg) {
+	i2c_port_t port = (i2c_port_t)(intptr_t)arg;
+	i2c_manager_trans_t *batch[I2C_MANAGER_BATCH_MAX];
+
+	while (1) {
+		size_t count = 0;
+		xQueueReceive(I2C_FN(_queue)[port], &batch[count++], portMAX_DELAY);
+
+		// Whatever else is already waiting runs under the same lock
+		while (count < I2C_MANAGER_BATCH_MAX &&
+		       xQueueReceive(I2C_FN(_queue)[port], &batch[count], 0) == pdTRUE) {
+			count++;
+		}
+
+		// Each entry may be a chain from transact(); a chain never gives up
+		// the lock part way through
+		if (I2C_FN(_lock)(port) == ESP_OK) {
+			for (size_t i = 0; i < count; i++) {
+				for (i2c_manager_trans_t *t = batch[i]; t != NULL; t = t->next) {
+					t->result = i2c_run(port, t->addr, t->reg, t->buffer, t->size, t->write);
+				}
+			}
+			I2C_FN(_unlock)(port);
+		} else {
+			ESP_LOGE(TAG, "Lock could not be obtained for port %d.", (int)port);
+			for (size_t i = 0; i < count; i++) {
+				for (i2c_manager_trans_t *t = batch[i]; t != NULL; t = t->next) {
+					t->result = ESP_ERR_TIMEOUT;
+				}
+			}
+		}
+
+		// Outside the lock, so callbacks can use the port themselves. Read
+		// next first: completing a transfer hands the descriptor back.
+		for (size_t i = 0; i < count; i++) {
+			i2c_manager_trans_t *t = batch[i];
+			while (t != NULL) {
+				i2c_manager_trans_t *next = t->next;
+				i2c_complete(t);
+				t = next;
+			}
+		}
+	}
+}
+
 esp_err_t I2C_FN(_init)(i2c_port_t port) {
 
 	esp_err_t ret = ESP_OK;
@@ -158,6 +280,15 @@ esp_err_t I2C_FN(_init)(i2c_port_t port) {
 //					 pullups ? ", internal pullups" : "");
 		}
 
+		if (I2C_FN(_queue)[port] == NULL) {
+			I2C_FN(_queue)[port] = xQueueCreate(I2C_MANAGER_QUEUE_LEN, sizeof(i2c_manager_trans_t*));
+			const char *name = (port == I2C_NUM_0) ? "i2c0" : "i2c1";
+			if (I2C_FN(_queue)[port] == NULL ||
+			    xTaskCreate(i2c_worker_task, name, I2C_MANAGER_TASK_STACK, (void*)(intptr_t)port, I2C_MANAGER_TASK_PRIORITY, &I2C_FN(_worker)[port]) != pdPASS) {
+				ESP_LOGE(TAG, "Failed to start the transaction queue for port %d.", (int)port);
+			}
+		}
+
 	}
 
     return ret;
@@ -167,38 +298,14 @@ esp_err_t I2C_FN(_read)(i2c_port_t port, uint16_t addr, uint32_t reg, uint8_t *b
 
     esp_err_t result;
 
-    // May seem weird, but init starts with a check if it's needed, no need for that check twice.
-	I2C_FN(_init)(port);
+	if (I2C_FN(_mutex)[port] == NULL) {
+		I2C_FN(_init)(port);
+	}
 
    	ESP_LOGD(TAG, "Reading port %d, addr 0x%03x, reg 0x%04x", port, addr, reg);
 
-	TickType_t timeout = 0;
-	#if defined (CONFIG_I2C_MANAGER_0_ENABLED)
-		if (port == I2C_NUM_0) {
-			timeout = (CONFIG_I2C_MANAGER_0_TIMEOUT) / portTICK_RATE_MS;
-		}
-	#endif
-	#if defined (CONFIG_I2C_MANAGER_1_ENABLED)
-		if (port == I2C_NUM_1) {
-			timeout = (CONFIG_I2C_MANAGER_1_TIMEOUT) / portTICK_RATE_MS;
-		}
-	#endif
-
 	if (I2C_FN(_lock)((int)port) == ESP_OK) {
-		i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-		if (reg != 0) {
-			/* When reading specific register set the addr pointer first. */
-			i2c_master_start(cmd);
-			i2c_send_address(cmd, addr, I2C_MASTER_WRITE);
-			i2c_send_register(cmd, reg);
-		}
-		/* Read size bytes from the current pointer. */
-		i2c_master_start(cmd);
-		i2c_send_address(cmd, addr, I2C_MASTER_READ);
-		i2c_master_read(cmd, buffer, size, I2C_MASTER_LAST_NACK);
-		i2c_master_stop(cmd);
-		result = i2c_master_cmd_begin(port, cmd, timeout);
-		i2c_cmd_link_delete(cmd);
+		result = i2c_run(port, addr, reg, buffer, size, false);
 		I2C_FN(_unlock)((int)port);
 	} else {
 		ESP_LOGE(TAG, "Lock could not be obtained for port %d.", (int)port);
@@ -218,34 +325,14 @@ esp_err_t I2C_FN(_write)(i2c_port_t port, uint16_t addr, uint32_t reg, const uin
 
     esp_err_t result;
 
-    // May seem weird, but init starts with a check if it's needed, no need for that check twice.
-	I2C_FN(_init)(port);
+	if (I2C_FN(_mutex)[port] == NULL) {
+		I2C_FN(_init)(port);
+	}
 
     ESP_LOGD(TAG, "Writing port %d, addr 0x%03x, reg 0x%04x", port, addr, reg);
 
-	TickType_t timeout = 0;
-	#if defined (CONFIG_I2C_MANAGER_0_ENABLED)
-		if (port == I2C_NUM_0) {
-			timeout = (CONFIG_I2C_MANAGER_0_TIMEOUT) / portTICK_RATE_MS;
-		}
-	#endif
-	#if defined (CONFIG_I2C_MANAGER_1_ENABLED)
-		if (port == I2C_NUM_1) {
-			timeout = (CONFIG_I2C_MANAGER_1_TIMEOUT) / portTICK_RATE_MS;
-		}
-	#endif
-
 	if (I2C_FN(_lock)((int)port) == ESP_OK) {
-		i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-		i2c_master_start(cmd);
-		i2c_send_address(cmd, addr, I2C_MASTER_WRITE);
-		if (reg != 0) {
-			i2c_send_register(cmd, reg);
-		}
-		i2c_master_write(cmd, (uint8_t *)buffer, size, ACK_CHECK_EN);
-		i2c_master_stop(cmd);
-		result = i2c_master_cmd_begin( port, cmd, timeout);
-		i2c_cmd_link_delete(cmd);
+		result = i2c_run(port, addr, reg, (uint8_t *)buffer, size, true);
 		I2C_FN(_unlock)((int)port);
 	} else {
 		ESP_LOGE(TAG, "Lock could not be obtained for port %d.", (int)port);
@@ -261,7 +348,70 @@ esp_err_t I2C_FN(_write)(i2c_port_t port, uint16_t addr, uint32_t reg, const uin
     return result;
 }
 
+// Queues trans and whatever is chained to it through next as one entry
+static esp_err_t i2c_enqueue(i2c_port_t port, i2c_manager_trans_t *trans) {
+
+	if (I2C_FN(_queue)[port] == NULL) {
+		I2C_FN(_init)(port);
+		if (I2C_FN(_queue)[port] == NULL) {
+			return ESP_ERR_INVALID_STATE;
+		}
+	}
+
+	ESP_LOGD(TAG, "Queueing %s on port %d, addr 0x%03x, reg 0x%04x", trans->write ? "write" : "read", port, trans->addr, trans->reg);
+
+	for (i2c_manager_trans_t *t = trans; t != NULL; t = t->next) {
+		t->result = ESP_ERR_INVALID_STATE;
+	}
+	if (xQueueSend(I2C_FN(_queue)[port], &trans, i2c_timeout(port)) != pdTRUE) {
+		ESP_LOGE(TAG, "Transaction queue full for port %d.", (int)port);
+		return ESP_ERR_TIMEOUT;
+	}
+	return ESP_OK;
+}
+
+esp_err_t I2C_FN(_submit)(i2c_port_t port, i2c_manager_trans_t *trans) {
+	trans->next = NULL;
+	return i2c_enqueue(port, trans);
+}
+
+esp_err_t I2C_FN(_transact)(i2c_port_t port, i2c_manager_trans_t *trans, size_t count) {
+
+	if (count == 0) {
+		return ESP_OK;
+	}
+
+	// One queue entry, so the worker runs them all under a single lock hold
+	for (size_t i = 0; i < count; i++) {
+		trans[i].notify_task = xTaskGetCurrentTaskHandle();
+		trans[i].next = (i + 1 < count) ? &trans[i + 1] : NULL;
+	}
+
+	esp_err_t result = i2c_enqueue(port, trans);
+	if (result != ESP_OK) {
+		return result;
+	}
+
+	// Every transfer reports on its own, each with its own timeout
+	for (size_t i = 0; i < count; i++) {
+		ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+	}
+
+	for (size_t i = 0; i < count && result == ESP_OK; i++) {
+		result = trans[i].result;
+	}
+	return result;
+}
+
 esp_err_t I2C_FN(_close)(i2c_port_t port) {
+    if (I2C_FN(_worker)[port]) {
+        vTaskDelete(I2C_FN(_worker)[port]);
+        I2C_FN(_worker)[port] = NULL;
+    }
+    if (I2C_FN(_queue)[port]) {
+        vQueueDelete(I2C_FN(_queue)[port]);
+        I2C_FN(_queue)[port] = NULL;
+    }
     vSemaphoreDelete(I2C_FN(_mutex)[port]);
     I2C_FN(_mutex)[port] = NULL;
     ESP_LOGI(TAG, "Closing I2C master at port %d", port);
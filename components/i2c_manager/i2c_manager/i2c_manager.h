@@ -21,6 +21,7 @@ extern "C" {
 
 // Only here to get the I2C_NUM_0 and I2C_NUM_1 defines.
 #include <driver/i2c.h>
+#include <stdbool.h>
 
 #define CONCATX(A, B) A ## B
 #define CONCAT(A, B) CONCATX(A, B)
@@ -50,6 +51,56 @@ esp_err_t I2C_FN(_unlock)(i2c_port_t port);
 esp_err_t I2C_FN(_force_unlock)(i2c_port_t port);
 
 
+/*
+
+    Queued transactions. Each port gets a worker task that runs whatever
+    has been submitted by the time it wakes, holding the port lock once per
+    batch rather than once per transfer. That batching is opportunistic:
+    the worker usually preempts the submitter, so two separate submits can
+    run under separate lock holds with other users of the port in between.
+    transact() queues its descriptors as one chain that always runs under a
+    single lock hold, so nothing else on the port gets between them.
+
+    The descriptors belong to the caller (static or preallocated, nothing is
+    allocated per transfer) and must stay valid until they complete.
+    Completion is reported by calling done_cb on the worker task and/or
+    giving a task notification to notify_task.
+
+*/
+
+#ifndef I2C_MANAGER_QUEUE_LEN
+    #define I2C_MANAGER_QUEUE_LEN       16
+#endif
+#ifndef I2C_MANAGER_TASK_PRIORITY
+    #define I2C_MANAGER_TASK_PRIORITY   5
+#endif
+#ifndef I2C_MANAGER_TASK_STACK
+    #define I2C_MANAGER_TASK_STACK      4096
+#endif
+#define I2C_MANAGER_BATCH_MAX           8
+
+typedef struct i2c_manager_trans_t i2c_manager_trans_t;
+typedef void (* i2c_manager_done_cb_t)(i2c_manager_trans_t *trans);
+
+struct i2c_manager_trans_t {
+    uint16_t addr;
+    uint32_t reg;
+    uint8_t *buffer;
+    uint16_t size;
+    bool write;
+    i2c_manager_done_cb_t done_cb;  // Optional, runs on the worker task
+    void *notify_task;              // Optional TaskHandle_t, gets xTaskNotifyGive()
+    void *user;
+    esp_err_t result;               // Set before completion is reported
+    i2c_manager_trans_t *next;      // Set by submit/transact
+};
+
+esp_err_t I2C_FN(_submit)(i2c_port_t port, i2c_manager_trans_t *trans);
+// Submits count transactions and waits for all of them, using the calling
+// task's notification value. Returns the first error.
+esp_err_t I2C_FN(_transact)(i2c_port_t port, i2c_manager_trans_t *trans, size_t count);
+
+
 #ifdef I2C_OEM
 
     void I2C_FN(_locking)(void* leader);
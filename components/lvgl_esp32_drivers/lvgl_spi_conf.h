@@ -127,8 +127,12 @@ extern "C" {
 
 #define SPI_BUS_MAX_TRANSFER_SZ (DISP_BUF_SIZE * 3)
 
-#elif defined (CONFIG_LV_TFT_DISPLAY_CONTROLLER_ILI9341)  || \
-      defined (CONFIG_LV_TFT_DISPLAY_CONTROLLER_ST7789)   || \
+#elif defined (CONFIG_LV_TFT_DISPLAY_CONTROLLER_ILI9341)
+
+/* A whole frame, so the draw buffer height can be chosen at runtime */
+#define SPI_BUS_MAX_TRANSFER_SZ (LV_HOR_RES_MAX * LV_VER_RES_MAX * 2)
+
+#elif defined (CONFIG_LV_TFT_DISPLAY_CONTROLLER_ST7789)   || \
       defined (CONFIG_LV_TFT_DISPLAY_CONTROLLER_ST7735S)  || \
       defined (CONFIG_LV_TFT_DISPLAY_CONTROLLER_HX8357)   || \
       defined (CONFIG_LV_TFT_DISPLAY_CONTROLLER_SH1107)   || \
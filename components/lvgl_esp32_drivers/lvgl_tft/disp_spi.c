@@ -85,6 +85,7 @@
 /**********************
  *  STATIC PROTOTYPES
  **********************/
+static void IRAM_ATTR spi_pre (spi_transaction_t *trans);
 static void IRAM_ATTR spi_ready (spi_transaction_t *trans);
 
 /**********************
@@ -93,7 +94,9 @@ static void IRAM_ATTR spi_ready (spi_transaction_t *trans);
 static spi_host_device_t spi_host;
 static spi_device_handle_t spi;
 static QueueHandle_t TransactionPool = NULL;
+static transaction_cb_t chained_pre_cb;
 static transaction_cb_t chained_post_cb;
+static int dc_gpio = -1;
 
 /**********************
  *      MACROS
@@ -105,6 +108,8 @@ static transaction_cb_t chained_post_cb;
 void disp_spi_add_device_config(spi_host_device_t host, spi_device_interface_config_t *devcfg)
 {
     spi_host=host;
+    chained_pre_cb=devcfg->pre_cb;
+    devcfg->pre_cb=spi_pre;
     chained_post_cb=devcfg->post_cb;
     devcfg->post_cb=spi_ready;
     esp_err_t ret=spi_bus_add_device(host, devcfg, &spi);
@@ -176,6 +181,11 @@ void disp_spi_remove_device()
     assert(ret==ESP_OK);
 }
 
+void disp_spi_set_dc_pin(int dc_pin)
+{
+    dc_gpio = dc_pin;
+}
+
 void disp_spi_transaction(const uint8_t *data, size_t length,
     disp_spi_send_flag_t flags, uint8_t *out,
     uint64_t addr, uint8_t dummy_bits)
@@ -297,6 +307,19 @@ void disp_spi_release(void)
  *   STATIC FUNCTIONS
  **********************/
 
+static void IRAM_ATTR spi_pre(spi_transaction_t *trans)
+{
+    disp_spi_send_flag_t flags = (disp_spi_send_flag_t) trans->user;
+
+    if (dc_gpio >= 0 && (flags & (DISP_SPI_DC_COMMAND | DISP_SPI_DC_DATA))) {
+        gpio_set_level(dc_gpio, (flags & DISP_SPI_DC_DATA) ? 1 : 0);
+    }
+
+    if (chained_pre_cb) {
+        chained_pre_cb(trans);
+    }
+}
+
 static void IRAM_ATTR spi_ready(spi_transaction_t *trans)
 {
     disp_spi_send_flag_t flags = (disp_spi_send_flag_t) trans->user;
@@ -40,6 +40,8 @@ typedef enum _disp_spi_send_flag_t {
     DISP_SPI_MODE_QIO           = 0x00000800, 
     DISP_SPI_MODE_DIOQIO_ADDR   = 0x00001000, 
 	DISP_SPI_VARIABLE_DUMMY		= 0x00002000,
+    DISP_SPI_DC_COMMAND         = 0x00004000, /* Drive DC low in pre_cb, see disp_spi_set_dc_pin() */
+    DISP_SPI_DC_DATA            = 0x00008000, /* Drive DC high in pre_cb */
 } disp_spi_send_flag_t;
 
 
@@ -52,6 +54,10 @@ void disp_spi_add_device_with_speed(spi_host_device_t host, int clock_speed_hz);
 void disp_spi_change_device_speed(int clock_speed_hz);
 void disp_spi_remove_device();
 
+/* Lets queued transactions carry their own DC level (DISP_SPI_DC_COMMAND/DATA),
+   so commands and data can be queued back to back. -1 to disable. */
+void disp_spi_set_dc_pin(int dc_pin);
+
 /*	Important! 
 	All buffers should also be 32-bit aligned and DMA capable to prevent extra allocations and copying.
 	When DMA reading (even in polling mode) the ESP32 always read in 4-byte chunks even if less is requested.
@@ -36,11 +36,14 @@ static void ili9341_set_orientation(uint8_t orientation);
 
 static void ili9341_send_cmd(uint8_t cmd);
 static void ili9341_send_data(void * data, uint16_t length);
-static void ili9341_send_color(void * data, uint16_t length);
+static void ili9341_send_color(void * data, size_t length);
+static void ili9341_queue_cmd(uint8_t cmd, const uint8_t * data, size_t length);
+static void ili9341_flush_polled(const lv_area_t * area, lv_color_t * color_map);
 
 /**********************
  *  STATIC VARIABLES
  **********************/
+static bool batched_flush = true;
 
 /**********************
  *      MACROS
@@ -93,6 +96,7 @@ void ili9341_init(void)
 	//Initialize non-SPI GPIOs
         gpio_pad_select_gpio(ILI9341_DC);
 	gpio_set_direction(ILI9341_DC, GPIO_MODE_OUTPUT);
+	disp_spi_set_dc_pin(ILI9341_DC);
 #if ILI9341_USE_RST
         gpio_pad_select_gpio(ILI9341_RST);
 	gpio_set_direction(ILI9341_RST, GPIO_MODE_OUTPUT);
@@ -138,31 +142,38 @@ void ili9341_init(void)
 
 void ili9341_flush(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * color_map)
 {
-	uint8_t data[4];
-
-	/*Column addresses*/
-	ili9341_send_cmd(0x2A);
-	data[0] = (area->x1 >> 8) & 0xFF;
-	data[1] = area->x1 & 0xFF;
-	data[2] = (area->x2 >> 8) & 0xFF;
-	data[3] = area->x2 & 0xFF;
-	ili9341_send_data(data, 4);
+	if (!batched_flush) {
+		ili9341_flush_polled(area, color_map);
+		return;
+	}
 
-	/*Page addresses*/
-	ili9341_send_cmd(0x2B);
-	data[0] = (area->y1 >> 8) & 0xFF;
-	data[1] = area->y1 & 0xFF;
-	data[2] = (area->y2 >> 8) & 0xFF;
-	data[3] = area->y2 & 0xFF;
-	ili9341_send_data(data, 4);
+	/* Window and memory write go out as one run of queued transactions. DC is
+	 * switched in the SPI pre_cb, so nothing here waits for the previous flush:
+	 * the queue keeps them in order behind its pixels. Up to 4 bytes ride in the
+	 * transaction's own tx_data, so the window needs no DMA buffer of its own. */
+	uint8_t cols[4] = {
+		(area->x1 >> 8) & 0xFF, area->x1 & 0xFF,
+		(area->x2 >> 8) & 0xFF, area->x2 & 0xFF,
+	};
+	uint8_t pages[4] = {
+		(area->y1 >> 8) & 0xFF, area->y1 & 0xFF,
+		(area->y2 >> 8) & 0xFF, area->y2 & 0xFF,
+	};
 
-	/*Memory write*/
-	ili9341_send_cmd(0x2C);
+	ili9341_queue_cmd(0x2A, cols, 4);	/*Column addresses*/
+	ili9341_queue_cmd(0x2B, pages, 4);	/*Page addresses*/
+	ili9341_queue_cmd(0x2C, NULL, 0);	/*Memory write*/
 
+	size_t size = lv_area_get_width(area) * lv_area_get_height(area);
 
-	uint32_t size = lv_area_get_width(area) * lv_area_get_height(area);
+	disp_spi_transaction((uint8_t *) color_map, size * 2,
+		DISP_SPI_SEND_QUEUED | DISP_SPI_SIGNAL_FLUSH | DISP_SPI_DC_DATA, NULL, 0, 0);
+}
 
-	ili9341_send_color((void*)color_map, size * 2);
+void ili9341_set_batched_flush(bool batched)
+{
+	disp_wait_for_pending_transactions();
+	batched_flush = batched;
 }
 
 void ili9341_enable_backlight(bool backlight)
@@ -214,13 +225,52 @@ static void ili9341_send_data(void * data, uint16_t length)
     disp_spi_send_data(data, length);
 }
 
-static void ili9341_send_color(void * data, uint16_t length)
+static void ili9341_send_color(void * data, size_t length)
 {
     disp_wait_for_pending_transactions();
     gpio_set_level(ILI9341_DC, 1);   /*Data mode*/
     disp_spi_send_colors(data, length);
 }
 
+/* Each command and its data waits for everything before it, with DC set from
+ * this task. Kept to compare against the batched flush. */
+static void ili9341_flush_polled(const lv_area_t * area, lv_color_t * color_map)
+{
+	uint8_t data[4];
+
+	/*Column addresses*/
+	ili9341_send_cmd(0x2A);
+	data[0] = (area->x1 >> 8) & 0xFF;
+	data[1] = area->x1 & 0xFF;
+	data[2] = (area->x2 >> 8) & 0xFF;
+	data[3] = area->x2 & 0xFF;
+	ili9341_send_data(data, 4);
+
+	/*Page addresses*/
+	ili9341_send_cmd(0x2B);
+	data[0] = (area->y1 >> 8) & 0xFF;
+	data[1] = area->y1 & 0xFF;
+	data[2] = (area->y2 >> 8) & 0xFF;
+	data[3] = area->y2 & 0xFF;
+	ili9341_send_data(data, 4);
+
+	/*Memory write*/
+	ili9341_send_cmd(0x2C);
+
+
+	uint32_t size = lv_area_get_width(area) * lv_area_get_height(area);
+
+	ili9341_send_color((void*)color_map, size * 2);
+}
+
+static void ili9341_queue_cmd(uint8_t cmd, const uint8_t * data, size_t length)
+{
+	disp_spi_transaction(&cmd, 1, DISP_SPI_SEND_QUEUED | DISP_SPI_DC_COMMAND, NULL, 0, 0);
+	if (length > 0) {
+		disp_spi_transaction(data, length, DISP_SPI_SEND_QUEUED | DISP_SPI_DC_DATA, NULL, 0, 0);
+	}
+}
+
 static void ili9341_set_orientation(uint8_t orientation)
 {
     // ESP_ASSERT(orientation < 4);
@@ -54,6 +54,9 @@ void ili9341_flush(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * col
 void ili9341_enable_backlight(bool backlight);
 void ili9341_sleep_in(void);
 void ili9341_sleep_out(void);
+/* Queue the window and pixels of a flush as one batch (the default) rather
+ * than sending each command and waiting for it */
+void ili9341_set_batched_flush(bool batched);
 
 /**********************
  *      MACROS
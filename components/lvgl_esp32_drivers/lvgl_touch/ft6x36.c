@@ -56,6 +56,23 @@ uint8_t ft6x36_get_gesture_id() {
     return data_buf;
 }
 
+/**
+  * @brief  Select how the INT line reports touches. Initialize first!
+  * @param  trigger: true to pulse INT once per report, false to hold it low while touched
+  * @retval ESP_OK on success
+  */
+esp_err_t ft6x36_set_interrupt_mode(bool trigger) {
+    if (!ft6x36_status.inited) {
+        ESP_LOGE(TAG, "Init first!");
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t mode = trigger ? FT6X36_G_MODE_TRIGGER : FT6X36_G_MODE_POLLING;
+    esp_err_t ret = lvgl_i2c_write(CONFIG_LV_I2C_TOUCH_PORT, current_dev_addr, FT6X36_G_MODE_REG, &mode, 1);
+    if (ret != ESP_OK)
+        ESP_LOGE(TAG, "Error setting interrupt mode: %s", esp_err_to_name(ret));
+    return ret;
+}
+
 /**
   * @brief  Initialize for FT6x36 communication via I2C
   * @param  dev_addr: Device address on communication Bus (I2C slave address of FT6X36).
@@ -87,50 +104,103 @@ void ft6x06_init(uint16_t dev_addr) {
 
 }
 
+static void ft6x36_orient_point(int16_t *x, int16_t *y) {
+#if CONFIG_LV_FT6X36_SWAPXY
+    int16_t swap_buf = *x;
+    *x = *y;
+    *y = swap_buf;
+#endif
+#if CONFIG_LV_FT6X36_INVERT_X
+    *x = LV_HOR_RES - *x;
+#endif
+#if CONFIG_LV_FT6X36_INVERT_Y
+    *y = LV_VER_RES - *y;
+#endif
+}
+
+static uint8_t ft6x36_orient_gesture(uint8_t gesture) {
+#if CONFIG_LV_FT6X36_SWAPXY
+    switch (gesture) {
+        case FT6X36_GEST_ID_MOVE_UP:    gesture = FT6X36_GEST_ID_MOVE_LEFT;  break;
+        case FT6X36_GEST_ID_MOVE_LEFT:  gesture = FT6X36_GEST_ID_MOVE_UP;    break;
+        case FT6X36_GEST_ID_MOVE_DOWN:  gesture = FT6X36_GEST_ID_MOVE_RIGHT; break;
+        case FT6X36_GEST_ID_MOVE_RIGHT: gesture = FT6X36_GEST_ID_MOVE_DOWN;  break;
+    }
+#endif
+#if CONFIG_LV_FT6X36_INVERT_X
+    if (gesture == FT6X36_GEST_ID_MOVE_LEFT) gesture = FT6X36_GEST_ID_MOVE_RIGHT;
+    else if (gesture == FT6X36_GEST_ID_MOVE_RIGHT) gesture = FT6X36_GEST_ID_MOVE_LEFT;
+#endif
+#if CONFIG_LV_FT6X36_INVERT_Y
+    if (gesture == FT6X36_GEST_ID_MOVE_UP) gesture = FT6X36_GEST_ID_MOVE_DOWN;
+    else if (gesture == FT6X36_GEST_ID_MOVE_DOWN) gesture = FT6X36_GEST_ID_MOVE_UP;
+#endif
+    return gesture;
+}
+
 /**
-  * @brief  Get the touch screen X and Y positions values. Ignores multi touch
-  * @param  drv:
-  * @param  data: Store data here
-  * @retval Always false
+  * @brief  Read every touch point and the gesture ID in one transfer. Initialize first!
+  * @param  touch: Store data here. Count is 0 on failure
+  * @retval ESP_OK on success
   */
-bool ft6x36_read(lv_indev_drv_t *drv, lv_indev_data_t *data) {
+esp_err_t ft6x36_read_touches(ft6x36_touch_t *touch) {
+    touch->gesture = FT6X36_GEST_ID_NO_GESTURE;
+    touch->count = 0;
     if (!ft6x36_status.inited) {
         ESP_LOGE(TAG, "Init first!");
-        return 0x00;
+        return ESP_ERR_INVALID_STATE;
     }
-    uint8_t data_buf[5];        // 1 byte status, 2 bytes X, 2 bytes Y
-    static int16_t last_x = 0;  // 12bit pixel value
-    static int16_t last_y = 0;  // 12bit pixel value
 
-    esp_err_t ret = lvgl_i2c_read(CONFIG_LV_I2C_TOUCH_PORT, current_dev_addr, FT6X36_TD_STAT_REG, &data_buf[0], 5);
+    // Gesture ID, status, then 6 registers per point
+    uint8_t data_buf[FT6X36_P2_MISC_REG - FT6X36_GEST_ID_REG + 1];
+    esp_err_t ret = lvgl_i2c_read(CONFIG_LV_I2C_TOUCH_PORT, current_dev_addr, FT6X36_GEST_ID_REG, &data_buf[0], sizeof(data_buf));
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Error talking to touch IC: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    uint8_t touch_pnt_cnt = (data_buf[FT6X36_TD_STAT_REG - FT6X36_GEST_ID_REG] & FT6X36_TD_STAT_MASK) >> FT6X36_TD_STAT_SHIFT;
+    if (touch_pnt_cnt > FT6X36_MAX_TOUCH_PNTS) {
+        return ESP_OK;      // Not a valid report
+    }
+
+    for (uint8_t i = 0; i < touch_pnt_cnt; i++) {
+        const uint8_t *pnt = &data_buf[FT6X36_P1_XH_REG - FT6X36_GEST_ID_REG + i * (FT6X36_P2_XH_REG - FT6X36_P1_XH_REG)];
+        ft6x36_touch_point_t *point = &touch->points[i];
+
+        point->x = ((pnt[0] & FT6X36_MSB_MASK) << 8) | (pnt[1] & FT6X36_LSB_MASK);
+        point->y = ((pnt[2] & FT6X36_MSB_MASK) << 8) | (pnt[3] & FT6X36_LSB_MASK);
+        point->event = (pnt[0] & FT6X36_TOUCH_EVT_FLAG_MASK) >> FT6X36_TOUCH_EVT_FLAG_SHIFT;
+        point->id = pnt[2] >> 4;
+        ft6x36_orient_point(&point->x, &point->y);
     }
-    uint8_t touch_pnt_cnt = data_buf[0];  // Number of detected touch points
 
-    if (ret != ESP_OK || touch_pnt_cnt != 1) {    // ignore no touch & multi touch
+    touch->gesture = ft6x36_orient_gesture(data_buf[0]);
+    touch->count = touch_pnt_cnt;
+    return ESP_OK;
+}
+
+/**
+  * @brief  Get the touch screen X and Y positions values. Ignores multi touch
+  * @param  drv:
+  * @param  data: Store data here
+  * @retval Always false
+  */
+bool ft6x36_read(lv_indev_drv_t *drv, lv_indev_data_t *data) {
+    static int16_t last_x = 0;  // 12bit pixel value
+    static int16_t last_y = 0;  // 12bit pixel value
+    ft6x36_touch_t touch;
+
+    if (ft6x36_read_touches(&touch) != ESP_OK || touch.count != 1) {    // ignore no touch & multi touch
         data->point.x = last_x;
         data->point.y = last_y;
         data->state = LV_INDEV_STATE_REL;
         return false;
     }
 
-    last_x = ((data_buf[1] & FT6X36_MSB_MASK) << 8) | (data_buf[2] & FT6X36_LSB_MASK);
-    last_y = ((data_buf[3] & FT6X36_MSB_MASK) << 8) | (data_buf[4] & FT6X36_LSB_MASK);
+    last_x = touch.points[0].x;
+    last_y = touch.points[0].y;
 
-    //ESP_LOGI(TAG, "TOUCH STATUS: %02x %02x %02x %02x %02x | (%d,%d)", data_buf[0], data_buf[1], data_buf[2], data_buf[3], data_buf[4], data->point.x, data->point.y);
-
-#if CONFIG_LV_FT6X36_SWAPXY
-    int16_t swap_buf = last_x;
-    last_x = last_y;
-    last_y = swap_buf;
-#endif
-#if CONFIG_LV_FT6X36_INVERT_X
-    last_x =  LV_HOR_RES - last_x;
-#endif
-#if CONFIG_LV_FT6X36_INVERT_Y
-    last_y = LV_VER_RES - last_y;
-#endif
     data->point.x = last_x;
     data->point.y = last_y;
     data->state = LV_INDEV_STATE_PR;
@@ -23,6 +23,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "esp_err.h"
 #ifdef LV_LVGL_H_INCLUDE_SIMPLE
 #include "lvgl.h"
 #else
@@ -134,6 +135,10 @@ extern "C" {
 
 #define FT6X36_CHIPSELECT_REG            0xA3       /* 0x36 for ft6236; 0x06 for ft6206 */
 
+#define FT6X36_G_MODE_REG                0xA4       /* How the INT line reports touches */
+#define FT6X36_G_MODE_POLLING            0x00       /* INT held low while touched */
+#define FT6X36_G_MODE_TRIGGER            0x01       /* INT pulsed once per report */
+
 #define FT6X36_POWER_MODE_REG            0xA5
 #define FT6X36_FIRMWARE_ID_REG           0xA6
 #define FT6X36_RELEASECODE_REG           0xAF
@@ -145,6 +150,19 @@ typedef struct {
     bool inited;
 } ft6x36_status_t;
 
+typedef struct {
+    int16_t x;
+    int16_t y;
+    uint8_t id;         /* Stays the same while the finger is down */
+    uint8_t event;      /* FT6X36_TOUCH_EVT_FLAG_* */
+} ft6x36_touch_point_t;
+
+typedef struct {
+    uint8_t gesture;    /* FT6X36_GEST_ID_*, turned to match the screen like the points */
+    uint8_t count;      /* Valid entries in points */
+    ft6x36_touch_point_t points[FT6X36_MAX_TOUCH_PNTS];
+} ft6x36_touch_t;
+
 /**
   * @brief  Initialize for FT6x36 communication via I2C
   * @param  dev_addr: Device address on communication Bus (I2C slave address of FT6X36).
@@ -154,6 +172,20 @@ void ft6x06_init(uint16_t dev_addr);
 
 uint8_t ft6x36_get_gesture_id();
 
+/**
+  * @brief  Select how the INT line reports touches. Initialize first!
+  * @param  trigger: true to pulse INT once per report, false to hold it low while touched
+  * @retval ESP_OK on success
+  */
+esp_err_t ft6x36_set_interrupt_mode(bool trigger);
+
+/**
+  * @brief  Read every touch point and the gesture ID in one transfer. Initialize first!
+  * @param  touch: Store data here. Count is 0 on failure
+  * @retval ESP_OK on success
+  */
+esp_err_t ft6x36_read_touches(ft6x36_touch_t *touch);
+
 /**
   * @brief  Get the touch screen X and Y positions values. Ignores multi touch
   * @param  drv:
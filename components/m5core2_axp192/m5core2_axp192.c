@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "axp192.h"
 #include "i2c_manager.h"
@@ -22,6 +23,9 @@ esp_err_t m5core2_init() {
 
     ESP_LOGI(TAG, "Initialising");
 
+    // Start from whatever the chip holds now
+    m5core2_axp_shadow_invalidate();
+
     // turn off everything except bit 2 and then turn bit 1 on
     if (m5core2_axp_twiddle(AXP192_VBUS_IPSOUT_CHANNEL, 0b11111011, 0x02) == ESP_OK) {
         ESP_LOGI(TAG, "\tVbus limit off");
@@ -77,6 +81,10 @@ esp_err_t m5core2_init() {
     	ESP_LOGI(TAG, "\tEnabled all ADC channels");
     }
 
+    if (axp192_ioctl((axp192_t*)AXP_I2C, AXP192_COULOMB_COUNTER_ENABLE, NULL) == ESP_OK) {
+    	ESP_LOGI(TAG, "\tCoulomb counter enabled");
+    }
+
     if (m5core2_int_5v(true) == ESP_OK) {
     	ESP_LOGI(TAG, "\tUSB / battery powered, 5V bus on");
     }
@@ -130,26 +138,163 @@ esp_err_t m5core2_speaker(bool on) {
 }
 
 
-esp_err_t m5core2_axp_read_reg(uint8_t reg, uint8_t *buffer) {
+// Write-through copy of the control registers, so read-modify-write only
+// costs the write. Status, IRQ status, ADC and coulomb registers change
+// underneath us and always go to the chip.
+static uint8_t shadow[256];
+static uint32_t shadow_valid[256 / 32];
+static portMUX_TYPE shadow_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool shadow_reg(uint8_t reg) {
+	return (reg >= AXP192_EXTEN_DCDC2_CONTROL && reg <= AXP192_BATTERY_DISCHARGE_HIGH_TEMP) ||
+	       (reg >= AXP192_ENABLE_CONTROL_1 && reg <= AXP192_ENABLE_CONTROL_4) ||
+	       reg == AXP192_ENABLE_CONTROL_5 ||
+	       (reg >= AXP192_DCDC_MODE && reg <= AXP192_N_RSTO_GPIO5_CONTROL);
+}
+
+// Bits in a control register the chip sets by itself: GPIO input levels and
+// the timer's timeout flag. They are kept as zero in the shadow, which the
+// chip ignores or treats as "leave alone" when written back.
+static uint8_t live_bits(uint8_t reg) {
+	switch (reg) {
+		case AXP192_TIMER_CONTROL:          return 0x80;
+		case AXP192_GPIO20_SIGNAL_STATUS:   return 0x70;
+		case AXP192_GPIO40_SIGNAL_STATUS:   return 0x30;
+		default:                            return 0x00;
+	}
+}
+
+static bool shadow_get(uint8_t reg, uint8_t *value) {
+	bool valid;
+	portENTER_CRITICAL(&shadow_lock);
+	valid = shadow_valid[reg / 32] & (1u << (reg % 32));
+	*value = shadow[reg];
+	portEXIT_CRITICAL(&shadow_lock);
+	return valid;
+}
+
+static void shadow_set(uint8_t reg, uint8_t value) {
+	if (!shadow_reg(reg)) return;
+	portENTER_CRITICAL(&shadow_lock);
+	shadow[reg] = value & ~live_bits(reg);
+	shadow_valid[reg / 32] |= (1u << (reg % 32));
+	portEXIT_CRITICAL(&shadow_lock);
+}
+
+static void shadow_drop(uint8_t reg) {
+	portENTER_CRITICAL(&shadow_lock);
+	shadow_valid[reg / 32] &= ~(1u << (reg % 32));
+	portEXIT_CRITICAL(&shadow_lock);
+}
+
+static esp_err_t hw_read_reg(uint8_t reg, uint8_t *buffer) {
 	axp192_t* ptr = (axp192_t*)AXP_I2C;
 	return ptr->read(ptr->handle, AXP192_ADDRESS, reg, buffer, 1);
 }
 
-esp_err_t m5core2_axp_write_reg(uint8_t reg, uint8_t value) {
+static esp_err_t hw_write_reg(uint8_t reg, uint8_t value) {
 	axp192_t* ptr = (axp192_t*)AXP_I2C;
 	uint8_t buffer = value;
 	return ptr->write(ptr->handle, AXP192_ADDRESS, reg, &buffer, 1);
 }
 
+esp_err_t m5core2_axp_read_reg(uint8_t reg, uint8_t *buffer) {
+	if (live_bits(reg) == 0 && shadow_get(reg, buffer)) {
+		return ESP_OK;
+	}
+
+	esp_err_t ret = hw_read_reg(reg, buffer);
+	if (ret == ESP_OK) {
+		shadow_set(reg, *buffer);
+	}
+	return ret;
+}
+
+esp_err_t m5core2_axp_write_reg(uint8_t reg, uint8_t value) {
+	esp_err_t ret = hw_write_reg(reg, value);
+	if (ret == ESP_OK) {
+		shadow_set(reg, value);
+	} else {
+		// Can't tell whether it landed
+		shadow_drop(reg);
+	}
+	return ret;
+}
+
+void m5core2_axp_shadow_invalidate() {
+	portENTER_CRITICAL(&shadow_lock);
+	memset(shadow_valid, 0, sizeof(shadow_valid));
+	portEXIT_CRITICAL(&shadow_lock);
+}
+
+esp_err_t m5core2_axp_shadow_verify(uint8_t *checked, uint8_t *mismatches) {
+	esp_err_t ret = ESP_OK;
+	*checked = 0;
+	*mismatches = 0;
+
+	for (int reg = 0; reg < 256; reg++) {
+		uint8_t cached, actual;
+		if (!shadow_get(reg, &cached)) continue;
+
+		ret = hw_read_reg(reg, &actual);
+		if (ret != ESP_OK) {
+			break;
+		}
+		(*checked)++;
+
+		actual &= ~live_bits(reg);
+		if (actual != cached) {
+			ESP_LOGW(TAG, "Shadow of 0x%02x is 0x%02x, chip has 0x%02x", reg, cached, actual);
+			(*mismatches)++;
+			// The chip is right; take its value
+			shadow_set(reg, actual);
+		}
+	}
+	return ret;
+}
+
 esp_err_t m5core2_axp_read(uint8_t reg, float *buffer) {
 	axp192_t* ptr = (axp192_t*)AXP_I2C;
 	return axp192_read(ptr, reg, buffer);
 }
 
+esp_err_t m5core2_axp_read_adc(axp192_adc_block_t *block) {
+	axp192_t* ptr = (axp192_t*)AXP_I2C;
+	return axp192_read_adc_block(ptr, block);
+}
+
+esp_err_t m5core2_axp_read_coulomb(uint32_t *charge, uint32_t *discharge) {
+	axp192_t* ptr = (axp192_t*)AXP_I2C;
+	return axp192_read_coulomb(ptr, charge, discharge);
+}
+
+esp_err_t m5core2_axp_read_telemetry(axp192_adc_block_t *block, uint32_t *charge, uint32_t *discharge) {
+	uint8_t coulomb[8];
+	i2c_manager_trans_t trans[2] = {
+		{ .addr = AXP192_ADDRESS, .reg = AXP192_ADC_BLOCK_START, .buffer = block->raw, .size = AXP192_ADC_BLOCK_SIZE },
+		{ .addr = AXP192_ADDRESS, .reg = AXP192_CHARGE_COULOMB, .buffer = coulomb, .size = sizeof(coulomb) },
+	};
+
+	// One transact() runs both under a single lock hold, so nothing else on
+	// the port gets between them
+	esp_err_t ret = i2c_manager_transact(CONFIG_M5CORE2_I2C_INTERNAL, trans, 2);
+	if (ret == ESP_OK) {
+		axp192_coulomb_decode(coulomb, charge, discharge);
+	}
+	return ret;
+}
+
 esp_err_t m5core2_axp_twiddle(uint8_t reg, uint8_t affect, uint8_t value) {
-	esp_err_t ret;
+	esp_err_t ret = ESP_OK;
 	uint8_t buffer;
-	ret = m5core2_axp_read_reg(reg, &buffer);
+	// Live bits are read-only or write-one-to-clear, so the shadow is good
+	// enough to build the write from even for those registers
+	if (!shadow_get(reg, &buffer)) {
+		ret = hw_read_reg(reg, &buffer);
+		if (ret == ESP_OK) {
+			buffer &= ~live_bits(reg);
+		}
+	}
 	if (ret == ESP_OK) {
 		buffer &= ~affect;
 		buffer |= (value & affect);
@@ -248,15 +393,8 @@ esp_err_t m5core2_get_rail_state(axp192_rail_t rail, bool *enabled)
 
 esp_err_t m5core2_set_rail_state(axp192_rail_t rail, bool enabled)
 {
-    esp_err_t ret;
-    uint8_t val;
     uint8_t mask;
 
-    ret = m5core2_axp_read_reg(AXP192_DCDC13_LDO23_CONTROL, &val);
-    if (ret != ESP_OK) {
-        return ret;
-    }
-
     switch (rail) {
         case AXP192_RAIL_DCDC1:
             mask = (1 << 0);
@@ -280,18 +418,7 @@ esp_err_t m5core2_set_rail_state(axp192_rail_t rail, bool enabled)
             return ESP_ERR_INVALID_ARG;
     }
 
-    if (enabled) {
-        val |= mask;
-    } else {
-        val = val & ~mask;
-    }
-
-    ret = m5core2_axp_write_reg(AXP192_DCDC13_LDO23_CONTROL, val);
-    if (ret != ESP_OK) {
-        return ret;
-    }
-
-    return ESP_OK;
+    return m5core2_axp_twiddle(AXP192_DCDC13_LDO23_CONTROL, mask, enabled ? mask : 0);
 }
 
 esp_err_t m5core2_get_rail_mv(axp192_rail_t rail, uint16_t *millivolts)
@@ -323,8 +450,7 @@ esp_err_t m5core2_get_rail_mv(axp192_rail_t rail, uint16_t *millivolts)
 esp_err_t m5core2_set_rail_mv(axp192_rail_t rail, uint16_t millivolts)
 {
 
-    esp_err_t ret;
-    uint8_t val, steps;
+    uint8_t steps;
 
     if ((rail < AXP192_RAIL_DCDC1) || (rail >= AXP192_RAIL_COUNT)) {
         return ESP_ERR_INVALID_ARG;
@@ -339,18 +465,7 @@ esp_err_t m5core2_set_rail_mv(axp192_rail_t rail, uint16_t millivolts)
         return ESP_ERR_INVALID_ARG;
     }
 
-    ret = m5core2_axp_read_reg(cfg->voltage_reg, &val);
-    if (ret != ESP_OK) {
-        return ret;
-    }
-
     steps = (millivolts - cfg->min_millivolts) / cfg->step_millivolts;
-    val = (val & ~(cfg->voltage_mask)) | (steps << cfg->voltage_lsb);
 
-    ret = m5core2_axp_write_reg(cfg->voltage_reg, val);
-    if (ret != ESP_OK) {
-        return ret;
-    }
-
-    return ESP_OK;
+    return m5core2_axp_twiddle(cfg->voltage_reg, cfg->voltage_mask, steps << cfg->voltage_lsb);
 }
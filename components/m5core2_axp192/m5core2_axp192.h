@@ -38,7 +38,19 @@ esp_err_t m5core2_speaker(bool on);
 esp_err_t m5core2_axp_read_reg(uint8_t reg, uint8_t *buffer);
 esp_err_t m5core2_axp_write_reg(uint8_t reg, uint8_t value);
 esp_err_t m5core2_axp_read(uint8_t reg, float *buffer);
+// All ADC channels in one bus transaction; decode with axp192_adc_value()
+esp_err_t m5core2_axp_read_adc(axp192_adc_block_t *block);
+esp_err_t m5core2_axp_read_coulomb(uint32_t *charge, uint32_t *discharge);
+// Both of the above as queued I2C transactions, waiting for both. Uses the
+// calling task's notification value.
+esp_err_t m5core2_axp_read_telemetry(axp192_adc_block_t *block, uint32_t *charge, uint32_t *discharge);
 esp_err_t m5core2_axp_twiddle(uint8_t reg, uint8_t affect, uint8_t value);
+// Control registers are shadowed, so reads of them and twiddles cost at most
+// one bus transaction. Invalidate if something else may have written the chip
+// (another driver, a reset); verify re-reads every shadowed register, logs
+// and counts the ones that differ and takes the chip's value.
+void m5core2_axp_shadow_invalidate();
+esp_err_t m5core2_axp_shadow_verify(uint8_t *checked, uint8_t *mismatches);
 esp_err_t m5core2_get_rail_state(axp192_rail_t rail, bool *enabled);
 esp_err_t m5core2_set_rail_state(axp192_rail_t rail, bool enabled);
 esp_err_t m5core2_get_rail_mv(axp192_rail_t rail, uint16_t *millivolts);
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "esp_timer.h"
+#include "fake_esp.h"
+#include "fake_nvs.h"
+#include "fake_ble.h"
+#include "example_ble_sec_gattc_demo.h"
+#include "write_pipeline.h"
+#include "ble_scan.h"
+
+// Runs the whole GATT client against the simulated controller and reports,
+// in simulated time:
+//  - list transfer: both lists fetched after a connect, across MTU, packet
+//    loss and list size, averaged over several loss patterns
+//  - write coalescing: a slider dragged for two seconds, across connection
+//    interval and how often the UI reports a new value. Age is how old each
+//    value the controller received was by the time it landed.
+// Latency is 15ms and the interval 15ms unless stated; the controller keeps
+// its interval, so conn_profile doesn't move it between runs.
+
+#define MS      1000
+#define SEEDS   10
+
+struct Session
+{
+    int64_t connected_us = 0;
+    int64_t lists_us[2] = {};
+    std::string lists[2];
+};
+
+static Session session;
+
+static void on_connect_changed(bool connected)
+{
+    if (!connected || session.connected_us != 0) return;
+
+    session.connected_us = esp_timer_get_time();
+    BeginRead(BLE_CHAR_PATTERN_LIST);
+    BeginRead(BLE_CHAR_COLOR_LIST);
+}
+
+template <int list>
+static void on_list(char * str, int len)
+{
+    session.lists[list] = std::string(str, len - 1);
+    session.lists_us[list] = esp_timer_get_time();
+    free(str);
+}
+
+// Boots the client against one controller and runs until done() or timeout_ms
+template <typename F>
+static bool run_session(const fake_ble_config_t * cfg, F done, int timeout_ms)
+{
+    fake_esp_reset();
+    fake_nvs_reset();
+    fake_ble_reset();
+    session = Session();
+
+    SetConnectChangedCallback(on_connect_changed);
+    SetListCallback(BLE_CHAR_PATTERN_LIST, on_list<0>);
+    SetListCallback(BLE_CHAR_COLOR_LIST, on_list<1>);
+
+    fake_ble_add(cfg);
+    init_gatt_client();
+
+    for (int t = 0; t < timeout_ms; t += 1)
+    {
+        if (done()) return true;
+        fake_advance_us(1 * MS);
+    }
+    return done();
+}
+
+// Leaves the client's statics ready for the next session, as test_ble_client does
+static void end_session()
+{
+    fake_ble_set_power(0, false);
+    fake_advance_us(40000 * MS);
+    ble_scan_stop();
+    fake_advance_us(1000 * MS);
+}
+
+static void bench_lists()
+{
+    static const uint16_t mtus[] = { 23, 185, 247, 517 };
+    static const uint16_t losses[] = { 0, 20, 100 };
+    static const uint16_t sizes[] = { 50, 200 };
+
+    printf("List transfer: patterns + colors (half as many), %d loss patterns each\n", SEEDS);
+    printf("%8s %5s %6s %7s %9s %8s %9s %8s %8s %6s\n",
+           "entries", "mtu", "loss%", "bytes", "ms", "KB/s", "notifies", "lost", "requests", "whole");
+
+    for (uint16_t entries : sizes)
+    {
+        for (uint16_t mtu : mtus)
+        {
+            for (uint16_t loss : losses)
+            {
+                double ms_sum = 0;
+                uint32_t bytes = 0;
+                uint32_t notifies = 0;
+                uint32_t lost = 0;
+                uint32_t requests = 0;
+                int whole = 0;
+
+                int seeds = (loss == 0) ? 1 : SEEDS;
+                for (int seed = 1; seed <= seeds; seed++)
+                {
+                    fake_ble_config_t cfg;
+                    fake_ble_default_config(&cfg);
+                    cfg.conn_interval_us = 15000;
+                    cfg.follow_conn_params = false;
+                    cfg.mtu = mtu;
+                    cfg.loss_permille = loss;
+                    cfg.seed = seed;
+                    cfg.pattern_count = entries;
+                    cfg.color_count = entries / 2;
+
+                    bool done = run_session(&cfg, [] { return session.lists_us[0] != 0 && session.lists_us[1] != 0; }, 60000);
+
+                    uint16_t len[2];
+                    const char * expect[2] = { fake_ble_list(0, FAKE_LED_PATTERN_LIST, &len[0]), fake_ble_list(0, FAKE_LED_COLOR_LIST, &len[1]) };
+                    int64_t end_us = (session.lists_us[0] > session.lists_us[1]) ? session.lists_us[0] : session.lists_us[1];
+                    ms_sum += (end_us - session.connected_us) / 1000.0;
+                    bytes = len[0] + len[1];
+                    if (done && session.lists[0] == expect[0] && session.lists[1] == expect[1]) whole++;
+
+                    fake_ble_stats_t stats;
+                    fake_ble_get_stats(0, &stats);
+                    notifies += stats.notifies;
+                    lost += stats.notifies_lost;
+                    requests += stats.list_requests;
+
+                    end_session();
+                }
+
+                double ms = ms_sum / seeds;
+                printf("%8u %5u %6.1f %7u %9.1f %8.1f %9.1f %8.1f %8.1f %3d/%-2d\n",
+                       entries, mtu, loss / 10.0, bytes, ms, bytes / ms, (double) notifies / seeds,
+                       (double) lost / seeds, (double) requests / seeds, whole, seeds);
+            }
+        }
+    }
+}
+
+static void bench_writes()
+{
+    static const uint32_t intervals_us[] = { 7500, 15000, 30000, 50000 };
+    static const int periods_ms[] = { 2, 10, 33 };
+    const int drag_ms = 2000;
+
+    printf("\nWrite coalescing: brightness slider dragged for %d ms\n", drag_ms);
+    printf("%9s %10s %6s %6s %7s %7s %9s %9s\n",
+           "interval", "set every", "calls", "sent", "merged", "landed", "mean age", "max age");
+
+    for (uint32_t interval_us : intervals_us)
+    {
+        for (int period_ms : periods_ms)
+        {
+            fake_ble_config_t cfg;
+            fake_ble_default_config(&cfg);
+            cfg.conn_interval_us = interval_us;
+            cfg.follow_conn_params = false;
+
+            if (!run_session(&cfg, [] { return session.connected_us != 0; }, 20000))
+            {
+                printf("%9.1f: no connection\n", interval_us / 1000.0);
+                end_session();
+                continue;
+            }
+            // Let the connect's own reads and writes finish
+            fake_advance_us(500 * MS);
+
+            write_pipeline_stats_t before;
+            write_pipeline_get_stats(&before);
+            fake_ble_stats_t ctrl_before;
+            fake_ble_get_stats(0, &ctrl_before);
+
+            // Each value set, and when. The ramp wraps, so a landing is matched
+            // to the newest call with its value.
+            static uint8_t values[10000];
+            static int64_t set_us[10000];
+            int calls = 0;
+
+            int64_t last_landing = fake_ble_value_time_us(0, FAKE_LED_BRIGHTNESS);
+            double age_sum = 0;
+            double age_max = 0;
+            int landings = 0;
+
+            for (int t = 0; t < drag_ms + 200; t++)
+            {
+                if (t < drag_ms && t % period_ms == 0)
+                {
+                    values[calls] = calls & 0xFF;
+                    set_us[calls] = esp_timer_get_time();
+                    SetValue(BLE_CHAR_BRIGHTNESS, values[calls]);
+                    calls++;
+                }
+                fake_advance_us(1 * MS);
+
+                int64_t landing = fake_ble_value_time_us(0, FAKE_LED_BRIGHTNESS);
+                if (landing == last_landing) continue;
+                last_landing = landing;
+
+                uint8_t value = fake_ble_value(0, FAKE_LED_BRIGHTNESS);
+                for (int i = calls - 1; i >= 0; i--)
+                {
+                    if (values[i] != value || set_us[i] > landing) continue;
+
+                    double age_ms = (landing - set_us[i]) / 1000.0;
+                    age_sum += age_ms;
+                    if (age_ms > age_max) age_max = age_ms;
+                    landings++;
+                    break;
+                }
+            }
+
+            write_pipeline_stats_t after;
+            write_pipeline_get_stats(&after);
+            fake_ble_stats_t ctrl_after;
+            fake_ble_get_stats(0, &ctrl_after);
+
+            printf("%7.1fms %8dms %6d %6u %7u %7u %7.1fms %7.1fms\n",
+                   interval_us / 1000.0, period_ms, calls, after.sent - before.sent, after.merged - before.merged,
+                   ctrl_after.value_writes - ctrl_before.value_writes,
+                   (landings > 0) ? age_sum / landings : 0.0, age_max);
+
+            end_session();
+        }
+    }
+}
+
+int main()
+{
+    bench_lists();
+    bench_writes();
+    return 0;
+}
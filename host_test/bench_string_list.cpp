@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "string_list.h"
+
+// Loads pattern lists of 10-500 entries with StringList and with the
+// std::vector<std::string> split main.cpp used before it, counting heap
+// allocations and time per load. Built with -Wl,--wrap so StringList's
+// malloc/realloc calls are counted; operator new is replaced for the
+// std::string side.
+
+#define LOADS   2000
+
+static size_t allocs = 0;
+
+extern "C" {
+void * __real_malloc(size_t size);
+void * __real_realloc(void * ptr, size_t size);
+
+void * __wrap_malloc(size_t size)
+{
+    allocs++;
+    return __real_malloc(size);
+}
+
+void * __wrap_realloc(void * ptr, size_t size)
+{
+    allocs++;
+    return __real_realloc(ptr, size);
+}
+}
+
+void * operator new(size_t size)
+{
+    allocs++;
+    void * p = __real_malloc(size);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+
+// The split main.cpp did before StringList. The positions are size_t here:
+// the original's uint32_t only matches npos where size_t is 32 bits.
+static void linesToList(const char * str, std::vector<std::string> * list)
+{
+    list->clear();
+
+    const std::string strTemp(str);
+    size_t pos = 0;
+    size_t next = 0;
+    while ((next = strTemp.find_first_of('\n', pos)) != std::string::npos)
+    {
+        list->push_back(strTemp.substr(pos, next - pos));
+        pos = next + 1;
+    }
+    if (pos < strTemp.size())
+    {
+        list->push_back(strTemp.substr(pos, strTemp.size() - pos));
+    }
+}
+
+static std::string make_list(int count)
+{
+    std::string list;
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0) list += "\n";
+        list += "Rainbow Chase Variant " + std::to_string(i);
+    }
+    return list;
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+static double us_since(clock_type::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(clock_type::now() - start).count() / LOADS;
+}
+
+int main()
+{
+    static const int sizes[] = { 10, 50, 100, 250, 500 };
+
+    printf("%8s %20s %20s\n", "entries", "vector<string>", "StringList");
+    printf("%8s %10s %9s %10s %9s\n", "", "allocs", "us", "allocs", "us");
+
+    for (int n : sizes)
+    {
+        std::string text = make_list(n);
+        size_t len = text.size() + 1;
+
+        // Both keep their container between loads, as the globals in main.cpp do
+        std::vector<std::string> vec;
+        StringList list;
+        size_t checksum = 0;
+
+        size_t before = allocs;
+        clock_type::time_point start = clock_type::now();
+        for (int i = 0; i < LOADS; i++)
+        {
+            linesToList(text.c_str(), &vec);
+            checksum += vec.size();
+        }
+        double vec_us = us_since(start);
+        double vec_allocs = (double) (allocs - before) / LOADS;
+
+        before = allocs;
+        start = clock_type::now();
+        for (int i = 0; i < LOADS; i++)
+        {
+            // The BLE side hands over a malloc'd copy either way; count it here too
+            char * buf = (char *) malloc(len);
+            memcpy(buf, text.c_str(), len);
+            list.adopt(buf, len);
+            checksum += list.size();
+        }
+        double list_us = us_since(start);
+        double list_allocs = (double) (allocs - before) / LOADS;
+
+        if (checksum != (size_t) n * LOADS * 2)
+        {
+            printf("Lists didn't split to %d entries\n", n);
+            return 1;
+        }
+        printf("%8d %10.1f %9.2f %10.1f %9.2f\n", n, vec_allocs, vec_us, list_allocs, list_us);
+    }
+
+    return 0;
+}
@@ -0,0 +1,1271 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_gap_ble_api.h"
+#include "esp_gattc_api.h"
+#include "esp_gatt_common_api.h"
+#include "fake_ble.h"
+
+#define GATTC_IF                3
+#define DEFAULT_FIRST_HANDLE    40
+#define HANDLES_PER_CHAR        3       // Declaration, value, CCCD
+#define SUPERVISION_TIMEOUT_US  4000000
+#define OPEN_TIMEOUT_US         30000000
+#define ADV_RSSI                -60
+#define MAX_EVENTS              256
+
+#define BASE_UUID 0xc8, 0xcb, 0xff, 0x07, 0x89, 0x9c, 0x4b, 0xb1, 0xa9, 0xf6, 0x39, 0x49
+
+static const uint8_t service_uuid[ESP_UUID_LEN_128] = { BASE_UUID, 0xFF, 0x00, 0x00, 0x00 };
+static const uint8_t char_uuid_ids[FAKE_LED_CHAR_COUNT] = { 0x02, 0x03, 0x04, 0x05, 0x10, 0x11, 0x12 };
+static const char device_name[] = "LedController";
+
+typedef enum
+{
+    EV_GAP,                 // Straight to the GAP callback
+    EV_GATTC,               // Straight to the GATTC callback
+    EV_ADV,                 // A controller's advertisement reaches the scanner
+    EV_SCAN_DONE,
+    EV_CONNECT,             // The controller advertised while an open was waiting for it
+    EV_OPEN_TIMEOUT,
+    EV_SUPERVISION,         // A powered off controller's connection times out
+    EV_VALUE_WRITE,         // A write lands on a single byte characteristic
+    EV_NOTIFY,              // A notification goes out, unless it's lost
+    EV_STREAM,              // The next chunk of a list
+} ev_kind_t;
+
+typedef struct sim_event_t
+{
+    bool used;
+    int64_t at_us;
+    uint32_t seq;           // Keeps events due at the same time in order
+    ev_kind_t kind;
+    int ctrl;               // -1 for events that don't belong to a connection
+    uint32_t gen;           // Connection the event belongs to; dropped once it's gone
+    uint32_t aux;           // Scan, open or stream generation, as the kind needs
+    int event;
+    union
+    {
+        esp_ble_gap_cb_param_t gap;
+        esp_ble_gattc_cb_param_t gattc;
+    } param;
+    uint16_t len;
+    uint8_t data[ESP_GATT_MAX_ATTR_LEN];
+} sim_event_t;
+
+// Connection event slots used so far in one direction
+typedef struct air_slots_t
+{
+    int64_t event_us;
+    uint8_t used;
+} air_slots_t;
+
+typedef struct controller_t
+{
+    fake_ble_config_t cfg;
+    esp_bd_addr_t bda;
+    bool powered;
+    bool bonded;
+    bool open_waiting;      // The client is trying to open a connection to it
+
+    bool connected;
+    uint32_t gen;           // Bumped on every connect and disconnect
+    uint16_t mtu;
+    uint32_t interval_us;
+    int64_t anchor_us;      // A connection event; the others follow every interval_us
+    air_slots_t to_client;
+    air_slots_t to_controller;
+    uint8_t tx_queued;      // Writes without response not yet landed
+    bool congested;
+
+    uint16_t first_handle;
+    uint8_t values[FAKE_LED_CHAR_COUNT];
+    int64_t value_us[FAKE_LED_CHAR_COUNT];
+    bool notifying[FAKE_LED_CHAR_COUNT];
+    char lists[2][FAKE_BLE_MAX_LIST];
+    uint16_t list_len[2];
+    uint32_t hash;
+    uint32_t stream_gen[2];
+    uint16_t stream_offset[2];
+
+    uint32_t rng;
+    fake_ble_stats_t stats;
+} controller_t;
+
+static controller_t controllers[FAKE_BLE_MAX_CONTROLLERS];
+static int controller_count = 0;
+
+static sim_event_t events[MAX_EVENTS];
+static uint32_t next_seq = 0;
+static esp_timer_handle_t event_timer = NULL;
+
+static esp_gap_ble_cb_t gap_cb = NULL;
+static esp_gattc_cb_t gattc_cb = NULL;
+static uint16_t local_mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+
+static bool scanning = false;
+static esp_ble_scan_type_t scan_type = BLE_SCAN_TYPE_PASSIVE;
+static uint32_t scan_gen = 0;
+static uint32_t open_gen = 0;
+
+static void deliver_due(void * arg);
+
+void fake_ble_default_config(fake_ble_config_t * cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->latency_us = 15000;
+    cfg->conn_interval_us = 30000;
+    cfg->packets_per_event = 4;
+    cfg->tx_buffers = 8;
+    cfg->mtu = 247;
+    cfg->loss_permille = 0;
+    cfg->seed = 1;
+    cfg->pattern_count = 40;
+    cfg->color_count = 20;
+    cfg->chunked_lists = true;
+    cfg->catalog_hash = true;
+    cfg->follow_conn_params = true;
+    cfg->adv_interval_us = 100000;
+}
+
+// ---- Event queue ----
+
+static void rearm()
+{
+    const sim_event_t * next = NULL;
+    for (int i = 0; i < MAX_EVENTS; i++)
+    {
+        const sim_event_t * e = &events[i];
+        if (e->used && (next == NULL || e->at_us < next->at_us || (e->at_us == next->at_us && e->seq < next->seq))) next = e;
+    }
+
+    esp_timer_stop(event_timer);
+    if (next == NULL) return;
+
+    int64_t delay_us = next->at_us - esp_timer_get_time();
+    esp_timer_start_once(event_timer, (delay_us > 0) ? delay_us : 0);
+}
+
+// The event is queued once filled in, by the next rearm()
+static sim_event_t * schedule(ev_kind_t kind, const controller_t * c, int64_t at_us)
+{
+    for (int i = 0; i < MAX_EVENTS; i++)
+    {
+        sim_event_t * e = &events[i];
+        if (e->used) continue;
+
+        memset(e, 0, offsetof(sim_event_t, data));
+        e->used = true;
+        e->at_us = at_us;
+        e->seq = next_seq++;
+        e->kind = kind;
+        e->ctrl = (c != NULL) ? (int)(c - controllers) : -1;
+        e->gen = (c != NULL) ? c->gen : 0;
+        return e;
+    }
+
+    fprintf(stderr, "fake_ble: event queue full\n");
+    abort();
+}
+
+static sim_event_t * schedule_gap(esp_gap_ble_cb_event_t event, const controller_t * c, int64_t at_us)
+{
+    sim_event_t * e = schedule(EV_GAP, c, at_us);
+    e->event = event;
+    return e;
+}
+
+static sim_event_t * schedule_gattc(esp_gattc_cb_event_t event, const controller_t * c, int64_t at_us)
+{
+    sim_event_t * e = schedule(EV_GATTC, c, at_us);
+    e->event = event;
+    return e;
+}
+
+static bool pop_due(sim_event_t * out)
+{
+    int64_t now = esp_timer_get_time();
+    sim_event_t * due = NULL;
+    for (int i = 0; i < MAX_EVENTS; i++)
+    {
+        sim_event_t * e = &events[i];
+        if (!e->used || e->at_us > now) continue;
+        if (due == NULL || e->at_us < due->at_us || (e->at_us == due->at_us && e->seq < due->seq)) due = e;
+    }
+    if (due == NULL) return false;
+
+    memcpy(out, due, sizeof(*out));
+    due->used = false;
+    return true;
+}
+
+// ---- Controller model ----
+
+static controller_t * controller_for_bda(const esp_bd_addr_t bda)
+{
+    for (int i = 0; i < controller_count; i++)
+    {
+        if (memcmp(controllers[i].bda, bda, sizeof(esp_bd_addr_t)) == 0) return &controllers[i];
+    }
+    return NULL;
+}
+
+static controller_t * controller_for_conn_id(uint16_t conn_id)
+{
+    if (conn_id >= controller_count || !controllers[conn_id].connected) return NULL;
+    return &controllers[conn_id];
+}
+
+static uint32_t next_random(controller_t * c)
+{
+    // xorshift32
+    c->rng ^= c->rng << 13;
+    c->rng ^= c->rng >> 17;
+    c->rng ^= c->rng << 5;
+    return c->rng;
+}
+
+static uint16_t value_handle(const controller_t * c, int ch)
+{
+    return c->first_handle + 2 + HANDLES_PER_CHAR * ch;
+}
+
+static bool has_char(const controller_t * c, int ch)
+{
+    return ch != FAKE_LED_CATALOG_HASH || c->cfg.catalog_hash;
+}
+
+static bool is_list(int ch)
+{
+    return ch == FAKE_LED_PATTERN_LIST || ch == FAKE_LED_COLOR_LIST;
+}
+
+static bool char_notifies(const controller_t * c, int ch)
+{
+    return !is_list(ch) || c->cfg.chunked_lists;
+}
+
+// Characteristic whose value is at handle, -1 if none
+static int char_for_value(const controller_t * c, uint16_t handle)
+{
+    for (int ch = 0; ch < FAKE_LED_CHAR_COUNT; ch++)
+    {
+        if (has_char(c, ch) && value_handle(c, ch) == handle) return ch;
+    }
+    return -1;
+}
+
+static int char_for_cccd(const controller_t * c, uint16_t handle)
+{
+    for (int ch = 0; ch < FAKE_LED_CHAR_COUNT; ch++)
+    {
+        if (has_char(c, ch) && char_notifies(c, ch) && value_handle(c, ch) + 1 == handle) return ch;
+    }
+    return -1;
+}
+
+static void make_list(char * buf, uint16_t * len, const char * prefix, uint16_t count, uint32_t variant)
+{
+    // Names of mixed lengths, like the real catalog
+    static const char * const words[] = { "Rainbow", "Chase", "Twinkle", "Fire", "Breathe", "Comet", "Ocean Wave", "Strobe" };
+
+    size_t pos = 0;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        int n = snprintf(&buf[pos], FAKE_BLE_MAX_LIST - pos, "%s%s %s %u%s", (i > 0) ? "\n" : "", prefix,
+                         words[(i + variant) % (sizeof(words) / sizeof(words[0]))], i, (variant != 0) ? "b" : "");
+        if (n < 0 || pos + n >= FAKE_BLE_MAX_LIST - 1) break;
+        pos += n;
+    }
+    buf[pos] = 0;
+    *len = pos + 1;
+}
+
+static void build_lists(controller_t * c, uint16_t pattern_count, uint16_t color_count, uint32_t variant)
+{
+    make_list(c->lists[0], &c->list_len[0], "Pattern", pattern_count, variant);
+    make_list(c->lists[1], &c->list_len[1], "Color", color_count, variant);
+
+    // FNV-1a over both, as the controller firmware does
+    c->hash = 2166136261u;
+    for (int l = 0; l < 2; l++)
+    {
+        for (uint16_t i = 0; i < c->list_len[l]; i++)
+        {
+            c->hash ^= (uint8_t)c->lists[l][i];
+            c->hash *= 16777619u;
+        }
+    }
+}
+
+// Value of a characteristic as a read sees it; returns its full length
+static uint16_t read_value(const controller_t * c, int ch, uint8_t * out)
+{
+    if (is_list(ch))
+    {
+        uint16_t len = c->list_len[ch - FAKE_LED_PATTERN_LIST];
+        memcpy(out, c->lists[ch - FAKE_LED_PATTERN_LIST], (len < ESP_GATT_MAX_ATTR_LEN) ? len : ESP_GATT_MAX_ATTR_LEN);
+        return len;
+    }
+    if (ch == FAKE_LED_CATALOG_HASH)
+    {
+        out[0] = c->hash;
+        out[1] = c->hash >> 8;
+        out[2] = c->hash >> 16;
+        out[3] = c->hash >> 24;
+        return 4;
+    }
+    out[0] = c->values[ch];
+    return 1;
+}
+
+// Connection event a packet ready at not_before_us goes out in, taking one of
+// that event's slots
+static int64_t take_slot(controller_t * c, air_slots_t * slots, int64_t not_before_us)
+{
+    // Before the anchor the interval is still changing over; it starts there
+    int64_t event_us = c->anchor_us;
+    int64_t since = not_before_us - c->anchor_us;
+    if (since > 0) event_us += ((since + c->interval_us - 1) / c->interval_us) * c->interval_us;
+
+    if (event_us < slots->event_us) event_us = slots->event_us;
+    if (event_us == slots->event_us && slots->used >= c->cfg.packets_per_event) event_us += c->interval_us;
+    if (event_us != slots->event_us)
+    {
+        slots->event_us = event_us;
+        slots->used = 0;
+    }
+    slots->used++;
+    return event_us;
+}
+
+static void notify_later(controller_t * c, int ch, const uint8_t * value, uint16_t len, int64_t not_before_us)
+{
+    sim_event_t * e = schedule(EV_NOTIFY, c, take_slot(c, &c->to_client, not_before_us));
+    e->event = ESP_GATTC_NOTIFY_EVT;
+    e->param.gattc.notify.conn_id = c - controllers;
+    memcpy(e->param.gattc.notify.remote_bda, c->bda, sizeof(esp_bd_addr_t));
+    e->param.gattc.notify.handle = value_handle(c, ch);
+    e->param.gattc.notify.value_len = len;
+    e->param.gattc.notify.is_notify = true;
+    e->len = len;
+    memcpy(e->data, value, len);
+}
+
+static void disconnect(controller_t * c, esp_gatt_conn_reason_t reason)
+{
+    c->connected = false;
+    c->gen++;
+    c->congested = false;
+    c->tx_queued = 0;
+    memset(c->notifying, 0, sizeof(c->notifying));
+
+    // Queued after the gen bump, so it isn't dropped as stale
+    sim_event_t * e = schedule_gattc(ESP_GATTC_DISCONNECT_EVT, NULL, esp_timer_get_time());
+    e->param.gattc.disconnect.reason = reason;
+    e->param.gattc.disconnect.conn_id = c - controllers;
+    memcpy(e->param.gattc.disconnect.remote_bda, c->bda, sizeof(esp_bd_addr_t));
+}
+
+static void connect(controller_t * c)
+{
+    int64_t now = esp_timer_get_time();
+
+    c->open_waiting = false;
+    c->connected = true;
+    c->gen++;
+    c->mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+    c->interval_us = c->cfg.conn_interval_us;
+    c->anchor_us = now;
+    memset(&c->to_client, 0, sizeof(c->to_client));
+    memset(&c->to_controller, 0, sizeof(c->to_controller));
+    c->stats.connects++;
+
+    sim_event_t * e = schedule_gattc(ESP_GATTC_OPEN_EVT, c, now);
+    e->param.gattc.open.status = ESP_GATT_OK;
+    e->param.gattc.open.conn_id = c - controllers;
+    memcpy(e->param.gattc.open.remote_bda, c->bda, sizeof(esp_bd_addr_t));
+    e->param.gattc.open.mtu = c->mtu;
+
+    e = schedule_gap(ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, c, now);
+    e->param.gap.update_conn_params.status = ESP_BT_STATUS_SUCCESS;
+    memcpy(e->param.gap.update_conn_params.bda, c->bda, sizeof(esp_bd_addr_t));
+    e->param.gap.update_conn_params.conn_int = c->interval_us / 1250;
+    e->param.gap.update_conn_params.timeout = SUPERVISION_TIMEOUT_US / 10000;
+
+    // The controller asks for encryption straight away, as the real one does
+    e = schedule_gap(ESP_GAP_BLE_SEC_REQ_EVT, c, now);
+    memcpy(e->param.gap.ble_security.ble_req.bd_addr, c->bda, sizeof(esp_bd_addr_t));
+}
+
+// Stream the next chunk of a list: [offset u16][total u16][data]
+static void send_chunk(controller_t * c, int ch)
+{
+    int l = ch - FAKE_LED_PATTERN_LIST;
+    uint16_t offset = c->stream_offset[l];
+    uint16_t total = c->list_len[l];
+    if (offset >= total) return;
+
+    uint16_t room = c->mtu - 3 - 4;
+    uint16_t len = (total - offset < room) ? total - offset : room;
+
+    uint8_t chunk[ESP_GATT_MAX_MTU_SIZE];
+    chunk[0] = offset;
+    chunk[1] = offset >> 8;
+    chunk[2] = total;
+    chunk[3] = total >> 8;
+    memcpy(&chunk[4], &c->lists[l][offset], len);
+    c->stream_offset[l] = offset + len;
+
+    c->stats.notifies++;
+    if (next_random(c) % 1000 < c->cfg.loss_permille)
+        c->stats.notifies_lost++;
+    else
+    {
+        esp_ble_gattc_cb_param_t param;
+        memset(&param, 0, sizeof(param));
+        param.notify.conn_id = c - controllers;
+        memcpy(param.notify.remote_bda, c->bda, sizeof(esp_bd_addr_t));
+        param.notify.handle = value_handle(c, ch);
+        param.notify.value = chunk;
+        param.notify.value_len = 4 + len;
+        param.notify.is_notify = true;
+        if (gattc_cb != NULL) gattc_cb(ESP_GATTC_NOTIFY_EVT, GATTC_IF, &param);
+    }
+
+    if (c->connected && c->stream_offset[l] < total)
+    {
+        sim_event_t * e = schedule(EV_STREAM, c, take_slot(c, &c->to_client, esp_timer_get_time()));
+        e->event = ch;
+        e->aux = c->stream_gen[l];
+    }
+}
+
+static void handle_event(sim_event_t * e)
+{
+    controller_t * c = (e->ctrl >= 0) ? &controllers[e->ctrl] : NULL;
+    // Anything sent over a connection is lost with it, or with the power
+    bool live = (c == NULL) || (e->gen == c->gen && c->powered);
+
+    switch (e->kind)
+    {
+    case EV_GAP:
+        if (live && gap_cb != NULL) gap_cb(e->event, &e->param.gap);
+        break;
+    case EV_GATTC:
+        if (!live || gattc_cb == NULL) break;
+        if (e->event == ESP_GATTC_READ_CHAR_EVT) e->param.gattc.read.value = e->data;
+        gattc_cb(e->event, GATTC_IF, &e->param.gattc);
+        break;
+    case EV_NOTIFY:
+        if (!live || !c->connected) break;
+        c->stats.notifies++;
+        if (next_random(c) % 1000 < c->cfg.loss_permille)
+        {
+            c->stats.notifies_lost++;
+            break;
+        }
+        e->param.gattc.notify.value = e->data;
+        if (gattc_cb != NULL) gattc_cb(ESP_GATTC_NOTIFY_EVT, GATTC_IF, &e->param.gattc);
+        break;
+    case EV_STREAM:
+        if (live && c->connected && e->aux == c->stream_gen[e->event - FAKE_LED_PATTERN_LIST] && c->notifying[e->event])
+            send_chunk(c, e->event);
+        break;
+    case EV_VALUE_WRITE: {
+        if (!live || !c->connected) break;
+        // The table may have moved since it was sent
+        int ch = char_for_value(c, e->param.gattc.write.handle);
+        if (ch < 0) break;
+        c->values[ch] = e->data[0];
+        c->value_us[ch] = esp_timer_get_time();
+        c->stats.value_writes++;
+
+        if (e->aux)
+        {
+            // Without response: the write is off the client's queue
+            if (c->tx_queued > 0) c->tx_queued--;
+            if (c->congested && c->tx_queued == 0)
+            {
+                c->congested = false;
+                sim_event_t * u = schedule_gattc(ESP_GATTC_CONGEST_EVT, c, esp_timer_get_time());
+                u->param.gattc.congest.conn_id = c - controllers;
+                u->param.gattc.congest.congested = false;
+            }
+        }
+        if (gattc_cb != NULL) gattc_cb(ESP_GATTC_WRITE_CHAR_EVT, GATTC_IF, &e->param.gattc);
+        break;
+    }
+    case EV_ADV: {
+        if (!scanning || e->aux != scan_gen || !c->powered || c->connected) break;
+
+        esp_ble_gap_cb_param_t param;
+        memset(&param, 0, sizeof(param));
+        struct ble_scan_result_evt_param * r = &param.scan_rst;
+        r->search_evt = ESP_GAP_SEARCH_INQ_RES_EVT;
+        memcpy(r->bda, c->bda, sizeof(esp_bd_addr_t));
+        r->dev_type = ESP_BT_DEVICE_TYPE_BLE;
+        r->ble_addr_type = BLE_ADDR_TYPE_PUBLIC;
+        r->ble_evt_type = ESP_BLE_EVT_CONN_ADV;
+        r->rssi = ADV_RSSI;
+
+        // Flags and the service UUID, with the name in the scan response
+        uint8_t * p = r->ble_adv;
+        *p++ = 2;
+        *p++ = ESP_BLE_AD_TYPE_FLAG;
+        *p++ = 0x06;
+        *p++ = 1 + ESP_UUID_LEN_128;
+        *p++ = ESP_BLE_AD_TYPE_128SRV_CMPL;
+        memcpy(p, service_uuid, ESP_UUID_LEN_128);
+        p += ESP_UUID_LEN_128;
+        r->adv_data_len = p - r->ble_adv;
+        if (scan_type == BLE_SCAN_TYPE_ACTIVE)
+        {
+            *p++ = 1 + strlen(device_name);
+            *p++ = ESP_BLE_AD_TYPE_NAME_CMPL;
+            memcpy(p, device_name, strlen(device_name));
+            p += strlen(device_name);
+            r->scan_rsp_len = p - r->ble_adv - r->adv_data_len;
+        }
+        r->num_resps = 1;
+        if (gap_cb != NULL) gap_cb(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+        break;
+    }
+    case EV_SCAN_DONE: {
+        if (!scanning || e->aux != scan_gen) break;
+        scanning = false;
+
+        esp_ble_gap_cb_param_t param;
+        memset(&param, 0, sizeof(param));
+        param.scan_rst.search_evt = ESP_GAP_SEARCH_INQ_CMPL_EVT;
+        if (gap_cb != NULL) gap_cb(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+        break;
+    }
+    case EV_CONNECT:
+        if (e->aux == open_gen && c->open_waiting && c->powered && !c->connected) connect(c);
+        break;
+    case EV_OPEN_TIMEOUT: {
+        if (e->aux != open_gen) break;
+        if (c != NULL && !c->open_waiting) break;
+        if (c != NULL) c->open_waiting = false;
+        open_gen++;
+
+        esp_ble_gattc_cb_param_t param;
+        memset(&param, 0, sizeof(param));
+        param.open.status = ESP_GATT_ERROR;
+        memcpy(param.open.remote_bda, e->data, sizeof(esp_bd_addr_t));
+        if (gattc_cb != NULL) gattc_cb(ESP_GATTC_OPEN_EVT, GATTC_IF, &param);
+        break;
+    }
+    case EV_SUPERVISION:
+        if (e->gen == c->gen && c->connected && !c->powered) disconnect(c, ESP_GATT_CONN_TIMEOUT);
+        break;
+    }
+}
+
+static void deliver_due(void * arg)
+{
+    (void) arg;
+
+    sim_event_t e;
+    while (pop_due(&e))
+    {
+        handle_event(&e);
+    }
+    rearm();
+}
+
+// ---- Test controls ----
+
+void fake_ble_reset()
+{
+    memset(controllers, 0, sizeof(controllers));
+    controller_count = 0;
+    memset(events, 0, sizeof(events));
+
+    gap_cb = NULL;
+    gattc_cb = NULL;
+    local_mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+    scanning = false;
+    scan_gen++;
+    open_gen++;
+
+    const esp_timer_create_args_t args = {
+        .callback = deliver_due,
+        .name = "fake_ble"
+    };
+    esp_timer_create(&args, &event_timer);
+}
+
+int fake_ble_add(const fake_ble_config_t * cfg)
+{
+    if (controller_count == FAKE_BLE_MAX_CONTROLLERS) return -1;
+
+    int index = controller_count++;
+    controller_t * c = &controllers[index];
+    memset(c, 0, sizeof(*c));
+    c->cfg = *cfg;
+    if (c->cfg.packets_per_event == 0) c->cfg.packets_per_event = 1;
+    if (c->cfg.mtu < ESP_GATT_DEF_BLE_MTU_SIZE) c->cfg.mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+
+    // Random static addresses have the top two bits set
+    uint8_t bda[6] = { 0xC0, 0x4E, 0x30, 0x00, 0x00, (uint8_t)(index + 1) };
+    memcpy(c->bda, bda, sizeof(bda));
+    c->powered = true;
+    c->first_handle = DEFAULT_FIRST_HANDLE;
+    c->rng = (cfg->seed != 0) ? cfg->seed : 1;
+    c->values[FAKE_LED_BRIGHTNESS] = 128;
+    c->values[FAKE_LED_SPEED] = 64;
+    build_lists(c, cfg->pattern_count, cfg->color_count, 0);
+
+    // Seen by a scan that's already running
+    if (scanning)
+    {
+        schedule(EV_ADV, c, esp_timer_get_time() + c->cfg.adv_interval_us)->aux = scan_gen;
+        rearm();
+    }
+    return index;
+}
+
+void fake_ble_get_bda(int controller, esp_bd_addr_t bda)
+{
+    memcpy(bda, controllers[controller].bda, sizeof(esp_bd_addr_t));
+}
+
+void fake_ble_set_power(int controller, bool on)
+{
+    controller_t * c = &controllers[controller];
+    if (c->powered == on) return;
+    c->powered = on;
+
+    int64_t now = esp_timer_get_time();
+    if (!on)
+    {
+        if (c->connected) schedule(EV_SUPERVISION, c, now + SUPERVISION_TIMEOUT_US);
+    }
+    else if (c->open_waiting)
+    {
+        schedule(EV_CONNECT, c, now + c->cfg.adv_interval_us)->aux = open_gen;
+    }
+    else if (scanning && !c->connected)
+    {
+        schedule(EV_ADV, c, now + c->cfg.adv_interval_us)->aux = scan_gen;
+    }
+    rearm();
+}
+
+bool fake_ble_connected(int controller)
+{
+    return controllers[controller].connected;
+}
+
+bool fake_ble_bonded(int controller)
+{
+    return controllers[controller].bonded;
+}
+
+uint32_t fake_ble_conn_interval_us(int controller)
+{
+    return controllers[controller].connected ? controllers[controller].interval_us : 0;
+}
+
+void fake_ble_set_value(int controller, fake_led_char_t ch, uint8_t value)
+{
+    controller_t * c = &controllers[controller];
+    c->values[ch] = value;
+
+    if (c->connected && c->notifying[ch])
+    {
+        notify_later(c, ch, &value, 1, esp_timer_get_time());
+        rearm();
+    }
+}
+
+uint8_t fake_ble_value(int controller, fake_led_char_t ch)
+{
+    return controllers[controller].values[ch];
+}
+
+int64_t fake_ble_value_time_us(int controller, fake_led_char_t ch)
+{
+    return controllers[controller].value_us[ch];
+}
+
+void fake_ble_set_lists(int controller, uint16_t pattern_count, uint16_t color_count)
+{
+    static uint32_t variant = 0;
+
+    controller_t * c = &controllers[controller];
+    build_lists(c, pattern_count, color_count, ++variant);
+
+    if (c->connected && c->notifying[FAKE_LED_CATALOG_HASH] && c->cfg.catalog_hash)
+    {
+        uint8_t value[4];
+        read_value(c, FAKE_LED_CATALOG_HASH, value);
+        notify_later(c, FAKE_LED_CATALOG_HASH, value, sizeof(value), esp_timer_get_time());
+        rearm();
+    }
+}
+
+const char * fake_ble_list(int controller, fake_led_char_t ch, uint16_t * len)
+{
+    const controller_t * c = &controllers[controller];
+    if (!is_list(ch)) return NULL;
+
+    if (len != NULL) *len = c->list_len[ch - FAKE_LED_PATTERN_LIST];
+    return c->lists[ch - FAKE_LED_PATTERN_LIST];
+}
+
+void fake_ble_move_handles(int controller, uint16_t first_handle, bool tell)
+{
+    controller_t * c = &controllers[controller];
+    c->first_handle = first_handle;
+    memset(c->notifying, 0, sizeof(c->notifying));
+
+    if (c->connected && tell)
+    {
+        // An indication, so it goes out like a notification but is never lost
+        sim_event_t * e = schedule_gattc(ESP_GATTC_SRVC_CHG_EVT, c, take_slot(c, &c->to_client, esp_timer_get_time()));
+        memcpy(e->param.gattc.srvc_chg.remote_bda, c->bda, sizeof(esp_bd_addr_t));
+        rearm();
+    }
+}
+
+void fake_ble_get_stats(int controller, fake_ble_stats_t * stats)
+{
+    *stats = controllers[controller].stats;
+}
+
+// ---- Bluetooth bring-up ----
+
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode)
+{
+    (void) mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t * cfg)
+{
+    (void) cfg;
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode)
+{
+    (void) mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_enable(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu)
+{
+    if (mtu < ESP_GATT_DEF_BLE_MTU_SIZE || mtu > ESP_GATT_MAX_MTU_SIZE) return ESP_ERR_INVALID_SIZE;
+
+    local_mtu = mtu;
+    return ESP_OK;
+}
+
+// ---- GAP ----
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback)
+{
+    gap_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_config_local_privacy(bool privacy_enable)
+{
+    (void) privacy_enable;
+
+    sim_event_t * e = schedule_gap(ESP_GAP_BLE_SET_LOCAL_PRIVACY_COMPLETE_EVT, NULL, esp_timer_get_time());
+    e->param.gap.local_privacy_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t * scan_params)
+{
+    scan_type = scan_params->scan_type;
+
+    sim_event_t * e = schedule_gap(ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT, NULL, esp_timer_get_time());
+    e->param.gap.scan_param_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_start_scanning(uint32_t duration)
+{
+    int64_t now = esp_timer_get_time();
+
+    scanning = true;
+    scan_gen++;
+
+    sim_event_t * e = schedule_gap(ESP_GAP_BLE_SCAN_START_COMPLETE_EVT, NULL, now);
+    e->param.gap.scan_start_cmpl.status = ESP_BT_STATUS_SUCCESS;
+
+    // Duplicates are filtered, so each controller is reported once per scan
+    for (int i = 0; i < controller_count; i++)
+    {
+        controller_t * c = &controllers[i];
+        if (c->powered && !c->connected) schedule(EV_ADV, c, now + c->cfg.adv_interval_us)->aux = scan_gen;
+    }
+    if (duration > 0) schedule(EV_SCAN_DONE, NULL, now + (int64_t)duration * 1000000)->aux = scan_gen;
+
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_stop_scanning(void)
+{
+    scanning = false;
+    scan_gen++;
+
+    sim_event_t * e = schedule_gap(ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT, NULL, esp_timer_get_time());
+    e->param.gap.scan_stop_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t * params)
+{
+    controller_t * c = controller_for_bda(params->bda);
+    if (c == NULL || !c->connected) return ESP_ERR_INVALID_STATE;
+
+    int64_t now = esp_timer_get_time();
+    if (c->cfg.follow_conn_params)
+    {
+        // Takes effect from the next connection event
+        c->interval_us = params->min_int * 1250;
+        c->anchor_us = now + c->cfg.latency_us;
+        memset(&c->to_client, 0, sizeof(c->to_client));
+        memset(&c->to_controller, 0, sizeof(c->to_controller));
+    }
+
+    sim_event_t * e = schedule_gap(ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, c, now + c->cfg.latency_us);
+    e->param.gap.update_conn_params.status = ESP_BT_STATUS_SUCCESS;
+    memcpy(e->param.gap.update_conn_params.bda, c->bda, sizeof(esp_bd_addr_t));
+    e->param.gap.update_conn_params.min_int = params->min_int;
+    e->param.gap.update_conn_params.max_int = params->max_int;
+    e->param.gap.update_conn_params.latency = c->cfg.follow_conn_params ? params->latency : 0;
+    e->param.gap.update_conn_params.conn_int = c->interval_us / 1250;
+    e->param.gap.update_conn_params.timeout = params->timeout;
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_read_rssi(esp_bd_addr_t remote_addr)
+{
+    controller_t * c = controller_for_bda(remote_addr);
+    if (c == NULL || !c->connected) return ESP_ERR_INVALID_STATE;
+
+    sim_event_t * e = schedule_gap(ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT, c, esp_timer_get_time() + c->interval_us);
+    e->param.gap.read_rssi_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    e->param.gap.read_rssi_cmpl.rssi = ADV_RSSI;
+    memcpy(e->param.gap.read_rssi_cmpl.remote_addr, c->bda, sizeof(esp_bd_addr_t));
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_security_param(esp_ble_sm_param_t param_type, void * value, uint8_t len)
+{
+    (void) param_type;
+    (void) value;
+    (void) len;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_security_rsp(esp_bd_addr_t bd_addr, bool accept)
+{
+    controller_t * c = controller_for_bda(bd_addr);
+    if (c == NULL || !c->connected) return ESP_ERR_INVALID_STATE;
+
+    // Just Works pairing, one round trip for the keys
+    if (accept) c->bonded = true;
+
+    sim_event_t * e = schedule_gap(ESP_GAP_BLE_AUTH_CMPL_EVT, c, esp_timer_get_time() + c->cfg.latency_us);
+    esp_ble_auth_cmpl_t * auth = &e->param.gap.ble_security.auth_cmpl;
+    memcpy(auth->bd_addr, c->bda, sizeof(esp_bd_addr_t));
+    auth->success = accept;
+    auth->fail_reason = accept ? 0 : 0x05;  // Pairing not supported
+    auth->addr_type = BLE_ADDR_TYPE_PUBLIC;
+    auth->dev_type = ESP_BT_DEVICE_TYPE_BLE;
+    auth->auth_mode = ESP_LE_AUTH_BOND;
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_passkey_reply(esp_bd_addr_t bd_addr, bool accept, uint32_t passkey)
+{
+    (void) bd_addr;
+    (void) accept;
+    (void) passkey;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_confirm_reply(esp_bd_addr_t bd_addr, bool accept)
+{
+    (void) bd_addr;
+    (void) accept;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_oob_req_reply(esp_bd_addr_t bd_addr, uint8_t * TK, uint8_t len)
+{
+    (void) bd_addr;
+    (void) TK;
+    (void) len;
+    return ESP_OK;
+}
+
+int esp_ble_get_bond_device_num(void)
+{
+    int count = 0;
+    for (int i = 0; i < controller_count; i++)
+    {
+        if (controllers[i].bonded) count++;
+    }
+    return count;
+}
+
+esp_err_t esp_ble_get_bond_device_list(int * dev_num, esp_ble_bond_dev_t * dev_list)
+{
+    int count = 0;
+    for (int i = 0; i < controller_count && count < *dev_num; i++)
+    {
+        if (controllers[i].bonded) memcpy(dev_list[count++].bd_addr, controllers[i].bda, sizeof(esp_bd_addr_t));
+    }
+    *dev_num = count;
+    return ESP_OK;
+}
+
+// ---- GATT client ----
+
+esp_err_t esp_ble_gattc_register_callback(esp_gattc_cb_t callback)
+{
+    gattc_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_app_register(uint16_t app_id)
+{
+    sim_event_t * e = schedule_gattc(ESP_GATTC_REG_EVT, NULL, esp_timer_get_time());
+    e->param.gattc.reg.status = ESP_GATT_OK;
+    e->param.gattc.reg.app_id = app_id;
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_open(esp_gatt_if_t gattc_if, esp_bd_addr_t remote_bda, esp_ble_addr_type_t remote_addr_type, bool is_direct)
+{
+    (void) remote_addr_type;
+    (void) is_direct;
+    if (gattc_if != GATTC_IF) return ESP_ERR_INVALID_ARG;
+
+    int64_t now = esp_timer_get_time();
+    controller_t * c = controller_for_bda(remote_bda);
+    if (c != NULL && c->connected) return ESP_ERR_INVALID_STATE;
+
+    // Only one open at a time, as in Bluedroid; a new one replaces the last
+    open_gen++;
+    for (int i = 0; i < controller_count; i++)
+    {
+        controllers[i].open_waiting = false;
+    }
+
+    if (c != NULL)
+    {
+        c->open_waiting = true;
+        if (c->powered) schedule(EV_CONNECT, c, now + c->cfg.adv_interval_us)->aux = open_gen;
+    }
+    sim_event_t * e = schedule(EV_OPEN_TIMEOUT, c, now + OPEN_TIMEOUT_US);
+    e->aux = open_gen;
+    memcpy(e->data, remote_bda, sizeof(esp_bd_addr_t));
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_close(esp_gatt_if_t gattc_if, uint16_t conn_id)
+{
+    (void) gattc_if;
+    controller_t * c = controller_for_conn_id(conn_id);
+    if (c == NULL) return ESP_ERR_INVALID_STATE;
+
+    disconnect(c, ESP_GATT_CONN_TERMINATE_LOCAL_HOST);
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t gattc_if, uint16_t conn_id)
+{
+    (void) gattc_if;
+    controller_t * c = controller_for_conn_id(conn_id);
+    if (c == NULL) return ESP_ERR_INVALID_STATE;
+
+    c->mtu = (local_mtu < c->cfg.mtu) ? local_mtu : c->cfg.mtu;
+
+    sim_event_t * e = schedule_gattc(ESP_GATTC_CFG_MTU_EVT, c, esp_timer_get_time() + c->cfg.latency_us);
+    e->param.gattc.cfg_mtu.status = ESP_GATT_OK;
+    e->param.gattc.cfg_mtu.conn_id = conn_id;
+    e->param.gattc.cfg_mtu.mtu = c->mtu;
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_search_service(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_bt_uuid_t * filter_uuid)
+{
+    (void) gattc_if;
+    controller_t * c = controller_for_conn_id(conn_id);
+    if (c == NULL) return ESP_ERR_INVALID_STATE;
+
+    c->stats.discoveries++;
+
+    // Primary services, then characteristics, then a descriptor search per characteristic
+    int64_t done_us = esp_timer_get_time() + (int64_t)c->cfg.latency_us * (2 + FAKE_LED_CHAR_COUNT);
+    bool match = (filter_uuid == NULL) ||
+                 (filter_uuid->len == ESP_UUID_LEN_128 && memcmp(filter_uuid->uuid.uuid128, service_uuid, ESP_UUID_LEN_128) == 0);
+    if (match)
+    {
+        sim_event_t * e = schedule_gattc(ESP_GATTC_SEARCH_RES_EVT, c, done_us);
+        e->param.gattc.search_res.conn_id = conn_id;
+        e->param.gattc.search_res.start_handle = c->first_handle;
+        e->param.gattc.search_res.end_handle = c->first_handle + HANDLES_PER_CHAR * FAKE_LED_CHAR_COUNT;
+        e->param.gattc.search_res.srvc_id.uuid.len = ESP_UUID_LEN_128;
+        memcpy(e->param.gattc.search_res.srvc_id.uuid.uuid.uuid128, service_uuid, ESP_UUID_LEN_128);
+        e->param.gattc.search_res.is_primary = true;
+    }
+
+    sim_event_t * e = schedule_gattc(ESP_GATTC_SEARCH_CMPL_EVT, c, done_us);
+    e->param.gattc.search_cmpl.status = ESP_GATT_OK;
+    e->param.gattc.search_cmpl.conn_id = conn_id;
+    e->param.gattc.search_cmpl.searched_service_source = ESP_GATT_SERVICE_FROM_REMOTE_DEVICE;
+    rearm();
+    return ESP_OK;
+}
+
+static void fill_char_elem(const controller_t * c, int ch, esp_gattc_char_elem_t * elem)
+{
+    memset(elem, 0, sizeof(*elem));
+    elem->char_handle = value_handle(c, ch);
+    elem->properties = ESP_GATT_CHAR_PROP_BIT_READ;
+    if (ch < FAKE_LED_PATTERN_LIST) elem->properties |= ESP_GATT_CHAR_PROP_BIT_WRITE_NR | ESP_GATT_CHAR_PROP_BIT_WRITE;
+    if (is_list(ch) && c->cfg.chunked_lists) elem->properties |= ESP_GATT_CHAR_PROP_BIT_WRITE;
+    if (char_notifies(c, ch)) elem->properties |= ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+
+    uint8_t uuid[ESP_UUID_LEN_128] = { BASE_UUID, char_uuid_ids[ch], 0xFF, 0x00, 0x00 };
+    elem->uuid.len = ESP_UUID_LEN_128;
+    memcpy(elem->uuid.uuid.uuid128, uuid, sizeof(uuid));
+}
+
+esp_gatt_status_t esp_ble_gattc_get_attr_count(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_gatt_db_attr_type_t type,
+                                               uint16_t start_handle, uint16_t end_handle, uint16_t char_handle, uint16_t * count)
+{
+    (void) gattc_if;
+    (void) char_handle;
+    const controller_t * c = controller_for_conn_id(conn_id);
+    if (c == NULL || type != ESP_GATT_DB_CHARACTERISTIC) return ESP_GATT_ERROR;
+
+    *count = 0;
+    for (int ch = 0; ch < FAKE_LED_CHAR_COUNT; ch++)
+    {
+        uint16_t handle = value_handle(c, ch);
+        if (has_char(c, ch) && handle >= start_handle && handle <= end_handle) (*count)++;
+    }
+    return ESP_GATT_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_all_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t start_handle, uint16_t end_handle,
+                                             esp_gattc_char_elem_t * result, uint16_t * count, uint16_t offset)
+{
+    (void) gattc_if;
+    const controller_t * c = controller_for_conn_id(conn_id);
+    if (c == NULL) return ESP_GATT_ERROR;
+
+    uint16_t found = 0;
+    uint16_t seen = 0;
+    for (int ch = 0; ch < FAKE_LED_CHAR_COUNT && found < *count; ch++)
+    {
+        uint16_t handle = value_handle(c, ch);
+        if (!has_char(c, ch) || handle < start_handle || handle > end_handle) continue;
+        if (seen++ < offset) continue;
+
+        fill_char_elem(c, ch, &result[found++]);
+    }
+    *count = found;
+    return (found > 0) ? ESP_GATT_OK : ESP_GATT_NOT_FOUND;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_descr_by_char_handle(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t char_handle,
+                                                         esp_bt_uuid_t descr_uuid, esp_gattc_descr_elem_t * result, uint16_t * count)
+{
+    (void) gattc_if;
+    const controller_t * c = controller_for_conn_id(conn_id);
+    if (c == NULL) return ESP_GATT_ERROR;
+
+    int ch = char_for_value(c, char_handle);
+    if (ch < 0 || !char_notifies(c, ch) || *count == 0 ||
+        descr_uuid.len != ESP_UUID_LEN_16 || descr_uuid.uuid.uuid16 != ESP_GATT_UUID_CHAR_CLIENT_CONFIG)
+    {
+        *count = 0;
+        return ESP_GATT_NOT_FOUND;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->handle = char_handle + 1;
+    result->uuid = descr_uuid;
+    *count = 1;
+    return ESP_GATT_OK;
+}
+
+esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle)
+{
+    (void) gattc_if;
+    (void) server_bda;
+
+    // Only Bluedroid's own bookkeeping, nothing goes over the air
+    sim_event_t * e = schedule_gattc(ESP_GATTC_REG_FOR_NOTIFY_EVT, NULL, esp_timer_get_time());
+    e->param.gattc.reg_for_notify.status = ESP_GATT_OK;
+    e->param.gattc.reg_for_notify.handle = handle;
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_read_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, esp_gatt_auth_req_t auth_req)
+{
+    (void) gattc_if;
+    (void) auth_req;
+    controller_t * c = controller_for_conn_id(conn_id);
+    if (c == NULL) return ESP_ERR_INVALID_STATE;
+
+    int ch = char_for_value(c, handle);
+
+    sim_event_t * e = schedule_gattc(ESP_GATTC_READ_CHAR_EVT, c, 0);
+    e->param.gattc.read.conn_id = conn_id;
+    e->param.gattc.read.handle = handle;
+
+    uint32_t round_trips = 1;
+    if (ch < 0)
+        e->param.gattc.read.status = ESP_GATT_INVALID_HANDLE;
+    else
+    {
+        // Long values take a Read Blob per MTU's worth, up to the attribute limit
+        uint16_t len = read_value(c, ch, e->data);
+        if (len > ESP_GATT_MAX_ATTR_LEN) len = ESP_GATT_MAX_ATTR_LEN;
+        round_trips = (len + c->mtu - 2) / (c->mtu - 1);
+        if (round_trips == 0) round_trips = 1;
+
+        e->param.gattc.read.status = ESP_GATT_OK;
+        e->param.gattc.read.value_len = len;
+        e->len = len;
+        c->stats.reads++;
+        c->stats.read_bytes += len;
+    }
+    e->at_us = esp_timer_get_time() + (int64_t)c->cfg.latency_us * round_trips;
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+                                   uint8_t * value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req)
+{
+    (void) gattc_if;
+    (void) auth_req;
+    controller_t * c = controller_for_conn_id(conn_id);
+    if (c == NULL) return ESP_ERR_INVALID_STATE;
+    if (value_len > c->mtu - 3) return ESP_ERR_INVALID_SIZE;
+
+    int64_t now = esp_timer_get_time();
+    bool no_rsp = (write_type == ESP_GATT_WRITE_TYPE_NO_RSP);
+    int ch = char_for_value(c, handle);
+
+    if (ch >= 0 && ch < FAKE_LED_PATTERN_LIST && value_len == 1)
+    {
+        sim_event_t * e;
+        if (no_rsp)
+        {
+            e = schedule(EV_VALUE_WRITE, c, take_slot(c, &c->to_controller, now));
+            e->aux = 1;
+            if (++c->tx_queued >= c->cfg.tx_buffers && !c->congested)
+            {
+                c->congested = true;
+                sim_event_t * u = schedule_gattc(ESP_GATTC_CONGEST_EVT, c, now);
+                u->param.gattc.congest.conn_id = conn_id;
+                u->param.gattc.congest.congested = true;
+            }
+        }
+        else
+            e = schedule(EV_VALUE_WRITE, c, now + c->cfg.latency_us);
+        e->param.gattc.write.status = ESP_GATT_OK;
+        e->param.gattc.write.conn_id = conn_id;
+        e->param.gattc.write.handle = handle;
+        e->data[0] = value[0];
+        e->len = 1;
+        rearm();
+        return ESP_OK;
+    }
+
+    esp_gatt_status_t status = ESP_GATT_OK;
+    if (ch < 0)
+        status = ESP_GATT_INVALID_HANDLE;
+    else if (!is_list(ch) || !c->cfg.chunked_lists || value_len != 2)
+        status = ESP_GATT_WRITE_NOT_PERMIT;
+    else
+    {
+        // Offset request: the controller streams the list from there once it has answered
+        int l = ch - FAKE_LED_PATTERN_LIST;
+        c->stats.list_requests++;
+        c->stream_gen[l]++;
+        c->stream_offset[l] = value[0] | (value[1] << 8);
+
+        sim_event_t * s = schedule(EV_STREAM, c, take_slot(c, &c->to_client, now + c->cfg.latency_us));
+        s->event = ch;
+        s->aux = c->stream_gen[l];
+    }
+
+    // Writes without response aren't answered at all
+    if (!no_rsp)
+    {
+        sim_event_t * e = schedule_gattc(ESP_GATTC_WRITE_CHAR_EVT, c, now + c->cfg.latency_us);
+        e->param.gattc.write.status = status;
+        e->param.gattc.write.conn_id = conn_id;
+        e->param.gattc.write.handle = handle;
+    }
+    rearm();
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+                                         uint8_t * value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req)
+{
+    (void) gattc_if;
+    (void) write_type;
+    (void) auth_req;
+    controller_t * c = controller_for_conn_id(conn_id);
+    if (c == NULL) return ESP_ERR_INVALID_STATE;
+
+    int ch = char_for_cccd(c, handle);
+    esp_gatt_status_t status = ESP_GATT_OK;
+    if (ch < 0)
+        status = ESP_GATT_INVALID_HANDLE;
+    else
+        c->notifying[ch] = (value_len >= 1) && (value[0] & 1);
+
+    sim_event_t * e = schedule_gattc(ESP_GATTC_WRITE_DESCR_EVT, c, esp_timer_get_time() + c->cfg.latency_us);
+    e->param.gattc.write.status = status;
+    e->param.gattc.write.conn_id = conn_id;
+    e->param.gattc.write.handle = handle;
+    rearm();
+    return ESP_OK;
+}
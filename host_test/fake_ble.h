@@ -0,0 +1,110 @@
+#ifndef FAKE_BLE_H
+#define FAKE_BLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Simulated LedControllers on the far side of the GAP and GATT client calls,
+// so the whole client runs under test: scanning, connecting, bonding,
+// discovery, the list transfer and writes all arrive as the events Bluedroid
+// would send. Events are delivered from an esp_timer as fake_advance_us()
+// moves the clock, never from inside the call that caused them.
+//
+// Timing is per connection. Anything with a response (reads, writes with
+// response, the MTU exchange, discovery round trips) takes latency_us, and
+// long reads one latency_us per MTU's worth. Writes without response and
+// notifications go out in connection events, packets_per_event each way per
+// event. Notifications may be lost; nothing else is, as the link layer
+// retransmits.
+
+#define FAKE_BLE_MAX_CONTROLLERS    4
+#define FAKE_BLE_MAX_LIST           8192
+
+// The controller's characteristics, in the order of ble_char_id_t
+typedef enum
+{
+    FAKE_LED_PATTERN,
+    FAKE_LED_COLOR,
+    FAKE_LED_BRIGHTNESS,
+    FAKE_LED_SPEED,
+    FAKE_LED_PATTERN_LIST,
+    FAKE_LED_COLOR_LIST,
+    FAKE_LED_CATALOG_HASH,
+
+    FAKE_LED_CHAR_COUNT,
+} fake_led_char_t;
+
+typedef struct fake_ble_config_t
+{
+    uint32_t latency_us;            // Request to response
+    uint32_t conn_interval_us;      // Until the client asks for another
+    uint8_t packets_per_event;      // Each way, per connection event
+    uint8_t tx_buffers;             // Writes without response queued before the link reports congestion
+    uint16_t mtu;                   // The link gets the smaller of this and the client's
+    uint16_t loss_permille;         // Chance of each notification being lost
+    uint32_t seed;
+    uint16_t pattern_count;         // List sizes, in entries
+    uint16_t color_count;
+    bool chunked_lists;             // Lists notify and take offset writes; older firmware only reads
+    bool catalog_hash;              // Older firmware has no catalog hash characteristic
+    bool follow_conn_params;        // Take the interval the client asks for
+    uint32_t adv_interval_us;
+} fake_ble_config_t;
+
+typedef struct fake_ble_stats_t
+{
+    uint32_t connects;
+    uint32_t discoveries;           // Service searches
+    uint32_t reads;
+    uint32_t read_bytes;
+    uint32_t notifies;              // Sent, lost ones included
+    uint32_t notifies_lost;
+    uint32_t list_requests;         // Offset writes to the lists
+    uint32_t value_writes;          // Writes that landed on the single byte characteristics
+} fake_ble_stats_t;
+
+void fake_ble_default_config(fake_ble_config_t * cfg);
+
+// Forgets every controller, bond and pending event. Call after
+// fake_esp_reset(), which deletes the timer events are delivered from.
+void fake_ble_reset();
+
+// Adds a powered, advertising controller. Returns its index.
+int fake_ble_add(const fake_ble_config_t * cfg);
+void fake_ble_get_bda(int controller, esp_bd_addr_t bda);
+
+// Powering off drops the connection once the supervision timeout runs out
+void fake_ble_set_power(int controller, bool on);
+bool fake_ble_connected(int controller);
+bool fake_ble_bonded(int controller);
+// The connection interval in use, 0 while disconnected
+uint32_t fake_ble_conn_interval_us(int controller);
+
+// Changes a single byte characteristic from the controller's side, as another
+// remote would. Notifies the client if it subscribed.
+void fake_ble_set_value(int controller, fake_led_char_t ch, uint8_t value);
+uint8_t fake_ble_value(int controller, fake_led_char_t ch);
+// When a write from the client last landed on ch, 0 if none has
+int64_t fake_ble_value_time_us(int controller, fake_led_char_t ch);
+
+// Replaces the lists, which changes the catalog hash and notifies it
+void fake_ble_set_lists(int controller, uint16_t pattern_count, uint16_t color_count);
+// NUL terminated; len includes the NUL
+const char * fake_ble_list(int controller, fake_led_char_t ch, uint16_t * len);
+
+// Moves the attribute table, as a firmware update would, and indicates
+// Service Changed if tell is set
+void fake_ble_move_handles(int controller, uint16_t first_handle, bool tell);
+
+void fake_ble_get_stats(int controller, fake_ble_stats_t * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,18 @@
+#include "ble_metrics.h"
+#include "fake_ble_metrics.h"
+
+// Stands in for ble_metrics.c, which needs FreeRTOS and the GAP API
+
+static uint32_t writes_sent = 0;
+
+void ble_metrics_write_sent(uint8_t link, uint8_t id)
+{
+    (void) link;
+    (void) id;
+    writes_sent++;
+}
+
+uint32_t fake_metrics_writes_sent()
+{
+    return writes_sent;
+}
@@ -0,0 +1,17 @@
+#ifndef FAKE_BLE_METRICS_H
+#define FAKE_BLE_METRICS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Calls to ble_metrics_write_sent() so far
+uint32_t fake_metrics_writes_sent();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
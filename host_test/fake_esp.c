@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include "esp_timer.h"
+#include "fake_esp.h"
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void * arg;
+    bool armed;
+    int64_t deadline_us;
+    uint64_t period_us;     // 0 for one-shot
+    struct esp_timer * next;
+};
+
+static int64_t now_us = 0;
+static struct esp_timer * timers = NULL;
+
+const char * esp_err_to_name(esp_err_t code)
+{
+    return (code == ESP_OK) ? "ESP_OK" : "ESP_ERR";
+}
+
+void fake_esp_reset()
+{
+    // Anything a test leaked is dropped along with the list
+    while (timers != NULL)
+    {
+        struct esp_timer * next = timers->next;
+        free(timers);
+        timers = next;
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t * create_args, esp_timer_handle_t * out_handle)
+{
+    struct esp_timer * t = calloc(1, sizeof(*t));
+    if (t == NULL) return ESP_ERR_NO_MEM;
+
+    t->callback = create_args->callback;
+    t->arg = create_args->arg;
+    t->next = timers;
+    timers = t;
+
+    *out_handle = t;
+    return ESP_OK;
+}
+
+static esp_err_t start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    if (timer->armed) return ESP_ERR_INVALID_STATE;
+
+    timer->armed = true;
+    timer->deadline_us = now_us + timeout_us;
+    timer->period_us = period_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->armed) return ESP_ERR_INVALID_STATE;
+
+    timer->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer->armed) return ESP_ERR_INVALID_STATE;
+
+    for (struct esp_timer ** p = &timers; *p != NULL; p = &(*p)->next)
+    {
+        if (*p == timer)
+        {
+            *p = timer->next;
+            free(timer);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+static struct esp_timer * next_due(int64_t until_us)
+{
+    struct esp_timer * due = NULL;
+    for (struct esp_timer * t = timers; t != NULL; t = t->next)
+    {
+        if (t->armed && t->deadline_us <= until_us && (due == NULL || t->deadline_us < due->deadline_us)) due = t;
+    }
+    return due;
+}
+
+void fake_advance_us(int64_t us)
+{
+    int64_t until_us = now_us + us;
+
+    struct esp_timer * t;
+    while ((t = next_due(until_us)) != NULL)
+    {
+        now_us = t->deadline_us;
+        if (t->period_us != 0)
+            t->deadline_us += t->period_us;
+        else
+            t->armed = false;
+
+        // May stop, delete or re-arm any timer, this one included
+        t->callback(t->arg);
+    }
+    now_us = until_us;
+}
+
+int fake_timers_armed()
+{
+    int count = 0;
+    for (struct esp_timer * t = timers; t != NULL; t = t->next)
+    {
+        if (t->armed) count++;
+    }
+    return count;
+}
+
+int fake_timers_alive()
+{
+    int count = 0;
+    for (struct esp_timer * t = timers; t != NULL; t = t->next) count++;
+    return count;
+}
@@ -0,0 +1,29 @@
+#ifndef FAKE_ESP_H
+#define FAKE_ESP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Controls for the host stand-in of esp_timer. Everything runs on the test's
+// thread: timers fire from fake_advance_us().
+
+// Deletes all timers. The clock keeps going, as modules remember timestamps
+// across tests just as they would across connections.
+void fake_esp_reset();
+
+// Moves the clock on, firing due timers in deadline order
+void fake_advance_us(int64_t us);
+// Timers that exist and are armed
+int fake_timers_armed();
+int fake_timers_alive();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
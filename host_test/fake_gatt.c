@@ -0,0 +1,67 @@
+#include <string.h>
+#include "esp_timer.h"
+#include "fake_gatt.h"
+
+static fake_gatt_request_t requests[FAKE_GATT_MAX_REQUESTS];
+static int request_count = 0;
+static int fail_count = 0;
+static esp_err_t fail_err = ESP_OK;
+
+void fake_gatt_reset()
+{
+    request_count = 0;
+    fail_count = 0;
+    fail_err = ESP_OK;
+}
+
+static esp_err_t record(fake_gatt_op_t op, esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle,
+                        esp_gatt_write_type_t write_type, const uint8_t * value, uint16_t len)
+{
+    if (fail_count > 0)
+    {
+        fail_count--;
+        return fail_err;
+    }
+    if (request_count == FAKE_GATT_MAX_REQUESTS) return ESP_ERR_NO_MEM;
+
+    fake_gatt_request_t * r = &requests[request_count++];
+    memset(r, 0, sizeof(*r));
+    r->op = op;
+    r->gattc_if = gattc_if;
+    r->conn_id = conn_id;
+    r->handle = handle;
+    r->write_type = write_type;
+    r->t_us = esp_timer_get_time();
+    r->len = (len < FAKE_GATT_MAX_VALUE) ? len : FAKE_GATT_MAX_VALUE;
+    if (value != NULL) memcpy(r->value, value, r->len);
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+                                   uint8_t * value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req)
+{
+    (void) auth_req;
+    return record(FAKE_GATT_WRITE, gattc_if, conn_id, handle, write_type, value, value_len);
+}
+
+esp_err_t esp_ble_gattc_read_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, esp_gatt_auth_req_t auth_req)
+{
+    (void) auth_req;
+    return record(FAKE_GATT_READ, gattc_if, conn_id, handle, ESP_GATT_WRITE_TYPE_NO_RSP, NULL, 0);
+}
+
+int fake_gatt_count()
+{
+    return request_count;
+}
+
+const fake_gatt_request_t * fake_gatt_request(int i)
+{
+    return (i >= 0 && i < request_count) ? &requests[i] : NULL;
+}
+
+void fake_gatt_fail_next(int count, esp_err_t err)
+{
+    fail_count = count;
+    fail_err = err;
+}
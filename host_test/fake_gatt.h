@@ -0,0 +1,51 @@
+#ifndef FAKE_GATT_H
+#define FAKE_GATT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_gattc_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stands in for the GATT client calls when testing a module on its own.
+// Requests are only recorded, for the test to check and answer. fake_ble.h
+// simulates the controller instead, for tests of the whole client.
+
+#define FAKE_GATT_MAX_REQUESTS  256
+#define FAKE_GATT_MAX_VALUE     32
+
+typedef enum
+{
+    FAKE_GATT_WRITE,
+    FAKE_GATT_READ,
+} fake_gatt_op_t;
+
+typedef struct fake_gatt_request_t
+{
+    fake_gatt_op_t op;
+    esp_gatt_if_t gattc_if;
+    uint16_t conn_id;
+    uint16_t handle;
+    esp_gatt_write_type_t write_type;
+    int64_t t_us;
+    uint16_t len;
+    uint8_t value[FAKE_GATT_MAX_VALUE];
+} fake_gatt_request_t;
+
+// Clears the request log and failure settings
+void fake_gatt_reset();
+
+// Requests made since the last reset, oldest first
+int fake_gatt_count();
+const fake_gatt_request_t * fake_gatt_request(int i);
+// The next count write_char/read_char calls return err instead of ESP_OK
+void fake_gatt_fail_next(int count, esp_err_t err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,161 @@
+#include <string.h>
+#include <stdbool.h>
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "fake_nvs.h"
+
+#define MAX_NAMESPACES  8
+
+typedef struct
+{
+    bool used;
+    uint32_t ns;
+    char key[16];
+    uint8_t value[FAKE_NVS_MAX_BLOB];
+    size_t len;
+} entry_t;
+
+static char namespaces[MAX_NAMESPACES][16];
+static entry_t entries[FAKE_NVS_MAX_ENTRIES];
+
+void fake_nvs_reset()
+{
+    memset(namespaces, 0, sizeof(namespaces));
+    memset(entries, 0, sizeof(entries));
+}
+
+// Handles are the namespace index + 1
+static int find_namespace(const char * name)
+{
+    for (int i = 0; i < MAX_NAMESPACES; i++)
+    {
+        if (strcmp(namespaces[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static entry_t * find_entry(nvs_handle_t handle, const char * key)
+{
+    for (int i = 0; i < FAKE_NVS_MAX_ENTRIES; i++)
+    {
+        if (entries[i].used && entries[i].ns == handle && strcmp(entries[i].key, key) == 0) return &entries[i];
+    }
+    return NULL;
+}
+
+esp_err_t nvs_open(const char * name, nvs_open_mode_t open_mode, nvs_handle_t * out_handle)
+{
+    int ns = find_namespace(name);
+    if (ns < 0)
+    {
+        if (open_mode == NVS_READONLY) return ESP_ERR_NVS_NOT_FOUND;
+
+        ns = find_namespace("");
+        if (ns < 0) return ESP_ERR_NO_MEM;
+        strncpy(namespaces[ns], name, sizeof(namespaces[ns]) - 1);
+    }
+
+    *out_handle = ns + 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void) handle;
+}
+
+// Writes land straight away; nothing here can lose them before a commit
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void) handle;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * out_value, size_t * length)
+{
+    entry_t * e = find_entry(handle, key);
+    if (e == NULL) return ESP_ERR_NVS_NOT_FOUND;
+
+    if (out_value == NULL)
+    {
+        *length = e->len;
+        return ESP_OK;
+    }
+    if (*length < e->len) return ESP_ERR_NVS_INVALID_LENGTH;
+
+    memcpy(out_value, e->value, e->len);
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char * key, const void * value, size_t length)
+{
+    if (length > FAKE_NVS_MAX_BLOB || strlen(key) >= sizeof(entries[0].key)) return ESP_ERR_INVALID_ARG;
+
+    entry_t * e = find_entry(handle, key);
+    for (int i = 0; i < FAKE_NVS_MAX_ENTRIES && e == NULL; i++)
+    {
+        if (!entries[i].used) e = &entries[i];
+    }
+    if (e == NULL) return ESP_ERR_NO_MEM;
+
+    e->used = true;
+    e->ns = handle;
+    strcpy(e->key, key);
+    memcpy(e->value, value, length);
+    e->len = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char * key)
+{
+    entry_t * e = find_entry(handle, key);
+    if (e == NULL) return ESP_ERR_NVS_NOT_FOUND;
+
+    memset(e, 0, sizeof(*e));
+    return ESP_OK;
+}
+
+// Counted as NVS lays a blob out: an index entry, a chunk header and 32 byte data entries
+esp_err_t nvs_get_stats(const char * part_name, nvs_stats_t * nvs_stats)
+{
+    (void) part_name;
+
+    size_t used = 0;
+    for (int i = 0; i < FAKE_NVS_MAX_ENTRIES; i++)
+    {
+        if (entries[i].used) used += 2 + (entries[i].len + 31) / 32;
+    }
+
+    size_t namespace_count = 0;
+    for (int i = 0; i < MAX_NAMESPACES; i++)
+    {
+        if (namespaces[i][0] != 0) namespace_count++;
+    }
+
+    nvs_stats->used_entries = used + namespace_count;
+    nvs_stats->total_entries = FAKE_NVS_TOTAL_ENTRIES;
+    nvs_stats->free_entries = FAKE_NVS_TOTAL_ENTRIES - nvs_stats->used_entries;
+    nvs_stats->namespace_count = namespace_count;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    fake_nvs_reset();
+    return ESP_OK;
+}
+
+size_t fake_nvs_blob_len(const char * name, const char * key)
+{
+    int ns = find_namespace(name);
+    if (ns < 0) return 0;
+
+    entry_t * e = find_entry(ns + 1, key);
+    return (e != NULL) ? e->len : 0;
+}
@@ -0,0 +1,28 @@
+#ifndef FAKE_NVS_H
+#define FAKE_NVS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// In-memory NVS for the host tests. Namespaces come into being when opened
+// read-write, as on the device.
+
+#define FAKE_NVS_MAX_ENTRIES    32
+#define FAKE_NVS_MAX_BLOB       4608    // Room for a list at CATALOG_MAX_LIST_LEN
+
+// nvs_get_stats() reports the 24KB default partition: six pages of 126 entries
+#define FAKE_NVS_TOTAL_ENTRIES  756
+
+// Forgets everything, as if the partition was erased
+void fake_nvs_reset();
+// Blobs committed under namespace/key, 0 if none
+size_t fake_nvs_blob_len(const char * name, const char * key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef ESP_BT_MAIN_H
+#define ESP_BT_MAIN_H
+
+#include "esp_err.h"
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t esp_bluedroid_init(void);
+esp_err_t esp_bluedroid_enable(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef ESP_GATT_COMMON_API_H
+#define ESP_GATT_COMMON_API_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_gatt_defs.h"
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
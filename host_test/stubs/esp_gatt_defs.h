@@ -0,0 +1,94 @@
+#ifndef ESP_GATT_DEFS_H
+#define ESP_GATT_DEFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_bt_defs.h"
+
+// Host stand-in for the ESP-IDF header of the same name
+
+#define ESP_GATT_IF_NONE                    0xff
+#define ESP_GATT_DEF_BLE_MTU_SIZE           23
+#define ESP_GATT_MAX_MTU_SIZE               517
+#define ESP_GATT_MAX_ATTR_LEN               600
+
+#define ESP_GATT_UUID_CHAR_CLIENT_CONFIG    0x2902
+
+#define ESP_GATT_CHAR_PROP_BIT_BROADCAST    (1 << 0)
+#define ESP_GATT_CHAR_PROP_BIT_READ         (1 << 1)
+#define ESP_GATT_CHAR_PROP_BIT_WRITE_NR     (1 << 2)
+#define ESP_GATT_CHAR_PROP_BIT_WRITE        (1 << 3)
+#define ESP_GATT_CHAR_PROP_BIT_NOTIFY       (1 << 4)
+#define ESP_GATT_CHAR_PROP_BIT_INDICATE     (1 << 5)
+typedef uint8_t esp_gatt_char_prop_t;
+
+typedef uint8_t esp_gatt_if_t;
+
+typedef enum
+{
+    ESP_GATT_OK = 0x0,
+    ESP_GATT_INVALID_HANDLE = 0x01,
+    ESP_GATT_READ_NOT_PERMIT = 0x02,
+    ESP_GATT_WRITE_NOT_PERMIT = 0x03,
+    ESP_GATT_NOT_FOUND = 0x0a,
+    ESP_GATT_ERROR = 0x85,
+    ESP_GATT_CONGESTED = 0x8f,
+} esp_gatt_status_t;
+
+typedef enum
+{
+    ESP_GATT_CONN_UNKNOWN = 0,
+    ESP_GATT_CONN_TIMEOUT = 0x08,
+    ESP_GATT_CONN_TERMINATE_PEER_USER = 0x13,
+    ESP_GATT_CONN_TERMINATE_LOCAL_HOST = 0x16,
+    ESP_GATT_CONN_FAIL_ESTABLISH = 0x3e,
+} esp_gatt_conn_reason_t;
+
+typedef enum
+{
+    ESP_GATT_WRITE_TYPE_NO_RSP = 1,
+    ESP_GATT_WRITE_TYPE_RSP,
+} esp_gatt_write_type_t;
+
+typedef enum
+{
+    ESP_GATT_AUTH_REQ_NONE = 0,
+} esp_gatt_auth_req_t;
+
+typedef struct
+{
+    esp_bt_uuid_t uuid;
+    uint8_t inst_id;
+} esp_gatt_id_t;
+
+typedef enum
+{
+    ESP_GATT_SERVICE_FROM_REMOTE_DEVICE = 0,
+    ESP_GATT_SERVICE_FROM_NVS_FLASH = 1,
+    ESP_GATT_SERVICE_FROM_UNKNOWN = 2,
+} esp_service_source_t;
+
+typedef enum
+{
+    ESP_GATT_DB_PRIMARY_SERVICE,
+    ESP_GATT_DB_SECONDARY_SERVICE,
+    ESP_GATT_DB_CHARACTERISTIC,
+    ESP_GATT_DB_DESCRIPTOR,
+    ESP_GATT_DB_INCLUDED_SERVICE,
+    ESP_GATT_DB_ALL,
+} esp_gatt_db_attr_type_t;
+
+typedef struct
+{
+    uint16_t char_handle;
+    esp_gatt_char_prop_t properties;
+    esp_bt_uuid_t uuid;
+} esp_gattc_char_elem_t;
+
+typedef struct
+{
+    uint16_t handle;
+    esp_bt_uuid_t uuid;
+} esp_gattc_descr_elem_t;
+
+#endif
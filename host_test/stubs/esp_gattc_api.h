@@ -0,0 +1,161 @@
+#ifndef ESP_GATTC_API_H
+#define ESP_GATTC_API_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_bt_defs.h"
+#include "esp_gatt_defs.h"
+
+// Host stand-in for the ESP-IDF header of the same name. Only the events and
+// calls the GATT client makes. fake_gatt.c records write_char/read_char for
+// the module tests; fake_ble.c answers all of them from a simulated
+// controller.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    ESP_GATTC_REG_EVT = 0,
+    ESP_GATTC_UNREG_EVT = 1,
+    ESP_GATTC_OPEN_EVT = 2,
+    ESP_GATTC_READ_CHAR_EVT = 3,
+    ESP_GATTC_WRITE_CHAR_EVT = 4,
+    ESP_GATTC_CLOSE_EVT = 5,
+    ESP_GATTC_SEARCH_CMPL_EVT = 6,
+    ESP_GATTC_SEARCH_RES_EVT = 7,
+    ESP_GATTC_READ_DESCR_EVT = 8,
+    ESP_GATTC_WRITE_DESCR_EVT = 9,
+    ESP_GATTC_NOTIFY_EVT = 10,
+    ESP_GATTC_SRVC_CHG_EVT = 15,
+    ESP_GATTC_CFG_MTU_EVT = 18,
+    ESP_GATTC_CONGEST_EVT = 24,
+    ESP_GATTC_REG_FOR_NOTIFY_EVT = 38,
+    ESP_GATTC_UNREG_FOR_NOTIFY_EVT = 39,
+    ESP_GATTC_CONNECT_EVT = 40,
+    ESP_GATTC_DISCONNECT_EVT = 41,
+} esp_gattc_cb_event_t;
+
+typedef union
+{
+    struct gattc_reg_evt_param
+    {
+        esp_gatt_status_t status;
+        uint16_t app_id;
+    } reg;
+
+    struct gattc_open_evt_param
+    {
+        esp_gatt_status_t status;
+        uint16_t conn_id;
+        esp_bd_addr_t remote_bda;
+        uint16_t mtu;
+    } open;
+
+    struct gattc_cfg_mtu_evt_param
+    {
+        esp_gatt_status_t status;
+        uint16_t conn_id;
+        uint16_t mtu;
+    } cfg_mtu;
+
+    struct gattc_search_cmpl_evt_param
+    {
+        esp_gatt_status_t status;
+        uint16_t conn_id;
+        esp_service_source_t searched_service_source;
+    } search_cmpl;
+
+    struct gattc_search_res_evt_param
+    {
+        uint16_t conn_id;
+        uint16_t start_handle;
+        uint16_t end_handle;
+        esp_gatt_id_t srvc_id;
+        bool is_primary;
+    } search_res;
+
+    struct gattc_read_char_evt_param
+    {
+        esp_gatt_status_t status;
+        uint16_t conn_id;
+        uint16_t handle;
+        uint8_t * value;
+        uint16_t value_len;
+    } read;
+
+    struct gattc_write_evt_param
+    {
+        esp_gatt_status_t status;
+        uint16_t conn_id;
+        uint16_t handle;
+        uint16_t offset;
+    } write;
+
+    struct gattc_notify_evt_param
+    {
+        uint16_t conn_id;
+        esp_bd_addr_t remote_bda;
+        uint16_t handle;
+        uint16_t value_len;
+        uint8_t * value;
+        bool is_notify;
+    } notify;
+
+    struct gattc_srvc_chg_evt_param
+    {
+        esp_bd_addr_t remote_bda;
+    } srvc_chg;
+
+    struct gattc_congest_evt_param
+    {
+        uint16_t conn_id;
+        bool congested;
+    } congest;
+
+    struct gattc_reg_for_notify_evt_param
+    {
+        esp_gatt_status_t status;
+        uint16_t handle;
+    } reg_for_notify;
+
+    struct gattc_disconnect_evt_param
+    {
+        esp_gatt_conn_reason_t reason;
+        uint16_t conn_id;
+        esp_bd_addr_t remote_bda;
+    } disconnect;
+} esp_ble_gattc_cb_param_t;
+
+typedef void (*esp_gattc_cb_t)(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t * param);
+
+esp_err_t esp_ble_gattc_register_callback(esp_gattc_cb_t callback);
+esp_err_t esp_ble_gattc_app_register(uint16_t app_id);
+
+esp_err_t esp_ble_gattc_open(esp_gatt_if_t gattc_if, esp_bd_addr_t remote_bda, esp_ble_addr_type_t remote_addr_type, bool is_direct);
+esp_err_t esp_ble_gattc_close(esp_gatt_if_t gattc_if, uint16_t conn_id);
+esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t gattc_if, uint16_t conn_id);
+
+esp_err_t esp_ble_gattc_search_service(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_bt_uuid_t * filter_uuid);
+esp_gatt_status_t esp_ble_gattc_get_attr_count(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_gatt_db_attr_type_t type,
+                                               uint16_t start_handle, uint16_t end_handle, uint16_t char_handle, uint16_t * count);
+esp_gatt_status_t esp_ble_gattc_get_all_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t start_handle, uint16_t end_handle,
+                                             esp_gattc_char_elem_t * result, uint16_t * count, uint16_t offset);
+esp_gatt_status_t esp_ble_gattc_get_descr_by_char_handle(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t char_handle,
+                                                         esp_bt_uuid_t descr_uuid, esp_gattc_descr_elem_t * result, uint16_t * count);
+
+esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle);
+
+esp_err_t esp_ble_gattc_read_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, esp_gatt_auth_req_t auth_req);
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+                                   uint8_t * value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req);
+esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+                                         uint8_t * value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
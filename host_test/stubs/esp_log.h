@@ -0,0 +1,17 @@
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+#include <stdio.h>
+
+// Host stand-in for the ESP-IDF header of the same name. Warnings and errors
+// go to stderr so a failing test shows what the module complained about;
+// the rest is only compiled, to keep the format checks.
+
+#define ESP_LOGE(tag, fmt, ...)     fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)     fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)     do { if (0) printf("%s: " fmt, tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, fmt, ...)     do { if (0) printf("%s: " fmt, tag, ##__VA_ARGS__); } while (0)
+
+#define esp_log_buffer_hex(tag, buffer, len)    do { (void) (tag); (void) (buffer); (void) (len); } while (0)
+
+#endif
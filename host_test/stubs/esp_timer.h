@@ -0,0 +1,39 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Host stand-in for the ESP-IDF header of the same name. Time only moves when
+// a test calls fake_advance_us() (see fake_esp.h), which also runs any timer
+// that comes due.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct esp_timer * esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void * arg);
+
+typedef struct
+{
+    esp_timer_cb_t callback;
+    void * arg;
+    int dispatch_method;
+    const char * name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t * create_args, esp_timer_handle_t * out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef NVS_H
+#define NVS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Host stand-in for the ESP-IDF header of the same name, backed by the
+// in-memory store in fake_nvs.c
+
+#define ESP_ERR_NVS_BASE              0x1100
+#define ESP_ERR_NVS_NOT_FOUND         (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_NOT_ENOUGH_SPACE  (ESP_ERR_NVS_BASE + 0x05)
+#define ESP_ERR_NVS_INVALID_LENGTH    (ESP_ERR_NVS_BASE + 0x0c)
+#define ESP_ERR_NVS_NO_FREE_PAGES     (ESP_ERR_NVS_BASE + 0x0d)
+#define ESP_ERR_NVS_NEW_VERSION_FOUND (ESP_ERR_NVS_BASE + 0x10)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum
+{
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+typedef struct
+{
+    size_t used_entries;
+    size_t free_entries;
+    size_t total_entries;
+    size_t namespace_count;
+} nvs_stats_t;
+
+esp_err_t nvs_open(const char * name, nvs_open_mode_t open_mode, nvs_handle_t * out_handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * out_value, size_t * length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char * key, const void * value, size_t length);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char * key);
+// part_name is ignored, there's only the one partition
+esp_err_t nvs_get_stats(const char * part_name, nvs_stats_t * nvs_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
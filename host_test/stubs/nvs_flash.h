@@ -0,0 +1,21 @@
+#ifndef NVS_FLASH_H
+#define NVS_FLASH_H
+
+#include "esp_err.h"
+#include "nvs.h"
+
+// Host stand-in for the ESP-IDF header of the same name. Init always finds
+// the in-memory store ready; erase empties it like fake_nvs_reset().
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// Host stand-in for the generated ESP-IDF header. Only the options the
+// host-built modules check, set as in the project's sdkconfig.
+
+#define CONFIG_BT_ACL_CONNECTIONS           4
+#define CONFIG_BTDM_CTRL_BLE_MAX_CONN_EFF   4
+
+#endif
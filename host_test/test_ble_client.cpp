@@ -0,0 +1,393 @@
+#include <stdlib.h>
+#include <string>
+#include <gtest/gtest.h>
+
+#include "fake_esp.h"
+#include "fake_nvs.h"
+#include "fake_ble.h"
+#include "example_ble_sec_gattc_demo.h"
+#include "write_pipeline.h"
+#include "ble_scan.h"
+
+// The whole GATT client - init_gatt_client() and the real event handlers,
+// list_fetch, the write pipeline and the caches - against simulated
+// controllers. The callbacks below stand in for main.cpp's.
+
+#define MS  1000
+
+struct AppView
+{
+    int connects = 0;
+    bool connected = false;
+    std::string lists[2];
+    int list_deliveries[2] = {};
+    int values[4] = { -1, -1, -1, -1 };
+};
+
+static AppView app;
+
+static void on_connect_changed(bool connected)
+{
+    app.connected = connected;
+    if (!connected) return;
+
+    // What connectChangeCb does
+    app.connects++;
+    BeginRead(BLE_CHAR_PATTERN_LIST);
+    BeginRead(BLE_CHAR_COLOR_LIST);
+    BeginRead(BLE_CHAR_BRIGHTNESS);
+    BeginRead(BLE_CHAR_SPEED);
+}
+
+template <int list, ble_char_id_t then_read>
+static void on_list(char * str, int len)
+{
+    ASSERT_GT(len, 0);
+    EXPECT_EQ(str[len - 1], 0);
+    app.lists[list] = std::string(str, len - 1);
+    app.list_deliveries[list]++;
+    free(str);
+    BeginRead(then_read);
+}
+
+template <ble_char_id_t id>
+static void on_value(uint8_t value)
+{
+    app.values[id] = value;
+}
+
+static std::string controller_list(int controller, fake_led_char_t ch)
+{
+    return std::string(fake_ble_list(controller, ch, NULL));
+}
+
+static int links_in(ble_link_state_t state)
+{
+    ble_link_info_t info[BLE_MAX_LINKS];
+    GetLinkInfo(info);
+
+    int count = 0;
+    for (int i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (info[i].state == state) count++;
+    }
+    return count;
+}
+
+// Runs the clock in small steps until done() or timeout_ms has passed
+template <typename F>
+static bool run_until(F done, int timeout_ms)
+{
+    for (int t = 0; t < timeout_ms; t += 5)
+    {
+        if (done()) return true;
+        fake_advance_us(5 * MS);
+    }
+    return done();
+}
+
+class BleClientTest : public ::testing::Test
+{
+protected:
+    fake_ble_config_t cfg;
+    int controller_count = 0;
+
+    void SetUp() override
+    {
+        fake_esp_reset();
+        fake_nvs_reset();
+        fake_ble_reset();
+        fake_ble_default_config(&cfg);
+        app = AppView();
+
+        SetConnectChangedCallback(on_connect_changed);
+        SetListCallback(BLE_CHAR_PATTERN_LIST, on_list<0, BLE_CHAR_PATTERN>);
+        SetListCallback(BLE_CHAR_COLOR_LIST, on_list<1, BLE_CHAR_COLOR>);
+        SetValueChangedCallback(BLE_CHAR_PATTERN, on_value<BLE_CHAR_PATTERN>);
+        SetValueChangedCallback(BLE_CHAR_COLOR, on_value<BLE_CHAR_COLOR>);
+        SetValueChangedCallback(BLE_CHAR_BRIGHTNESS, on_value<BLE_CHAR_BRIGHTNESS>);
+        SetValueChangedCallback(BLE_CHAR_SPEED, on_value<BLE_CHAR_SPEED>);
+    }
+
+    void TearDown() override
+    {
+        // The client keeps its links in statics, so leave them as a fresh
+        // boot finds them: every controller gone, the direct reconnect given
+        // up on, no scan running and no flush pending
+        for (int i = 0; i < controller_count; i++)
+        {
+            fake_ble_set_power(i, false);
+        }
+        fake_advance_us(40000 * MS);
+        ble_scan_stop();
+        fake_advance_us(1000 * MS);
+
+        EXPECT_EQ(links_in(BLE_LINK_FREE), BLE_MAX_LINKS);
+    }
+
+    int add_controller()
+    {
+        controller_count++;
+        return fake_ble_add(&cfg);
+    }
+
+    // Boots the client and waits for the primary's lists and values
+    void connect(int live_links = 1)
+    {
+        init_gatt_client();
+        ASSERT_TRUE(run_until([&] {
+            return links_in(BLE_LINK_LIVE) == live_links && app.list_deliveries[0] > 0 && app.list_deliveries[1] > 0 &&
+                   app.values[BLE_CHAR_PATTERN] >= 0 && app.values[BLE_CHAR_COLOR] >= 0 &&
+                   app.values[BLE_CHAR_BRIGHTNESS] >= 0 && app.values[BLE_CHAR_SPEED] >= 0;
+        }, 20000));
+    }
+};
+
+TEST_F(BleClientTest, ConnectsDiscoversAndLoadsEverything)
+{
+    int c = add_controller();
+    connect();
+
+    EXPECT_TRUE(fake_ble_connected(c));
+    EXPECT_TRUE(fake_ble_bonded(c));
+    EXPECT_TRUE(app.connected);
+    EXPECT_EQ(app.connects, 1);
+
+    EXPECT_EQ(app.lists[0], controller_list(c, FAKE_LED_PATTERN_LIST));
+    EXPECT_EQ(app.lists[1], controller_list(c, FAKE_LED_COLOR_LIST));
+    EXPECT_EQ(app.values[BLE_CHAR_PATTERN], fake_ble_value(c, FAKE_LED_PATTERN));
+    EXPECT_EQ(app.values[BLE_CHAR_COLOR], fake_ble_value(c, FAKE_LED_COLOR));
+    EXPECT_EQ(app.values[BLE_CHAR_BRIGHTNESS], fake_ble_value(c, FAKE_LED_BRIGHTNESS));
+    EXPECT_EQ(app.values[BLE_CHAR_SPEED], fake_ble_value(c, FAKE_LED_SPEED));
+
+    fake_ble_stats_t stats;
+    fake_ble_get_stats(c, &stats);
+    EXPECT_EQ(stats.connects, 1u);
+    EXPECT_EQ(stats.discoveries, 1u);
+    EXPECT_GE(stats.list_requests, 2u);
+    EXPECT_EQ(stats.notifies_lost, 0u);
+
+    bool cached = true;
+    EXPECT_GT(GetLastConnectTimeMs(&cached), 0u);
+    EXPECT_FALSE(cached);
+}
+
+TEST_F(BleClientTest, SliderDragIsCoalescedToOneWritePerInterval)
+{
+    int c = add_controller();
+    connect();
+
+    write_pipeline_stats_t before;
+    write_pipeline_get_stats(&before);
+
+    // A drag reporting every millisecond for 200ms
+    for (int i = 0; i < 200; i++)
+    {
+        SetValue(BLE_CHAR_BRIGHTNESS, i);
+        fake_advance_us(1 * MS);
+    }
+    fake_advance_us(200 * MS);
+
+    EXPECT_EQ(fake_ble_value(c, FAKE_LED_BRIGHTNESS), 199);
+
+    write_pipeline_stats_t after;
+    write_pipeline_get_stats(&after);
+    uint32_t sent = after.sent - before.sent;
+    uint32_t interval_ms = fake_ble_conn_interval_us(c) / MS;
+    ASSERT_GT(interval_ms, 0u);
+    EXPECT_LE(sent, 200 / interval_ms + 2);
+    EXPECT_EQ(sent + (after.merged - before.merged), 200u);
+}
+
+TEST_F(BleClientTest, LostChunksAreAskedForAgain)
+{
+    // This seed loses chunks mid-stream but never a list's last one, which
+    // would leave the fetch to the timeout and a single read
+    cfg.mtu = 23;
+    cfg.loss_permille = 100;
+    cfg.seed = 12;
+    cfg.pattern_count = 100;
+    cfg.color_count = 60;
+    int c = add_controller();
+    connect();
+
+    EXPECT_EQ(app.lists[0], controller_list(c, FAKE_LED_PATTERN_LIST));
+    EXPECT_EQ(app.lists[1], controller_list(c, FAKE_LED_COLOR_LIST));
+
+    fake_ble_stats_t stats;
+    fake_ble_get_stats(c, &stats);
+    EXPECT_GT(stats.notifies_lost, 0u);
+    // From where the gap was, not the whole list again
+    EXPECT_GT(stats.list_requests, 2u);
+    EXPECT_LT(stats.notifies - stats.notifies_lost, 3u * (app.lists[0].size() + app.lists[1].size()) / 16);
+}
+
+TEST_F(BleClientTest, ReconnectUsesCachedHandlesAndLists)
+{
+    int c = add_controller();
+    connect();
+
+    fake_ble_stats_t first;
+    fake_ble_get_stats(c, &first);
+
+    fake_ble_set_power(c, false);
+    ASSERT_TRUE(run_until([&] { return !app.connected; }, 10000));
+    fake_ble_set_power(c, true);
+    ASSERT_TRUE(run_until([&] { return app.connects == 2 && app.list_deliveries[0] == 2 && app.list_deliveries[1] == 2; }, 10000));
+
+    bool cached = false;
+    GetLastConnectTimeMs(&cached);
+    EXPECT_TRUE(cached);
+
+    fake_ble_stats_t second;
+    fake_ble_get_stats(c, &second);
+    EXPECT_EQ(second.connects, 2u);
+    EXPECT_EQ(second.discoveries, first.discoveries);
+    EXPECT_EQ(second.list_requests, first.list_requests);
+    EXPECT_EQ(app.lists[0], controller_list(c, FAKE_LED_PATTERN_LIST));
+    EXPECT_EQ(app.lists[1], controller_list(c, FAKE_LED_COLOR_LIST));
+}
+
+TEST_F(BleClientTest, ChangedListsAreFetchedAgain)
+{
+    int c = add_controller();
+    connect();
+    std::string old_patterns = app.lists[0];
+
+    fake_ble_set_lists(c, 70, 25);
+    ASSERT_TRUE(run_until([&] { return app.list_deliveries[0] == 2 && app.list_deliveries[1] == 2; }, 5000));
+
+    EXPECT_NE(app.lists[0], old_patterns);
+    EXPECT_EQ(app.lists[0], controller_list(c, FAKE_LED_PATTERN_LIST));
+    EXPECT_EQ(app.lists[1], controller_list(c, FAKE_LED_COLOR_LIST));
+}
+
+TEST_F(BleClientTest, OlderFirmwareListsAreRead)
+{
+    cfg.chunked_lists = false;
+    cfg.catalog_hash = false;
+    cfg.pattern_count = 20;
+    cfg.color_count = 20;
+    int c = add_controller();
+    connect();
+
+    EXPECT_EQ(app.lists[0], controller_list(c, FAKE_LED_PATTERN_LIST));
+    EXPECT_EQ(app.lists[1], controller_list(c, FAKE_LED_COLOR_LIST));
+
+    fake_ble_stats_t stats;
+    fake_ble_get_stats(c, &stats);
+    EXPECT_EQ(stats.list_requests, 0u);
+}
+
+TEST_F(BleClientTest, ServiceChangedRediscoversWithoutReconnecting)
+{
+    int c = add_controller();
+    connect();
+
+    fake_ble_move_handles(c, 80, true);
+    fake_advance_us(1000 * MS);
+
+    SetValue(BLE_CHAR_SPEED, 77);
+    fake_advance_us(200 * MS);
+    EXPECT_EQ(fake_ble_value(c, FAKE_LED_SPEED), 77);
+
+    fake_ble_stats_t stats;
+    fake_ble_get_stats(c, &stats);
+    EXPECT_EQ(stats.discoveries, 2u);
+    EXPECT_EQ(stats.connects, 1u);
+    EXPECT_EQ(app.connects, 1);
+    EXPECT_EQ(links_in(BLE_LINK_LIVE), 1);
+}
+
+TEST_F(BleClientTest, MovedHandlesAreFoundFromAFailedRead)
+{
+    int c = add_controller();
+    connect();
+
+    // No Service Changed, so the first the client knows is the read failing
+    fake_ble_move_handles(c, 100, false);
+    BeginRead(BLE_CHAR_BRIGHTNESS);
+    fake_advance_us(1000 * MS);
+
+    fake_ble_stats_t stats;
+    fake_ble_get_stats(c, &stats);
+    EXPECT_EQ(stats.discoveries, 2u);
+
+    SetValue(BLE_CHAR_BRIGHTNESS, 33);
+    fake_advance_us(200 * MS);
+    EXPECT_EQ(fake_ble_value(c, FAKE_LED_BRIGHTNESS), 33);
+}
+
+TEST_F(BleClientTest, EveryControllerGetsTheWrites)
+{
+    int a = add_controller();
+    int b = add_controller();
+    connect(2);
+
+    SetValue(BLE_CHAR_PATTERN, 9);
+    SetValue(BLE_CHAR_SPEED, 200);
+    fake_advance_us(200 * MS);
+
+    EXPECT_EQ(fake_ble_value(a, FAKE_LED_PATTERN), 9);
+    EXPECT_EQ(fake_ble_value(b, FAKE_LED_PATTERN), 9);
+    EXPECT_EQ(fake_ble_value(a, FAKE_LED_SPEED), 200);
+    EXPECT_EQ(fake_ble_value(b, FAKE_LED_SPEED), 200);
+    // The second controller joining didn't reload the UI
+    EXPECT_EQ(app.connects, 1);
+}
+
+TEST_F(BleClientTest, ControllerSideChangesReachTheApp)
+{
+    int c = add_controller();
+    connect();
+
+    fake_ble_set_value(c, FAKE_LED_PATTERN, 5);
+    fake_ble_set_value(c, FAKE_LED_BRIGHTNESS, 250);
+    fake_advance_us(200 * MS);
+
+    EXPECT_EQ(app.values[BLE_CHAR_PATTERN], 5);
+    EXPECT_EQ(app.values[BLE_CHAR_BRIGHTNESS], 250);
+}
+
+TEST_F(BleClientTest, WritesWaitOutCongestion)
+{
+    cfg.packets_per_event = 1;
+    cfg.tx_buffers = 2;
+    int c = add_controller();
+    connect();
+
+    for (int i = 0; i < 50; i++)
+    {
+        SetValue(BLE_CHAR_PATTERN, i);
+        SetValue(BLE_CHAR_COLOR, i + 1);
+        SetValue(BLE_CHAR_BRIGHTNESS, i + 2);
+        SetValue(BLE_CHAR_SPEED, i + 3);
+        fake_advance_us(2 * MS);
+    }
+    fake_advance_us(500 * MS);
+
+    EXPECT_EQ(fake_ble_value(c, FAKE_LED_PATTERN), 49);
+    EXPECT_EQ(fake_ble_value(c, FAKE_LED_COLOR), 50);
+    EXPECT_EQ(fake_ble_value(c, FAKE_LED_BRIGHTNESS), 51);
+    EXPECT_EQ(fake_ble_value(c, FAKE_LED_SPEED), 52);
+
+    write_pipeline_stats_t stats;
+    write_pipeline_get_stats(&stats);
+    EXPECT_GT(stats.congested, 0u);
+}
+
+TEST_F(BleClientTest, MissingControllerFallsBackToScanning)
+{
+    int c = add_controller();
+    connect();
+
+    // Gone long enough for the direct reconnect to give up
+    fake_ble_set_power(c, false);
+    fake_advance_us(40000 * MS);
+    EXPECT_FALSE(app.connected);
+    EXPECT_EQ(links_in(BLE_LINK_FREE), BLE_MAX_LINKS);
+
+    fake_ble_set_power(c, true);
+    ASSERT_TRUE(run_until([&] { return app.connected; }, 30000));
+    EXPECT_EQ(links_in(BLE_LINK_LIVE), 1);
+}
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "fake_nvs.h"
+#include "fuel_gauge.h"
+
+// Replays the traces in traces/ (see make_fuel_traces.py for the format)
+// through the gauge and compares it with the true state of charge.
+
+struct TraceRow
+{
+    uint32_t t_ms;
+    fuel_gauge_input_t in;
+    int32_t true_permille;
+};
+
+static std::vector<TraceRow> load_trace(const char * name)
+{
+    std::vector<TraceRow> rows;
+    std::string path = std::string(TRACE_DIR) + "/" + name;
+
+    FILE * f = fopen(path.c_str(), "r");
+    if (f == NULL)
+    {
+        ADD_FAILURE() << "Can't open " << path;
+        return rows;
+    }
+
+    char line[160];
+    if (fgets(line, sizeof(line), f) == NULL) line[0] = 0;   // Header
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        TraceRow r = {};
+        if (sscanf(line, "%u,%d,%d,%d,%u,%u,%d", &r.t_ms, &r.in.battery_mv, &r.in.charge_ma, &r.in.discharge_ma,
+                   &r.in.coulomb_charge, &r.in.coulomb_discharge, &r.true_permille) == 7)
+            rows.push_back(r);
+    }
+    fclose(f);
+
+    EXPECT_GT(rows.size(), 100u) << path;
+    return rows;
+}
+
+struct Replay
+{
+    std::vector<fuel_gauge_status_t> status;
+    int32_t max_error = 0;      // Permille, once settled
+};
+
+// The first few minutes only have the voltage to go on
+#define SETTLE_SAMPLES  30
+
+static Replay replay(const std::vector<TraceRow> & rows)
+{
+    Replay result;
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        fuel_gauge_update(&rows[i].in);
+
+        fuel_gauge_status_t s;
+        fuel_gauge_get(&s);
+        result.status.push_back(s);
+
+        int32_t error = abs((int32_t) s.soc_permille - rows[i].true_permille);
+        if (i >= SETTLE_SAMPLES && error > result.max_error) result.max_error = error;
+    }
+    return result;
+}
+
+class FuelGaugeTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        fake_nvs_reset();
+        fuel_gauge_init();
+    }
+};
+
+TEST_F(FuelGaugeTest, NotValidBeforeTheFirstSample)
+{
+    fuel_gauge_status_t s;
+    fuel_gauge_get(&s);
+    EXPECT_FALSE(s.valid);
+}
+
+TEST_F(FuelGaugeTest, FullDischargeTracksTheCell)
+{
+    std::vector<TraceRow> rows = load_trace("fuel_full_discharge.csv");
+    Replay r = replay(rows);
+
+    EXPECT_LE(r.max_error, 60);
+    EXPECT_TRUE(r.status.back().valid);
+    EXPECT_LE(r.status.back().soc_permille, 100);
+
+    // Shown percentage shouldn't climb back up while running on battery
+    int32_t highest = 1000;
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        if (rows[i].in.charge_ma > 0) continue;
+        EXPECT_LE(r.status[i].soc_permille, highest + 10) << "at " << rows[i].t_ms << " ms";
+        if (r.status[i].soc_permille < highest) highest = r.status[i].soc_permille;
+    }
+}
+
+TEST_F(FuelGaugeTest, TimeToEmptyIsRoughlyRight)
+{
+    std::vector<TraceRow> rows = load_trace("fuel_full_discharge.csv");
+    Replay r = replay(rows);
+
+    // Check at about half way down, against when the trace actually ends
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        if (rows[i].true_permille > 500) continue;
+
+        int32_t actual_min = (rows.back().t_ms - rows[i].t_ms) / 60000;
+        int32_t shown_min = r.status[i].time_to_empty_min;
+        EXPECT_GT(shown_min, actual_min * 7 / 10);
+        EXPECT_LT(shown_min, actual_min * 13 / 10);
+        break;
+    }
+}
+
+TEST_F(FuelGaugeTest, NoTimeToEmptyWhileCharging)
+{
+    std::vector<TraceRow> rows = load_trace("fuel_partial_topup.csv");
+    Replay r = replay(rows);
+
+    int charging_seen = 0;
+    for (size_t i = SETTLE_SAMPLES; i < rows.size(); i++)
+    {
+        if (rows[i].in.charge_ma < 100) continue;
+        charging_seen++;
+        EXPECT_EQ(r.status[i].time_to_empty_min, -1) << "at " << rows[i].t_ms << " ms";
+    }
+    EXPECT_GT(charging_seen, 0);
+}
+
+TEST_F(FuelGaugeTest, PartialTopUpTracksWithoutLearning)
+{
+    std::vector<TraceRow> rows = load_trace("fuel_partial_topup.csv");
+    Replay r = replay(rows);
+
+    EXPECT_LE(r.max_error, 60);
+    EXPECT_EQ(r.status.back().learned_cycles, 0u);
+    EXPECT_EQ(r.status.back().capacity_uah, (uint32_t) FUEL_GAUGE_DESIGN_CAPACITY_UAH);
+    EXPECT_EQ(fake_nvs_blob_len("fuel", "capacity"), 0u);
+}
+
+TEST_F(FuelGaugeTest, DesignCellKeepsItsCapacity)
+{
+    Replay r = replay(load_trace("fuel_full_discharge.csv"));
+
+    EXPECT_EQ(r.status.back().learned_cycles, 1u);
+    EXPECT_NEAR((double) r.status.back().capacity_uah, FUEL_GAUGE_DESIGN_CAPACITY_UAH,
+                FUEL_GAUGE_DESIGN_CAPACITY_UAH * 0.03);
+}
+
+TEST_F(FuelGaugeTest, WornCellIsLearnedAndSaved)
+{
+    Replay r = replay(load_trace("fuel_worn_cell.csv"));
+
+    // One run moves a quarter of the way from 390 to the cell's 320mAh
+    fuel_gauge_status_t end = r.status.back();
+    EXPECT_EQ(end.learned_cycles, 1u);
+    EXPECT_LT(end.capacity_uah, 380000u);
+    EXPECT_GT(end.capacity_uah, 365000u);
+    EXPECT_GT(fake_nvs_blob_len("fuel", "capacity"), 0u);
+
+    // A restart picks it up again
+    fuel_gauge_init();
+    std::vector<TraceRow> rows = load_trace("fuel_worn_cell.csv");
+    fuel_gauge_update(&rows[0].in);
+
+    fuel_gauge_status_t s;
+    fuel_gauge_get(&s);
+    EXPECT_EQ(s.capacity_uah, end.capacity_uah);
+    EXPECT_EQ(s.learned_cycles, 1u);
+}
+
+TEST_F(FuelGaugeTest, RepeatedRunsConvergeOnTheWornCapacity)
+{
+    std::vector<TraceRow> rows = load_trace("fuel_worn_cell.csv");
+
+    for (int run = 0; run < 8; run++)
+    {
+        // Restarting between runs, as the remote is switched off when flat
+        fuel_gauge_init();
+        replay(rows);
+    }
+
+    fuel_gauge_status_t s;
+    fuel_gauge_get(&s);
+    EXPECT_EQ(s.learned_cycles, 8u);
+    EXPECT_NEAR((double) s.capacity_uah, 320000, 320000 * 0.06);
+}
+
+TEST_F(FuelGaugeTest, CounterResetIsIgnored)
+{
+    std::vector<TraceRow> rows = load_trace("fuel_full_discharge.csv");
+    Replay before = replay(std::vector<TraceRow>(rows.begin(), rows.begin() + 200));
+
+    // The AXP192 counters were cleared behind the gauge's back
+    std::vector<TraceRow> after(rows.begin() + 200, rows.end());
+    for (TraceRow & r : after)
+    {
+        r.in.coulomb_charge -= rows[200].in.coulomb_charge;
+        r.in.coulomb_discharge -= rows[200].in.coulomb_discharge;
+    }
+    Replay rest = replay(after);
+
+    EXPECT_LE(rest.max_error, 60);
+    (void) before;
+}
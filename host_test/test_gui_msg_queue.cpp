@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "gui_msg_queue.h"
+
+struct Applied
+{
+	gui_msg_type_t type;
+	uint32_t value;
+	std::string list;
+};
+
+static std::vector<Applied> applied;
+
+static void record(gui_msg_t * msg)
+{
+	Applied a = { msg->type, 0, "" };
+	if (msg->type == GUI_MSG_CONNECTED) a.value = msg->connected;
+	else if (msg->type == GUI_MSG_PATTERN_LIST || msg->type == GUI_MSG_COLOR_LIST) a.list = std::string(msg->list.str, msg->list.len);
+	else a.value = msg->value;
+	applied.push_back(a);
+}
+
+static char * list_of(const char * text)
+{
+	char * str = (char *) malloc(strlen(text));
+	memcpy(str, text, strlen(text));
+	return str;
+}
+
+class GuiMsgQueueTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		gui_msg_drain(NULL);
+		applied.clear();
+	}
+};
+
+TEST_F(GuiMsgQueueTest, NothingPostedNothingApplied)
+{
+	EXPECT_EQ(gui_msg_drain(record), 0u);
+	EXPECT_TRUE(applied.empty());
+}
+
+TEST_F(GuiMsgQueueTest, OnlyTheNewestValueIsApplied)
+{
+	uint32_t coalesced = gui_msg_coalesced_count();
+	for (int v = 0; v < 10; v++) gui_msg_post_value(GUI_MSG_BRIGHTNESS, v);
+
+	EXPECT_EQ(gui_msg_drain(record), 1u);
+	ASSERT_EQ(applied.size(), 1u);
+	EXPECT_EQ(applied[0].type, GUI_MSG_BRIGHTNESS);
+	EXPECT_EQ(applied[0].value, 9u);
+	EXPECT_EQ(gui_msg_coalesced_count() - coalesced, 9u);
+}
+
+TEST_F(GuiMsgQueueTest, DisconnectSurvivesANotifyBurst)
+{
+	gui_msg_t msg = {};
+	msg.type = GUI_MSG_CONNECTED;
+	msg.connected = true;
+	gui_msg_post(&msg);
+	for (int v = 0; v < 200; v++) gui_msg_post_value((gui_msg_type_t) (GUI_MSG_PATTERN + v % 4), v);
+	msg.connected = false;
+	gui_msg_post(&msg);
+	for (int v = 0; v < 200; v++) gui_msg_post_value((gui_msg_type_t) (GUI_MSG_PATTERN + v % 4), v);
+
+	uint32_t dropped = gui_msg_dropped_count();
+	gui_msg_drain(record);
+
+	ASSERT_FALSE(applied.empty());
+	EXPECT_EQ(applied[0].type, GUI_MSG_CONNECTED);
+	EXPECT_EQ(applied[0].value, 0u);
+	EXPECT_EQ(gui_msg_dropped_count(), dropped);
+}
+
+TEST_F(GuiMsgQueueTest, AppliedInTypeOrder)
+{
+	gui_msg_post_value(GUI_MSG_PATTERN, 3);
+	gui_msg_post_list(GUI_MSG_PATTERN_LIST, list_of("a\nb\nc\nd"), 7);
+	gui_msg_post_value(GUI_MSG_SPEED, 50);
+	gui_msg_t links = {};
+	links.type = GUI_MSG_LINKS;
+	gui_msg_post(&links);
+
+	EXPECT_EQ(gui_msg_drain(record), 4u);
+	ASSERT_EQ(applied.size(), 4u);
+	EXPECT_EQ(applied[0].type, GUI_MSG_LINKS);
+	EXPECT_EQ(applied[1].type, GUI_MSG_PATTERN_LIST);
+	EXPECT_EQ(applied[1].list, "a\nb\nc\nd");
+	EXPECT_EQ(applied[2].type, GUI_MSG_PATTERN);
+	EXPECT_EQ(applied[3].type, GUI_MSG_SPEED);
+}
+
+TEST_F(GuiMsgQueueTest, ReplacedListIsFreed)
+{
+	// Leaks show up under ASan/valgrind
+	gui_msg_post_list(GUI_MSG_COLOR_LIST, list_of("red"), 3);
+	gui_msg_post_list(GUI_MSG_COLOR_LIST, list_of("green"), 5);
+
+	gui_msg_drain(record);
+	ASSERT_EQ(applied.size(), 1u);
+	EXPECT_EQ(applied[0].list, "green");
+}
+
+static char * taken = NULL;
+
+TEST_F(GuiMsgQueueTest, HandlerCanKeepAList)
+{
+	gui_msg_post_list(GUI_MSG_COLOR_LIST, list_of("blue"), 4);
+
+	gui_msg_drain([](gui_msg_t * msg) {
+		taken = msg->list.str;
+		msg->list.str = NULL;
+	});
+
+	ASSERT_NE(taken, nullptr);
+	EXPECT_EQ(std::string(taken, 4), "blue");
+	free(taken);
+}
+
+TEST_F(GuiMsgQueueTest, PostsFromAnotherThreadAreNotLost)
+{
+	// The newest value always lands, whatever the drain is doing meanwhile
+	std::thread producer([] {
+		for (int v = 0; v < 100000; v++) gui_msg_post_value(GUI_MSG_SPEED, v & 0xFF);
+		gui_msg_post_value(GUI_MSG_SPEED, 7);
+	});
+	while (applied.empty() || applied.back().value != 7) gui_msg_drain(record);
+	producer.join();
+
+	applied.clear();
+	gui_msg_drain(record);
+	EXPECT_TRUE(applied.empty() || applied.back().value == 7);
+}
@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <gtest/gtest.h>
+
+#include "gui_sleep.h"
+
+// Matches CONFIG_FREERTOS_HZ, the GUI task never sleeps less than one tick
+#define TICK_MS             10
+#define IDLE_MINUTE_MS      60000
+
+// LVGL's anim task period while a backlight fade is running
+#define LV_ANIM_PERIOD_MS   30
+
+#define DIM_AFTER_MS        20000
+#define DIM_FADE_MS         1000
+#define OFF_AFTER_MS        120000
+#define POWEROFF_AFTER_MS   40000
+
+// Plays the GUI loop against a fake clock: each pass fills in the wake sources
+// the way the real ones would report them, sleeps for gui_sleep_ms() rounded
+// to ticks like ulTaskNotifyTake(), and counts the pass as a wakeup. Nothing
+// touches the screen, so only timers wake the task.
+struct IdleSim
+{
+	bool connected = true;
+	std::function<uint32_t(uint32_t)> lvgl = [](uint32_t) { return UINT32_MAX; };
+
+	uint32_t now = 0;
+	uint32_t last_diag = 0;
+	uint32_t wakeups = 0;
+	bool dimmed = false;
+	bool powered_off = false;
+	uint32_t powered_off_at = 0;
+	uint32_t fade_end = 0;
+
+	uint32_t backlight(uint32_t t)
+	{
+		if (!dimmed && t >= DIM_AFTER_MS)
+		{
+			dimmed = true;
+			fade_end = t + DIM_FADE_MS;
+		}
+		if (!connected && !powered_off && t >= POWEROFF_AFTER_MS)
+		{
+			powered_off = true;
+			powered_off_at = t;
+		}
+
+		uint32_t next = gui_ms_until(dimmed ? OFF_AFTER_MS : DIM_AFTER_MS, t);
+		if (!connected && !powered_off) next = std::min(next, gui_ms_until(POWEROFF_AFTER_MS, t));
+		return next;
+	}
+
+	void run(uint32_t until_ms)
+	{
+		while (now < until_ms && !powered_off)
+		{
+			gui_wake_sources_t wake;
+			wake.display_ms = UINT32_MAX;
+			wake.lvgl_ms = lvgl(now);
+			if (now < fade_end) wake.lvgl_ms = std::min(wake.lvgl_ms, (uint32_t) LV_ANIM_PERIOD_MS);
+			wake.backlight_ms = backlight(now);
+
+			if (now >= last_diag + DIAG_UPDATE_PERIOD_MS) last_diag = now;
+			wake.diag_ms = gui_ms_until(last_diag + DIAG_UPDATE_PERIOD_MS, now);
+
+			uint32_t ticks = gui_sleep_ms(&wake) / TICK_MS;
+			now += ((ticks > 0) ? ticks : 1) * TICK_MS;
+			wakeups++;
+		}
+	}
+};
+
+TEST(GuiSleep, TakesTheEarliestSource)
+{
+	gui_wake_sources_t wake = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX };
+	EXPECT_EQ(gui_sleep_ms(&wake), (uint32_t) GUI_MAX_SLEEP_MS);
+
+	wake.backlight_ms = 700;
+	wake.diag_ms = 300;
+	EXPECT_EQ(gui_sleep_ms(&wake), 300u);
+
+	wake.lvgl_ms = 30;
+	EXPECT_EQ(gui_sleep_ms(&wake), 30u);
+
+	wake.display_ms = 0;
+	EXPECT_EQ(gui_sleep_ms(&wake), 0u);
+}
+
+TEST(GuiSleep, MsUntilStopsAtZero)
+{
+	EXPECT_EQ(gui_ms_until(1500, 1000), 500u);
+	EXPECT_EQ(gui_ms_until(1000, 1000), 0u);
+	EXPECT_EQ(gui_ms_until(1000, 1200), 0u);
+}
+
+TEST(GuiWakeups, IdleMinuteOnlyWakesForTimers)
+{
+	IdleSim sim;
+	sim.run(IDLE_MINUTE_MS);
+
+	// One wakeup per diag refresh, plus the anim frames of the dim fade
+	uint32_t expected = IDLE_MINUTE_MS / DIAG_UPDATE_PERIOD_MS + DIM_FADE_MS / LV_ANIM_PERIOD_MS;
+	EXPECT_TRUE(sim.dimmed);
+	EXPECT_GE(sim.wakeups, IDLE_MINUTE_MS / DIAG_UPDATE_PERIOD_MS);
+	EXPECT_LE(sim.wakeups, expected + 2);
+
+	// The old 10ms polling loop
+	EXPECT_LT(sim.wakeups * 20, (uint32_t) (IDLE_MINUTE_MS / TICK_MS));
+}
+
+TEST(GuiWakeups, WakesOnTimeForEachStage)
+{
+	IdleSim sim;
+	sim.run(DIM_AFTER_MS - 1);
+	EXPECT_FALSE(sim.dimmed);
+
+	// Dimming is due at a diag refresh, so it must land exactly on it
+	sim.run(DIM_AFTER_MS + 1);
+	EXPECT_TRUE(sim.dimmed);
+	EXPECT_EQ(sim.fade_end, (uint32_t) (DIM_AFTER_MS + DIM_FADE_MS));
+}
+
+TEST(GuiWakeups, DisconnectedPowersOffOnTime)
+{
+	IdleSim sim;
+	sim.connected = false;
+	sim.run(IDLE_MINUTE_MS);
+
+	EXPECT_TRUE(sim.powered_off);
+	EXPECT_GE(sim.powered_off_at, (uint32_t) POWEROFF_AFTER_MS);
+	EXPECT_LT(sim.powered_off_at, (uint32_t) (POWEROFF_AFTER_MS + TICK_MS));
+}
+
+TEST(GuiWakeups, BusyLvglFallsBackToOneTick)
+{
+	// A task that is always ready, e.g. the perf monitor redrawing itself
+	IdleSim sim;
+	sim.lvgl = [](uint32_t) { return 0u; };
+	sim.run(IDLE_MINUTE_MS);
+
+	EXPECT_EQ(sim.wakeups, (uint32_t) (IDLE_MINUTE_MS / TICK_MS));
+}
+
+TEST(GuiWakeups, NothingScheduledStillWakesEverySecond)
+{
+	gui_wake_sources_t wake = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX };
+
+	uint32_t now = 0, wakeups = 0;
+	while (now < IDLE_MINUTE_MS)
+	{
+		now += gui_sleep_ms(&wake);
+		wakeups++;
+	}
+	EXPECT_EQ(wakeups, (uint32_t) (IDLE_MINUTE_MS / GUI_MAX_SLEEP_MS));
+}
@@ -0,0 +1,317 @@
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <gtest/gtest.h>
+
+#include "fake_esp.h"
+#include "fake_gatt.h"
+#include "list_fetch.h"
+
+#define GATTC_IF    3
+#define CONN_ID     1
+#define LIST_HANDLE 42
+
+// The LedController end of the chunked transfer: asked for an offset, it
+// streams [offset, total, data...] notifications of up to MTU - 3 bytes.
+// Offsets in drop are lost on their first send, as a busy link would.
+struct SimController
+{
+    std::string list;
+    uint16_t mtu = 23;
+    std::set<uint16_t> drop;
+
+    uint16_t total() const { return list.size() + 1; }
+
+    std::vector<std::vector<uint8_t>> stream_from(uint16_t offset)
+    {
+        std::vector<std::vector<uint8_t>> chunks;
+        uint16_t per_chunk = mtu - 3 - LIST_FETCH_HDR_LEN;
+
+        for (uint16_t at = offset; at < total(); at += per_chunk)
+        {
+            if (drop.erase(at) > 0) continue;
+
+            uint16_t len = (total() - at < per_chunk) ? total() - at : per_chunk;
+            std::vector<uint8_t> chunk = { (uint8_t) (at & 0xFF), (uint8_t) (at >> 8),
+                                           (uint8_t) (total() & 0xFF), (uint8_t) (total() >> 8) };
+            chunk.insert(chunk.end(), list.c_str() + at, list.c_str() + at + len);
+            chunks.push_back(chunk);
+        }
+        return chunks;
+    }
+};
+
+static std::vector<std::string> delivered;
+
+static void on_done(list_fetch_t * fetch, char * str, int len)
+{
+    (void) fetch;
+    EXPECT_EQ(str[len - 1], 0);
+    delivered.push_back(std::string(str, len - 1));
+    free(str);
+}
+
+// Builds a newline-separated list of count items
+static std::string make_list(int count)
+{
+    std::string list;
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0) list += "\n";
+        list += "Pattern " + std::to_string(i);
+    }
+    return list;
+}
+
+class ListFetchTest : public ::testing::Test
+{
+protected:
+    list_fetch_t fetch = {};
+    SimController controller;
+
+    void SetUp() override
+    {
+        fake_esp_reset();
+        fake_gatt_reset();
+        delivered.clear();
+
+        fetch.name = "patterns";
+        fetch.handle = LIST_HANDLE;
+        fetch.chunked = true;
+        fetch.done_cb = on_done;
+        controller.list = make_list(40);
+    }
+
+    void TearDown() override
+    {
+        list_fetch_reset(&fetch);
+        EXPECT_EQ(fake_timers_alive(), 0);
+    }
+
+    void deliver(const std::vector<std::vector<uint8_t>> & chunks)
+    {
+        for (const auto & c : chunks)
+            list_fetch_on_notify(&fetch, GATTC_IF, CONN_ID, c.data(), c.size());
+    }
+
+    // The offset asked for by write request i
+    uint16_t requested_offset(int i)
+    {
+        const fake_gatt_request_t * r = fake_gatt_request(i);
+        EXPECT_NE(r, nullptr);
+        EXPECT_EQ(r->op, FAKE_GATT_WRITE);
+        EXPECT_EQ(r->handle, LIST_HANDLE);
+        EXPECT_EQ(r->write_type, ESP_GATT_WRITE_TYPE_RSP);
+        EXPECT_EQ(r->len, 2);
+        return r->value[0] | (r->value[1] << 8);
+    }
+
+    void answer_read()
+    {
+        const fake_gatt_request_t * r = fake_gatt_request(fake_gatt_count() - 1);
+        ASSERT_NE(r, nullptr);
+        ASSERT_EQ(r->op, FAKE_GATT_READ);
+        list_fetch_on_read(&fetch, (const uint8_t *) controller.list.c_str(), controller.total());
+    }
+};
+
+TEST_F(ListFetchTest, ChunkedFetchReassemblesTheList)
+{
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+    ASSERT_EQ(fake_gatt_count(), 1);
+    EXPECT_EQ(requested_offset(0), 0);
+
+    deliver(controller.stream_from(0));
+
+    ASSERT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0], controller.list);
+    EXPECT_FALSE(fetch.busy);
+    EXPECT_EQ(fake_timers_alive(), 0);
+}
+
+TEST_F(ListFetchTest, LargerMtuNeedsFewerChunks)
+{
+    controller.mtu = 247;
+    controller.list = make_list(300);
+
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+    auto chunks = controller.stream_from(0);
+    EXPECT_EQ(chunks.size(), (controller.total() + 239) / 240u);
+    deliver(chunks);
+
+    ASSERT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0], controller.list);
+}
+
+TEST_F(ListFetchTest, MissedChunkIsResumedOnce)
+{
+    controller.drop = { 32 };
+
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+    deliver(controller.stream_from(0));
+
+    // Every chunk after the gap is out of order, but only one resume is sent
+    ASSERT_EQ(fake_gatt_count(), 2);
+    EXPECT_EQ(requested_offset(1), 32);
+    EXPECT_TRUE(delivered.empty());
+
+    deliver(controller.stream_from(32));
+
+    ASSERT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0], controller.list);
+    EXPECT_EQ(fake_gatt_count(), 2);
+}
+
+TEST_F(ListFetchTest, StalledFetchFallsBackToARead)
+{
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+
+    // A few chunks, then nothing
+    auto chunks = controller.stream_from(0);
+    chunks.resize(3);
+    deliver(chunks);
+
+    fake_advance_us((LIST_FETCH_TIMEOUT_MS - 1) * 1000LL);
+    EXPECT_EQ(fake_gatt_count(), 1);
+
+    fake_advance_us(1000);
+    ASSERT_EQ(fake_gatt_count(), 2);
+    answer_read();
+
+    ASSERT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0], controller.list);
+}
+
+TEST_F(ListFetchTest, EveryChunkRestartsTheTimeout)
+{
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+
+    auto chunks = controller.stream_from(0);
+    for (size_t i = 0; i + 1 < chunks.size(); i++)
+    {
+        fake_advance_us((LIST_FETCH_TIMEOUT_MS - 100) * 1000LL);
+        list_fetch_on_notify(&fetch, GATTC_IF, CONN_ID, chunks[i].data(), chunks[i].size());
+    }
+    EXPECT_EQ(fake_gatt_count(), 1);
+
+    deliver({ chunks.back() });
+    ASSERT_EQ(delivered.size(), 1u);
+}
+
+TEST_F(ListFetchTest, LostResumeFallsBackToARead)
+{
+    controller.drop = { 16 };
+
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+    deliver(controller.stream_from(0));
+    ASSERT_EQ(fake_gatt_count(), 2);
+
+    // The resume never gets an answer
+    fake_advance_us(LIST_FETCH_TIMEOUT_MS * 1000LL);
+    ASSERT_EQ(fake_gatt_count(), 3);
+    answer_read();
+
+    ASSERT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0], controller.list);
+}
+
+TEST_F(ListFetchTest, FailedOffsetWriteFallsBackForTheConnection)
+{
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+    list_fetch_on_write(&fetch, ESP_GATT_ERROR);
+
+    ASSERT_EQ(fake_gatt_count(), 2);
+    answer_read();
+    ASSERT_EQ(delivered.size(), 1u);
+
+    // The next fetch doesn't try chunks again
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+    ASSERT_EQ(fake_gatt_count(), 3);
+    EXPECT_EQ(fake_gatt_request(2)->op, FAKE_GATT_READ);
+    EXPECT_EQ(fake_timers_alive(), 0);
+}
+
+TEST_F(ListFetchTest, RejectedOffsetRequestReadsStraightAway)
+{
+    fake_gatt_fail_next(1, ESP_FAIL);
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+
+    ASSERT_EQ(fake_gatt_count(), 1);
+    EXPECT_EQ(fake_gatt_request(0)->op, FAKE_GATT_READ);
+    EXPECT_EQ(fake_timers_alive(), 0);
+}
+
+TEST_F(ListFetchTest, ChunksAfterTheFallbackAreIgnored)
+{
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+    fake_advance_us(LIST_FETCH_TIMEOUT_MS * 1000LL);
+    ASSERT_EQ(fake_gatt_count(), 2);
+
+    // The controller wakes up late; the read still answers the fetch
+    deliver(controller.stream_from(0));
+    EXPECT_TRUE(delivered.empty());
+
+    answer_read();
+    ASSERT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0], controller.list);
+}
+
+TEST_F(ListFetchTest, PlainCharacteristicIsRead)
+{
+    fetch.chunked = false;
+
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+    ASSERT_EQ(fake_gatt_count(), 1);
+    EXPECT_EQ(fake_gatt_request(0)->op, FAKE_GATT_READ);
+    EXPECT_EQ(fake_timers_alive(), 0);
+
+    // Without the trailing NUL, which the fetch adds
+    list_fetch_on_read(&fetch, (const uint8_t *) controller.list.c_str(), controller.list.size());
+    ASSERT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0], controller.list);
+}
+
+TEST_F(ListFetchTest, UnpromptedPushIsAccepted)
+{
+    deliver(controller.stream_from(0));
+
+    ASSERT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0], controller.list);
+    EXPECT_EQ(fake_gatt_count(), 0);
+}
+
+TEST_F(ListFetchTest, ListChangingMidFetchRestarts)
+{
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+
+    auto chunks = controller.stream_from(0);
+    chunks.resize(2);
+    deliver(chunks);
+
+    controller.list = make_list(55);
+    deliver(controller.stream_from(0));
+
+    ASSERT_EQ(delivered.size(), 1u);
+    EXPECT_EQ(delivered[0], controller.list);
+}
+
+TEST_F(ListFetchTest, OversizedListIsRefused)
+{
+    uint8_t chunk[] = { 0, 0, (LIST_FETCH_MAX_LEN + 1) & 0xFF, (LIST_FETCH_MAX_LEN + 1) >> 8, 'x' };
+
+    ASSERT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_OK);
+    list_fetch_on_notify(&fetch, GATTC_IF, CONN_ID, chunk, sizeof(chunk));
+
+    EXPECT_FALSE(fetch.busy);
+    EXPECT_TRUE(delivered.empty());
+    EXPECT_EQ(fake_timers_alive(), 0);
+}
+
+TEST_F(ListFetchTest, NoHandleIsAnError)
+{
+    fetch.handle = 0;
+
+    EXPECT_EQ(list_fetch_start(&fetch, GATTC_IF, CONN_ID), ESP_ERR_INVALID_STATE);
+    EXPECT_EQ(fake_gatt_count(), 0);
+}
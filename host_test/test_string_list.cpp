@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <gtest/gtest.h>
+
+#include "string_list.h"
+
+// adopt() takes a malloc'd buffer, as the BLE list callbacks hand over
+static char * dup_with_nul(const std::string & s)
+{
+    char * buf = (char *) malloc(s.size() + 1);
+    memcpy(buf, s.c_str(), s.size() + 1);
+    return buf;
+}
+
+static bool load(StringList & list, const std::string & s)
+{
+    return list.adopt(dup_with_nul(s), s.size() + 1);
+}
+
+static std::string item(const StringList & list, size_t i)
+{
+    StringSlice slice = list[i];
+    EXPECT_EQ(strlen(slice.c_str()), slice.size());
+    return std::string(slice.data, slice.size());
+}
+
+TEST(StringListTest, SplitsOnNewlines)
+{
+    StringList list;
+    ASSERT_TRUE(load(list, "Solid\nRainbow\nChase"));
+
+    ASSERT_EQ(list.size(), 3u);
+    EXPECT_EQ(item(list, 0), "Solid");
+    EXPECT_EQ(item(list, 1), "Rainbow");
+    EXPECT_EQ(item(list, 2), "Chase");
+}
+
+TEST(StringListTest, TrailingNewlineAddsNoItem)
+{
+    StringList list;
+    ASSERT_TRUE(load(list, "Red\nGreen\n"));
+
+    ASSERT_EQ(list.size(), 2u);
+    EXPECT_EQ(item(list, 1), "Green");
+}
+
+TEST(StringListTest, EmptyLinesAreKept)
+{
+    StringList list;
+    ASSERT_TRUE(load(list, "Red\n\nBlue"));
+
+    ASSERT_EQ(list.size(), 3u);
+    EXPECT_EQ(item(list, 1), "");
+    EXPECT_EQ(item(list, 2), "Blue");
+}
+
+TEST(StringListTest, EmptyStringIsAnEmptyList)
+{
+    StringList list;
+    ASSERT_TRUE(load(list, ""));
+
+    EXPECT_EQ(list.size(), 0u);
+}
+
+TEST(StringListTest, OutOfRangeIsEmpty)
+{
+    StringList list;
+    ASSERT_TRUE(load(list, "Red"));
+
+    EXPECT_EQ(list[1].size(), 0u);
+    EXPECT_STREQ(list[1].c_str(), "");
+    EXPECT_EQ(StringList()[0].size(), 0u);
+}
+
+TEST(StringListTest, RejectsBuffersWithoutTheNul)
+{
+    StringList list;
+    ASSERT_TRUE(load(list, "Red"));
+
+    char * buf = (char *) malloc(3);
+    memcpy(buf, "Red", 3);
+    EXPECT_FALSE(list.adopt(buf, 3));
+    EXPECT_EQ(list.size(), 0u);
+
+    EXPECT_FALSE(list.adopt((char *) malloc(1), 0));
+    EXPECT_FALSE(list.adopt(NULL, 4));
+}
+
+TEST(StringListTest, RejectsListsOver64KiB)
+{
+    StringList list;
+    std::string big(UINT16_MAX, 'x');
+
+    EXPECT_FALSE(load(list, big));
+    EXPECT_EQ(list.size(), 0u);
+}
+
+TEST(StringListTest, ReloadingReplacesTheList)
+{
+    StringList list;
+    std::string long_list;
+    for (int i = 0; i < 500; i++) long_list += "Pattern " + std::to_string(i) + "\n";
+
+    ASSERT_TRUE(load(list, long_list));
+    ASSERT_EQ(list.size(), 500u);
+    EXPECT_EQ(item(list, 0), "Pattern 0");
+    EXPECT_EQ(item(list, 499), "Pattern 499");
+
+    ASSERT_TRUE(load(list, "One\nTwo"));
+    ASSERT_EQ(list.size(), 2u);
+    EXPECT_EQ(item(list, 1), "Two");
+    EXPECT_EQ(list[2].size(), 0u);
+
+    list.clear();
+    EXPECT_EQ(list.size(), 0u);
+}
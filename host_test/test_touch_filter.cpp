@@ -0,0 +1,263 @@
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "touch_filter.h"
+
+// Replays the traces in traces/ (see make_touch_traces.py, or dump one from a
+// device with 'touch -t') through the filter chain.
+
+#define SCREEN_W    320
+#define SCREEN_H    240
+
+typedef std::vector<touch_filter_sample_t> Trace;
+
+static Trace load_trace(const char * name)
+{
+    Trace samples;
+    std::string path = std::string(TRACE_DIR) + "/" + name;
+
+    FILE * f = fopen(path.c_str(), "r");
+    if (f == NULL)
+    {
+        ADD_FAILURE() << "Can't open " << path;
+        return samples;
+    }
+
+    char line[80];
+    if (fgets(line, sizeof(line), f) == NULL) line[0] = 0;   // Header
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        touch_filter_sample_t s = {};
+        int pressed;
+        if (sscanf(line, "%u,%hd,%hd,%d", &s.t_ms, &s.x, &s.y, &pressed) != 4) continue;
+        s.pressed = pressed != 0;
+        samples.push_back(s);
+    }
+    fclose(f);
+
+    EXPECT_GT(samples.size(), 10u) << path;
+    return samples;
+}
+
+static Trace replay(const Trace & in)
+{
+    Trace out(in.size());
+    touch_filter_replay(in.data(), out.data(), in.size());
+    return out;
+}
+
+// The stages touch_input_set_filter() builds for its presets
+static touch_filter_cfg_t median_stage()
+{
+    touch_filter_cfg_t cfg = {};
+    cfg.kind = TOUCH_FILTER_MEDIAN;
+    cfg.median.window = 3;
+    return cfg;
+}
+
+static touch_filter_cfg_t euro_stage()
+{
+    touch_filter_cfg_t cfg = {};
+    cfg.kind = TOUCH_FILTER_ONE_EURO;
+    cfg.one_euro.min_cutoff_mhz = 1000;
+    cfg.one_euro.beta = 7;
+    cfg.one_euro.d_cutoff_mhz = 1000;
+    return cfg;
+}
+
+static touch_filter_cfg_t predict_stage(uint16_t lead_ms)
+{
+    touch_filter_cfg_t cfg = {};
+    cfg.kind = TOUCH_FILTER_PREDICT;
+    cfg.predict.lead_ms = lead_ms;
+    cfg.predict.max_x = SCREEN_W - 1;
+    cfg.predict.max_y = SCREEN_H - 1;
+    return cfg;
+}
+
+static void set_chain(std::vector<touch_filter_cfg_t> stages)
+{
+    ASSERT_TRUE(touch_filter_set_chain(stages.data(), stages.size()));
+}
+
+// Spread of x around its mean while pressed, skipping the first reports
+static double x_deviation(const Trace & t)
+{
+    double sum = 0, sum_sq = 0;
+    int n = 0;
+    for (size_t i = 10; i < t.size(); i++)
+    {
+        if (!t[i].pressed) continue;
+        sum += t[i].x;
+        sum_sq += (double) t[i].x * t[i].x;
+        n++;
+    }
+    double mean = sum / n;
+    return sqrt(sum_sq / n - mean * mean);
+}
+
+// When x first reaches at_x, 0 if it never does
+static uint32_t time_reaching(const Trace & t, int16_t at_x)
+{
+    for (const touch_filter_sample_t & s : t)
+    {
+        if (s.pressed && s.x >= at_x) return s.t_ms;
+    }
+    return 0;
+}
+
+class TouchFilterTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        touch_filter_set_chain(NULL, 0);
+    }
+};
+
+TEST_F(TouchFilterTest, EmptyChainPassesReportsThrough)
+{
+    set_chain({});
+    Trace raw = load_trace("touch_swipe.csv");
+    Trace out = replay(raw);
+
+    for (size_t i = 0; i < raw.size(); i++)
+    {
+        if (!raw[i].pressed) continue;
+        EXPECT_EQ(out[i].x, raw[i].x);
+        EXPECT_EQ(out[i].y, raw[i].y);
+        EXPECT_EQ(out[i].t_ms, raw[i].t_ms);
+    }
+}
+
+TEST_F(TouchFilterTest, MedianDropsSingleReportSpikes)
+{
+    set_chain({ median_stage() });
+    Trace raw = load_trace("touch_rest_shaking.csv");
+    Trace out = replay(raw);
+
+    int raw_spikes = 0;
+    for (size_t i = 0; i < raw.size(); i++)
+    {
+        if (!raw[i].pressed) continue;
+        if (raw[i].x > 180) raw_spikes++;
+        EXPECT_LT(out[i].x, 175) << "at " << raw[i].t_ms << " ms";
+    }
+    EXPECT_GT(raw_spikes, 0);
+}
+
+TEST_F(TouchFilterTest, DefaultChainSteadiesAShakingFinger)
+{
+    Trace raw = load_trace("touch_rest_shaking.csv");
+
+    set_chain({ median_stage() });
+    double median_only = x_deviation(replay(raw));
+
+    set_chain({ median_stage(), euro_stage() });
+    double with_euro = x_deviation(replay(raw));
+
+    EXPECT_LT(with_euro, median_only / 2);
+    EXPECT_LT(with_euro, 1.5);
+}
+
+TEST_F(TouchFilterTest, DefaultChainKeepsUpWithASwipe)
+{
+    Trace raw = load_trace("touch_swipe.csv");
+    set_chain({ median_stage(), euro_stage() });
+    Trace out = replay(raw);
+
+    uint32_t raw_mid = time_reaching(raw, 160);
+    uint32_t out_mid = time_reaching(out, 160);
+    ASSERT_NE(raw_mid, 0u);
+    ASSERT_NE(out_mid, 0u);
+    EXPECT_LE(out_mid - raw_mid, 50u);
+
+    // And settles where the finger stopped
+    size_t last_pressed = raw.size() - 2;
+    EXPECT_NEAR(out[last_pressed].x, 290, 3);
+    EXPECT_NEAR(out[last_pressed].y, 180, 3);
+}
+
+TEST_F(TouchFilterTest, PredictionMakesUpLag)
+{
+    Trace raw = load_trace("touch_swipe.csv");
+
+    set_chain({ median_stage(), euro_stage() });
+    uint32_t without = time_reaching(replay(raw), 160);
+
+    set_chain({ median_stage(), euro_stage(), predict_stage(30) });
+    uint32_t with = time_reaching(replay(raw), 160);
+
+    ASSERT_NE(without, 0u);
+    ASSERT_NE(with, 0u);
+    EXPECT_LT(with, without);
+}
+
+TEST_F(TouchFilterTest, PredictionStaysOnScreen)
+{
+    set_chain({ predict_stage(100) });
+    Trace out = replay(load_trace("touch_edge_flick.csv"));
+
+    for (const touch_filter_sample_t & s : out)
+    {
+        EXPECT_GE(s.x, 0);
+        EXPECT_LT(s.x, SCREEN_W);
+        EXPECT_GE(s.y, 0);
+        EXPECT_LT(s.y, SCREEN_H);
+    }
+}
+
+TEST_F(TouchFilterTest, LiftOffKeepsTheLastShownPoint)
+{
+    set_chain({ median_stage(), euro_stage(), predict_stage(30) });
+    Trace raw = load_trace("touch_edge_flick.csv");
+    Trace out = replay(raw);
+
+    for (size_t i = 1; i < raw.size(); i++)
+    {
+        if (raw[i].pressed || !raw[i - 1].pressed) continue;
+        EXPECT_EQ(out[i].x, out[i - 1].x);
+        EXPECT_EQ(out[i].y, out[i - 1].y);
+        EXPECT_FALSE(out[i].pressed);
+    }
+}
+
+TEST_F(TouchFilterTest, ReplayStartsFromAClearState)
+{
+    set_chain({ median_stage(), euro_stage(), predict_stage(30) });
+    Trace raw = load_trace("touch_swipe.csv");
+
+    // Leave the chain mid-swipe before replaying it again
+    Trace first = replay(Trace(raw.begin(), raw.begin() + 20));
+    Trace again = replay(raw);
+    Trace fresh = replay(raw);
+
+    ASSERT_EQ(again.size(), fresh.size());
+    for (size_t i = 0; i < fresh.size(); i++)
+    {
+        EXPECT_EQ(again[i].x, fresh[i].x);
+        EXPECT_EQ(again[i].y, fresh[i].y);
+    }
+    (void) first;
+}
+
+TEST_F(TouchFilterTest, InvalidChainIsRefused)
+{
+    set_chain({ median_stage() });
+
+    touch_filter_cfg_t bad_median = median_stage();
+    bad_median.median.window = 4;
+    touch_filter_cfg_t bad_predict = predict_stage(101);
+    std::vector<touch_filter_cfg_t> too_long(TOUCH_FILTER_MAX_STAGES + 1, median_stage());
+
+    EXPECT_FALSE(touch_filter_check_chain(&bad_median, 1));
+    EXPECT_FALSE(touch_filter_set_chain(&bad_predict, 1));
+    EXPECT_FALSE(touch_filter_set_chain(too_long.data(), too_long.size()));
+
+    touch_filter_cfg_t stages[TOUCH_FILTER_MAX_STAGES];
+    ASSERT_EQ(touch_filter_get_chain(stages, TOUCH_FILTER_MAX_STAGES), 1u);
+    EXPECT_EQ(stages[0].kind, TOUCH_FILTER_MEDIAN);
+}
@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+
+#include "fake_esp.h"
+#include "fake_gatt.h"
+#include "fake_ble_metrics.h"
+#include "write_pipeline.h"
+
+#define GATTC_IF    3
+
+// 7.5ms, in the GAP's 1.25ms units
+#define FAST_CONN_INT           6
+#define FAST_CONN_INTERVAL_US   7500
+
+class WritePipelineTest : public ::testing::Test
+{
+protected:
+    write_pipeline_stats_t before;
+    uint32_t metrics_before;
+
+    void SetUp() override
+    {
+        fake_esp_reset();
+        fake_gatt_reset();
+        write_pipeline_init();
+        for (int l = 0; l < WRITE_PIPELINE_MAX_LINKS; l++) write_pipeline_disconnected(l);
+        write_pipeline_get_stats(&before);
+        metrics_before = fake_metrics_writes_sent();
+
+        // Far enough from any earlier flush that the first one isn't held back
+        fake_advance_us(1000000);
+    }
+
+    void TearDown() override
+    {
+        // Let an armed flush run, so the next test starts with none pending
+        fake_advance_us(1000000);
+        for (int l = 0; l < WRITE_PIPELINE_MAX_LINKS; l++) write_pipeline_disconnected(l);
+    }
+
+    write_pipeline_stats_t delta()
+    {
+        write_pipeline_stats_t now;
+        write_pipeline_get_stats(&now);
+        return { now.sent - before.sent, now.merged - before.merged,
+                 now.dropped - before.dropped, now.congested - before.congested };
+    }
+
+    void expect_write(int i, uint16_t conn_id, uint16_t handle, uint8_t value)
+    {
+        const fake_gatt_request_t * r = fake_gatt_request(i);
+        ASSERT_NE(r, nullptr);
+        EXPECT_EQ(r->op, FAKE_GATT_WRITE);
+        EXPECT_EQ(r->conn_id, conn_id);
+        EXPECT_EQ(r->handle, handle);
+        EXPECT_EQ(r->write_type, ESP_GATT_WRITE_TYPE_NO_RSP);
+        ASSERT_EQ(r->len, 1);
+        EXPECT_EQ(r->value[0], value);
+    }
+};
+
+TEST_F(WritePipelineTest, NothingIsSentWhileDisconnected)
+{
+    write_pipeline_set(0, 0, 20, 5);
+    fake_advance_us(100000);
+
+    EXPECT_EQ(fake_gatt_count(), 0);
+    EXPECT_EQ(delta().dropped, 1u);
+}
+
+TEST_F(WritePipelineTest, ValuesSetBeforeAFlushAreMerged)
+{
+    write_pipeline_connected(0, GATTC_IF, 1);
+
+    for (int v = 1; v <= 10; v++) write_pipeline_set(0, 0, 20, v);
+    fake_advance_us(100000);
+
+    ASSERT_EQ(fake_gatt_count(), 1);
+    expect_write(0, 1, 20, 10);
+    EXPECT_EQ(delta().sent, 1u);
+    EXPECT_EQ(delta().merged, 9u);
+}
+
+TEST_F(WritePipelineTest, FlushesAreSpacedByTheConnectionInterval)
+{
+    write_pipeline_connected(0, GATTC_IF, 1);
+    write_pipeline_set_conn_interval(0, FAST_CONN_INT);
+
+    // One change every millisecond for 30ms, like a dragged slider
+    for (int ms = 0; ms < 30; ms++)
+    {
+        write_pipeline_set(0, 0, 20, ms);
+        fake_advance_us(1000);
+    }
+    fake_advance_us(FAST_CONN_INTERVAL_US);
+
+    // The first goes straight out, then one per interval and the last value
+    ASSERT_GE(fake_gatt_count(), 4);
+    ASSERT_LE(fake_gatt_count(), 6);
+    for (int i = 1; i < fake_gatt_count(); i++)
+    {
+        EXPECT_GE(fake_gatt_request(i)->t_us - fake_gatt_request(i - 1)->t_us, FAST_CONN_INTERVAL_US);
+    }
+    expect_write(fake_gatt_count() - 1, 1, 20, 29);
+}
+
+TEST_F(WritePipelineTest, EachSlotKeepsItsOwnValue)
+{
+    write_pipeline_connected(0, GATTC_IF, 1);
+
+    write_pipeline_set(0, 0, 20, 1);
+    write_pipeline_set(0, 1, 22, 2);
+    write_pipeline_set(0, 2, 24, 3);
+    fake_advance_us(100000);
+
+    ASSERT_EQ(fake_gatt_count(), 3);
+    expect_write(0, 1, 20, 1);
+    expect_write(1, 1, 22, 2);
+    expect_write(2, 1, 24, 3);
+    EXPECT_EQ(fake_metrics_writes_sent() - metrics_before, 3u);
+}
+
+TEST_F(WritePipelineTest, EveryLinkGetsItsWrites)
+{
+    write_pipeline_connected(0, GATTC_IF, 1);
+    write_pipeline_connected(2, GATTC_IF, 7);
+
+    write_pipeline_set(0, 0, 20, 4);
+    write_pipeline_set(2, 0, 30, 4);
+    fake_advance_us(100000);
+
+    ASSERT_EQ(fake_gatt_count(), 2);
+    expect_write(0, 1, 20, 4);
+    expect_write(1, 7, 30, 4);
+}
+
+TEST_F(WritePipelineTest, CongestedLinkWaitsForTheCongestionToClear)
+{
+    write_pipeline_connected(0, GATTC_IF, 1);
+    write_pipeline_set_congested(0, true);
+
+    write_pipeline_set(0, 0, 20, 1);
+    write_pipeline_set(0, 0, 20, 2);
+    fake_advance_us(100000);
+    EXPECT_EQ(fake_gatt_count(), 0);
+    EXPECT_EQ(delta().congested, 1u);
+
+    write_pipeline_set_congested(0, false);
+    fake_advance_us(100000);
+    ASSERT_EQ(fake_gatt_count(), 1);
+    expect_write(0, 1, 20, 2);
+}
+
+TEST_F(WritePipelineTest, DisconnectDropsPendingValues)
+{
+    write_pipeline_connected(0, GATTC_IF, 1);
+
+    write_pipeline_set(0, 0, 20, 1);
+    write_pipeline_set(0, 1, 22, 1);
+    write_pipeline_disconnected(0);
+    fake_advance_us(100000);
+
+    EXPECT_EQ(fake_gatt_count(), 0);
+    EXPECT_EQ(delta().dropped, 2u);
+}
+
+TEST_F(WritePipelineTest, RejectedWriteIsCountedAsDropped)
+{
+    write_pipeline_connected(0, GATTC_IF, 1);
+    fake_gatt_fail_next(1, ESP_FAIL);
+
+    write_pipeline_set(0, 0, 20, 1);
+    fake_advance_us(100000);
+
+    EXPECT_EQ(delta().sent, 0u);
+    EXPECT_EQ(delta().dropped, 1u);
+}
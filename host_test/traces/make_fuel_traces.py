@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Writes the fuel gauge traces replayed by test_fuel_gauge.cpp.
+
+Each row is one telemetry sample as powerSampleCb() sees it, plus the cell
+model's true state of charge:
+
+    t_ms,battery_mv,charge_ma,discharge_ma,coulomb_charge,coulomb_discharge,true_permille
+
+The cell is a simple model rather than a capture: a LiPo open circuit curve
+close to (but not the same as) the one in fuel_gauge.c, a fixed internal
+resistance, a few mV of ADC noise and an AXP192-style coulomb counter that
+only moves in whole counts. Traces captured on a device in the same format
+can be dropped in next to these.
+"""
+import math
+import random
+
+SAMPLE_MS = 10000
+R_MOHM = 230                            # A little above the gauge's 200
+COUNT_UAH = 32768 * 1000 / (3600 * 25)  # One AXP192 count at 25Hz
+
+# Resting voltage of the modelled cell, slightly off the gauge's table
+OCV = [(0, 3290), (30, 3490), (80, 3605), (150, 3690), (250, 3735), (350, 3772),
+       (450, 3806), (550, 3848), (650, 3906), (750, 3975), (850, 4056), (950, 4134), (1000, 4192)]
+
+
+def ocv_mv(permille):
+    for (p0, v0), (p1, v1) in zip(OCV, OCV[1:]):
+        if permille <= p1:
+            return v0 + (v1 - v0) * (permille - p0) / (p1 - p0)
+    return OCV[-1][1]
+
+
+class Cell:
+    def __init__(self, capacity_uah, permille, seed):
+        self.capacity = capacity_uah
+        self.charge = capacity_uah * permille / 1000
+        self.rng = random.Random(seed)
+        self.t_ms = 0
+        self.in_uah = 0.0
+        self.out_uah = 0.0
+        self.count_base = (11000, 14000)    # Counters don't start at zero
+        self.rows = []
+
+    def permille(self):
+        return max(0, min(1000, round(self.charge * 1000 / self.capacity)))
+
+    def sample(self, discharge_ma, charge_ma):
+        hours = SAMPLE_MS / 3600000
+        self.out_uah += discharge_ma * 1000 * hours
+        self.in_uah += charge_ma * 1000 * hours
+        self.charge += (charge_ma - discharge_ma) * 1000 * hours
+        self.charge = max(0, min(self.capacity, self.charge))
+        self.t_ms += SAMPLE_MS
+
+        net_ma = discharge_ma - charge_ma
+        mv = ocv_mv(self.charge * 1000 / self.capacity) - net_ma * R_MOHM / 1000 + self.rng.gauss(0, 4)
+        self.rows.append((self.t_ms, round(mv), round(charge_ma), round(discharge_ma),
+                          self.count_base[0] + int(self.in_uah / COUNT_UAH),
+                          self.count_base[1] + int(self.out_uah / COUNT_UAH),
+                          self.permille()))
+
+    # Remote in use: screen on and off, BLE writes, the odd spike
+    def discharge(self, until_permille):
+        phase = 0
+        while self.permille() > until_permille:
+            phase += 1
+            bright = (phase // 30) % 3 != 2
+            base = 190 if bright else 95
+            ma = base + 25 * math.sin(phase / 7) + self.rng.uniform(-15, 15)
+            if self.rng.random() < 0.03:
+                ma += 120
+            self.sample(ma, 0)
+
+    # USB charging: constant current, then tapering once the cell is near full
+    def charge_to(self, until_permille, tail_samples=0):
+        while self.permille() < until_permille:
+            p = self.permille()
+            ma = 350 if p < 900 else max(8, 350 * (1000 - p) / 100)
+            self.sample(0, ma)
+        for _ in range(tail_samples):
+            self.sample(0, self.rng.uniform(3, 10))
+
+    def write(self, path):
+        with open(path, "w") as f:
+            f.write("t_ms,battery_mv,charge_ma,discharge_ma,coulomb_charge,coulomb_discharge,true_permille\n")
+            for row in self.rows:
+                f.write(",".join(str(v) for v in row) + "\n")
+
+
+def main():
+    # Design capacity cell, topped off on USB, then run flat
+    cell = Cell(390000, 970, seed=1)
+    cell.charge_to(1000, tail_samples=6)
+    cell.discharge(40)
+    cell.write("fuel_full_discharge.csv")
+
+    # Worn cell holding 320mAh: the run from full should pull the capacity down
+    cell = Cell(320000, 970, seed=2)
+    cell.charge_to(1000, tail_samples=6)
+    cell.discharge(40)
+    cell.write("fuel_worn_cell.csv")
+
+    # Half-charged remote, put on USB part way down, then used again
+    cell = Cell(390000, 600, seed=3)
+    cell.discharge(350)
+    cell.charge_to(700)
+    cell.discharge(200)
+    cell.write("fuel_partial_topup.csv")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Writes the touch traces replayed by test_touch_filter.cpp.
+
+The format is what the 'touch -t' console command dumps, so a trace taken
+off a device can be dropped in next to these:
+
+    t_ms,x,y,pressed
+
+The reports are modelled on the FT6336 in trigger mode: one every 12ms or
+so while a finger is down, a pixel or two of noise, and on the shaking
+trace the odd single-report spike the median stage is there for. Like the
+device, the trace stops at 256 reports.
+"""
+import math
+import random
+
+REPORT_MS = 12
+TRACE_LEN = 256
+WIDTH = 320
+HEIGHT = 240
+
+
+class Trace:
+    def __init__(self, seed):
+        self.rng = random.Random(seed)
+        self.t_ms = 1000
+        self.rows = []
+
+    def report(self, x, y, pressed=True, noise=1.0):
+        x = min(WIDTH - 1, max(0, round(x + self.rng.gauss(0, noise))))
+        y = min(HEIGHT - 1, max(0, round(y + self.rng.gauss(0, noise))))
+        self.rows.append((self.t_ms, x, y, 1 if pressed else 0))
+        self.t_ms += REPORT_MS + self.rng.choice((-1, 0, 0, 1))
+
+    # Controller reports a released finger where it last saw it, give or take
+    def lift(self, x, y):
+        self.report(x, y, pressed=False, noise=6)
+        self.t_ms += 300
+
+    def write(self, path):
+        assert len(self.rows) <= TRACE_LEN
+        with open(path, "w") as f:
+            f.write("t_ms,x,y,pressed\n")
+            for row in self.rows:
+                f.write(",".join(str(v) for v in row) + "\n")
+
+
+def main():
+    # Finger resting on a slider on a cart: a few px of 6Hz shake and spikes
+    trace = Trace(seed=1)
+    spikes = {40, 95, 150, 190}
+    for i in range(200):
+        t = i * REPORT_MS / 1000
+        x = 160 + 3 * math.sin(2 * math.pi * 6 * t)
+        y = 120 + 2 * math.cos(2 * math.pi * 6 * t + 0.7)
+        if i in spikes:
+            x += 45
+        trace.report(x, y, noise=1.5)
+    trace.lift(160, 120)
+    trace.write("touch_rest_shaking.csv")
+
+    # A deliberate swipe across most of the screen at about 1000px/s
+    trace = Trace(seed=2)
+    for _ in range(8):
+        trace.report(30, 200)
+    steps = 22
+    for i in range(1, steps + 1):
+        ease = (1 - math.cos(math.pi * i / steps)) / 2
+        trace.report(30 + 260 * ease, 200 - 20 * ease)
+    for _ in range(16):
+        trace.report(290, 180)
+    trace.lift(290, 180)
+    trace.write("touch_swipe.csv")
+
+    # A flick off the right edge, lifted while still moving
+    trace = Trace(seed=3)
+    for _ in range(6):
+        trace.report(180, 60)
+    for i in range(1, 10):
+        trace.report(180 + 18 * i, 60 + 2 * i)
+    trace.lift(WIDTH - 1, 80)
+    trace.write("touch_edge_flick.csv")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include "esp_log.h"
+#include "lvgl.h"
+#include "m5core2_axp192.h"
+#include "backlight.h"
+
+#define BACKLIGHT_TAG   "BACKLIGHT"
+
+static backlight_stage_cfg_t stages[BACKLIGHT_STAGE_COUNT] = {
+    [BACKLIGHT_BRIGHT]   = { .after_ms = 0,      .mv = 2800, .fade_ms = 150,  .curve = BACKLIGHT_CURVE_EASE_OUT },
+    [BACKLIGHT_DIM]      = { .after_ms = 20000,  .mv = 2500, .fade_ms = 1000, .curve = BACKLIGHT_CURVE_EASE_IN_OUT },
+    [BACKLIGHT_OFF]      = { .after_ms = 120000, .mv = 2200, .fade_ms = 1500, .curve = BACKLIGHT_CURVE_EASE_IN },
+    // Counted from the disconnect if that was more recent than the last touch
+    [BACKLIGHT_POWEROFF] = { .after_ms = 40000,  .mv = 2200, .fade_ms = 0,    .curve = BACKLIGHT_CURVE_LINEAR },
+};
+
+static const lv_anim_path_cb_t curves[BACKLIGHT_CURVE_COUNT] = {
+    [BACKLIGHT_CURVE_LINEAR]      = lv_anim_path_linear,
+    [BACKLIGHT_CURVE_EASE_IN]     = lv_anim_path_ease_in,
+    [BACKLIGHT_CURVE_EASE_OUT]    = lv_anim_path_ease_out,
+    [BACKLIGHT_CURVE_EASE_IN_OUT] = lv_anim_path_ease_in_out,
+};
+
+static const char * stage_names[BACKLIGHT_STAGE_COUNT] = { "bright", "dim", "off", "poweroff" };
+
+static backlight_stage_t stage = BACKLIGHT_BRIGHT;
+static BacklightStageCb stageCallback = NULL;
+
+static uint32_t last_activity;
+static uint32_t disconnect_time;
+static bool connected = false;
+
+static lv_coord_t rail_mv = -1;     // Last value written, -1 until known. Also the animation's var.
+static bool rail_on = true;
+
+// One write per 25mV step the fade crosses, however often LVGL calls this
+static void fade_exec(void * var, lv_anim_value_t value)
+{
+    (void) var;
+
+    int mv = BACKLIGHT_MIN_MV + ((value - BACKLIGHT_MIN_MV + BACKLIGHT_STEP_MV / 2) / BACKLIGHT_STEP_MV) * BACKLIGHT_STEP_MV;
+    if (mv < BACKLIGHT_MIN_MV) mv = BACKLIGHT_MIN_MV;
+    if (mv > BACKLIGHT_MAX_MV) mv = BACKLIGHT_MAX_MV;
+
+    if (mv == rail_mv) return;
+    if (m5core2_set_rail_mv(LCD_BACKLIGHT, mv) == ESP_OK) rail_mv = mv;
+}
+
+static void fade_ready(lv_anim_t * a)
+{
+    (void) a;
+
+    if (stage == BACKLIGHT_OFF && m5core2_set_rail_state(LCD_BACKLIGHT, false) == ESP_OK)
+    {
+        rail_on = false;
+    }
+}
+
+static void fade_to(const backlight_stage_cfg_t * cfg)
+{
+    lv_anim_del(&rail_mv, fade_exec);
+
+    if (!rail_on)
+    {
+        // Come back on from where the screen went dark rather than from wherever the rail was left
+        fade_exec(&rail_mv, stages[BACKLIGHT_OFF].mv);
+        if (m5core2_set_rail_state(LCD_BACKLIGHT, true) == ESP_OK) rail_on = true;
+    }
+
+    if (rail_mv < 0)
+    {
+        uint16_t mv;
+        if (m5core2_get_rail_mv(LCD_BACKLIGHT, &mv) == ESP_OK) rail_mv = mv;
+    }
+
+    if (cfg->fade_ms == 0 || rail_mv < 0 || rail_mv == cfg->mv)
+    {
+        fade_exec(&rail_mv, cfg->mv);
+        fade_ready(NULL);
+        return;
+    }
+
+    lv_anim_path_t path;
+    lv_anim_path_init(&path);
+    lv_anim_path_set_cb(&path, curves[cfg->curve]);
+
+    lv_anim_t a;
+    lv_anim_init(&a);
+    lv_anim_set_var(&a, &rail_mv);
+    lv_anim_set_exec_cb(&a, fade_exec);
+    lv_anim_set_values(&a, rail_mv, cfg->mv);
+    lv_anim_set_time(&a, cfg->fade_ms);
+    lv_anim_set_path(&a, &path);
+    lv_anim_set_ready_cb(&a, fade_ready);
+    lv_anim_start(&a);
+}
+
+static void set_stage(backlight_stage_t next)
+{
+    if (next == stage) return;
+
+    ESP_LOGI(BACKLIGHT_TAG, "%s -> %s", stage_names[stage], stage_names[next]);
+    stage = next;
+
+    if (next != BACKLIGHT_POWEROFF) fade_to(&stages[next]);
+    if (stageCallback != NULL) stageCallback(next);
+}
+
+void backlight_init(BacklightStageCb fn)
+{
+    stageCallback = fn;
+    last_activity = lv_tick_get();
+    disconnect_time = last_activity;
+
+    stage = BACKLIGHT_BRIGHT;
+    fade_to(&stages[BACKLIGHT_BRIGHT]);
+}
+
+bool backlight_set_stage_config(backlight_stage_t s, const backlight_stage_cfg_t * cfg)
+{
+    if (s >= BACKLIGHT_STAGE_COUNT || cfg->curve >= BACKLIGHT_CURVE_COUNT ||
+        cfg->mv < BACKLIGHT_MIN_MV || cfg->mv > BACKLIGHT_MAX_MV)
+    {
+        return false;
+    }
+
+    stages[s] = *cfg;
+    if (s == stage && s != BACKLIGHT_POWEROFF) fade_to(&stages[s]);
+    return true;
+}
+
+void backlight_get_stage_config(backlight_stage_t s, backlight_stage_cfg_t * cfg)
+{
+    if (s < BACKLIGHT_STAGE_COUNT) *cfg = stages[s];
+}
+
+bool backlight_activity()
+{
+    bool was_dark = (stage >= BACKLIGHT_OFF);
+
+    last_activity = lv_tick_get();
+    set_stage(BACKLIGHT_BRIGHT);
+
+    return was_dark;
+}
+
+void backlight_set_connected(bool c)
+{
+    if (connected && !c) disconnect_time = lv_tick_get();
+    connected = c;
+}
+
+static uint32_t ms_left(uint32_t after_ms, uint32_t elapsed)
+{
+    return (elapsed >= after_ms) ? 0 : (after_ms - elapsed);
+}
+
+uint32_t backlight_update()
+{
+    uint32_t idle = lv_tick_elaps(last_activity);
+    uint32_t next_ms = UINT32_MAX;
+    backlight_stage_t target = stage;
+
+    for (int s = BACKLIGHT_DIM; s <= BACKLIGHT_OFF; s++)
+    {
+        if (s <= (int) stage) continue;
+        if (idle >= stages[s].after_ms) target = s;
+        else next_ms = LV_MATH_MIN(next_ms, ms_left(stages[s].after_ms, idle));
+    }
+
+    if (!connected)
+    {
+        uint32_t quiet = LV_MATH_MIN(idle, lv_tick_elaps(disconnect_time));
+        if (quiet >= stages[BACKLIGHT_POWEROFF].after_ms) target = BACKLIGHT_POWEROFF;
+        else next_ms = LV_MATH_MIN(next_ms, ms_left(stages[BACKLIGHT_POWEROFF].after_ms, quiet));
+    }
+
+    if (target > stage) set_stage(target);
+
+    return next_ms;
+}
+
+backlight_stage_t backlight_get_stage() { return stage; }
+
+const char * backlight_stage_name(backlight_stage_t s)
+{
+    return (s < BACKLIGHT_STAGE_COUNT) ? stage_names[s] : "?";
+}
@@ -0,0 +1,72 @@
+#ifndef BACKLIGHT_H
+#define BACKLIGHT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Backlight and power policy. The longer the screen goes untouched the further
+// it steps down: bright -> dim -> off, and while no controller is connected,
+// power off. Each step fades the LCD_BACKLIGHT rail (DCDC3) with an LVGL
+// animation, writing the rail only when the value crosses one of its 25mV
+// steps, so a fade costs at most one I2C write per step.
+//
+// Everything here runs on the GUI thread.
+
+typedef enum
+{
+    BACKLIGHT_BRIGHT,
+    BACKLIGHT_DIM,
+    BACKLIGHT_OFF,
+    BACKLIGHT_POWEROFF,     // Only entered while disconnected
+
+    BACKLIGHT_STAGE_COUNT,
+} backlight_stage_t;
+
+typedef enum
+{
+    BACKLIGHT_CURVE_LINEAR,
+    BACKLIGHT_CURVE_EASE_IN,
+    BACKLIGHT_CURVE_EASE_OUT,
+    BACKLIGHT_CURVE_EASE_IN_OUT,
+
+    BACKLIGHT_CURVE_COUNT,
+} backlight_curve_t;
+
+typedef struct backlight_stage_cfg_t
+{
+    uint32_t after_ms;          // Untouched this long -> this stage (ignored for BRIGHT)
+    uint16_t mv;                // Rail voltage to fade to. OFF fades here, then cuts the rail.
+    uint16_t fade_ms;
+    backlight_curve_t curve;
+} backlight_stage_cfg_t;
+
+#define BACKLIGHT_MIN_MV    700
+#define BACKLIGHT_MAX_MV    2800    // Brighter than this shortens the backlight's life
+#define BACKLIGHT_STEP_MV   25
+
+// Called on the GUI thread each time the stage changes
+typedef void (*BacklightStageCb)(backlight_stage_t stage);
+
+void backlight_init(BacklightStageCb fn);
+bool backlight_set_stage_config(backlight_stage_t stage, const backlight_stage_cfg_t * cfg);
+void backlight_get_stage_config(backlight_stage_t stage, backlight_stage_cfg_t * cfg);
+
+// A touch. Returns true if the screen was off, so the touch can be kept from
+// pressing whatever the user couldn't see.
+bool backlight_activity();
+void backlight_set_connected(bool connected);
+
+// Steps down if a timeout has passed. Returns the ms until the next one.
+uint32_t backlight_update();
+backlight_stage_t backlight_get_stage();
+const char * backlight_stage_name(backlight_stage_t stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
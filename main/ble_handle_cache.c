@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <string.h>
+#include "nvs.h"
+#include "esp_log.h"
+#include "ble_handle_cache.h"
+
+#define CACHE_TAG       "BLE_CACHE"
+#define CACHE_NAMESPACE "ble_cache"
+#define CACHE_KEY_LEN   16
+
+// Bump when the layout of ble_handle_cache_t changes
+#define CACHE_VERSION   1
+
+// One entry per controller: "p" followed by the address in hex
+static void cache_key(const esp_bd_addr_t bda, char * key)
+{
+    snprintf(key, CACHE_KEY_LEN, "p%02x%02x%02x%02x%02x%02x", bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+}
+
+esp_err_t ble_handle_cache_load(const esp_bd_addr_t bda, ble_handle_cache_t * cache)
+{
+    char key[CACHE_KEY_LEN];
+    cache_key(bda, key);
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CACHE_NAMESPACE, NVS_READONLY, &nvs);
+    if (err != ESP_OK) return err;
+
+    size_t len = sizeof(*cache);
+    err = nvs_get_blob(nvs, key, cache, &len);
+    nvs_close(nvs);
+
+    if (err == ESP_OK && (len != sizeof(*cache) || cache->version != CACHE_VERSION || cache->char_count > BLE_HANDLE_CACHE_MAX_CHARS ||
+                          memcmp(cache->bda, bda, sizeof(esp_bd_addr_t)) != 0))
+    {
+        ESP_LOGW(CACHE_TAG, "Ignoring stale handle cache");
+        err = ESP_ERR_INVALID_VERSION;
+    }
+    if (err != ESP_OK) memset(cache, 0, sizeof(*cache));
+
+    return err;
+}
+
+esp_err_t ble_handle_cache_save(const ble_handle_cache_t * cache)
+{
+    ble_handle_cache_t to_save = *cache;
+    to_save.version = CACHE_VERSION;
+
+    char key[CACHE_KEY_LEN];
+    cache_key(cache->bda, key);
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) return err;
+
+    err = nvs_set_blob(nvs, key, &to_save, sizeof(to_save));
+    if (err == ESP_OK) err = nvs_commit(nvs);
+    nvs_close(nvs);
+
+    if (err != ESP_OK) ESP_LOGE(CACHE_TAG, "Saving handle cache failed: %s", esp_err_to_name(err));
+    return err;
+}
+
+esp_err_t ble_handle_cache_erase(const esp_bd_addr_t bda)
+{
+    char key[CACHE_KEY_LEN];
+    cache_key(bda, key);
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) return err;
+
+    err = nvs_erase_key(nvs, key);
+    if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND) err = nvs_commit(nvs);
+    nvs_close(nvs);
+
+    return err;
+}
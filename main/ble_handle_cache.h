@@ -0,0 +1,36 @@
+#ifndef BLE_HANDLE_CACHE_H
+#define BLE_HANDLE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLE_HANDLE_CACHE_MAX_CHARS  16
+
+// Characteristic handles of each controller we've connected to, kept in NVS
+// (keyed by address) so a reconnect to a bonded controller can skip service
+// discovery.
+typedef struct ble_handle_cache_t
+{
+    uint8_t version;
+    uint8_t addr_type;                                  // esp_ble_addr_type_t
+    esp_bd_addr_t bda;
+    uint8_t char_count;
+    uint16_t char_handles[BLE_HANDLE_CACHE_MAX_CHARS];
+    uint16_t cccd_handles[BLE_HANDLE_CACHE_MAX_CHARS];  // 0 if the characteristic doesn't notify
+} ble_handle_cache_t;
+
+esp_err_t ble_handle_cache_load(const esp_bd_addr_t bda, ble_handle_cache_t * cache);
+esp_err_t ble_handle_cache_save(const ble_handle_cache_t * cache);
+esp_err_t ble_handle_cache_erase(const esp_bd_addr_t bda);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,320 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_gap_ble_api.h"
+#include "ble_metrics.h"
+
+#define METRICS_TAG "BLE_METRICS"
+
+// Bluedroid takes one RSSI read at a time, so the live links are read in turn
+#define RSSI_TICK_MS    (BLE_METRICS_RSSI_PERIOD_MS / BLE_METRICS_MAX_LINKS)
+
+const uint32_t ble_metrics_bucket_us[BLE_METRICS_HIST_BUCKETS] = {
+    5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, UINT32_MAX,
+};
+
+typedef struct
+{
+    atomic_uint buckets[BLE_METRICS_HIST_BUCKETS];
+    atomic_uint count;
+    atomic_uint max_us;
+} hist_t;
+
+typedef struct
+{
+    hist_t hists[BLE_HIST_COUNT];
+    atomic_uint write_errors;
+    atomic_uint read_errors;
+
+    // Start time (low 32 bits of esp_timer, with bit 0 set so it's never 0)
+    // of the outstanding request for each id, 0 if none
+    atomic_uint write_start[BLE_METRICS_MAX_IDS];
+    atomic_uint read_start[BLE_METRICS_MAX_IDS];
+
+    // RSSI samples; rssi_head counts every sample ever taken
+    volatile int8_t rssi_ring[BLE_METRICS_RSSI_SAMPLES];
+    atomic_uint rssi_head;
+
+    atomic_uint conn_params;        // [interval:16][latency:16]
+    atomic_uint conn_timeout;
+    atomic_uint connects;
+    atomic_uint disconnects;
+    atomic_uint last_disconnect_reason;
+} link_metrics_t;
+
+static link_metrics_t links[BLE_METRICS_MAX_LINKS];
+
+// Which controller each link slot is talking to. Written from the BTC task,
+// read by the RSSI timer.
+static portMUX_TYPE peer_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_bd_addr_t peer_bda[BLE_METRICS_MAX_LINKS];
+static bool peer_connected[BLE_METRICS_MAX_LINKS];
+
+// Only touched from the BTC task. A drop is timed until that controller's
+// controls are live again, whichever slot it comes back in.
+static int64_t disconnect_us[BLE_METRICS_MAX_LINKS];
+
+static esp_timer_handle_t rssi_timer = NULL;
+static uint8_t rssi_next = 0;               // Only touched by rssi_timer
+
+static uint32_t now_stamp()
+{
+    return (uint32_t)esp_timer_get_time() | 1;
+}
+
+static link_metrics_t * metrics_for(uint8_t link)
+{
+    return (link < BLE_METRICS_MAX_LINKS) ? &links[link] : NULL;
+}
+
+static void hist_record(link_metrics_t * m, ble_hist_id_t id, uint32_t us)
+{
+    hist_t * h = &m->hists[id];
+
+    int b = 0;
+    while (b < BLE_METRICS_HIST_BUCKETS - 1 && us > ble_metrics_bucket_us[b]) b++;
+    atomic_fetch_add(&h->buckets[b], 1);
+    atomic_fetch_add(&h->count, 1);
+
+    unsigned int max = atomic_load(&h->max_us);
+    while (us > max && !atomic_compare_exchange_weak(&h->max_us, &max, us)) {}
+}
+
+static void request_sent(atomic_uint * starts, uint8_t id)
+{
+    if (id < BLE_METRICS_MAX_IDS) atomic_store(&starts[id], now_stamp());
+}
+
+static void request_done(link_metrics_t * m, atomic_uint * starts, uint8_t id, ble_hist_id_t hist)
+{
+    if (id >= BLE_METRICS_MAX_IDS) return;
+
+    uint32_t start = atomic_exchange(&starts[id], 0);
+    if (start == 0) return;   // Unsolicited, or the request was superseded
+
+    hist_record(m, hist, now_stamp() - start);
+}
+
+static void read_rssi(void *arg)
+{
+    (void) arg;
+
+    esp_bd_addr_t bda;
+    bool found = false;
+
+    portENTER_CRITICAL(&peer_lock);
+    for (int i = 0; i < BLE_METRICS_MAX_LINKS && !found; i++)
+    {
+        uint8_t link = rssi_next;
+        rssi_next = (rssi_next + 1) % BLE_METRICS_MAX_LINKS;
+        if (!peer_connected[link]) continue;
+
+        memcpy(bda, peer_bda[link], sizeof(esp_bd_addr_t));
+        found = true;
+    }
+    portEXIT_CRITICAL(&peer_lock);
+
+    if (found) esp_ble_gap_read_rssi(bda);
+}
+
+static bool any_connected()
+{
+    for (int i = 0; i < BLE_METRICS_MAX_LINKS; i++)
+    {
+        if (peer_connected[i]) return true;
+    }
+    return false;
+}
+
+void ble_metrics_init()
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = &read_rssi,
+        .name = "rssi_poll"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &rssi_timer));
+}
+
+void ble_metrics_write_sent(uint8_t link, uint8_t id)
+{
+    link_metrics_t * m = metrics_for(link);
+    if (m != NULL) request_sent(m->write_start, id);
+}
+
+void ble_metrics_write_done(uint8_t link, uint8_t id, bool ok)
+{
+    link_metrics_t * m = metrics_for(link);
+    if (m == NULL) return;
+
+    if (!ok) atomic_fetch_add(&m->write_errors, 1);
+    request_done(m, m->write_start, id, BLE_HIST_WRITE_QUEUE);
+}
+
+void ble_metrics_read_sent(uint8_t link, uint8_t id)
+{
+    link_metrics_t * m = metrics_for(link);
+    if (m != NULL) request_sent(m->read_start, id);
+}
+
+void ble_metrics_read_done(uint8_t link, uint8_t id, bool ok)
+{
+    link_metrics_t * m = metrics_for(link);
+    if (m == NULL) return;
+
+    if (!ok) atomic_fetch_add(&m->read_errors, 1);
+    request_done(m, m->read_start, id, BLE_HIST_READ);
+}
+
+void ble_metrics_connected(uint8_t link, const esp_bd_addr_t bda)
+{
+    link_metrics_t * m = metrics_for(link);
+    if (m == NULL) return;
+
+    atomic_fetch_add(&m->connects, 1);
+
+    // Pick up the drop time if this controller was last seen in another slot
+    for (int i = 0; i < BLE_METRICS_MAX_LINKS; i++)
+    {
+        if (i == link || disconnect_us[i] == 0 || memcmp(peer_bda[i], bda, sizeof(esp_bd_addr_t)) != 0) continue;
+        disconnect_us[link] = disconnect_us[i];
+        disconnect_us[i] = 0;
+    }
+
+    portENTER_CRITICAL(&peer_lock);
+    bool was_polling = any_connected();
+    memcpy(peer_bda[link], bda, sizeof(esp_bd_addr_t));
+    peer_connected[link] = true;
+    portEXIT_CRITICAL(&peer_lock);
+
+    if (rssi_timer != NULL && !was_polling) esp_timer_start_periodic(rssi_timer, RSSI_TICK_MS * 1000);
+}
+
+void ble_metrics_controls_live(uint8_t link)
+{
+    link_metrics_t * m = metrics_for(link);
+    if (m == NULL || disconnect_us[link] == 0) return;
+
+    int64_t elapsed = esp_timer_get_time() - disconnect_us[link];
+    hist_record(m, BLE_HIST_RECONNECT, (elapsed > UINT32_MAX) ? UINT32_MAX : (uint32_t)elapsed);
+    disconnect_us[link] = 0;
+}
+
+void ble_metrics_disconnected(uint8_t link, uint8_t reason)
+{
+    link_metrics_t * m = metrics_for(link);
+    if (m == NULL) return;
+
+    atomic_fetch_add(&m->disconnects, 1);
+    atomic_store(&m->last_disconnect_reason, reason);
+
+    // A reconnect from a failed direct connect still counts from the first drop
+    if (disconnect_us[link] == 0) disconnect_us[link] = esp_timer_get_time();
+
+    portENTER_CRITICAL(&peer_lock);
+    peer_connected[link] = false;
+    bool still_polling = any_connected();
+    portEXIT_CRITICAL(&peer_lock);
+
+    if (rssi_timer != NULL && !still_polling) esp_timer_stop(rssi_timer);
+}
+
+void ble_metrics_rssi(const esp_bd_addr_t bda, int8_t rssi)
+{
+    int link = -1;
+
+    portENTER_CRITICAL(&peer_lock);
+    for (int i = 0; i < BLE_METRICS_MAX_LINKS; i++)
+    {
+        if (peer_connected[i] && memcmp(peer_bda[i], bda, sizeof(esp_bd_addr_t)) == 0) link = i;
+    }
+    portEXIT_CRITICAL(&peer_lock);
+
+    if (link < 0) return;
+
+    link_metrics_t * m = &links[link];
+    unsigned int head = atomic_fetch_add(&m->rssi_head, 1);
+    m->rssi_ring[head % BLE_METRICS_RSSI_SAMPLES] = rssi;
+}
+
+void ble_metrics_conn_params(uint8_t link, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    link_metrics_t * m = metrics_for(link);
+    if (m == NULL) return;
+
+    atomic_store(&m->conn_params, ((uint32_t)interval << 16) | latency);
+    atomic_store(&m->conn_timeout, timeout);
+}
+
+void ble_metrics_get(uint8_t link, ble_metrics_t * metrics)
+{
+    memset(metrics, 0, sizeof(*metrics));
+
+    link_metrics_t * m = metrics_for(link);
+    if (m == NULL) return;
+
+    for (int h = 0; h < BLE_HIST_COUNT; h++)
+    {
+        for (int b = 0; b < BLE_METRICS_HIST_BUCKETS; b++)
+            metrics->hist[h].buckets[b] = atomic_load(&m->hists[h].buckets[b]);
+        metrics->hist[h].count = atomic_load(&m->hists[h].count);
+        metrics->hist[h].max_us = atomic_load(&m->hists[h].max_us);
+    }
+    metrics->write_errors = atomic_load(&m->write_errors);
+    metrics->read_errors = atomic_load(&m->read_errors);
+
+    // A sample landing mid-copy just means that slot is slightly newer
+    unsigned int head = atomic_load(&m->rssi_head);
+    unsigned int count = (head < BLE_METRICS_RSSI_SAMPLES) ? head : BLE_METRICS_RSSI_SAMPLES;
+    for (unsigned int i = 0; i < count; i++)
+        metrics->rssi[i] = m->rssi_ring[(head - count + i) % BLE_METRICS_RSSI_SAMPLES];
+    metrics->rssi_count = count;
+
+    uint32_t params = atomic_load(&m->conn_params);
+    metrics->conn_interval = params >> 16;
+    metrics->conn_latency = params & 0xFFFF;
+    metrics->conn_timeout = atomic_load(&m->conn_timeout);
+
+    metrics->connects = atomic_load(&m->connects);
+    metrics->disconnects = atomic_load(&m->disconnects);
+    metrics->last_disconnect_reason = atomic_load(&m->last_disconnect_reason);
+}
+
+void ble_metrics_reset()
+{
+    for (int l = 0; l < BLE_METRICS_MAX_LINKS; l++)
+    {
+        link_metrics_t * m = &links[l];
+        for (int h = 0; h < BLE_HIST_COUNT; h++)
+        {
+            for (int b = 0; b < BLE_METRICS_HIST_BUCKETS; b++)
+                atomic_store(&m->hists[h].buckets[b], 0);
+            atomic_store(&m->hists[h].count, 0);
+            atomic_store(&m->hists[h].max_us, 0);
+        }
+        atomic_store(&m->write_errors, 0);
+        atomic_store(&m->read_errors, 0);
+        atomic_store(&m->rssi_head, 0);
+        atomic_store(&m->connects, 0);
+        atomic_store(&m->disconnects, 0);
+    }
+}
+
+uint32_t ble_metrics_percentile_us(const ble_hist_t * hist, uint8_t percent)
+{
+    if (hist->count == 0) return 0;
+
+    uint32_t target = ((uint64_t)hist->count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int b = 0; b < BLE_METRICS_HIST_BUCKETS; b++)
+    {
+        seen += hist->buckets[b];
+        if (seen >= target)
+        {
+            // Nothing can be slower than the slowest sample
+            return (ble_metrics_bucket_us[b] < hist->max_us) ? ble_metrics_bucket_us[b] : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
@@ -0,0 +1,92 @@
+#ifndef BLE_METRICS_H
+#define BLE_METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Link quality and latency numbers for tuning the connection. Recorded from
+// the BLE callbacks and the write pipeline, read from the console and GUI.
+// Everything is fixed size and updated with atomics, so recording never blocks.
+//
+// Kept separately for each link slot (the index the GATT client gives a
+// connection). RSSI is polled for every connected link in turn, each one
+// about every BLE_METRICS_RSSI_PERIOD_MS.
+
+#define BLE_METRICS_MAX_LINKS       4
+#define BLE_METRICS_MAX_IDS         8       // Characteristic ids per link that can be timed
+#define BLE_METRICS_HIST_BUCKETS    9
+#define BLE_METRICS_RSSI_SAMPLES    32
+#define BLE_METRICS_RSSI_PERIOD_MS  2000
+
+typedef enum
+{
+    // Write handed to Bluedroid -> write complete event. The controls are
+    // written without response, so this completes once the packet is queued
+    // for the air, not when the controller has it: it shows how backed up
+    // the local stack is, not the round trip.
+    BLE_HIST_WRITE_QUEUE,
+    BLE_HIST_READ,          // Read requested -> read response
+    BLE_HIST_RECONNECT,     // Disconnect -> controls live again
+
+    BLE_HIST_COUNT,
+} ble_hist_id_t;
+
+typedef struct ble_hist_t
+{
+    uint32_t buckets[BLE_METRICS_HIST_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+} ble_hist_t;
+
+typedef struct ble_metrics_t
+{
+    ble_hist_t hist[BLE_HIST_COUNT];
+    uint32_t write_errors;
+    uint32_t read_errors;
+
+    int8_t rssi[BLE_METRICS_RSSI_SAMPLES];     // Oldest first
+    uint8_t rssi_count;
+
+    uint16_t conn_interval;     // 1.25ms units
+    uint16_t conn_latency;
+    uint16_t conn_timeout;      // 10ms units
+
+    uint32_t connects;
+    uint32_t disconnects;
+    uint8_t last_disconnect_reason;
+} ble_metrics_t;
+
+// Upper edge of each histogram bucket in us; the last one is open ended
+extern const uint32_t ble_metrics_bucket_us[BLE_METRICS_HIST_BUCKETS];
+
+void ble_metrics_init();
+
+void ble_metrics_write_sent(uint8_t link, uint8_t id);
+void ble_metrics_write_done(uint8_t link, uint8_t id, bool ok);
+void ble_metrics_read_sent(uint8_t link, uint8_t id);
+void ble_metrics_read_done(uint8_t link, uint8_t id, bool ok);
+
+void ble_metrics_connected(uint8_t link, const esp_bd_addr_t bda);
+void ble_metrics_controls_live(uint8_t link);
+void ble_metrics_disconnected(uint8_t link, uint8_t reason);
+// Matched to a link by address
+void ble_metrics_rssi(const esp_bd_addr_t bda, int8_t rssi);
+void ble_metrics_conn_params(uint8_t link, uint16_t interval, uint16_t latency, uint16_t timeout);
+
+void ble_metrics_get(uint8_t link, ble_metrics_t * metrics);
+// All links
+void ble_metrics_reset();
+
+// Approximate percentile (0-100) from the buckets, as the bucket's upper edge
+uint32_t ble_metrics_percentile_us(const ble_hist_t * hist, uint8_t percent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
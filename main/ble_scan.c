@@ -0,0 +1,223 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "esp_log.h"
+#include "ble_scan.h"
+
+#define SCAN_TAG "BLE_SCAN"
+
+#define MAX_BONDED  8
+
+typedef struct
+{
+    esp_ble_scan_type_t type;
+    uint16_t interval;      // 0.625ms units
+    uint16_t window;
+    uint32_t duration_s;
+} scan_stage_t;
+
+// The last stage repeats until something is found (or the remote powers off),
+// unless the scan was started without repeat
+static const scan_stage_t stages[] = {
+    { BLE_SCAN_TYPE_PASSIVE, 0x50,  0x30, 10 },     // 50ms / 30ms - 60% duty
+    { BLE_SCAN_TYPE_ACTIVE,  0x50,  0x30, 10 },     // Pick up names only sent in scan responses
+    { BLE_SCAN_TYPE_PASSIVE, 0x200, 0x30, 30 },     // 320ms / 30ms - 9% duty
+};
+#define STAGE_COUNT (sizeof(stages) / sizeof(stages[0]))
+
+static esp_bt_uuid_t service;
+static bool have_service = false;
+static const char * target_name = NULL;
+static size_t target_name_len = 0;
+
+// Bonded addresses, read once per scan rather than for every report
+static esp_bd_addr_t bonded[MAX_BONDED];
+static int bonded_count = 0;
+
+static bool scanning = false;
+static bool repeat_last = true;
+static uint8_t stage = 0;
+
+static atomic_uint seen_count;
+static atomic_uint processed_count;
+static atomic_uint matched_count;
+
+static void load_bonded()
+{
+    bonded_count = 0;
+
+    int dev_num = esp_ble_get_bond_device_num();
+    if (dev_num <= 0) return;
+
+    esp_ble_bond_dev_t *dev_list = (esp_ble_bond_dev_t *)malloc(sizeof(esp_ble_bond_dev_t) * dev_num);
+    if (dev_list == NULL) return;
+
+    if (esp_ble_get_bond_device_list(&dev_num, dev_list) == ESP_OK)
+    {
+        for (int i = 0; i < dev_num && bonded_count < MAX_BONDED; i++)
+        {
+            memcpy(bonded[bonded_count++], dev_list[i].bd_addr, sizeof(esp_bd_addr_t));
+        }
+    }
+
+    free(dev_list);
+}
+
+static void set_stage_params()
+{
+    const scan_stage_t * s = &stages[stage];
+
+    esp_ble_scan_params_t params = {
+        .scan_type              = s->type,
+        .own_addr_type          = BLE_ADDR_TYPE_RANDOM,
+        .scan_filter_policy     = BLE_SCAN_FILTER_ALLOW_ALL,
+        .scan_interval          = s->interval,
+        .scan_window            = s->window,
+        // Let the controller drop repeats so each device is reported once per window
+        .scan_duplicate         = BLE_SCAN_DUPLICATE_ENABLE
+    };
+
+    esp_err_t ret = esp_ble_gap_set_scan_params(&params);
+    if (ret)
+    {
+        ESP_LOGE(SCAN_TAG, "set scan params error, error code = %x", ret);
+    }
+}
+
+void ble_scan_init(const esp_bt_uuid_t * service_uuid, const char * name)
+{
+    have_service = (service_uuid != NULL);
+    if (have_service) service = *service_uuid;
+
+    target_name = name;
+    target_name_len = (name != NULL) ? strlen(name) : 0;
+}
+
+void ble_scan_start(bool repeat)
+{
+    // Already looking - just widen it if asked to keep going
+    if (scanning)
+    {
+        repeat_last = repeat_last || repeat;
+        return;
+    }
+
+    load_bonded();
+
+    scanning = true;
+    repeat_last = repeat;
+    stage = 0;
+    set_stage_params();
+}
+
+void ble_scan_stop()
+{
+    if (!scanning) return;
+
+    scanning = false;
+    esp_ble_gap_stop_scanning();
+}
+
+void ble_scan_on_params_set(esp_bt_status_t status)
+{
+    if (!scanning) return;
+
+    if (status != ESP_BT_STATUS_SUCCESS)
+    {
+        ESP_LOGE(SCAN_TAG, "scan params failed, status = %x", status);
+        return;
+    }
+
+    ESP_LOGI(SCAN_TAG, "Scan stage %u: %s, interval %u, window %u", stage,
+             (stages[stage].type == BLE_SCAN_TYPE_ACTIVE) ? "active" : "passive",
+             stages[stage].interval, stages[stage].window);
+    esp_ble_gap_start_scanning(stages[stage].duration_s);
+}
+
+void ble_scan_on_complete()
+{
+    if (!scanning) return;
+
+    if (stage < STAGE_COUNT - 1)
+    {
+        stage++;
+    }
+    else if (!repeat_last)
+    {
+        ESP_LOGI(SCAN_TAG, "No more controllers found");
+        scanning = false;
+        return;
+    }
+    set_stage_params();
+}
+
+// Walk the AD structures once, looking for our service UUID or name
+static bool adv_matches(const uint8_t * data, uint16_t len)
+{
+    uint16_t pos = 0;
+    while (pos + 1 < len)
+    {
+        uint8_t field_len = data[pos];
+        if (field_len == 0 || pos + 1 + field_len > len) break;
+
+        uint8_t type = data[pos + 1];
+        const uint8_t * field = &data[pos + 2];
+        uint8_t field_data_len = field_len - 1;
+
+        if (have_service && service.len == ESP_UUID_LEN_128 &&
+            (type == ESP_BLE_AD_TYPE_128SRV_CMPL || type == ESP_BLE_AD_TYPE_128SRV_PART))
+        {
+            for (int i = 0; i + ESP_UUID_LEN_128 <= field_data_len; i += ESP_UUID_LEN_128)
+            {
+                if (memcmp(&field[i], service.uuid.uuid128, ESP_UUID_LEN_128) == 0) return true;
+            }
+        }
+        else if (target_name != NULL && type == ESP_BLE_AD_TYPE_NAME_CMPL &&
+                 field_data_len == target_name_len && memcmp(field, target_name, target_name_len) == 0)
+        {
+            return true;
+        }
+
+        pos += 1 + field_len;
+    }
+
+    return false;
+}
+
+bool ble_scan_is_match(const struct ble_scan_result_evt_param * result)
+{
+    atomic_fetch_add(&seen_count, 1);
+
+    if (!scanning) return false;
+
+    // Only connectable advertising (or the scan response to it) can be the controller
+    if (result->ble_evt_type != ESP_BLE_EVT_CONN_ADV &&
+        result->ble_evt_type != ESP_BLE_EVT_CONN_DIR_ADV &&
+        result->ble_evt_type != ESP_BLE_EVT_SCAN_RSP)
+    {
+        return false;
+    }
+
+    atomic_fetch_add(&processed_count, 1);
+
+    bool match = false;
+    for (int i = 0; i < bonded_count && !match; i++)
+    {
+        match = (memcmp(bonded[i], result->bda, sizeof(esp_bd_addr_t)) == 0);
+    }
+    if (!match)
+    {
+        match = adv_matches(result->ble_adv, result->adv_data_len + result->scan_rsp_len);
+    }
+
+    if (match) atomic_fetch_add(&matched_count, 1);
+    return match;
+}
+
+void ble_scan_get_stats(ble_scan_stats_t * stats)
+{
+    stats->seen = atomic_load(&seen_count);
+    stats->processed = atomic_load(&processed_count);
+    stats->matched = atomic_load(&matched_count);
+    stats->stage = stage;
+}
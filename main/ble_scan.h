@@ -0,0 +1,45 @@
+#ifndef BLE_SCAN_H
+#define BLE_SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_gap_ble_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Looks for the controller while disconnected. Scanning starts fast and
+// passive, tries an active window for controllers that only give their name in
+// the scan response, then backs off to a slow passive duty cycle. Results are
+// filtered cheaply (event type, bonded address, service UUID in the raw
+// advertisement) so a busy parking lot doesn't load the BTC task.
+
+typedef struct ble_scan_stats_t
+{
+    uint32_t seen;          // Advertising reports received
+    uint32_t processed;     // Reports that got as far as parsing the payload
+    uint32_t matched;       // Reports that were our controller
+    uint8_t stage;          // Current backoff stage
+} ble_scan_stats_t;
+
+// service_uuid may be NULL to match on the advertised name alone
+void ble_scan_init(const esp_bt_uuid_t * service_uuid, const char * name);
+
+// With repeat set the last stage runs until stopped; otherwise (looking for
+// more controllers while already connected) scanning ends after it
+void ble_scan_start(bool repeat);
+void ble_scan_stop();
+
+// From esp_gap_cb
+void ble_scan_on_params_set(esp_bt_status_t status);
+void ble_scan_on_complete();
+bool ble_scan_is_match(const struct ble_scan_result_evt_param * result);
+
+void ble_scan_get_stats(ble_scan_stats_t * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
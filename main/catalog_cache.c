@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nvs.h"
+#include "esp_log.h"
+#include "catalog_cache.h"
+
+#define CATALOG_TAG         "CATALOG"
+#define CATALOG_NAMESPACE   "catalog"
+#define CATALOG_KEY_LEN     16
+#define CATALOG_LAST_KEY    "last"
+#define CATALOG_LRU_KEY     "lru"
+#define CATALOG_LIST_IDS    16      // list_key() keeps 4 bits of the list id
+#define NVS_PAGE_ENTRIES    126     // NVS keeps a page this size spare for garbage collection
+#define NVS_ENTRY_SIZE      32
+
+// Bump when the layout of the blobs changes
+#define CATALOG_VERSION     1
+
+// Stored in front of the list text
+typedef struct
+{
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t len;           // Of the text, including the NUL
+    uint32_t hash;
+} list_header_t;
+
+typedef struct
+{
+    uint8_t version;
+    esp_bd_addr_t bda;
+    uint32_t hash;
+} last_entry_t;
+
+typedef struct
+{
+    uint8_t version;
+    uint8_t count;
+    esp_bd_addr_t bda[CATALOG_MAX_CONTROLLERS];     // Most recently saved first
+} lru_entry_t;
+
+// One entry per list per controller: "l", the list id, then the address in hex
+static void list_key(const esp_bd_addr_t bda, uint8_t list_id, char * key)
+{
+    snprintf(key, CATALOG_KEY_LEN, "l%x%02x%02x%02x%02x%02x%02x", list_id & 0xF, bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+}
+
+esp_err_t catalog_cache_load(const esp_bd_addr_t bda, uint8_t list_id, uint32_t hash, char ** str, uint16_t * len)
+{
+    *str = NULL;
+    *len = 0;
+
+    char key[CATALOG_KEY_LEN];
+    list_key(bda, list_id, key);
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CATALOG_NAMESPACE, NVS_READONLY, &nvs);
+    if (err != ESP_OK) return err;
+
+    size_t blob_len = 0;
+    err = nvs_get_blob(nvs, key, NULL, &blob_len);
+    if (err != ESP_OK || blob_len <= sizeof(list_header_t))
+    {
+        nvs_close(nvs);
+        return (err == ESP_OK) ? ESP_ERR_INVALID_SIZE : err;
+    }
+
+    char * blob = malloc(blob_len);
+    if (blob == NULL)
+    {
+        nvs_close(nvs);
+        return ESP_ERR_NO_MEM;
+    }
+    err = nvs_get_blob(nvs, key, blob, &blob_len);
+    nvs_close(nvs);
+
+    if (err == ESP_OK)
+    {
+        list_header_t hdr;
+        memcpy(&hdr, blob, sizeof(hdr));
+
+        if (hdr.version != CATALOG_VERSION || hdr.len != blob_len - sizeof(hdr) || blob[blob_len - 1] != 0)
+        {
+            ESP_LOGW(CATALOG_TAG, "Ignoring bad cached list %s", key);
+            err = ESP_ERR_INVALID_SIZE;
+        }
+        else if (hdr.hash != hash)
+        {
+            err = ESP_ERR_INVALID_VERSION;
+        }
+        else
+        {
+            // Hand back the text in the same allocation
+            memmove(blob, blob + sizeof(hdr), hdr.len);
+            *str = blob;
+            *len = hdr.len;
+            return ESP_OK;
+        }
+    }
+
+    free(blob);
+    return err;
+}
+
+static void load_lru(nvs_handle_t nvs, lru_entry_t * lru)
+{
+    size_t len = sizeof(*lru);
+    if (nvs_get_blob(nvs, CATALOG_LRU_KEY, lru, &len) != ESP_OK || len != sizeof(*lru) ||
+        lru->version != CATALOG_VERSION || lru->count > CATALOG_MAX_CONTROLLERS)
+    {
+        memset(lru, 0, sizeof(*lru));
+        lru->version = CATALOG_VERSION;
+    }
+}
+
+static void erase_controller(nvs_handle_t nvs, const esp_bd_addr_t bda)
+{
+    char key[CATALOG_KEY_LEN];
+    for (uint8_t id = 0; id < CATALOG_LIST_IDS; id++)
+    {
+        list_key(bda, id, key);
+        nvs_erase_key(nvs, key);    // Most won't exist
+    }
+    ESP_LOGI(CATALOG_TAG, "Evicted lists of %02x:%02x:%02x:%02x:%02x:%02x", bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+}
+
+// Moves bda to the front, dropping the lists of whichever controller falls off the end
+static void lru_use(nvs_handle_t nvs, lru_entry_t * lru, const esp_bd_addr_t bda)
+{
+    uint8_t i = 0;
+    while (i < lru->count && memcmp(lru->bda[i], bda, sizeof(esp_bd_addr_t)) != 0) i++;
+
+    if (i == lru->count)
+    {
+        if (lru->count < CATALOG_MAX_CONTROLLERS)
+            lru->count++;
+        else
+            erase_controller(nvs, lru->bda[--i]);
+    }
+
+    memmove(lru->bda[1], lru->bda[0], i * sizeof(esp_bd_addr_t));
+    memcpy(lru->bda[0], bda, sizeof(esp_bd_addr_t));
+}
+
+// Entries NVS could still hand out, counting erased ones it can reclaim, less its spare page
+static size_t nvs_available_entries()
+{
+    nvs_stats_t stats;
+    if (nvs_get_stats(NULL, &stats) != ESP_OK) return 0;
+
+    size_t available = stats.total_entries - stats.used_entries;
+    return (available > NVS_PAGE_ENTRIES) ? available - NVS_PAGE_ENTRIES : 0;
+}
+
+esp_err_t catalog_cache_save(const esp_bd_addr_t bda, uint8_t list_id, uint32_t hash, const char * str, uint16_t len)
+{
+    if (str == NULL || len == 0 || str[len - 1] != 0) return ESP_ERR_INVALID_ARG;
+    if (len > CATALOG_MAX_LIST_LEN)
+    {
+        ESP_LOGI(CATALOG_TAG, "Not caching a %u byte list", len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    list_header_t hdr = {
+        .version = CATALOG_VERSION,
+        .len = len,
+        .hash = hash,
+    };
+
+    char * blob = malloc(sizeof(hdr) + len);
+    if (blob == NULL) return ESP_ERR_NO_MEM;
+    memcpy(blob, &hdr, sizeof(hdr));
+    memcpy(blob + sizeof(hdr), str, len);
+
+    char key[CATALOG_KEY_LEN];
+    list_key(bda, list_id, key);
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CATALOG_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK)
+    {
+        lru_entry_t lru;
+        load_lru(nvs, &lru);
+        lru_use(nvs, &lru, bda);
+
+        // A blob takes an index entry, a header entry per chunk and its data.
+        // Whatever this list replaces is counted as used until it's overwritten.
+        size_t needed = 2 + (sizeof(hdr) + len + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE;
+        while (nvs_available_entries() < needed + CATALOG_NVS_RESERVE_ENTRIES && lru.count > 1)
+        {
+            erase_controller(nvs, lru.bda[--lru.count]);
+        }
+
+        err = nvs_set_blob(nvs, CATALOG_LRU_KEY, &lru, sizeof(lru));
+        if (err == ESP_OK)
+        {
+            if (nvs_available_entries() >= needed + CATALOG_NVS_RESERVE_ENTRIES)
+                err = nvs_set_blob(nvs, key, blob, sizeof(hdr) + len);
+            else
+                err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        // Commit the evictions even if the list itself didn't fit
+        esp_err_t commit_err = nvs_commit(nvs);
+        if (err == ESP_OK) err = commit_err;
+        nvs_close(nvs);
+    }
+    free(blob);
+
+    if (err != ESP_OK) ESP_LOGE(CATALOG_TAG, "Saving list %s failed: %s", key, esp_err_to_name(err));
+    return err;
+}
+
+esp_err_t catalog_cache_get_last(esp_bd_addr_t bda, uint32_t * hash)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CATALOG_NAMESPACE, NVS_READONLY, &nvs);
+    if (err != ESP_OK) return err;
+
+    last_entry_t last;
+    size_t len = sizeof(last);
+    err = nvs_get_blob(nvs, CATALOG_LAST_KEY, &last, &len);
+    nvs_close(nvs);
+
+    if (err == ESP_OK && (len != sizeof(last) || last.version != CATALOG_VERSION)) err = ESP_ERR_INVALID_VERSION;
+    if (err != ESP_OK) return err;
+
+    memcpy(bda, last.bda, sizeof(esp_bd_addr_t));
+    *hash = last.hash;
+    return ESP_OK;
+}
+
+esp_err_t catalog_cache_set_last(const esp_bd_addr_t bda, uint32_t hash)
+{
+    esp_bd_addr_t old_bda;
+    uint32_t old_hash;
+    if (catalog_cache_get_last(old_bda, &old_hash) == ESP_OK &&
+        old_hash == hash && memcmp(old_bda, bda, sizeof(esp_bd_addr_t)) == 0)
+    {
+        return ESP_OK;
+    }
+
+    last_entry_t last;
+    memset(&last, 0, sizeof(last));
+    last.version = CATALOG_VERSION;
+    memcpy(last.bda, bda, sizeof(esp_bd_addr_t));
+    last.hash = hash;
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CATALOG_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) return err;
+
+    err = nvs_set_blob(nvs, CATALOG_LAST_KEY, &last, sizeof(last));
+    if (err == ESP_OK) err = nvs_commit(nvs);
+    nvs_close(nvs);
+
+    return err;
+}
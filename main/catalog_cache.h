@@ -0,0 +1,45 @@
+#ifndef CATALOG_CACHE_H
+#define CATALOG_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The controller's pattern/color lists, kept in NVS per controller address
+// along with the catalog hash they were fetched under. A connect then only
+// has to read the hash; the lists are fetched again when it changes.
+//
+// The last controller's address and hash are kept too, so its lists can be
+// shown at boot before anything is connected.
+//
+// This shares the default nvs partition with the Bluetooth bond keys and PHY
+// calibration, so it's kept on a budget: only the CATALOG_MAX_CONTROLLERS
+// controllers saved to most recently keep their lists, lists over
+// CATALOG_MAX_LIST_LEN aren't cached at all, and a save that would leave
+// fewer than CATALOG_NVS_RESERVE_ENTRIES free evicts older controllers first,
+// or is skipped.
+
+#define CATALOG_MAX_CONTROLLERS         2
+#define CATALOG_MAX_LIST_LEN            4096
+#define CATALOG_NVS_RESERVE_ENTRIES     128     // 32 byte entries, about a page
+
+// Hands back a malloc'd, NUL-terminated copy of the list (len includes the
+// NUL) if one was saved under this hash. ESP_ERR_INVALID_VERSION if the
+// saved copy is from a different hash.
+esp_err_t catalog_cache_load(const esp_bd_addr_t bda, uint8_t list_id, uint32_t hash, char ** str, uint16_t * len);
+esp_err_t catalog_cache_save(const esp_bd_addr_t bda, uint8_t list_id, uint32_t hash, const char * str, uint16_t len);
+
+esp_err_t catalog_cache_get_last(esp_bd_addr_t bda, uint32_t * hash);
+// Only writes to flash when something changed
+esp_err_t catalog_cache_set_last(const esp_bd_addr_t bda, uint32_t hash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,9 +1,12 @@
 #include <stdio.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_console.h"
 #include "argtable3/argtable3.h"
 #include "cmd_axp192.h"
 #include "m5core2_axp192.h"
+#include "power_telemetry.h"
+#include "fuel_gauge.h"
 
 static const char* TAG = "AXP192_CMD";
 
@@ -12,9 +15,32 @@ static struct
 {
     struct arg_int *bl_mv;
     struct arg_lit *poweroff;
+    struct arg_lit *history;
+    struct arg_int *rate_ms;
+    struct arg_lit *verify;
+    struct arg_lit *invalidate;
     struct arg_end *end;
 } axp192_args;
 
+#define ADC_CHANNEL(reg) { reg, #reg }
+
+static const struct
+{
+  uint8_t reg;
+  const char * name;
+} adc_channels[] = {
+  ADC_CHANNEL(AXP192_ACIN_VOLTAGE),
+  ADC_CHANNEL(AXP192_ACIN_CURRENT),
+  ADC_CHANNEL(AXP192_VBUS_VOLTAGE),
+  ADC_CHANNEL(AXP192_VBUS_CURRENT),
+  ADC_CHANNEL(AXP192_TEMP),
+  ADC_CHANNEL(AXP192_BATTERY_POWER),
+  ADC_CHANNEL(AXP192_BATTERY_VOLTAGE),
+  ADC_CHANNEL(AXP192_CHARGE_CURRENT),
+  ADC_CHANNEL(AXP192_DISCHARGE_CURRENT),
+  ADC_CHANNEL(AXP192_APS_VOLTAGE),
+};
+
 void print_rail_info(const char * name, axp192_rail_t rail)
 {
   bool enabled = false;
@@ -26,6 +52,23 @@ void print_rail_info(const char * name, axp192_rail_t rail)
   printf("Rail %s: %sabled, %umv\n", name, enabled ? "en" : "dis", mv);
 }
 
+static void print_telemetry_history()
+{
+  static power_sample_t samples[POWER_TELEMETRY_HISTORY];
+  uint32_t count = power_telemetry_history(samples, POWER_TELEMETRY_HISTORY);
+
+  printf("Telemetry every %u ms, %u samples, %u read errors\n", power_telemetry_get_period(), count, power_telemetry_error_count());
+  printf("    age_ms  bat_pwr  bat_v  chg_i   dis_i  acin_v  temp\n");
+
+  int64_t now = esp_timer_get_time();
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const power_sample_t * s = &samples[i];
+    printf("%10lld %8.2f %6.3f %6.3f %7.4f %7.2f %5.1f\n", (now - s->timestamp_us) / 1000,
+           s->battery_power, s->battery_voltage, s->charge_current, s->discharge_current, s->acin_voltage, s->temp);
+  }
+}
+
 static int axp192_cmd_func(int argc, char **argv)
 {
   int nerrors = arg_parse(argc, argv, (void **) &axp192_args);
@@ -45,6 +88,39 @@ static int axp192_cmd_func(int argc, char **argv)
     m5core2_set_rail_mv(LCD_BACKLIGHT, (uint16_t)axp192_args.bl_mv->ival[0]);
   }
 
+  if (axp192_args.rate_ms->count != 0)
+  {
+    if (axp192_args.rate_ms->ival[0] < POWER_TELEMETRY_MIN_PERIOD_MS)
+    {
+      ESP_LOGE(__func__, "Invalid rate. (minimum: %u ms)", POWER_TELEMETRY_MIN_PERIOD_MS);
+      return 1;
+    }
+    power_telemetry_set_period(axp192_args.rate_ms->ival[0]);
+  }
+
+  if (axp192_args.invalidate->count != 0)
+  {
+    m5core2_axp_shadow_invalidate();
+  }
+
+  if (axp192_args.verify->count != 0)
+  {
+    uint8_t checked, mismatches;
+    if (m5core2_axp_shadow_verify(&checked, &mismatches) != ESP_OK)
+    {
+      printf("Register read failed after %u registers\n", checked);
+      return 1;
+    }
+    printf("Register shadow: %u checked, %u mismatched\n", checked, mismatches);
+    return (mismatches == 0) ? 0 : 1;
+  }
+
+  if (axp192_args.history->count != 0)
+  {
+    print_telemetry_history();
+    return 0;
+  }
+
   if(axp192_args.poweroff->count != 0)
   {
     //void m5core2_power::power_off(void) { Write1Byte(0x32, Read8bit(0x32) | 0b10000000); }
@@ -57,34 +133,27 @@ static int axp192_cmd_func(int argc, char **argv)
   print_rail_info("LOGIC_AND_SD", LOGIC_AND_SD);
   print_rail_info("VIBRATOR", VIBRATOR);
 
-  float temp;
-  m5core2_axp_read(AXP192_ACIN_VOLTAGE, &temp);
-  printf("AXP192_ACIN_VOLTAGE: %f\n", temp);
-  m5core2_axp_read(AXP192_ACIN_CURRENT, &temp);
-  printf("AXP192_ACIN_CURRENT: %f\n", temp);
-
-  m5core2_axp_read(AXP192_VBUS_VOLTAGE, &temp);
-  printf("AXP192_VBUS_VOLTAGE: %f\n", temp);
-  m5core2_axp_read(AXP192_VBUS_CURRENT, &temp);
-  printf("AXP192_VBUS_CURRENT: %f\n", temp);
-
-  m5core2_axp_read(AXP192_TEMP, &temp);
-  printf("AXP192_TEMP: %f\n", temp);
-
-  m5core2_axp_read(AXP192_BATTERY_POWER, &temp);
-  printf("AXP192_BATTERY_POWER: %f\n", temp);
-
-  m5core2_axp_read(AXP192_BATTERY_VOLTAGE, &temp);
-  printf("AXP192_BATTERY_VOLTAGE: %f\n", temp);
-
-  m5core2_axp_read(AXP192_CHARGE_CURRENT, &temp);
-  printf("AXP192_CHARGE_CURRENT: %f\n", temp);
+  fuel_gauge_status_t fuel;
+  fuel_gauge_get(&fuel);
+  if (fuel.valid)
+  {
+    printf("Fuel gauge: %u.%u%%, %d min to empty, capacity %u uAh (%u learned cycles)\n",
+           fuel.soc_permille / 10, fuel.soc_permille % 10, fuel.time_to_empty_min, fuel.capacity_uah, fuel.learned_cycles);
+  }
 
-  m5core2_axp_read(AXP192_DISCHARGE_CURRENT, &temp);
-  printf("AXP192_DISCHARGE_CURRENT: %f\n", temp);
+  axp192_adc_block_t adc;
+  if (m5core2_axp_read_adc(&adc) != ESP_OK)
+  {
+    printf("ADC read failed\n");
+    return 1;
+  }
 
-  m5core2_axp_read(AXP192_APS_VOLTAGE, &temp);
-  printf("AXP192_APS_VOLTAGE: %f\n", temp);
+  for (size_t i = 0; i < sizeof(adc_channels) / sizeof(adc_channels[0]); i++)
+  {
+    float temp;
+    axp192_adc_value(&adc, adc_channels[i].reg, &temp);
+    printf("%s: %f\n", adc_channels[i].name, temp);
+  }
 
   return 0;
 }
@@ -94,7 +163,11 @@ void register_axp192_cmds(void)
    // AXP192 command
   axp192_args.bl_mv = arg_int0("b", "backlight", "<mv>", "Backlight millivoltage (0-2800)" );
   axp192_args.poweroff = arg_lit0(NULL, "poweroff", "Power-off the device");
-  axp192_args.end = arg_end(2);
+  axp192_args.history = arg_lit0("H", "history", "Print the telemetry history");
+  axp192_args.rate_ms = arg_int0("r", "rate", "<ms>", "Telemetry sample period");
+  axp192_args.verify = arg_lit0("V", "verify", "Check the register shadow against the chip");
+  axp192_args.invalidate = arg_lit0(NULL, "invalidate", "Drop the register shadow");
+  axp192_args.end = arg_end(6);
 
   const esp_console_cmd_t axp192_cmd = {
     .command = "axp192",
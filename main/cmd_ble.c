@@ -1,10 +1,15 @@
 #include <stdio.h>
+#include <string.h>
 #include "esp_log.h"
 #include "esp_console.h"
 #include "argtable3/argtable3.h"
 #include "cmd_ble.h"
 #include "esp_gap_ble_api.h"
 #include "esp_bt.h"
+#include "write_pipeline.h"
+#include "ble_metrics.h"
+#include "ble_scan.h"
+#include "example_ble_sec_gattc_demo.h"
 
 static const char* TAG = "BLE_CMD";
 
@@ -50,10 +55,76 @@ void clear_bonded_devices()
   free(device_list);
 }
 
+static const char * hist_names[BLE_HIST_COUNT] = { "Write queue", "Read", "Reconnect" };
+
+static void print_link_metrics(int link)
+{
+  ble_metrics_t m;
+  ble_metrics_get(link, &m);
+  if (m.connects == 0) return;
+
+  printf("Link %d metrics:\n", link);
+  printf("  Connects: %u, disconnects: %u (last reason 0x%02x)\n", m.connects, m.disconnects, m.last_disconnect_reason);
+  printf("  Conn params: interval %u.%02u ms, latency %u, timeout %u ms\n",
+         m.conn_interval * 125 / 100, m.conn_interval * 125 % 100, m.conn_latency, m.conn_timeout * 10);
+  printf("  Writes failed: %u, reads failed: %u\n", m.write_errors, m.read_errors);
+
+  for (int h = 0; h < BLE_HIST_COUNT; h++)
+  {
+    const ble_hist_t * hist = &m.hist[h];
+    printf("  %s latency: n=%u p50<=%u ms p90<=%u ms max=%u ms\n", hist_names[h], hist->count,
+           ble_metrics_percentile_us(hist, 50) / 1000, ble_metrics_percentile_us(hist, 90) / 1000, hist->max_us / 1000);
+    if (hist->count == 0) continue;
+
+    printf("\t");
+    for (int b = 0; b < BLE_METRICS_HIST_BUCKETS; b++)
+    {
+      if (b < BLE_METRICS_HIST_BUCKETS - 1)
+        printf("<=%ums:%u ", ble_metrics_bucket_us[b] / 1000, hist->buckets[b]);
+      else
+        printf(">%ums:%u", ble_metrics_bucket_us[b - 1] / 1000, hist->buckets[b]);
+    }
+    printf("\n");
+  }
+
+  printf("  RSSI (%u samples, oldest first):", m.rssi_count);
+  for (int i = 0; i < m.rssi_count; i++)
+    printf(" %d", m.rssi[i]);
+  printf("\n");
+}
+
+void print_ble_stats()
+{
+  static const char * link_states[] = { "free", "opening", "discovering", "live" };
+  ble_link_info_t links[BLE_MAX_LINKS];
+  GetLinkInfo(links);
+  for (int i = 0; i < BLE_MAX_LINKS; i++)
+  {
+    if (links[i].state == BLE_LINK_FREE) continue;
+    printf("Link %d: %02X:%02X:%02X:%02X:%02X:%02X %s%s\n", i,
+           links[i].bda[0], links[i].bda[1], links[i].bda[2], links[i].bda[3], links[i].bda[4], links[i].bda[5],
+           link_states[links[i].state], links[i].primary ? " (primary)" : "");
+  }
+
+  write_pipeline_stats_t stats;
+  write_pipeline_get_stats(&stats);
+  printf("Writes: %u sent, %u merged, %u dropped, %u deferred (congested)\n", stats.sent, stats.merged, stats.dropped, stats.congested);
+
+  ble_scan_stats_t scan;
+  ble_scan_get_stats(&scan);
+  printf("Scan: %u adverts seen, %u processed, %u matched (stage %u)\n", scan.seen, scan.processed, scan.matched, scan.stage);
+
+  // Slots that have been used keep their numbers after the link drops
+  for (int i = 0; i < BLE_MAX_LINKS; i++)
+    print_link_metrics(i);
+}
+
 /** Arguments used by 'ble' command */
 static struct
 {
+    struct arg_str *subcommand;
     struct arg_lit *clear_bonds;
+    struct arg_lit *reset_stats;
     struct arg_end *end;
 } ble_args;
 
@@ -66,6 +137,23 @@ static int ble_cmd_func(int argc, char **argv)
       return 1;
   }
 
+  if (ble_args.subcommand->count > 0)
+  {
+    if (strcmp(ble_args.subcommand->sval[0], "stats") != 0)
+    {
+      printf("Unknown subcommand '%s'\n", ble_args.subcommand->sval[0]);
+      return 1;
+    }
+
+    print_ble_stats();
+    if (ble_args.reset_stats->count > 0)
+    {
+      ble_metrics_reset();
+      printf("Stats reset\n");
+    }
+    return 0;
+  }
+
   if (ble_args.clear_bonds-> count > 0)
   {
     clear_bonded_devices();
@@ -75,13 +163,23 @@ static int ble_cmd_func(int argc, char **argv)
   ESP_ERROR_CHECK_WITHOUT_ABORT( esp_read_mac( mac, ESP_MAC_BT ) );
   printf("BLE MAC: " MACSTR "\r\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
   print_bonded_devices();
+
+  write_pipeline_stats_t stats;
+  write_pipeline_get_stats(&stats);
+  printf("Writes: %u sent, %u merged, %u dropped, %u deferred (congested)\n", stats.sent, stats.merged, stats.dropped, stats.congested);
+
+  bool used_cache = false;
+  uint32_t connect_ms = GetLastConnectTimeMs(&used_cache);
+  printf("Last connect: controls live after %u ms (%s)\n", connect_ms, used_cache ? "cached handles" : "full discovery");
   return 0;
 }
 
 void register_ble_cmds(void)
 {
    // BLE command
+  ble_args.subcommand = arg_str0(NULL, NULL, "stats", "Show link quality and latency stats");
   ble_args.clear_bonds = arg_lit0("c", "clear", "Clear BLE bonds");
+  ble_args.reset_stats = arg_lit0("r", "reset", "Reset the stats after showing them");
   ble_args.end = arg_end(2);
 
   const esp_console_cmd_t ble_cmd = {
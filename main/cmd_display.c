@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "cmd_display.h"
+#include "display_buffer.h"
+
+#define BENCH_TIMEOUT_MS  30000
+
+/** Arguments used by 'display' command */
+static struct
+{
+  struct arg_str *strategy;
+  struct arg_int *rows;
+  struct arg_lit *bench;
+  struct arg_lit *flush_bench;
+  struct arg_end *end;
+} display_args;
+
+static void print_bench()
+{
+  uint32_t waited = 0;
+  while (display_buffer_bench_running() && waited < BENCH_TIMEOUT_MS)
+  {
+    vTaskDelay(pdMS_TO_TICKS(100));
+    waited += 100;
+  }
+
+  if (display_buffer_bench_running())
+  {
+    printf("Bench still running, try 'display --bench' again later\n");
+    return;
+  }
+
+  display_buf_bench_t results[DISPLAY_BUF_BENCH_MAX];
+  uint32_t count = display_buffer_bench_results(results, DISPLAY_BUF_BENCH_MAX);
+
+  printf("Full-screen redraw over %u frames:\n", DISPLAY_BUF_BENCH_FRAMES);
+  for (uint32_t i = 0; i < count; i++)
+  {
+    if (!results[i].ok)
+    {
+      printf("  %-6s %3u rows: couldn't allocate\n", display_buffer_strategy_name(results[i].cfg.strategy), results[i].cfg.rows);
+      continue;
+    }
+
+    printf("  %-6s %3u rows: %6u bytes internal, %6u PSRAM, min %u us, avg %u us, max %u us (%.1f fps)\n",
+           display_buffer_strategy_name(results[i].cfg.strategy), results[i].cfg.rows,
+           results[i].ram_bytes, results[i].psram_bytes,
+           results[i].frame_us_min, results[i].frame_us_avg, results[i].frame_us_max,
+           (results[i].frame_us_avg > 0) ? 1000000.0f / results[i].frame_us_avg : 0.0f);
+  }
+}
+
+static void print_flush_bench()
+{
+  uint32_t waited = 0;
+  while (display_buffer_flush_bench_running() && waited < BENCH_TIMEOUT_MS)
+  {
+    vTaskDelay(pdMS_TO_TICKS(100));
+    waited += 100;
+  }
+
+  display_flush_bench_t results[2];
+  uint32_t count = display_buffer_flush_bench_results(results, 2);
+  if (count == 0)
+  {
+    printf("Bench still running, try 'display --flush-bench' again later\n");
+    return;
+  }
+
+  printf("%ux%u redraws over %u flushes:\n", DISPLAY_FLUSH_BENCH_W, DISPLAY_FLUSH_BENCH_H, DISPLAY_FLUSH_BENCH_FLUSHES);
+  for (uint32_t i = 0; i < count; i++)
+  {
+    printf("  %-7s %5u flushes/s, avg %u us in flush\n", results[i].batched ? "batched" : "polled",
+           results[i].flushes_per_s, results[i].call_us_avg);
+  }
+}
+
+static int display_cmd_func(int argc, char **argv)
+{
+  int nerrors = arg_parse(argc, argv, (void **) &display_args);
+  if (nerrors != 0)
+  {
+    arg_print_errors(stderr, display_args.end, argv[0]);
+    return 1;
+  }
+
+  if (display_args.bench->count > 0)
+  {
+    display_buffer_bench_start();
+    print_bench();
+    return 0;
+  }
+
+  if (display_args.flush_bench->count > 0)
+  {
+    display_buffer_flush_bench_start();
+    print_flush_bench();
+    return 0;
+  }
+
+  if (display_args.strategy->count > 0 || display_args.rows->count > 0)
+  {
+    display_buf_stats_t stats;
+    display_buffer_get_stats(&stats);
+
+    display_buf_cfg_t cfg = stats.cfg;
+    if (display_args.strategy->count > 0)
+    {
+      for (cfg.strategy = 0; cfg.strategy < DISPLAY_BUF_STRATEGY_COUNT; cfg.strategy++)
+      {
+        if (strcmp(display_args.strategy->sval[0], display_buffer_strategy_name(cfg.strategy)) == 0) break;
+      }
+      if (cfg.strategy >= DISPLAY_BUF_STRATEGY_COUNT)
+      {
+        printf("Unknown strategy\n");
+        return 1;
+      }
+      cfg.rows = 0;
+    }
+    if (display_args.rows->count > 0)
+    {
+      int rows = display_args.rows->ival[0];
+      if (rows < DISPLAY_BUF_MIN_ROWS || rows > LV_VER_RES_MAX)
+      {
+        printf("Rows must be %u-%u\n", DISPLAY_BUF_MIN_ROWS, LV_VER_RES_MAX);
+        return 1;
+      }
+      cfg.rows = rows;
+    }
+
+    display_buffer_request(&cfg);
+    vTaskDelay(pdMS_TO_TICKS(100));   // Give the GUI thread a moment to switch
+  }
+
+  display_buf_stats_t stats;
+  display_buffer_get_stats(&stats);
+
+  printf("Buffers: %s, %u rows, %u bytes internal, %u PSRAM\n", display_buffer_strategy_name(stats.cfg.strategy),
+         stats.cfg.rows, stats.ram_bytes, stats.psram_bytes);
+  printf("Refreshes: %u, last %u ms, avg %u ms, max %u ms, avg %u px\n",
+         stats.frames, stats.frame_ms_last, stats.frame_ms_avg, stats.frame_ms_max, stats.px_avg);
+
+  return 0;
+}
+
+void register_display_cmds(void)
+{
+  display_args.strategy = arg_str0("s", "strategy", "<auto|single|double|psram>", "Draw buffer layout");
+  display_args.rows = arg_int0("r", "rows", "<rows>", "Buffer height (bounce buffer height for psram)");
+  display_args.bench = arg_lit0("b", "bench", "Time full-screen redraws with each layout");
+  display_args.flush_bench = arg_lit0("f", "flush-bench", "Time small redraws with the window sent per command and batched");
+  display_args.end = arg_end(4);
+
+  const esp_console_cmd_t display_cmd = {
+    .command = "display",
+    .help = "Display buffer layout and frame times",
+    .hint = NULL,
+    .func = &display_cmd_func,
+    .argtable = &display_args
+  };
+  ESP_ERROR_CHECK( esp_console_cmd_register(&display_cmd) );
+}
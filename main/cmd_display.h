@@ -0,0 +1,11 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void register_display_cmds(void);
+
+#ifdef __cplusplus
+}
+#endif
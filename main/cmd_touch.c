@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "cmd_touch.h"
+#include "touch_input.h"
+
+/** Arguments used by 'touch' command */
+static struct
+{
+  struct arg_lit *reset;
+  struct arg_str *filter;
+  struct arg_int *predict_ms;
+  struct arg_lit *trace;
+  struct arg_end *end;
+} touch_args;
+
+static int touch_cmd_func(int argc, char **argv)
+{
+  int nerrors = arg_parse(argc, argv, (void **) &touch_args);
+  if (nerrors != 0)
+  {
+    arg_print_errors(stderr, touch_args.end, argv[0]);
+    return 1;
+  }
+
+  if (touch_args.filter->count > 0 || touch_args.predict_ms->count > 0)
+  {
+    // Keep whichever half wasn't given
+    touch_filter_preset_t preset;
+    uint16_t current_lead;
+    touch_input_get_filter(&preset, &current_lead);
+    int lead_ms = current_lead;
+
+    if (touch_args.filter->count > 0)
+    {
+      for (preset = 0; preset < TOUCH_FILTER_PRESET_COUNT; preset++)
+      {
+        if (strcmp(touch_args.filter->sval[0], touch_input_preset_name(preset)) == 0) break;
+      }
+    }
+    if (touch_args.predict_ms->count > 0) lead_ms = touch_args.predict_ms->ival[0];
+
+    if (lead_ms < 0 || lead_ms > UINT16_MAX || !touch_input_set_filter(preset, lead_ms))
+    {
+      printf("Invalid filter settings\n");
+      return 1;
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));   // Give the GUI thread a moment to switch
+  }
+
+  if (touch_args.trace->count > 0)
+  {
+    static touch_filter_sample_t samples[TOUCH_TRACE_LEN];
+    uint32_t count = touch_input_get_trace(samples, TOUCH_TRACE_LEN);
+
+    printf("t_ms,x,y,pressed\n");
+    for (uint32_t i = 0; i < count; i++)
+    {
+      printf("%u,%d,%d,%d\n", samples[i].t_ms, samples[i].x, samples[i].y, samples[i].pressed);
+    }
+    return 0;
+  }
+
+  touch_input_stats_t stats;
+  touch_input_get_stats(&stats);
+
+  printf("Reads: %s\n", touch_input_gated() ? "on INT pulses" : "polled (no trigger mode)");
+  printf("Interrupts: %u\n", stats.interrupts);
+  printf("I2C reads: %u, skipped: %u\n", stats.i2c_reads, stats.skipped_reads);
+  printf("Two-finger reads: %u, chip gestures: %u\n", stats.multi_touch_frames, stats.hw_gestures);
+  if (stats.presses > 0)
+  {
+    printf("Press latency over %u presses: min %u us, avg %u us, max %u us, last %u us\n",
+           stats.presses, stats.latency_min_us, stats.latency_avg_us, stats.latency_max_us, stats.latency_last_us);
+  }
+  else
+  {
+    printf("No presses timed yet\n");
+  }
+
+  touch_filter_stage_stats_t stage_stats[TOUCH_FILTER_MAX_STAGES];
+  size_t stages = touch_filter_get_stats(stage_stats, TOUCH_FILTER_MAX_STAGES);
+  printf("Filter stages: %u\n", (unsigned) stages);
+  for (size_t i = 0; i < stages; i++)
+  {
+    printf("  %s: last %u cycles, max %u, budget %u, %u overruns%s\n",
+           touch_filter_kind_name(stage_stats[i].kind), stage_stats[i].last_cycles, stage_stats[i].max_cycles,
+           stage_stats[i].budget_cycles, stage_stats[i].overruns, stage_stats[i].bypassed ? " (bypassed)" : "");
+  }
+
+  if (touch_args.reset->count > 0)
+  {
+    touch_input_reset_stats();
+    printf("Stats reset\n");
+  }
+
+  return 0;
+}
+
+void register_touch_cmds(void)
+{
+  touch_args.reset = arg_lit0(NULL, "reset", "Reset the counters after printing them");
+  touch_args.filter = arg_str0("f", "filter", "<off|median|euro|median+euro>", "Touch filter chain");
+  touch_args.predict_ms = arg_int0("p", "predict", "<ms>", "Predict this far ahead, 0 for off (max 100)");
+  touch_args.trace = arg_lit0("t", "trace", "Dump the recent raw touch reports as CSV");
+  touch_args.end = arg_end(4);
+
+  const esp_console_cmd_t touch_cmd = {
+    .command = "touch",
+    .help = "Touch interrupt and latency stats",
+    .hint = NULL,
+    .func = &touch_cmd_func,
+    .argtable = &touch_args
+  };
+  ESP_ERROR_CHECK( esp_console_cmd_register(&touch_cmd) );
+}
@@ -0,0 +1,206 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_gap_ble_api.h"
+#include "conn_profile.h"
+
+#define PROFILE_TAG "CONN_PROFILE"
+
+typedef struct
+{
+    const char * name;
+    uint16_t min_int;       // 1.25ms units
+    uint16_t max_int;
+    uint16_t latency;       // Connection events the controller may skip
+    uint16_t timeout;       // 10ms units
+} conn_params_t;
+
+static const conn_params_t profiles[CONN_PROFILE_COUNT] = {
+    [CONN_PROFILE_ACTIVE] = { .name = "active", .min_int = 6,  .max_int = 12,  .latency = 0, .timeout = 400 },   // 7.5-15ms
+    [CONN_PROFILE_IDLE]   = { .name = "idle",   .min_int = 80, .max_int = 160, .latency = 4, .timeout = 600 },   // 100-200ms
+};
+
+static esp_timer_handle_t eval_timer = NULL;
+
+// Written from the BTC task, read by eval_timer; peer_used is set only once
+// the address is in place
+static esp_bd_addr_t peers[CONN_PROFILE_MAX_PEERS];
+static atomic_bool peer_used[CONN_PROFILE_MAX_PEERS];
+
+static atomic_bool connected = false;
+static atomic_bool dimmed = false;
+static atomic_uint last_activity_ms = 0;
+static atomic_int requested = CONN_PROFILE_NONE;
+static atomic_int applied = CONN_PROFILE_NONE;
+static atomic_uint last_request_ms = 0; // eval_timer, and the BTC task on connect
+
+// Current draw while each profile was in effect; telemetry task only
+static float current_sum_ma[CONN_PROFILE_COUNT];
+static uint32_t current_samples[CONN_PROFILE_COUNT];
+static int sampled_profile = CONN_PROFILE_NONE;
+
+static uint32_t now_ms()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void arm(uint32_t ms)
+{
+    esp_timer_stop(eval_timer);
+    esp_timer_start_once(eval_timer, (uint64_t)ms * 1000);
+}
+
+static bool request_profile(conn_profile_id_t id)
+{
+    const conn_params_t * p = &profiles[id];
+
+    atomic_store(&last_request_ms, now_ms());
+
+    bool ok = true;
+    for (int i = 0; i < CONN_PROFILE_MAX_PEERS; i++)
+    {
+        if (!atomic_load(&peer_used[i])) continue;
+
+        esp_ble_conn_update_params_t params = {
+            .min_int = p->min_int,
+            .max_int = p->max_int,
+            .latency = p->latency,
+            .timeout = p->timeout,
+        };
+        memcpy(params.bda, peers[i], sizeof(esp_bd_addr_t));
+
+        esp_err_t ret = esp_ble_gap_update_conn_params(&params);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGW(PROFILE_TAG, "update to %s failed: %s", p->name, esp_err_to_name(ret));
+            ok = false;
+        }
+    }
+    if (!ok) return false;
+
+    ESP_LOGI(PROFILE_TAG, "Requesting %s profile", p->name);
+    atomic_store(&requested, id);
+    return true;
+}
+
+static void evaluate(void *arg)
+{
+    (void) arg;
+
+    if (!atomic_load(&connected)) return;
+
+    uint32_t now = now_ms();
+    uint32_t idle_for = now - atomic_load(&last_activity_ms);
+    conn_profile_id_t want = (!atomic_load(&dimmed) && idle_for < CONN_PROFILE_IDLE_AFTER_MS) ? CONN_PROFILE_ACTIVE : CONN_PROFILE_IDLE;
+
+    if ((int)want != atomic_load(&requested))
+    {
+        uint32_t since_request = now - atomic_load(&last_request_ms);
+        if (since_request < CONN_PROFILE_MIN_SPACING_MS)
+        {
+            arm(CONN_PROFILE_MIN_SPACING_MS - since_request);
+            return;
+        }
+        if (!request_profile(want))
+        {
+            arm(CONN_PROFILE_MIN_SPACING_MS);
+            return;
+        }
+    }
+
+    // Come back when the quiet period would run out
+    if (want == CONN_PROFILE_ACTIVE) arm(CONN_PROFILE_IDLE_AFTER_MS - idle_for);
+}
+
+void conn_profile_init()
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = &evaluate,
+        .name = "conn_profile"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &eval_timer));
+}
+
+void conn_profile_connected(const esp_bd_addr_t bda)
+{
+    for (int i = 0; i < CONN_PROFILE_MAX_PEERS; i++)
+    {
+        if (atomic_load(&peer_used[i])) continue;
+
+        memcpy(peers[i], bda, sizeof(esp_bd_addr_t));
+        atomic_store(&peer_used[i], true);
+        break;
+    }
+
+    // Brings the new controller (and any others) onto the same profile
+    atomic_store(&requested, CONN_PROFILE_NONE);
+    atomic_store(&applied, CONN_PROFILE_NONE);
+    atomic_store(&connected, true);
+
+    // Discovery and the list fetches go faster on the active profile, and
+    // someone just woke the remote up anyway
+    atomic_store(&last_request_ms, now_ms() - CONN_PROFILE_MIN_SPACING_MS);
+    atomic_store(&last_activity_ms, now_ms());
+    if (eval_timer != NULL) arm(0);
+}
+
+void conn_profile_disconnected(const esp_bd_addr_t bda)
+{
+    bool any = false;
+    for (int i = 0; i < CONN_PROFILE_MAX_PEERS; i++)
+    {
+        if (atomic_load(&peer_used[i]) && memcmp(peers[i], bda, sizeof(esp_bd_addr_t)) == 0)
+            atomic_store(&peer_used[i], false);
+        any |= atomic_load(&peer_used[i]);
+    }
+    if (any) return;
+
+    atomic_store(&connected, false);
+    atomic_store(&applied, CONN_PROFILE_NONE);
+    if (eval_timer != NULL) esp_timer_stop(eval_timer);
+}
+
+void conn_profile_params_updated(uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    // The controller may settle on something other than what was asked for,
+    // so go by what it reports
+    conn_profile_id_t id = (interval <= profiles[CONN_PROFILE_ACTIVE].max_int) ? CONN_PROFILE_ACTIVE : CONN_PROFILE_IDLE;
+    atomic_store(&applied, id);
+
+    ESP_LOGI(PROFILE_TAG, "Now %s: interval %u, latency %u, timeout %u", profiles[id].name, interval, latency, timeout);
+}
+
+void conn_profile_ui_activity()
+{
+    atomic_store(&last_activity_ms, now_ms());
+    atomic_store(&dimmed, false);
+
+    // Already active: evaluate() pushes the idle deadline out on its own
+    if (atomic_load(&requested) != CONN_PROFILE_ACTIVE && atomic_load(&connected) && eval_timer != NULL) arm(0);
+}
+
+void conn_profile_set_dimmed(bool dim)
+{
+    atomic_store(&dimmed, dim);
+    if (atomic_load(&connected) && eval_timer != NULL) arm(0);
+}
+
+void conn_profile_sample_current(float ma)
+{
+    int id = atomic_load(&applied);
+    if (id != sampled_profile)
+    {
+        // Profile changed since the last sample - report what each one has cost so far
+        for (int i = 0; i < CONN_PROFILE_COUNT; i++)
+        {
+            if (current_samples[i] == 0) continue;
+            ESP_LOGI(PROFILE_TAG, "%s profile: %.1f mA average over %u samples", profiles[i].name, current_sum_ma[i] / current_samples[i], current_samples[i]);
+        }
+        sampled_profile = id;
+    }
+    if (id == CONN_PROFILE_NONE) return;
+
+    current_sum_ma[id] += ma;
+    current_samples[id]++;
+}
@@ -0,0 +1,48 @@
+#ifndef CONN_PROFILE_H
+#define CONN_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Connection parameters follow what the user is doing: a short interval with
+// no slave latency while they're touching the screen, and a long interval with
+// slave latency once the remote has been left alone. Switching to idle waits
+// for a quiet period, and requests are rate limited, so a burst of touches
+// doesn't turn into a burst of renegotiations.
+typedef enum
+{
+    CONN_PROFILE_ACTIVE,
+    CONN_PROFILE_IDLE,
+
+    CONN_PROFILE_COUNT,
+    CONN_PROFILE_NONE = CONN_PROFILE_COUNT,
+} conn_profile_id_t;
+
+#define CONN_PROFILE_IDLE_AFTER_MS      5000    // No touches for this long -> idle
+#define CONN_PROFILE_MIN_SPACING_MS     2000    // Minimum time between update requests
+#define CONN_PROFILE_MAX_PEERS          4       // Every connected controller follows the same profile
+
+void conn_profile_init();
+
+// From the BLE callbacks
+void conn_profile_connected(const esp_bd_addr_t bda);
+void conn_profile_disconnected(const esp_bd_addr_t bda);
+void conn_profile_params_updated(uint16_t interval, uint16_t latency, uint16_t timeout);
+
+// From the GUI
+void conn_profile_ui_activity();
+void conn_profile_set_dimmed(bool dimmed);
+
+// From the telemetry task, with each power sample; not reentrant
+void conn_profile_sample_current(float ma);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
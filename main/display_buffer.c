@@ -0,0 +1,420 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "disp_spi.h"
+#include "ili9341.h"
+#include "display_buffer.h"
+
+#define DISPLAY_TAG         "DISPLAY"
+#define AUTO_MAX_ROWS       80      // Three flushes per full redraw; more buys little for the RAM
+#define ROW_PX              LV_HOR_RES_MAX
+#define ROW_BYTES           (ROW_PX * sizeof(lv_color_t))
+#define FRAME_PX            (LV_HOR_RES_MAX * LV_VER_RES_MAX)
+
+typedef void (*FlushCb)(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * color_map);
+
+static const display_buf_cfg_t bench_cfgs[] = {
+    { DISPLAY_BUF_SINGLE, 40 },
+    { DISPLAY_BUF_DOUBLE, 20 },
+    { DISPLAY_BUF_DOUBLE, 40 },
+    { DISPLAY_BUF_DOUBLE, 80 },
+    { DISPLAY_BUF_DOUBLE, 120 },
+    { DISPLAY_BUF_PSRAM, 20 },
+    { DISPLAY_BUF_PSRAM, 40 },
+};
+#define BENCH_CFGS (sizeof(bench_cfgs) / sizeof(bench_cfgs[0]))
+
+static const char * strategy_names[DISPLAY_BUF_STRATEGY_COUNT] = { "auto", "single", "double", "psram" };
+
+// Owned by the GUI thread
+static lv_disp_buf_t disp_buf;
+static lv_color_t * bufs[2];
+static lv_color_t * bounce[2];
+static FlushCb base_flush = NULL;
+static display_buf_cfg_t requested;         // As asked for, so a bench can put it back
+static TaskHandle_t notify = NULL;
+static uint32_t bench_next;
+static FlushCb timed_flush;
+static uint64_t flush_call_us;
+
+// Shared with the other tasks
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static display_buf_stats_t stats;
+static uint64_t frame_ms_total;
+static uint64_t px_total;
+static bool request_pending = false;
+static display_buf_cfg_t pending;
+static volatile bool bench_running = false;
+static display_buf_bench_t bench[DISPLAY_BUF_BENCH_MAX];
+static uint32_t bench_count;
+static volatile bool flush_bench_running = false;
+static display_flush_bench_t flush_bench[2];
+
+// SPI DMA can't read PSRAM, so copy each part of the area into a bounce buffer.
+// The flush itself only queues, so each part waits for the one before it to
+// go out; with two buffers the copy of one part overlaps the transfer of the
+// last. The buffers alternate across calls too, so a new area never copies
+// over the part still being sent.
+static void flush_bounced(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * color_map)
+{
+    static int which = 0;
+    lv_coord_t w = lv_area_get_width(area);
+    lv_coord_t rows_per_part = LV_MATH_MAX(1, (stats.cfg.rows * ROW_PX) / w);
+    lv_area_t part = *area;
+
+    // Every part signals flush ready, so LVGL may think it's done early. That's
+    // fine: once copied, the frame buffer isn't needed any more.
+    for (lv_coord_t y = area->y1; y <= area->y2; y += rows_per_part)
+    {
+        part.y1 = y;
+        part.y2 = LV_MATH_MIN(y + rows_per_part - 1, area->y2);
+
+        memcpy(bounce[which], color_map + (y - area->y1) * w, w * lv_area_get_height(&part) * sizeof(lv_color_t));
+        disp_wait_for_pending_transactions();
+        base_flush(drv, &part, bounce[which]);
+        which ^= 1;
+    }
+}
+
+static void monitor(lv_disp_drv_t * drv, uint32_t time_ms, uint32_t px)
+{
+    (void) drv;
+
+    portENTER_CRITICAL(&lock);
+    stats.frames++;
+    stats.frame_ms_last = time_ms;
+    if (time_ms > stats.frame_ms_max) stats.frame_ms_max = time_ms;
+    frame_ms_total += time_ms;
+    px_total += px;
+    stats.frame_ms_avg = frame_ms_total / stats.frames;
+    stats.px_avg = px_total / stats.frames;
+    portEXIT_CRITICAL(&lock);
+}
+
+static void release()
+{
+    for (int i = 0; i < 2; i++)
+    {
+        heap_caps_free(bufs[i]);
+        heap_caps_free(bounce[i]);
+        bufs[i] = NULL;
+        bounce[i] = NULL;
+    }
+}
+
+static uint16_t clamp_rows(uint32_t rows)
+{
+    if (rows < DISPLAY_BUF_MIN_ROWS) return DISPLAY_BUF_MIN_ROWS;
+    if (rows > LV_VER_RES_MAX) return LV_VER_RES_MAX;
+    return rows;
+}
+
+// Call with nothing allocated, so the heap shows what the buffers could have
+static display_buf_cfg_t resolve(const display_buf_cfg_t * cfg)
+{
+    display_buf_cfg_t r = *cfg;
+
+    if (r.strategy != DISPLAY_BUF_AUTO)
+    {
+        if (r.rows == 0) r.rows = (r.strategy == DISPLAY_BUF_PSRAM) ? DISPLAY_BUF_BOUNCE_ROWS : DISPLAY_BUF_DEFAULT_ROWS;
+        r.rows = clamp_rows(r.rows);
+        return r;
+    }
+
+    size_t free_dma = heap_caps_get_free_size(MALLOC_CAP_DMA);
+    size_t budget = (free_dma > DISPLAY_BUF_RAM_RESERVE) ? (free_dma - DISPLAY_BUF_RAM_RESERVE) : 0;
+    uint32_t rows = budget / (2 * ROW_BYTES);
+    rows = LV_MATH_MIN(rows, heap_caps_get_largest_free_block(MALLOC_CAP_DMA) / ROW_BYTES);
+    rows -= rows % DISPLAY_BUF_MIN_ROWS;
+
+    // Internal RAM is much quicker to draw into, so PSRAM only wins when that's short
+    bool psram = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) >= FRAME_PX * sizeof(lv_color_t) &&
+                 budget >= 2 * DISPLAY_BUF_BOUNCE_ROWS * ROW_BYTES;
+
+    if (rows >= DISPLAY_BUF_DEFAULT_ROWS)
+    {
+        r.strategy = DISPLAY_BUF_DOUBLE;
+        r.rows = LV_MATH_MIN(rows, AUTO_MAX_ROWS);
+    }
+    else if (psram)
+    {
+        r.strategy = DISPLAY_BUF_PSRAM;
+        r.rows = DISPLAY_BUF_BOUNCE_ROWS;
+    }
+    else if (rows >= DISPLAY_BUF_MIN_ROWS)
+    {
+        r.strategy = DISPLAY_BUF_DOUBLE;
+        r.rows = rows;
+    }
+    else
+    {
+        r.strategy = DISPLAY_BUF_SINGLE;
+        r.rows = DISPLAY_BUF_MIN_ROWS;
+    }
+
+    return r;
+}
+
+static bool allocate(const display_buf_cfg_t * cfg)
+{
+    uint32_t ram = 0;
+    uint32_t psram = 0;
+
+    if (cfg->strategy == DISPLAY_BUF_PSRAM)
+    {
+        bufs[0] = heap_caps_malloc(FRAME_PX * sizeof(lv_color_t), MALLOC_CAP_SPIRAM);
+        bounce[0] = heap_caps_malloc(cfg->rows * ROW_BYTES, MALLOC_CAP_DMA);
+        bounce[1] = heap_caps_malloc(cfg->rows * ROW_BYTES, MALLOC_CAP_DMA);
+        if (bufs[0] == NULL || bounce[0] == NULL || bounce[1] == NULL) goto fail;
+
+        lv_disp_buf_init(&disp_buf, bufs[0], NULL, FRAME_PX);
+        psram = FRAME_PX * sizeof(lv_color_t);
+        ram = 2 * cfg->rows * ROW_BYTES;
+    }
+    else
+    {
+        int count = (cfg->strategy == DISPLAY_BUF_DOUBLE) ? 2 : 1;
+        for (int i = 0; i < count; i++)
+        {
+            bufs[i] = heap_caps_malloc(cfg->rows * ROW_BYTES, MALLOC_CAP_DMA);
+            if (bufs[i] == NULL) goto fail;
+        }
+
+        lv_disp_buf_init(&disp_buf, bufs[0], bufs[1], cfg->rows * ROW_PX);
+        ram = count * cfg->rows * ROW_BYTES;
+    }
+
+    portENTER_CRITICAL(&lock);
+    memset(&stats, 0, sizeof(stats));
+    frame_ms_total = 0;
+    px_total = 0;
+    stats.cfg = *cfg;
+    stats.ram_bytes = ram;
+    stats.psram_bytes = psram;
+    portEXIT_CRITICAL(&lock);
+
+    return true;
+
+fail:
+    release();
+    return false;
+}
+
+// Returns false if the layout couldn't be had and a fallback is in use
+static bool apply(lv_disp_drv_t * drv, const display_buf_cfg_t * cfg)
+{
+    // LVGL's last flush may still be going out of the buffers about to be freed
+    disp_wait_for_pending_transactions();
+    release();
+
+    display_buf_cfg_t r = resolve(cfg);
+    bool ok = allocate(&r);
+    if (!ok)
+    {
+        ESP_LOGW(DISPLAY_TAG, "No room for %s, %u rows", strategy_names[r.strategy], r.rows);
+        r.strategy = DISPLAY_BUF_SINGLE;
+        r.rows = DISPLAY_BUF_MIN_ROWS;
+        if (!allocate(&r)) ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+    }
+
+    drv->buffer = &disp_buf;
+    drv->flush_cb = (r.strategy == DISPLAY_BUF_PSRAM) ? flush_bounced : base_flush;
+
+    ESP_LOGI(DISPLAY_TAG, "%s, %u rows: %u bytes internal, %u PSRAM", strategy_names[r.strategy], r.rows,
+             stats.ram_bytes, stats.psram_bytes);
+    return ok;
+}
+
+void display_buffer_init(lv_disp_drv_t * drv, const display_buf_cfg_t * cfg)
+{
+    notify = xTaskGetCurrentTaskHandle();
+    base_flush = drv->flush_cb;
+    drv->monitor_cb = monitor;
+    requested = *cfg;
+
+    apply(drv, cfg);
+}
+
+void display_buffer_request(const display_buf_cfg_t * cfg)
+{
+    portENTER_CRITICAL(&lock);
+    pending = *cfg;
+    request_pending = true;
+    portEXIT_CRITICAL(&lock);
+
+    if (notify != NULL) xTaskNotifyGive(notify);
+}
+
+void display_buffer_bench_start()
+{
+    if (bench_running) return;
+
+    bench_next = 0;
+    bench_count = 0;
+    bench_running = true;
+    if (notify != NULL) xTaskNotifyGive(notify);
+}
+
+// One layout per call, so the GUI isn't frozen for the whole bench
+static void bench_step(lv_disp_t * disp)
+{
+    const display_buf_cfg_t * cfg = &bench_cfgs[bench_next++];
+    display_buf_bench_t * result = &bench[bench_count++];
+
+    memset(result, 0, sizeof(*result));
+    result->cfg = *cfg;
+    result->ok = apply(&disp->driver, cfg);
+
+    if (result->ok)
+    {
+        uint64_t total = 0;
+        result->frame_us_min = UINT32_MAX;
+        for (int i = 0; i < DISPLAY_BUF_BENCH_FRAMES; i++)
+        {
+            lv_obj_invalidate(lv_scr_act());
+
+            int64_t start = esp_timer_get_time();
+            lv_refr_now(disp);
+            disp_wait_for_pending_transactions();
+            uint32_t us = esp_timer_get_time() - start;
+
+            total += us;
+            result->frame_us_min = LV_MATH_MIN(result->frame_us_min, us);
+            result->frame_us_max = LV_MATH_MAX(result->frame_us_max, us);
+        }
+        result->frame_us_avg = total / DISPLAY_BUF_BENCH_FRAMES;
+        result->ram_bytes = stats.ram_bytes;
+        result->psram_bytes = stats.psram_bytes;
+    }
+
+    if (bench_next >= BENCH_CFGS || bench_count >= DISPLAY_BUF_BENCH_MAX)
+    {
+        apply(&disp->driver, &requested);
+        lv_obj_invalidate(lv_scr_act());
+        bench_running = false;
+    }
+}
+
+void display_buffer_flush_bench_start()
+{
+    if (flush_bench_running) return;
+
+    flush_bench_running = true;
+    if (notify != NULL) xTaskNotifyGive(notify);
+}
+
+static void flush_timed(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * color_map)
+{
+    int64_t start = esp_timer_get_time();
+    timed_flush(drv, area, color_map);
+    flush_call_us += esp_timer_get_time() - start;
+}
+
+// Label-sized redraws, first with every window command sent and waited for
+// on its own, then with the window and pixels queued as one batch
+static void flush_bench_run(lv_disp_t * disp)
+{
+    const lv_area_t area = { 0, 0, DISPLAY_FLUSH_BENCH_W - 1, DISPLAY_FLUSH_BENCH_H - 1 };
+
+    timed_flush = disp->driver.flush_cb;
+    disp->driver.flush_cb = flush_timed;
+
+    for (int i = 0; i < 2; i++)
+    {
+        display_flush_bench_t * result = &flush_bench[i];
+        result->batched = (i == 1);
+        ili9341_set_batched_flush(result->batched);
+        flush_call_us = 0;
+
+        int64_t start = esp_timer_get_time();
+        for (int n = 0; n < DISPLAY_FLUSH_BENCH_FLUSHES; n++)
+        {
+            _lv_inv_area(disp, &area);
+            lv_refr_now(disp);
+        }
+        disp_wait_for_pending_transactions();
+        uint32_t us = esp_timer_get_time() - start;
+
+        result->flushes_per_s = (us > 0) ? (uint64_t)DISPLAY_FLUSH_BENCH_FLUSHES * 1000000 / us : 0;
+        result->call_us_avg = flush_call_us / DISPLAY_FLUSH_BENCH_FLUSHES;
+    }
+
+    disp->driver.flush_cb = timed_flush;
+    ili9341_set_batched_flush(true);
+    flush_bench_running = false;
+}
+
+uint32_t display_buffer_poll()
+{
+    lv_disp_t * disp = lv_disp_get_default();
+    if (disp == NULL) return UINT32_MAX;
+
+    if (flush_bench_running && !bench_running)
+    {
+        flush_bench_run(disp);
+    }
+
+    if (bench_running)
+    {
+        bench_step(disp);
+        return bench_running ? 0 : UINT32_MAX;
+    }
+
+    portENTER_CRITICAL(&lock);
+    bool have_request = request_pending;
+    display_buf_cfg_t cfg = pending;
+    request_pending = false;
+    portEXIT_CRITICAL(&lock);
+
+    if (have_request)
+    {
+        requested = cfg;
+        apply(&disp->driver, &cfg);
+        lv_obj_invalidate(lv_scr_act());
+    }
+
+    return UINT32_MAX;
+}
+
+void display_buffer_get_stats(display_buf_stats_t * s)
+{
+    portENTER_CRITICAL(&lock);
+    *s = stats;
+    portEXIT_CRITICAL(&lock);
+}
+
+bool display_buffer_bench_running()
+{
+    return bench_running;
+}
+
+uint32_t display_buffer_bench_results(display_buf_bench_t * results, uint32_t max)
+{
+    if (bench_running) return 0;
+
+    uint32_t count = LV_MATH_MIN(bench_count, max);
+    memcpy(results, bench, count * sizeof(bench[0]));
+    return count;
+}
+
+bool display_buffer_flush_bench_running()
+{
+    return flush_bench_running;
+}
+
+uint32_t display_buffer_flush_bench_results(display_flush_bench_t * results, uint32_t max)
+{
+    if (flush_bench_running) return 0;
+
+    uint32_t count = LV_MATH_MIN(2, max);
+    memcpy(results, flush_bench, count * sizeof(flush_bench[0]));
+    return count;
+}
+
+const char * display_buffer_strategy_name(display_buf_strategy_t strategy)
+{
+    return (strategy < DISPLAY_BUF_STRATEGY_COUNT) ? strategy_names[strategy] : "?";
+}
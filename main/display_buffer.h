@@ -0,0 +1,106 @@
+#ifndef DISPLAY_BUFFER_H
+#define DISPLAY_BUFFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Where LVGL draws before the ILI9341 gets it, chosen at runtime from the
+// memory that's actually free:
+//   single - one internal DMA buffer; LVGL waits for every flush
+//   double - two internal DMA buffers; LVGL draws one while the other is sent
+//   psram  - the whole frame in PSRAM, which SPI DMA can't read, so each
+//            flush is copied out through two internal bounce buffers
+// Taller buffers mean fewer flushes per redraw at the cost of internal RAM.
+//
+// Every refresh is timed through LVGL's monitor callback. A bench mode times
+// full-screen redraws with each candidate layout in turn, so the tradeoff can
+// be measured on the real hardware. A second bench times small, label-sized
+// redraws with the ILI9341 window sent command by command and as one queued
+// batch, where the per-flush setup dominates.
+
+#define DISPLAY_BUF_DEFAULT_ROWS    40
+#define DISPLAY_BUF_MIN_ROWS        10
+#define DISPLAY_BUF_BOUNCE_ROWS     20
+#define DISPLAY_BUF_RAM_RESERVE     (48 * 1024)     // Internal RAM left for BLE, the console and stacks
+#define DISPLAY_BUF_BENCH_FRAMES    10
+#define DISPLAY_BUF_BENCH_MAX       8
+#define DISPLAY_FLUSH_BENCH_FLUSHES 200
+#define DISPLAY_FLUSH_BENCH_W       64
+#define DISPLAY_FLUSH_BENCH_H       16
+
+typedef enum
+{
+    DISPLAY_BUF_AUTO,
+    DISPLAY_BUF_SINGLE,
+    DISPLAY_BUF_DOUBLE,
+    DISPLAY_BUF_PSRAM,
+    DISPLAY_BUF_STRATEGY_COUNT
+} display_buf_strategy_t;
+
+typedef struct display_buf_cfg_t
+{
+    display_buf_strategy_t strategy;
+    uint16_t rows;                  // Buffer height (bounce buffer height for psram), 0 for the default
+} display_buf_cfg_t;
+
+typedef struct display_buf_stats_t
+{
+    display_buf_cfg_t cfg;          // In use, never AUTO
+    uint32_t ram_bytes;             // Internal RAM held
+    uint32_t psram_bytes;
+    uint32_t frames;                // Refreshes since the layout was applied
+    uint32_t frame_ms_last;
+    uint32_t frame_ms_avg;
+    uint32_t frame_ms_max;
+    uint32_t px_avg;                // Pixels redrawn per refresh
+} display_buf_stats_t;
+
+typedef struct display_buf_bench_t
+{
+    display_buf_cfg_t cfg;
+    bool ok;                        // False if it couldn't be allocated
+    uint32_t ram_bytes;
+    uint32_t psram_bytes;
+    uint32_t frame_us_min;          // Full-screen redraw, render to last pixel sent
+    uint32_t frame_us_avg;
+    uint32_t frame_us_max;
+} display_buf_bench_t;
+
+typedef struct display_flush_bench_t
+{
+    bool batched;                   // Window and pixels queued as one batch
+    uint32_t flushes_per_s;         // Render to last pixel sent
+    uint32_t call_us_avg;           // Time the GUI thread spent in the flush callback
+} display_flush_bench_t;
+
+// Allocates the buffers and points drv at them. Call before lv_disp_drv_register().
+void display_buffer_init(lv_disp_drv_t * drv, const display_buf_cfg_t * cfg);
+
+// Any task. Applied by the next display_buffer_poll().
+void display_buffer_request(const display_buf_cfg_t * cfg);
+void display_buffer_bench_start();
+void display_buffer_flush_bench_start();
+
+// GUI thread, between lv_task_handler() calls. Returns ms until it needs to run again.
+uint32_t display_buffer_poll();
+
+// Any task
+void display_buffer_get_stats(display_buf_stats_t * stats);
+bool display_buffer_bench_running();
+// Results of the last bench. Returns how many were copied.
+uint32_t display_buffer_bench_results(display_buf_bench_t * results, uint32_t max);
+bool display_buffer_flush_bench_running();
+// Polled first, then batched. Returns how many were copied.
+uint32_t display_buffer_flush_bench_results(display_flush_bench_t * results, uint32_t max);
+const char * display_buffer_strategy_name(display_buf_strategy_t strategy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,6 +17,7 @@
 ****************************************************************************/
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -31,32 +32,26 @@
 #include "esp_gatt_common_api.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
 #include "example_ble_sec_gattc_demo.h"
+#include "list_fetch.h"
+#include "write_pipeline.h"
+#include "ble_handle_cache.h"
+#include "ble_metrics.h"
+#include "conn_profile.h"
+#include "ble_scan.h"
+#include "catalog_cache.h"
 
 #define GATTC_TAG             "BLE"
 // #define REMOTE_SERVICE_UUID   ESP_GATT_UUID_HEART_RATE_SVC
 // #define REMOTE_NOTIFY_UUID    0x2A37
 
-static esp_gattc_char_elem_t *char_elem_result   = NULL;
-static esp_gattc_descr_elem_t *descr_elem_result = NULL;
-
 ///Declare static functions
 static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
 static void esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
 static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
 
 
-enum
-{
-    IDX_CHAR_PATTERN,
-    IDX_CHAR_COLOR,
-    IDX_CHAR_BRIGHTNESS,
-    IDX_CHAR_SPEED,
-    IDX_CHAR_PATTERN_LIST,
-    IDX_CHAR_COLOR_LIST,
-    IDX_CHAR_TABLE_END,
-};
-
 #define BASE_UUID 0xc8, 0xcb, 0xff, 0x07, 0x89, 0x9c, 0x4b, 0xb1, 0xa9, 0xf6, 0x39, 0x49
 // Last 2 bytes
 #define TAIL_UUID 0x00, 0x00
@@ -76,36 +71,117 @@ static esp_bt_uuid_t remote_filter_service_uuid = {
     .uuid = {.uuid128 = {BASE_UUID, 0xFF, 0x00, TAIL_UUID},},
 };
 
-esp_gattc_descr_elem_t char_table[IDX_CHAR_TABLE_END] = {
-    { .handle = 0, .uuid = { .len = ESP_UUID_LEN_128, .uuid = {.uuid128 = {BASE_UUID, 0x02, 0xFF, TAIL_UUID}, }, }, },  // IDX_CHAR_PATTERN
-    { .handle = 0, .uuid = { .len = ESP_UUID_LEN_128, .uuid = {.uuid128 = {BASE_UUID, 0x03, 0xFF, TAIL_UUID}, }, }, },  // IDX_CHAR_COLOR
-    { .handle = 0, .uuid = { .len = ESP_UUID_LEN_128, .uuid = {.uuid128 = {BASE_UUID, 0x04, 0xFF, TAIL_UUID}, }, }, },  // IDX_CHAR_BRIGHTNESS
-    { .handle = 0, .uuid = { .len = ESP_UUID_LEN_128, .uuid = {.uuid128 = {BASE_UUID, 0x05, 0xFF, TAIL_UUID}, }, }, },  // IDX_CHAR_SPEED
-    { .handle = 0, .uuid = { .len = ESP_UUID_LEN_128, .uuid = {.uuid128 = {BASE_UUID, 0x10, 0xFF, TAIL_UUID}, }, }, },  // IDX_CHAR_PATTERN_LIST
-    { .handle = 0, .uuid = { .len = ESP_UUID_LEN_128, .uuid = {.uuid128 = {BASE_UUID, 0x11, 0xFF, TAIL_UUID}, }, }, },  // IDX_CHAR_COLOR_LIST
+typedef enum
+{
+    CHAR_TYPE_U8,       // Single byte, checked against min/max
+    CHAR_TYPE_LIST,     // Newline separated strings, fetched by list_fetch
+    CHAR_TYPE_HASH,     // uint32 (little endian) identifying the current lists
+} char_value_type_t;
+
+// Everything known about one controller characteristic. Adding a
+// characteristic means adding a ble_char_id_t and a row here - the event
+// handlers below work from the table.
+typedef struct char_desc_t
+{
+    const char * name;
+    esp_bt_uuid_t uuid;
+    char_value_type_t type;
+    uint8_t min;
+    uint8_t max;
+    ValueChangedCb value_cb;    // CHAR_TYPE_U8
+    StrListRecdCb list_cb;      // CHAR_TYPE_LIST
+} char_desc_t;
+
+#define CHAR_UUID(id) { .len = ESP_UUID_LEN_128, .uuid = {.uuid128 = {BASE_UUID, (id), 0xFF, TAIL_UUID}, }, }
+
+static char_desc_t char_table[BLE_CHAR_COUNT] = {
+    [BLE_CHAR_PATTERN]      = { .name = "pattern",    .uuid = CHAR_UUID(0x02), .type = CHAR_TYPE_U8, .min = 0, .max = UINT8_MAX },
+    [BLE_CHAR_COLOR]        = { .name = "color",      .uuid = CHAR_UUID(0x03), .type = CHAR_TYPE_U8, .min = 0, .max = UINT8_MAX },
+    [BLE_CHAR_BRIGHTNESS]   = { .name = "brightness", .uuid = CHAR_UUID(0x04), .type = CHAR_TYPE_U8, .min = 0, .max = UINT8_MAX },
+    [BLE_CHAR_SPEED]        = { .name = "speed",      .uuid = CHAR_UUID(0x05), .type = CHAR_TYPE_U8, .min = 0, .max = UINT8_MAX },
+    [BLE_CHAR_PATTERN_LIST] = { .name = "patterns",   .uuid = CHAR_UUID(0x10), .type = CHAR_TYPE_LIST },
+    [BLE_CHAR_COLOR_LIST]   = { .name = "colors",     .uuid = CHAR_UUID(0x11), .type = CHAR_TYPE_LIST },
+    [BLE_CHAR_CATALOG_HASH] = { .name = "catalog",    .uuid = CHAR_UUID(0x12), .type = CHAR_TYPE_HASH },
 };
 
-static bool connect = false;
-static bool get_service = false;
+// Where a characteristic lives on one particular controller
+typedef struct char_state_t
+{
+    uint16_t handle;            // Filled in at discovery (or from the handle cache)
+    uint16_t cccd;              // Client Characteristic Configuration descriptor, 0 if it doesn't notify
+    list_fetch_t fetch;         // CHAR_TYPE_LIST
+} char_state_t;
+
+// Reverse map from attribute handle to char_table index, so events don't have
+// to walk the table. The controller's characteristics sit close together in
+// one service, so a small window starting at the lowest handle covers them.
+#define HANDLE_INDEX_SIZE   64
+
+// One connection to a controller. All of them share the one GATTC app and
+// are told apart by conn_id (or address, for GAP events).
+typedef struct ble_link_t
+{
+    ble_link_state_t state;
+    uint16_t conn_id;
+    esp_bd_addr_t bda;
+    esp_ble_addr_type_t addr_type;
+    bool direct;                // Opened straight from the bond list, without scanning
+    bool cached;                // Handles came from the handle cache
+    bool get_service;
+    uint16_t service_start_handle;
+    uint16_t service_end_handle;
+    char_state_t chars[BLE_CHAR_COUNT];
+    uint16_t handle_index_base;
+    uint8_t handle_index[HANDLE_INDEX_SIZE];    // char_table index + 1, 0 for none
+    int64_t connect_start_us;
+    uint32_t catalog_hash;
+    bool catalog_hash_valid;
+    uint32_t lists_waiting;     // Bit per char_table index, lists waiting on the catalog hash
+} ble_link_t;
+
+static ble_link_t links[BLE_MAX_LINKS];
+
+// The link the UI follows: its values and lists are shown and reads go to it.
+// It only moves when it drops, so the UI isn't reloaded every time another
+// controller joins. Writes go to every live link.
+static int primary_link = -1;
+
+// Bluedroid runs one connection attempt at a time, so links are opened one
+// after another
+static ble_link_t * opening_link = NULL;
+
+// Set when a direct connect to a bonded controller fails, so the next attempt
+// scans rather than waiting on it again
+static bool skip_direct = false;
+
+// Everything SetValue() needs, since it runs on the app's task while the BTC
+// task owns the links. Last value seen or set for each characteristic, used to
+// bring a controller joining the group in line with the others, and the
+// handles of each live link (INVALID_HANDLE while it isn't live).
+// Also held while the BTC task changes a link's state or bda, or primary_link,
+// so GetLinkInfo() gets a consistent copy.
+static portMUX_TYPE value_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t last_values[BLE_CHAR_COUNT];
+static bool last_value_valid[BLE_CHAR_COUNT];
+static uint16_t live_handles[BLE_MAX_LINKS][BLE_CHAR_COUNT];
+
+_Static_assert(BLE_CHAR_COUNT <= WRITE_SLOT_COUNT, "write pipeline needs a slot per characteristic");
+_Static_assert(BLE_CHAR_COUNT <= BLE_HANDLE_CACHE_MAX_CHARS, "handle cache needs room for every characteristic");
+_Static_assert(BLE_CHAR_COUNT <= BLE_METRICS_MAX_IDS, "metrics need an id per characteristic");
+_Static_assert(BLE_CHAR_COUNT <= 32, "lists_waiting needs a bit per characteristic");
+_Static_assert(BLE_MAX_LINKS <= CONFIG_BT_ACL_CONNECTIONS, "Bluedroid must allow a connection per link");
+_Static_assert(BLE_MAX_LINKS <= CONFIG_BTDM_CTRL_BLE_MAX_CONN_EFF, "controller must allow a connection per link");
+_Static_assert(BLE_MAX_LINKS <= WRITE_PIPELINE_MAX_LINKS, "write pipeline needs room for every link");
+_Static_assert(BLE_MAX_LINKS <= BLE_METRICS_MAX_LINKS, "metrics need room for every link");
+_Static_assert(BLE_MAX_LINKS <= CONN_PROFILE_MAX_PEERS, "connection profiles need room for every link");
+
 static const char remote_device_name[] = "LedController";
-esp_gatt_if_t g_gattc_if;
-
-ValueChangedCb patternChangedCallback = NULL;
-ValueChangedCb colorChangedCallback = NULL;
-ValueChangedCb brightnessChangedCallback = NULL;
-ValueChangedCb speedChangedCallback = NULL;
-StrListRecdCb patternListCallback = NULL;
-StrListRecdCb colorListCallback = NULL;
+
 ConnectChangedCb connectChangedCallback = NULL;
+LinksChangedCb linksChangedCallback = NULL;
 
-static esp_ble_scan_params_t ble_scan_params = {
-    .scan_type              = BLE_SCAN_TYPE_ACTIVE,
-    .own_addr_type          = BLE_ADDR_TYPE_RANDOM,
-    .scan_filter_policy     = BLE_SCAN_FILTER_ALLOW_ALL,
-    .scan_interval          = 0x50,
-    .scan_window            = 0x30,
-    .scan_duplicate         = BLE_SCAN_DUPLICATE_DISABLE
-};
+static uint32_t last_connect_ms = 0;
+static bool last_connect_fast = false;
 
 
 #define PROFILE_NUM 1
@@ -116,11 +192,6 @@ struct gattc_profile_inst {
     esp_gattc_cb_t gattc_cb;
     uint16_t gattc_if;
     uint16_t app_id;
-    uint16_t conn_id;
-    uint16_t service_start_handle;
-    uint16_t service_end_handle;
-    uint16_t notify_char_handle;
-    esp_bd_addr_t remote_bda;
 };
 
 /* One gatt-based profile one app_id and one gattc_if, this array will store the gattc_if returned by ESP_GATTS_REG_EVT */
@@ -229,11 +300,502 @@ static char *esp_auth_req_to_str(esp_ble_auth_req_t auth_req)
    return auth_str;
 }
 
-static void start_scanning()
+static int link_index(const ble_link_t * link)
+{
+    return link - links;
+}
+
+static ble_link_t * link_for_conn_id(uint16_t conn_id)
+{
+    for (int i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (links[i].state >= BLE_LINK_DISCOVERING && links[i].conn_id == conn_id) return &links[i];
+    }
+    return NULL;
+}
+
+static ble_link_t * link_for_bda(const esp_bd_addr_t bda)
+{
+    for (int i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (links[i].state != BLE_LINK_FREE && memcmp(links[i].bda, bda, sizeof(esp_bd_addr_t)) == 0) return &links[i];
+    }
+    return NULL;
+}
+
+static ble_link_t * free_link()
+{
+    for (int i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (links[i].state == BLE_LINK_FREE) return &links[i];
+    }
+    return NULL;
+}
+
+static bool any_link_in_use()
+{
+    for (int i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (links[i].state != BLE_LINK_FREE) return true;
+    }
+    return false;
+}
+
+static void notify_links_changed()
+{
+    if (linksChangedCallback != NULL) linksChangedCallback();
+}
+
+// Pick a new primary if the current one has gone, and tell the app
+static void update_primary()
+{
+    notify_links_changed();
+
+    if (primary_link >= 0 && links[primary_link].state == BLE_LINK_LIVE) return;
+
+    int primary = -1;
+    for (int i = 0; i < BLE_MAX_LINKS && primary < 0; i++)
+    {
+        if (links[i].state == BLE_LINK_LIVE) primary = i;
+    }
+    if (primary == primary_link) return;
+
+    portENTER_CRITICAL(&value_lock);
+    primary_link = primary;
+    portEXIT_CRITICAL(&value_lock);
+
+    // A new primary means the UI reloads everything from it
+    if (connectChangedCallback != NULL) connectChangedCallback(primary >= 0);
+}
+
+// The state and bda are read by GetLinkInfo() on other tasks. bda may be NULL
+// to leave it as it is.
+static void set_link_state(ble_link_t * link, ble_link_state_t state, const uint8_t * bda)
+{
+    portENTER_CRITICAL(&value_lock);
+    link->state = state;
+    if (bda != NULL) memcpy(link->bda, bda, sizeof(esp_bd_addr_t));
+    portEXIT_CRITICAL(&value_lock);
+}
+
+static void list_fetched(list_fetch_t * fetch, char * str, int len);
+
+static void open_link(ble_link_t * link, const esp_bd_addr_t bda, esp_ble_addr_type_t addr_type, bool direct)
+{
+    portENTER_CRITICAL(&value_lock);
+    memset(link, 0, sizeof(*link));
+    portEXIT_CRITICAL(&value_lock);
+
+    link->addr_type = addr_type;
+    link->direct = direct;
+    link->connect_start_us = esp_timer_get_time();
+    for (int i = 0; i < BLE_CHAR_COUNT; i++)
+    {
+        link->chars[i].fetch.name = char_table[i].name;
+        link->chars[i].fetch.done_cb = list_fetched;
+        link->chars[i].fetch.ctx = link;
+    }
+
+    set_link_state(link, BLE_LINK_OPENING, bda);
+    opening_link = link;
+    notify_links_changed();
+
+    esp_err_t ret = esp_ble_gattc_open(gl_profile_tab[PROFILE_A_APP_ID].gattc_if, link->bda, addr_type, true);
+    if (ret)
+    {
+        ESP_LOGE(GATTC_TAG, "open error, error code = %x", ret);
+        set_link_state(link, BLE_LINK_FREE, NULL);
+        opening_link = NULL;
+        notify_links_changed();
+    }
+}
+
+// Work towards filling the free links: bonded controllers we have handles for
+// are opened directly, anything else has to be found by scanning
+static void start_connecting()
+{
+    if (opening_link != NULL) return;
+
+    ble_link_t * link = free_link();
+    if (link == NULL)
+    {
+        ble_scan_stop();
+        return;
+    }
+
+    if (!skip_direct)
+    {
+        int dev_num = esp_ble_get_bond_device_num();
+        esp_ble_bond_dev_t *dev_list = (dev_num > 0) ? (esp_ble_bond_dev_t *)malloc(sizeof(esp_ble_bond_dev_t) * dev_num) : NULL;
+
+        if (dev_list != NULL && esp_ble_get_bond_device_list(&dev_num, dev_list) == ESP_OK)
+        {
+            for (int i = 0; i < dev_num; i++)
+            {
+                ble_handle_cache_t cache;
+                if (link_for_bda(dev_list[i].bd_addr) != NULL) continue;
+                if (ble_handle_cache_load(dev_list[i].bd_addr, &cache) != ESP_OK) continue;
+
+                ESP_LOGI(GATTC_TAG, "Reconnecting directly to bonded controller");
+                ble_scan_stop();
+                open_link(link, cache.bda, cache.addr_type, true);
+                break;
+            }
+        }
+        free(dev_list);
+
+        if (opening_link != NULL) return;
+    }
+
+    // Keep scanning for as long as it takes to find the first controller, but
+    // only run through the stages once when looking for more
+    ble_scan_start(!any_link_in_use());
+}
+
+static void invalidate_handle_cache(ble_link_t * link)
+{
+    ble_handle_cache_erase(link->bda);
+}
+
+static void save_handle_cache(ble_link_t * link)
+{
+    ble_handle_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    memcpy(cache.bda, link->bda, sizeof(esp_bd_addr_t));
+    cache.addr_type = link->addr_type;
+    cache.char_count = BLE_CHAR_COUNT;
+    for (int i = 0; i < BLE_CHAR_COUNT; i++)
+    {
+        cache.char_handles[i] = link->chars[i].handle;
+        cache.cccd_handles[i] = link->chars[i].cccd;
+    }
+
+    ble_handle_cache_save(&cache);
+}
+
+// Record where a char_table entry lives on a link and subscribe to it if it notifies
+static void use_char_handle(ble_link_t * link, esp_gatt_if_t gattc_if, int char_table_idx, uint16_t handle, uint16_t cccd)
+{
+    char_state_t * c = &link->chars[char_table_idx];
+    c->handle = handle;
+    c->cccd = cccd;
+
+    // Lists that can notify are fetched in chunks
+    if (char_table[char_table_idx].type == CHAR_TYPE_LIST)
+    {
+        c->fetch.handle = handle;
+        c->fetch.chunked = (cccd != INVALID_HANDLE);
+    }
+
+    // Let the controller push changes (including ones made by
+    // other remotes) rather than us having to poll for them
+    if (cccd != INVALID_HANDLE)
+    {
+        esp_ble_gattc_register_for_notify(gattc_if, link->bda, handle);
+
+        // The CCCD is written here rather than on REG_FOR_NOTIFY, as that
+        // event doesn't say which connection it belongs to
+        uint16_t notify_en = 1;
+        esp_ble_gattc_write_char_descr (gattc_if,
+                                        link->conn_id,
+                                        cccd,
+                                        sizeof(notify_en),
+                                        (uint8_t *)&notify_en,
+                                        ESP_GATT_WRITE_TYPE_RSP,
+                                        ESP_GATT_AUTH_REQ_NONE);
+    }
+}
+
+// Rebuild a link's handle_index once it has its handles
+static void build_handle_index(ble_link_t * link)
+{
+    memset(link->handle_index, 0, sizeof(link->handle_index));
+
+    link->handle_index_base = UINT16_MAX;
+    for (int i = 0; i < BLE_CHAR_COUNT; i++)
+    {
+        if (link->chars[i].handle != INVALID_HANDLE && link->chars[i].handle < link->handle_index_base)
+            link->handle_index_base = link->chars[i].handle;
+    }
+
+    for (int i = 0; i < BLE_CHAR_COUNT; i++)
+    {
+        uint16_t handle = link->chars[i].handle;
+        if (handle == INVALID_HANDLE) continue;
+
+        if (handle - link->handle_index_base >= HANDLE_INDEX_SIZE)
+        {
+            ESP_LOGW(GATTC_TAG, "Handle %u for %s is outside the handle index", handle, char_table[i].name);
+            continue;
+        }
+        link->handle_index[handle - link->handle_index_base] = i + 1;
+    }
+}
+
+// char_table index for a handle on a link, -1 if it isn't one of ours
+static int char_for_handle(const ble_link_t * link, uint16_t handle)
+{
+    // Handles below the base wrap around and fail the size check too
+    uint16_t slot = (uint16_t)(handle - link->handle_index_base);
+    if (handle == INVALID_HANDLE || slot >= HANDLE_INDEX_SIZE || link->handle_index[slot] == 0) return -1;
+
+    return link->handle_index[slot] - 1;
+}
+
+static uint16_t find_cccd(esp_gatt_if_t gattc_if, const ble_link_t * link, uint16_t char_handle)
+{
+    esp_gattc_descr_elem_t descr;
+    uint16_t count = 1;
+    esp_bt_uuid_t cccd_uuid = {
+        .len = ESP_UUID_LEN_16,
+        .uuid = {.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG,},
+    };
+
+    esp_gatt_status_t ret_status = esp_ble_gattc_get_descr_by_char_handle(gattc_if,
+                                                                          link->conn_id,
+                                                                          char_handle,
+                                                                          cccd_uuid,
+                                                                          &descr,
+                                                                          &count);
+    if (ret_status != ESP_GATT_OK || count == 0) return INVALID_HANDLE;
+
+    return descr.handle;
+}
+
+// Let SetValue() write to the link, and send it the values the others
+// already have. Whatever SetValue() changes from here on reaches the link
+// itself, so nothing set in between is missed.
+static void publish_link(ble_link_t * link, bool sync)
+{
+    uint8_t values[BLE_CHAR_COUNT];
+    bool valid[BLE_CHAR_COUNT];
+
+    portENTER_CRITICAL(&value_lock);
+    for (int i = 0; i < BLE_CHAR_COUNT; i++)
+    {
+        live_handles[link_index(link)][i] = link->chars[i].handle;
+        values[i] = last_values[i];
+        valid[i] = last_value_valid[i];
+    }
+    portEXIT_CRITICAL(&value_lock);
+
+    for (int i = 0; i < BLE_CHAR_COUNT && sync; i++)
+    {
+        if (char_table[i].type == CHAR_TYPE_U8 && valid[i] && link->chars[i].handle != INVALID_HANDLE)
+            write_pipeline_set(link_index(link), i, link->chars[i].handle, values[i]);
+    }
+}
+
+// Stop SetValue() writing to the link before its handles go stale
+static void unpublish_link(ble_link_t * link)
 {
-    //the unit of the duration is second
-    uint32_t duration = 30;
-    esp_ble_gap_start_scanning(duration);
+    portENTER_CRITICAL(&value_lock);
+    memset(live_handles[link_index(link)], 0, sizeof(live_handles[0]));
+    portEXIT_CRITICAL(&value_lock);
+}
+
+// The controller's attribute table changed under the link: stop writing to
+// it and look its handles up again. controls_live() publishes it once found.
+// A live link stays BLE_LINK_LIVE meanwhile, so it isn't counted as a new connect.
+static void rediscover_link(ble_link_t * link, esp_gatt_if_t gattc_if)
+{
+    invalidate_handle_cache(link);
+    if (link->state < BLE_LINK_DISCOVERING) return;
+
+    unpublish_link(link);
+    link->get_service = false;
+    esp_ble_gattc_search_service(gattc_if, link->conn_id, &remote_filter_service_uuid);
+}
+
+// Everything needed to drive the controller is known - let the app loose
+static void controls_live(ble_link_t * link)
+{
+    if (link->state == BLE_LINK_LIVE)
+    {
+        // Back from rediscover_link(). Not a connect, so no timing; the
+        // controller only needs catching up if another link leads the UI.
+        ESP_LOGI(GATTC_TAG, "Link %d rediscovered", link_index(link));
+        publish_link(link, primary_link >= 0 && primary_link != link_index(link));
+        return;
+    }
+
+    last_connect_ms = (uint32_t)((esp_timer_get_time() - link->connect_start_us) / 1000);
+    last_connect_fast = link->cached;
+    ESP_LOGI(GATTC_TAG, "Link %d live %u ms after starting to connect (%s)", link_index(link), last_connect_ms, link->cached ? "cached handles" : "full discovery");
+    ble_metrics_controls_live(link_index(link));
+
+    set_link_state(link, BLE_LINK_LIVE, NULL);
+    publish_link(link, primary_link >= 0);
+    update_primary();
+
+    // Look for the next controller now this one is settled
+    start_connecting();
+}
+
+// Only the primary's lists reach the app
+static void deliver_list(ble_link_t * link, int char_table_idx, char * str, uint16_t len)
+{
+    if (link_index(link) == primary_link && char_table[char_table_idx].list_cb != NULL)
+        char_table[char_table_idx].list_cb(str, len);
+    else
+        free(str);
+}
+
+// list_fetch done_cb: keep a copy for the next connect, then hand it on
+static void list_fetched(list_fetch_t * fetch, char * str, int len)
+{
+    ble_link_t * link = (ble_link_t *)fetch->ctx;
+
+    for (int i = 0; i < BLE_CHAR_COUNT; i++)
+    {
+        if (&link->chars[i].fetch != fetch) continue;
+
+        if (link->catalog_hash_valid) catalog_cache_save(link->bda, i, link->catalog_hash, str, len);
+        deliver_list(link, i, str, len);
+        return;
+    }
+    free(str);
+}
+
+static void load_or_fetch_list(ble_link_t * link, esp_gatt_if_t gattc_if, int char_table_idx)
+{
+    char * str;
+    uint16_t len;
+    if (catalog_cache_load(link->bda, char_table_idx, link->catalog_hash, &str, &len) == ESP_OK)
+    {
+        ESP_LOGI(GATTC_TAG, "%s unchanged, using cached copy", char_table[char_table_idx].name);
+        deliver_list(link, char_table_idx, str, len);
+        return;
+    }
+    list_fetch_start(&link->chars[char_table_idx].fetch, gattc_if, link->conn_id);
+}
+
+// Start whatever lists were waiting on the catalog hash. Without a hash
+// they're simply fetched.
+static void resolve_waiting_lists(ble_link_t * link, esp_gatt_if_t gattc_if)
+{
+    uint32_t waiting = link->lists_waiting;
+    link->lists_waiting = 0;
+
+    for (int i = 0; i < BLE_CHAR_COUNT; i++)
+    {
+        if (!(waiting & (1 << i))) continue;
+
+        if (link->catalog_hash_valid)
+            load_or_fetch_list(link, gattc_if, i);
+        else
+            list_fetch_start(&link->chars[i].fetch, gattc_if, link->conn_id);
+    }
+}
+
+// Lists come from the catalog cache unless the controller's catalog hash
+// says they've changed. The hash is read once per connection.
+static void begin_list(ble_link_t * link, esp_gatt_if_t gattc_if, int char_table_idx)
+{
+    uint16_t hash_handle = link->chars[BLE_CHAR_CATALOG_HASH].handle;
+    if (hash_handle == INVALID_HANDLE)
+    {
+        // Older controller firmware without a catalog hash
+        list_fetch_start(&link->chars[char_table_idx].fetch, gattc_if, link->conn_id);
+        return;
+    }
+
+    if (link->catalog_hash_valid)
+    {
+        load_or_fetch_list(link, gattc_if, char_table_idx);
+        return;
+    }
+
+    bool reading = (link->lists_waiting != 0);
+    link->lists_waiting |= 1 << char_table_idx;
+    if (!reading) esp_ble_gattc_read_char(gattc_if, link->conn_id, hash_handle, ESP_GATT_AUTH_REQ_NONE);
+}
+
+static void catalog_hash_received(ble_link_t * link, esp_gatt_if_t gattc_if, bool notify, const uint8_t * value, uint16_t len)
+{
+    if (len != sizeof(uint32_t))
+    {
+        ESP_LOGW(GATTC_TAG, "Ignoring bad catalog hash (len %u)", len);
+        resolve_waiting_lists(link, gattc_if);
+        return;
+    }
+    uint32_t hash = value[0] | (value[1] << 8) | (value[2] << 16) | ((uint32_t)value[3] << 24);
+    ESP_LOGI(GATTC_TAG, "Catalog hash %08x", hash);
+
+    // The controller's lists changed while connected - what's on screen is stale
+    if (notify && link->catalog_hash_valid && hash != link->catalog_hash)
+    {
+        for (int i = 0; i < BLE_CHAR_COUNT; i++)
+        {
+            if (char_table[i].type == CHAR_TYPE_LIST) link->lists_waiting |= 1 << i;
+        }
+    }
+
+    link->catalog_hash = hash;
+    link->catalog_hash_valid = true;
+    // What's shown at boot is whatever the UI was last following
+    if (link_index(link) == primary_link) catalog_cache_set_last(link->bda, hash);
+    resolve_waiting_lists(link, gattc_if);
+}
+
+// Put the last controller's lists up at boot, before anything is connected.
+// They're checked against its catalog hash once it is.
+static void load_cached_lists()
+{
+    esp_bd_addr_t bda;
+    uint32_t hash;
+    if (catalog_cache_get_last(bda, &hash) != ESP_OK) return;
+
+    for (int i = 0; i < BLE_CHAR_COUNT; i++)
+    {
+        char * str;
+        uint16_t len;
+        if (char_table[i].type != CHAR_TYPE_LIST || char_table[i].list_cb == NULL) continue;
+        if (catalog_cache_load(bda, i, hash, &str, &len) != ESP_OK) continue;
+
+        ESP_LOGI(GATTC_TAG, "Showing cached %s", char_table[i].name);
+        char_table[i].list_cb(str, len);
+    }
+}
+
+// Hand a characteristic value to the matching callback. Shared by reads and
+// notifications so both paths behave the same. List and hash traffic always
+// goes to the link it arrived on, so a fetch in flight finishes even if the
+// primary moves; only the primary link's values and lists reach the app.
+static void dispatch_value(ble_link_t * link, int char_table_idx, esp_gatt_if_t gattc_if, bool notify, const uint8_t * value, uint16_t len)
+{
+    const char_desc_t * c = &char_table[char_table_idx];
+
+    if (value == NULL) return;
+
+    if (c->type == CHAR_TYPE_LIST)
+    {
+        list_fetch_t * fetch = &link->chars[char_table_idx].fetch;
+        if (notify)
+            list_fetch_on_notify(fetch, gattc_if, link->conn_id, value, len);
+        else
+            list_fetch_on_read(fetch, value, len);
+        return;
+    }
+
+    if (c->type == CHAR_TYPE_HASH)
+    {
+        catalog_hash_received(link, gattc_if, notify, value, len);
+        return;
+    }
+
+    if (link_index(link) != primary_link) return;
+
+    if (len != 1 || *value < c->min || *value > c->max)
+    {
+        ESP_LOGW(GATTC_TAG, "Ignoring bad %s value (len %u)", c->name, len);
+        return;
+    }
+    portENTER_CRITICAL(&value_lock);
+    last_values[char_table_idx] = *value;
+    last_value_valid[char_table_idx] = true;
+    portEXIT_CRITICAL(&value_lock);
+    if (c->value_cb != NULL) c->value_cb(*value);
 }
 
 static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
@@ -247,42 +809,85 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
         ESP_LOGI(GATTC_TAG, "REG_EVT");
         esp_ble_gap_config_local_privacy(true);
         break;
-    case ESP_GATTC_OPEN_EVT:
+    case ESP_GATTC_OPEN_EVT: {
+        ble_link_t * link = opening_link;
+        opening_link = NULL;
+
         if (param->open.status != ESP_GATT_OK){
             ESP_LOGE(GATTC_TAG, "open failed, error status = %x", p_data->open.status);
+
+            // Direct connect to a bonded controller failed - go back to looking for it
+            if (link != NULL)
+            {
+                if (link->direct) skip_direct = true;
+                set_link_state(link, BLE_LINK_FREE, NULL);
+                notify_links_changed();
+            }
+            start_connecting();
             break;
         }
-        ESP_LOGI(GATTC_TAG, "open success");
-        gl_profile_tab[PROFILE_A_APP_ID].conn_id = p_data->open.conn_id;
-        memcpy(gl_profile_tab[PROFILE_A_APP_ID].remote_bda, p_data->open.remote_bda, sizeof(esp_bd_addr_t));
+        if (link == NULL)
+        {
+            ESP_LOGW(GATTC_TAG, "open with no link waiting for it, closing");
+            esp_ble_gattc_close(gattc_if, p_data->open.conn_id);
+            break;
+        }
+        ESP_LOGI(GATTC_TAG, "open success, link %d", link_index(link));
+        link->conn_id = p_data->open.conn_id;
+        set_link_state(link, BLE_LINK_DISCOVERING, p_data->open.remote_bda);
+        skip_direct = false;
         ESP_LOGI(GATTC_TAG, "REMOTE BDA:");
-        esp_log_buffer_hex(GATTC_TAG, gl_profile_tab[PROFILE_A_APP_ID].remote_bda, sizeof(esp_bd_addr_t));
+        esp_log_buffer_hex(GATTC_TAG, link->bda, sizeof(esp_bd_addr_t));
         esp_err_t mtu_ret = esp_ble_gattc_send_mtu_req (gattc_if, p_data->open.conn_id);
         if (mtu_ret){
             ESP_LOGE(GATTC_TAG, "config MTU error, error code = %x", mtu_ret);
         }
-        g_gattc_if = gattc_if;
+        write_pipeline_connected(link_index(link), gattc_if, link->conn_id);
+        ble_metrics_connected(link_index(link), link->bda);
+        conn_profile_connected(link->bda);
+        notify_links_changed();
         break;
-    case ESP_GATTC_CFG_MTU_EVT:
+    }
+    case ESP_GATTC_CFG_MTU_EVT: {
         if (param->cfg_mtu.status != ESP_GATT_OK){
             ESP_LOGE(GATTC_TAG,"config mtu failed, error status = %x", param->cfg_mtu.status);
         }
         ESP_LOGI(GATTC_TAG, "ESP_GATTC_CFG_MTU_EVT, Status %d, MTU %d, conn_id %d", param->cfg_mtu.status, param->cfg_mtu.mtu, param->cfg_mtu.conn_id);
-        esp_ble_gattc_search_service(gattc_if, param->cfg_mtu.conn_id, &remote_filter_service_uuid);
+
+        ble_link_t * link = link_for_conn_id(param->cfg_mtu.conn_id);
+        if (link == NULL) break;
+
+        ble_handle_cache_t cache;
+        if (ble_handle_cache_load(link->bda, &cache) == ESP_OK && cache.char_count == BLE_CHAR_COUNT)
+        {
+            ESP_LOGI(GATTC_TAG, "Using cached handles, skipping discovery");
+            link->cached = true;
+            for (int i = 0; i < BLE_CHAR_COUNT; i++)
+            {
+                use_char_handle(link, gattc_if, i, cache.char_handles[i], cache.cccd_handles[i]);
+            }
+            build_handle_index(link);
+            controls_live(link);
+            break;
+        }
+
+        esp_ble_gattc_search_service(gattc_if, link->conn_id, &remote_filter_service_uuid);
         break;
+    }
     case ESP_GATTC_SEARCH_RES_EVT: {
         ESP_LOGI(GATTC_TAG, "SEARCH RES: conn_id = %x is primary service %d", p_data->search_res.conn_id, p_data->search_res.is_primary);
         ESP_LOGI(GATTC_TAG, "start handle %d end handle %d current handle value %d", p_data->search_res.start_handle, p_data->search_res.end_handle, p_data->search_res.srvc_id.inst_id);
-        if (p_data->search_res.srvc_id.uuid.len == ESP_UUID_LEN_128 && memcmp(p_data->search_res.srvc_id.uuid.uuid.uuid128, &remote_filter_service_uuid.uuid.uuid128, 128/8) == 0) {
+        ble_link_t * link = link_for_conn_id(p_data->search_res.conn_id);
+        if (link != NULL && p_data->search_res.srvc_id.uuid.len == ESP_UUID_LEN_128 && memcmp(p_data->search_res.srvc_id.uuid.uuid.uuid128, &remote_filter_service_uuid.uuid.uuid128, 128/8) == 0) {
             esp_log_buffer_hex(GATTC_TAG, p_data->search_res.srvc_id.uuid.uuid.uuid128, 128/8);
             // ESP_LOGI(GATTC_TAG, "UUID16: %x", p_data->search_res.srvc_id.uuid.uuid.uuid16);
-            get_service = true;
-            gl_profile_tab[PROFILE_A_APP_ID].service_start_handle = p_data->search_res.start_handle;
-            gl_profile_tab[PROFILE_A_APP_ID].service_end_handle = p_data->search_res.end_handle;
+            link->get_service = true;
+            link->service_start_handle = p_data->search_res.start_handle;
+            link->service_end_handle = p_data->search_res.end_handle;
         }
         break;
     }
-    case ESP_GATTC_SEARCH_CMPL_EVT:
+    case ESP_GATTC_SEARCH_CMPL_EVT: {
         if (p_data->search_cmpl.status != ESP_GATT_OK){
             ESP_LOGE(GATTC_TAG, "search service failed, error status = %x", p_data->search_cmpl.status);
             break;
@@ -294,30 +899,29 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
         } else {
             ESP_LOGI(GATTC_TAG, "unknown service source");
         }
-        if (get_service){
+        ble_link_t * link = link_for_conn_id(p_data->search_cmpl.conn_id);
+        if (link != NULL && link->get_service){
             uint16_t count  = 0;
             uint16_t offset = 0;
             esp_gatt_status_t ret_status = esp_ble_gattc_get_attr_count(gattc_if,
-                                                                        gl_profile_tab[PROFILE_A_APP_ID].conn_id,
+                                                                        link->conn_id,
                                                                         ESP_GATT_DB_CHARACTERISTIC,
-                                                                        gl_profile_tab[PROFILE_A_APP_ID].service_start_handle,
-                                                                        gl_profile_tab[PROFILE_A_APP_ID].service_end_handle,
+                                                                        link->service_start_handle,
+                                                                        link->service_end_handle,
                                                                         INVALID_HANDLE,
                                                                         &count);
             if (ret_status != ESP_GATT_OK){
                 ESP_LOGE(GATTC_TAG, "esp_ble_gattc_get_attr_count error, %d", __LINE__);
             }
             if (count > 0){
-                if (char_elem_result != NULL)
-                    free(char_elem_result);
-                char_elem_result = (esp_gattc_char_elem_t *)malloc(sizeof(esp_gattc_char_elem_t) * count);
+                esp_gattc_char_elem_t *char_elem_result = (esp_gattc_char_elem_t *)malloc(sizeof(esp_gattc_char_elem_t) * count);
                 if (!char_elem_result){
                     ESP_LOGE(GATTC_TAG, "gattc no mem");
                 }else{
                     ret_status = esp_ble_gattc_get_all_char(gattc_if,
-                                                            gl_profile_tab[PROFILE_A_APP_ID].conn_id,
-                                                            gl_profile_tab[PROFILE_A_APP_ID].service_start_handle,
-                                                            gl_profile_tab[PROFILE_A_APP_ID].service_end_handle,
+                                                            link->conn_id,
+                                                            link->service_start_handle,
+                                                            link->service_end_handle,
                                                             char_elem_result,
                                                             &count,
                                                             offset);
@@ -330,97 +934,53 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
                         {
                             ESP_LOGI(GATTC_TAG, "Characteristic - handle: %u, uuid:", char_elem_result[i].char_handle);
                             esp_log_buffer_hex(GATTC_TAG, &char_elem_result[i].uuid.uuid, char_elem_result[i].uuid.len);
-                            // esp_ble_gattc_read_char(gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_elem_result[i].char_handle, ESP_GATT_AUTH_REQ_NONE);
 
                             // Keep track of all the handles relative to the UUIDs
                             // Stored in the table at known indeces so we can recall them directly
-                            for (int char_table_idx = 0; char_table_idx < IDX_CHAR_TABLE_END; char_table_idx++)
+                            for (int char_table_idx = 0; char_table_idx < BLE_CHAR_COUNT; char_table_idx++)
                             {
                                 if (compare_uuids(&char_elem_result[i].uuid, &char_table[char_table_idx].uuid))
                                 {
                                     ESP_LOGI(GATTC_TAG, "Found match in char_table at index %d\n", char_table_idx);
-                                    char_table[char_table_idx].handle = char_elem_result[i].char_handle;
+
+                                    uint16_t cccd = INVALID_HANDLE;
+                                    if (char_elem_result[i].properties & ESP_GATT_CHAR_PROP_BIT_NOTIFY)
+                                    {
+                                        cccd = find_cccd(gattc_if, link, char_elem_result[i].char_handle);
+                                    }
+                                    use_char_handle(link, gattc_if, char_table_idx, char_elem_result[i].char_handle, cccd);
                                     break;
                                 }
                             }
-
-                            // if (char_elem_result[i].uuid.len == ESP_UUID_LEN_16 && char_elem_result[i].uuid.uuid.uuid16 == REMOTE_NOTIFY_UUID && (char_elem_result[i].properties & ESP_GATT_CHAR_PROP_BIT_NOTIFY))
-                            // {
-                            //     gl_profile_tab[PROFILE_A_APP_ID].notify_char_handle = char_elem_result[i].char_handle;
-                            //     esp_ble_gattc_register_for_notify (gattc_if,
-                            //                                        gl_profile_tab[PROFILE_A_APP_ID].remote_bda,
-                            //                                        char_elem_result[i].char_handle);
-                            //     break;
-                            // }
                         }
 
+                        build_handle_index(link);
+                        save_handle_cache(link);
+
                         // Now let the caller know we're ready
-                        if (connectChangedCallback != NULL) connectChangedCallback(connect);
+                        controls_live(link);
                     }
+                    free(char_elem_result);
                 }
             }
         }
 
         break;
-    case ESP_GATTC_REG_FOR_NOTIFY_EVT: {
+    }
+    case ESP_GATTC_REG_FOR_NOTIFY_EVT:
+        // Nothing to do here - use_char_handle() writes the CCCD straight away
         if (p_data->reg_for_notify.status != ESP_GATT_OK){
             ESP_LOGE(GATTC_TAG, "reg for notify failed, error status = %x", p_data->reg_for_notify.status);
-            break;
         }
-
-            uint16_t count = 0;
-            uint16_t offset = 0;
-            uint16_t notify_en = 1;
-            esp_gatt_status_t ret_status = esp_ble_gattc_get_attr_count(gattc_if,
-                                                                        gl_profile_tab[PROFILE_A_APP_ID].conn_id,
-                                                                        ESP_GATT_DB_DESCRIPTOR,
-                                                                        gl_profile_tab[PROFILE_A_APP_ID].service_start_handle,
-                                                                        gl_profile_tab[PROFILE_A_APP_ID].service_end_handle,
-                                                                        p_data->reg_for_notify.handle,
-                                                                        &count);
-            if (ret_status != ESP_GATT_OK){
-                ESP_LOGE(GATTC_TAG, "esp_ble_gattc_get_attr_count error, %d", __LINE__);
-            }
-            if (count > 0){
-                descr_elem_result = malloc(sizeof(esp_gattc_descr_elem_t) * count);
-                if (!descr_elem_result){
-                    ESP_LOGE(GATTC_TAG, "malloc error, gattc no mem");
-                }else{
-                    ret_status = esp_ble_gattc_get_all_descr(gattc_if,
-                                                             gl_profile_tab[PROFILE_A_APP_ID].conn_id,
-                                                             p_data->reg_for_notify.handle,
-                                                             descr_elem_result,
-                                                             &count,
-                                                             offset);
-                if (ret_status != ESP_GATT_OK){
-                    ESP_LOGE(GATTC_TAG, "esp_ble_gattc_get_all_descr error, %d", __LINE__);
-                }
-
-                    for (int i = 0; i < count; ++i)
-                    {
-                        if (descr_elem_result[i].uuid.len == ESP_UUID_LEN_16 && descr_elem_result[i].uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG)
-                        {
-                            esp_ble_gattc_write_char_descr (gattc_if,
-                                                            gl_profile_tab[PROFILE_A_APP_ID].conn_id,
-                                                            descr_elem_result[i].handle,
-                                                            sizeof(notify_en),
-                                                            (uint8_t *)&notify_en,
-                                                            ESP_GATT_WRITE_TYPE_RSP,
-                                                            ESP_GATT_AUTH_REQ_NONE);
-
-                            break;
-                        }
-                    }
-                }
-                free(descr_elem_result);
-            }
-
         break;
-    }
-    case ESP_GATTC_NOTIFY_EVT:
-        ESP_LOGI(GATTC_TAG, "ESP_GATTC_NOTIFY_EVT, receive notify value:");
-        esp_log_buffer_hex(GATTC_TAG, p_data->notify.value, p_data->notify.value_len);
+    case ESP_GATTC_NOTIFY_EVT: {
+        ESP_LOGD(GATTC_TAG, "ESP_GATTC_NOTIFY_EVT - handle: %d, len: %d", p_data->notify.handle, p_data->notify.value_len);
+        ble_link_t * link = link_for_conn_id(p_data->notify.conn_id);
+        int idx = (link != NULL) ? char_for_handle(link, p_data->notify.handle) : -1;
+        if (idx >= 0)
+            dispatch_value(link, idx, gattc_if, true, p_data->notify.value, p_data->notify.value_len);
         break;
+    }
     case ESP_GATTC_WRITE_DESCR_EVT:
         if (p_data->write.status != ESP_GATT_OK){
             ESP_LOGE(GATTC_TAG, "write descr failed, error status = %x", p_data->write.status);
@@ -433,29 +993,54 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
         memcpy(bda, p_data->srvc_chg.remote_bda, sizeof(esp_bd_addr_t));
         ESP_LOGI(GATTC_TAG, "ESP_GATTC_SRVC_CHG_EVT, bd_addr:");
         esp_log_buffer_hex(GATTC_TAG, bda, sizeof(esp_bd_addr_t));
+
+        // The controller's attribute table changed, so cached handles can't be trusted
+        ble_handle_cache_erase(bda);
+        ble_link_t * link = link_for_bda(bda);
+        if (link != NULL) rediscover_link(link, gattc_if);
         break;
     }
-    case ESP_GATTC_WRITE_CHAR_EVT:
+    case ESP_GATTC_WRITE_CHAR_EVT: {
+        ble_link_t * link = link_for_conn_id(p_data->write.conn_id);
+        int idx = (link != NULL) ? char_for_handle(link, p_data->write.handle) : -1;
+        if (idx >= 0) ble_metrics_write_done(link_index(link), idx, p_data->write.status == ESP_GATT_OK);
+        if (idx >= 0 && char_table[idx].type == CHAR_TYPE_LIST) list_fetch_on_write(&link->chars[idx].fetch, p_data->write.status);
+
         if (p_data->write.status != ESP_GATT_OK){
             ESP_LOGE(GATTC_TAG, "write char failed, error status = %x", p_data->write.status);
             break;
         }
         ESP_LOGI(GATTC_TAG, "Write char success ");
         break;
-    case ESP_GATTC_DISCONNECT_EVT:
+    }
+    case ESP_GATTC_CONGEST_EVT: {
+        ESP_LOGD(GATTC_TAG, "ESP_GATTC_CONGEST_EVT, conn_id = %d, congested = %d", p_data->congest.conn_id, p_data->congest.congested);
+        ble_link_t * link = link_for_conn_id(p_data->congest.conn_id);
+        if (link != NULL) write_pipeline_set_congested(link_index(link), p_data->congest.congested);
+        break;
+    }
+    case ESP_GATTC_DISCONNECT_EVT: {
         ESP_LOGI(GATTC_TAG, "ESP_GATTC_DISCONNECT_EVT, reason = 0x%x", p_data->disconnect.reason);
-        connect = false;
-        get_service = false;
-        if (char_elem_result != NULL)
+        ble_link_t * link = link_for_conn_id(p_data->disconnect.conn_id);
+        if (link != NULL)
         {
-            free(char_elem_result);
-            char_elem_result = NULL;
+            for (int i = 0; i < BLE_CHAR_COUNT; i++)
+            {
+                if (char_table[i].type == CHAR_TYPE_LIST) list_fetch_reset(&link->chars[i].fetch);
+            }
+            unpublish_link(link);
+            write_pipeline_disconnected(link_index(link));
+            ble_metrics_disconnected(link_index(link), p_data->disconnect.reason);
+            set_link_state(link, BLE_LINK_FREE, NULL);
         }
-        if (connectChangedCallback != NULL) connectChangedCallback(connect);
-        start_scanning();
+        skip_direct = false;
+        conn_profile_disconnected(p_data->disconnect.remote_bda);
+        update_primary();
+        start_connecting();
 
         break;
-    case ESP_GATTC_READ_CHAR_EVT:
+    }
+    case ESP_GATTC_READ_CHAR_EVT: {
         // struct gattc_read_char_evt_param {
         //     esp_gatt_status_t status;       /*!< Operation status */
         //     uint16_t conn_id;               /*!< Connection id */
@@ -467,23 +1052,34 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
         if (p_data->read.value_len == 1)
             ESP_LOGI(GATTC_TAG, "                         value: %u", *p_data->read.value);
 
+        ble_link_t * link = link_for_conn_id(p_data->read.conn_id);
+        if (link == NULL) break;
 
-        // Call the appropriate callback function for the handle
-        if (char_table[IDX_CHAR_PATTERN].handle == p_data->read.handle && patternChangedCallback != NULL && p_data->read.value_len == 1)
-            patternChangedCallback((uint8_t)*p_data->read.value);
-        if (char_table[IDX_CHAR_COLOR].handle == p_data->read.handle && colorChangedCallback != NULL && p_data->read.value_len == 1)
-            colorChangedCallback((uint8_t)*p_data->read.value);
-        if (char_table[IDX_CHAR_BRIGHTNESS].handle == p_data->read.handle && brightnessChangedCallback != NULL && p_data->read.value_len == 1)
-            brightnessChangedCallback((uint8_t)*p_data->read.value);
-        if (char_table[IDX_CHAR_SPEED].handle == p_data->read.handle && speedChangedCallback != NULL && p_data->read.value_len == 1)
-            speedChangedCallback((uint8_t)*p_data->read.value);
+        if (p_data->read.status == ESP_GATT_INVALID_HANDLE)
+        {
+            // Controller's attribute table moved without a Service Changed
+            ESP_LOGW(GATTC_TAG, "Read of invalid handle, rediscovering");
+            rediscover_link(link, gattc_if);
+        }
+        int idx = char_for_handle(link, p_data->read.handle);
+        if (idx >= 0 && char_table[idx].type == CHAR_TYPE_U8) ble_metrics_read_done(link_index(link), idx, p_data->read.status == ESP_GATT_OK);
+
+        // No usable catalog hash - fall back to fetching the lists
+        if (idx == BLE_CHAR_CATALOG_HASH && p_data->read.status != ESP_GATT_OK) resolve_waiting_lists(link, gattc_if);
+        // Nothing more is coming for a list whose read failed
+        if (idx >= 0 && char_table[idx].type == CHAR_TYPE_LIST && p_data->read.status != ESP_GATT_OK)
+        {
+            ESP_LOGW(GATTC_TAG, "Read of %s failed, status %d", char_table[idx].name, p_data->read.status);
+            list_fetch_reset(&link->chars[idx].fetch);
+        }
 
-        if (char_table[IDX_CHAR_PATTERN_LIST].handle == p_data->read.handle && patternListCallback != NULL)
-            patternListCallback((const char *)p_data->read.value, p_data->read.value_len);
-        if (char_table[IDX_CHAR_COLOR_LIST].handle == p_data->read.handle && colorListCallback != NULL)
-            colorListCallback((const char *)p_data->read.value, p_data->read.value_len);
+        if (p_data->read.status != ESP_GATT_OK) break;
+
+        if (idx >= 0)
+            dispatch_value(link, idx, gattc_if, false, p_data->read.value, p_data->read.value_len);
 
         break;
+    }
     default:
         ESP_LOGI(GATTC_TAG, "gattc_profile_event_handler: Unhandled event: %d", event);
         break;
@@ -492,9 +1088,6 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
 
 static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
 {
-    uint8_t *adv_name = NULL;
-    uint8_t adv_name_len = 0;
-
     // ESP_LOGI(GATTC_TAG, "esp_gap_cb - event: %d", (int)event);
 
     switch (event) {
@@ -503,13 +1096,10 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
             ESP_LOGE(GATTC_TAG, "config local privacy failed, error code =%x", param->local_privacy_cmpl.status);
             break;
         }
-        esp_err_t scan_ret = esp_ble_gap_set_scan_params(&ble_scan_params);
-        if (scan_ret){
-            ESP_LOGE(GATTC_TAG, "set scan params error, error code = %x", scan_ret);
-        }
+        start_connecting();
         break;
     case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
-        start_scanning();
+        ble_scan_on_params_set(param->scan_param_cmpl.status);
         break;
     case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
         //scan start complete event to indicate scan start successfully or failed
@@ -521,7 +1111,7 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
         break;
     case ESP_GAP_BLE_PASSKEY_REQ_EVT:                           /* passkey request event */
         /* Call the following function to input the passkey which is displayed on the remote device */
-        esp_ble_passkey_reply(gl_profile_tab[PROFILE_A_APP_ID].remote_bda, true, 456789);
+        esp_ble_passkey_reply(param->ble_security.ble_req.bd_addr, true, 456789);
         ESP_LOGI(GATTC_TAG, "ESP_GAP_BLE_PASSKEY_REQ_EVT");
         break;
     case ESP_GAP_BLE_OOB_REQ_EVT: {
@@ -576,25 +1166,20 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
         case ESP_GAP_SEARCH_INQ_RES_EVT:
             // esp_log_buffer_hex(GATTC_TAG, scan_result->scan_rst.bda, 6);
             // ESP_LOGI(GATTC_TAG, "Searched Adv Data Len %d, Scan Response Len %d", scan_result->scan_rst.adv_data_len, scan_result->scan_rst.scan_rsp_len);
-            adv_name = esp_ble_resolve_adv_data(scan_result->scan_rst.ble_adv,
-                                                ESP_BLE_AD_TYPE_NAME_CMPL, &adv_name_len);
-            // ESP_LOGI(GATTC_TAG, "Searched Device Name Len %d", adv_name_len);
-            // esp_log_buffer_char(GATTC_TAG, adv_name, adv_name_len);
-            // ESP_LOGI(GATTC_TAG, "\n");
-            if (adv_name != NULL) {
-                if (strlen(remote_device_name) == adv_name_len && strncmp((char *)adv_name, remote_device_name, adv_name_len) == 0) {
-                    ESP_LOGI(GATTC_TAG, "searched device %s\n", remote_device_name);
-                    if (connect == false) {
-                        connect = true;
-                        // ESP_LOGI(GATTC_TAG, "connect to the remote device.");
-                        esp_ble_gap_stop_scanning();
-                        esp_ble_gattc_open(gl_profile_tab[PROFILE_A_APP_ID].gattc_if, scan_result->scan_rst.bda, scan_result->scan_rst.ble_addr_type, true);
-                        // if (connectChangedCallback != NULL) connectChangedCallback(connect);
-                    }
-                }
+            if (opening_link == NULL && ble_scan_is_match(&scan_result->scan_rst) &&
+                link_for_bda(scan_result->scan_rst.bda) == NULL) {
+                ble_link_t * link = free_link();
+                ble_scan_stop();
+                if (link == NULL) break;
+
+                ESP_LOGI(GATTC_TAG, "searched device %s\n", remote_device_name);
+                // ESP_LOGI(GATTC_TAG, "connect to the remote device.");
+                open_link(link, scan_result->scan_rst.bda, scan_result->scan_rst.ble_addr_type, false);
             }
             break;
         case ESP_GAP_SEARCH_INQ_CMPL_EVT:
+            // Scan window ran out without finding the controller
+            ble_scan_on_complete();
             break;
         default:
             break;
@@ -609,6 +1194,33 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
         }
         ESP_LOGI(GATTC_TAG, "Stop scan successfully");
         break;
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+        ESP_LOGI(GATTC_TAG, "update conn params: status = %d, conn_int = %d, latency = %d, timeout = %d",
+                 param->update_conn_params.status,
+                 param->update_conn_params.conn_int,
+                 param->update_conn_params.latency,
+                 param->update_conn_params.timeout);
+        if (param->update_conn_params.status == ESP_BT_STATUS_SUCCESS)
+        {
+            ble_link_t * link = link_for_bda(param->update_conn_params.bda);
+            if (link != NULL)
+            {
+                write_pipeline_set_conn_interval(link_index(link), param->update_conn_params.conn_int);
+                ble_metrics_conn_params(link_index(link), param->update_conn_params.conn_int,
+                                        param->update_conn_params.latency,
+                                        param->update_conn_params.timeout);
+            }
+            conn_profile_params_updated(param->update_conn_params.conn_int,
+                                        param->update_conn_params.latency,
+                                        param->update_conn_params.timeout);
+        }
+        break;
+    case ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT:
+        if (param->read_rssi_cmpl.status == ESP_BT_STATUS_SUCCESS)
+        {
+            ble_metrics_rssi(param->read_rssi_cmpl.remote_addr, param->read_rssi_cmpl.rssi);
+        }
+        break;
 
     default:
         ESP_LOGI(GATTC_TAG, "esp_gap_cb: Unhandled event: %d", event);
@@ -657,6 +1269,8 @@ void init_gatt_client()
     }
     ESP_ERROR_CHECK( ret );
 
+    load_cached_lists();
+
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
 
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
@@ -703,7 +1317,13 @@ void init_gatt_client()
         ESP_LOGE(GATTC_TAG, "%s gattc app register error, error code = %x\n", __func__, ret);
     }
 
-    ret = esp_ble_gatt_set_local_mtu(200);
+    write_pipeline_init();
+    ble_metrics_init();
+    conn_profile_init();
+    ble_scan_init(&remote_filter_service_uuid, remote_device_name);
+
+    // Bigger MTU means fewer chunks when fetching the lists
+    ret = esp_ble_gatt_set_local_mtu(ESP_GATT_MAX_MTU_SIZE);
     if (ret){
         ESP_LOGE(GATTC_TAG, "set local  MTU failed, error code = %x", ret);
     }
@@ -728,94 +1348,75 @@ void init_gatt_client()
     esp_ble_gap_set_security_param(ESP_BLE_SM_SET_RSP_KEY, &rsp_key, sizeof(uint8_t));
 }
 
-void SetPatternChangedCallback(ValueChangedCb fn) { patternChangedCallback = fn; }
-void SetColorChangedCallback(ValueChangedCb fn) { colorChangedCallback = fn; }
-void SetBrightnessChangedCallback(ValueChangedCb fn) { brightnessChangedCallback = fn; }
-void SetSpeedChangedCallback(ValueChangedCb fn) { speedChangedCallback = fn; }
+void SetValueChangedCallback(ble_char_id_t id, ValueChangedCb fn)
+{
+    if (id < BLE_CHAR_COUNT && char_table[id].type == CHAR_TYPE_U8) char_table[id].value_cb = fn;
+}
 
-void SetPatternListCallback(StrListRecdCb fn) { patternListCallback = fn; }
-void SetColorListCallback(StrListRecdCb fn) { colorListCallback = fn; }
+void SetListCallback(ble_char_id_t id, StrListRecdCb fn)
+{
+    if (id < BLE_CHAR_COUNT && char_table[id].type == CHAR_TYPE_LIST) char_table[id].list_cb = fn;
+}
+
+void SetListProgressCallback(ListProgressCb fn) { list_fetch_set_progress_cb(fn); }
 
 void SetConnectChangedCallback(ConnectChangedCb fn) { connectChangedCallback = fn; }
 
+void SetLinksChangedCallback(LinksChangedCb fn) { linksChangedCallback = fn; }
 
-void SetPatternIdx(uint8_t index)
+uint32_t GetLastConnectTimeMs(bool * used_cache)
 {
-    if (connect)
-    {
-        esp_ble_gattc_write_char(g_gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_table[IDX_CHAR_PATTERN].handle, 1, &index, ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
-    }
+    if (used_cache != NULL) *used_cache = last_connect_fast;
+    return last_connect_ms;
 }
 
-void SetColorIdx(uint8_t index)
+void GetLinkInfo(ble_link_info_t * info)
 {
-    if (connect)
+    portENTER_CRITICAL(&value_lock);
+    for (int i = 0; i < BLE_MAX_LINKS; i++)
     {
-        esp_ble_gattc_write_char(g_gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_table[IDX_CHAR_COLOR].handle, 1, &index, ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
+        info[i].state = links[i].state;
+        memcpy(info[i].bda, links[i].bda, sizeof(info[i].bda));
+        info[i].primary = (i == primary_link);
     }
+    portEXIT_CRITICAL(&value_lock);
 }
 
-void SetBrightness(uint8_t brightness)
-{
-    if (connect)
-    {
-        esp_ble_gattc_write_char(g_gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_table[IDX_CHAR_BRIGHTNESS].handle, 1, &brightness, ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
-    }
-}
 
-void SetSpeed(uint8_t speed)
+void SetValue(ble_char_id_t id, uint8_t value)
 {
-    if (connect)
-    {
-        esp_ble_gattc_write_char(g_gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_table[IDX_CHAR_SPEED].handle, 1, &speed, ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
-    }
-}
+    if (id >= BLE_CHAR_COUNT || char_table[id].type != CHAR_TYPE_U8) return;
+    if (value < char_table[id].min || value > char_table[id].max) return;
 
-void BeginReadCurPattern()
-{
-    if (connect)
-    {
-        esp_ble_gattc_read_char(g_gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_table[IDX_CHAR_PATTERN].handle, ESP_GATT_AUTH_REQ_NONE);
-    }
-}
+    uint16_t handles[BLE_MAX_LINKS];
 
-void BeginReadCurColor()
-{
-    if (connect)
-    {
-        esp_ble_gattc_read_char(g_gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_table[IDX_CHAR_COLOR].handle, ESP_GATT_AUTH_REQ_NONE);
-    }
-}
+    portENTER_CRITICAL(&value_lock);
+    last_values[id] = value;
+    last_value_valid[id] = true;
+    for (int i = 0; i < BLE_MAX_LINKS; i++)
+        handles[i] = live_handles[i][id];
+    portEXIT_CRITICAL(&value_lock);
 
-void BeginReadBrightness()
-{
-    if (connect)
+    // Every controller gets it; the pipeline sends them back to back on its next flush
+    for (int i = 0; i < BLE_MAX_LINKS; i++)
     {
-        esp_ble_gattc_read_char(g_gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_table[IDX_CHAR_BRIGHTNESS].handle, ESP_GATT_AUTH_REQ_NONE);
+        if (handles[i] != INVALID_HANDLE) write_pipeline_set(i, id, handles[i], value);
     }
 }
 
-void BeginReadSpeed()
+void BeginRead(ble_char_id_t id)
 {
-    if (connect)
-    {
-        esp_ble_gattc_read_char(g_gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_table[IDX_CHAR_SPEED].handle, ESP_GATT_AUTH_REQ_NONE);
-    }
-}
+    int primary = primary_link;
+    if (primary < 0 || id >= BLE_CHAR_COUNT) return;
 
-void BeginReadPatterns()
-{
-    if (connect)
-    {
-        esp_ble_gattc_read_char(g_gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_table[IDX_CHAR_PATTERN_LIST].handle, ESP_GATT_AUTH_REQ_NONE);
-    }
-}
+    ble_link_t * link = &links[primary];
+    esp_gatt_if_t gattc_if = gl_profile_tab[PROFILE_A_APP_ID].gattc_if;
 
-void BeginReadColors()
-{
-    if (connect)
+    if (char_table[id].type == CHAR_TYPE_LIST)
+        begin_list(link, gattc_if, id);
+    else
     {
-        esp_ble_gattc_read_char(g_gattc_if, gl_profile_tab[PROFILE_A_APP_ID].conn_id, char_table[IDX_CHAR_COLOR_LIST].handle, ESP_GATT_AUTH_REQ_NONE);
+        ble_metrics_read_sent(primary, id);
+        esp_ble_gattc_read_char(gattc_if, link->conn_id, link->chars[id].handle, ESP_GATT_AUTH_REQ_NONE);
     }
 }
-
@@ -7,33 +7,66 @@ extern "C" {
 #endif
 
 
+// Controller characteristics, in the order of the char_table
+typedef enum
+{
+    BLE_CHAR_PATTERN,
+    BLE_CHAR_COLOR,
+    BLE_CHAR_BRIGHTNESS,
+    BLE_CHAR_SPEED,
+    BLE_CHAR_PATTERN_LIST,
+    BLE_CHAR_COLOR_LIST,
+    BLE_CHAR_CATALOG_HASH,      // Changes whenever either list does
+
+    BLE_CHAR_COUNT,
+} ble_char_id_t;
+
+// Controllers that can be driven at once. Every live controller gets each
+// write; values and lists are read from the primary one.
+#define BLE_MAX_LINKS   4
+
+typedef enum
+{
+    BLE_LINK_FREE,
+    BLE_LINK_OPENING,
+    BLE_LINK_DISCOVERING,
+    BLE_LINK_LIVE,
+} ble_link_state_t;
+
+typedef struct ble_link_info_t
+{
+    ble_link_state_t state;
+    uint8_t bda[6];
+    bool primary;
+} ble_link_info_t;
+
 typedef void (*ValueChangedCb)(uint8_t value);
-typedef void (*StrListRecdCb)(const char * str, int strlen);
+// str is malloc'd and NUL-terminated; ownership passes to the callee
+typedef void (*StrListRecdCb)(char * str, int strlen);
+typedef void (*ListProgressCb)(const char * name, uint16_t received, uint16_t total);
+// Called when the primary controller changes; false once none are left
 typedef void (*ConnectChangedCb)(bool connected);
+typedef void (*LinksChangedCb)();
 
 void init_gatt_client();
 
-void SetPatternChangedCallback(ValueChangedCb fn);
-void SetColorChangedCallback(ValueChangedCb fn);
-void SetBrightnessChangedCallback(ValueChangedCb fn);
-void SetSpeedChangedCallback(ValueChangedCb fn);
-
-void SetPatternListCallback(StrListRecdCb fn);
-void SetColorListCallback(StrListRecdCb fn);
+void SetValueChangedCallback(ble_char_id_t id, ValueChangedCb fn);
+void SetListCallback(ble_char_id_t id, StrListRecdCb fn);
+void SetListProgressCallback(ListProgressCb fn);
 
 void SetConnectChangedCallback(ConnectChangedCb fn);
+void SetLinksChangedCallback(LinksChangedCb fn);
+
+// Fills in BLE_MAX_LINKS entries
+void GetLinkInfo(ble_link_info_t * info);
+
+// Time from starting to connect until the controls were usable, for the last connection
+uint32_t GetLastConnectTimeMs(bool * used_cache);
 
-void SetPatternIdx(uint8_t index);
-void SetColorIdx(uint8_t index);
-void SetBrightness(uint8_t brightness);
-void SetSpeed(uint8_t speed);
-
-void BeginReadCurPattern();
-void BeginReadCurColor();
-void BeginReadBrightness();
-void BeginReadSpeed();
-void BeginReadPatterns();
-void BeginReadColors();
+// Queue a write of a single byte characteristic to every live controller
+void SetValue(ble_char_id_t id, uint8_t value);
+// Values arrive through the callbacks above
+void BeginRead(ble_char_id_t id);
 
 #ifdef __cplusplus
 }
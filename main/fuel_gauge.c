@@ -0,0 +1,237 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "nvs.h"
+#include "esp_log.h"
+#include "fuel_gauge.h"
+
+#define FUEL_TAG            "FUEL"
+#define FUEL_NAMESPACE      "fuel"
+#define FUEL_KEY            "capacity"
+#define FUEL_VERSION        1
+
+// One coulomb count is 65536 * 0.5mA for one ADC period; in uAh that's
+// COUNT_NUM / COUNT_DEN, kept as a ratio so nothing is lost per sample
+#define COUNT_NUM           (32768LL * 1000)
+#define COUNT_DEN           (3600LL * FUEL_GAUGE_ADC_RATE_HZ)
+
+#define REST_MA             30      // Below this the corrected voltage is close to the real OCV
+#define REST_SHIFT          5       // Voltage weight 1/32 per sample at rest...
+#define LOAD_SHIFT          9       // ...and 1/512 under load or charging
+
+#define FULL_MV             4150    // Full: at least this, on external power, charge tapered off
+#define FULL_TAPER_MA       15
+#define LEARN_LOW_PERMILLE  150     // Learn capacity once a run from full gets this low
+#define MAX_SAMPLE_COUNTS   1000    // More than this in one sample means the counter was reset
+
+// Resting cell voltage -> state of charge, for a typical LiPo
+static const struct
+{
+    int16_t mv;
+    int16_t permille;
+} ocv_table[] = {
+    { 3300, 0 }, { 3500, 30 }, { 3600, 80 }, { 3680, 150 }, { 3730, 250 },
+    { 3770, 350 }, { 3800, 450 }, { 3840, 550 }, { 3900, 650 }, { 3970, 750 },
+    { 4050, 850 }, { 4130, 950 }, { 4190, 1000 },
+};
+#define OCV_POINTS (sizeof(ocv_table) / sizeof(ocv_table[0]))
+
+typedef struct
+{
+    uint8_t version;
+    uint8_t reserved[3];
+    uint32_t capacity_uah;
+    uint32_t learned_cycles;
+} saved_t;
+
+// Updated on the telemetry task only
+static bool started = false;
+static uint32_t last_charge;
+static uint32_t last_discharge;
+static int64_t count_carry;         // Remainder of the last count -> uAh conversion
+static int32_t remaining_uah;
+static uint32_t capacity_uah = FUEL_GAUGE_DESIGN_CAPACITY_UAH;
+static uint32_t learned_cycles;
+static int32_t avg_ma_q4;           // Net discharge current, 4 fractional bits
+
+static bool full_anchor = false;    // Seen full since the last learn
+static int32_t since_full_uah;
+
+// Readers copy out under a sequence counter, as power_telemetry does
+static fuel_gauge_status_t published;
+static atomic_uint seq;
+
+static int32_t ocv_permille(int32_t mv)
+{
+    if (mv <= ocv_table[0].mv) return 0;
+    if (mv >= ocv_table[OCV_POINTS - 1].mv) return 1000;
+
+    size_t i = 1;
+    while (ocv_table[i].mv < mv) i++;
+
+    int32_t dmv = ocv_table[i].mv - ocv_table[i - 1].mv;
+    int32_t dp = ocv_table[i].permille - ocv_table[i - 1].permille;
+    return ocv_table[i - 1].permille + (mv - ocv_table[i - 1].mv) * dp / dmv;
+}
+
+static void save_capacity()
+{
+    saved_t saved;
+    memset(&saved, 0, sizeof(saved));
+    saved.version = FUEL_VERSION;
+    saved.capacity_uah = capacity_uah;
+    saved.learned_cycles = learned_cycles;
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(FUEL_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(nvs, FUEL_KEY, &saved, sizeof(saved));
+        if (err == ESP_OK) err = nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+
+    if (err != ESP_OK) ESP_LOGE(FUEL_TAG, "Saving capacity failed: %s", esp_err_to_name(err));
+}
+
+void fuel_gauge_init()
+{
+    // Start over from the voltage on the next sample
+    started = false;
+    count_carry = 0;
+    full_anchor = false;
+    capacity_uah = FUEL_GAUGE_DESIGN_CAPACITY_UAH;
+    learned_cycles = 0;
+
+    atomic_fetch_add(&seq, 1);
+    memset(&published, 0, sizeof(published));
+    atomic_fetch_add(&seq, 1);
+
+    nvs_handle_t nvs;
+    if (nvs_open(FUEL_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) return;
+
+    saved_t saved;
+    size_t len = sizeof(saved);
+    esp_err_t err = nvs_get_blob(nvs, FUEL_KEY, &saved, &len);
+    nvs_close(nvs);
+
+    // Ignore anything far enough from the design value to be nonsense
+    if (err == ESP_OK && len == sizeof(saved) && saved.version == FUEL_VERSION &&
+        saved.capacity_uah >= FUEL_GAUGE_DESIGN_CAPACITY_UAH / 2 &&
+        saved.capacity_uah <= FUEL_GAUGE_DESIGN_CAPACITY_UAH * 3 / 2)
+    {
+        capacity_uah = saved.capacity_uah;
+        learned_cycles = saved.learned_cycles;
+        ESP_LOGI(FUEL_TAG, "Capacity %u uAh, learned over %u cycles", capacity_uah, learned_cycles);
+    }
+}
+
+// A run from full to LEARN_LOW_PERMILLE shows how much the whole battery holds
+static void learn_capacity(int32_t low_permille)
+{
+    int64_t learned = (int64_t)since_full_uah * 1000 / (1000 - low_permille);
+    full_anchor = false;
+
+    if (learned < FUEL_GAUGE_DESIGN_CAPACITY_UAH / 2 || learned > FUEL_GAUGE_DESIGN_CAPACITY_UAH * 3 / 2)
+    {
+        ESP_LOGW(FUEL_TAG, "Ignoring learned capacity of %lld uAh", learned);
+        return;
+    }
+
+    uint32_t old = capacity_uah;
+    capacity_uah = (int64_t)capacity_uah + (learned - (int64_t)capacity_uah) / 4;
+    learned_cycles++;
+    ESP_LOGI(FUEL_TAG, "Capacity %u -> %u uAh (run measured %lld)", old, capacity_uah, learned);
+
+    save_capacity();
+}
+
+static void publish(bool charging)
+{
+    fuel_gauge_status_t s;
+    s.valid = true;
+    s.capacity_uah = capacity_uah;
+    s.learned_cycles = learned_cycles;
+    s.soc_permille = (int64_t)remaining_uah * 1000 / capacity_uah;
+
+    int32_t avg_ma = avg_ma_q4 / 16;
+    // The average takes a few samples to turn when the charger is plugged in
+    s.time_to_empty_min = (avg_ma > 0 && !charging) ? (int64_t)remaining_uah * 60 / ((int64_t)avg_ma * 1000) : -1;
+
+    atomic_fetch_add(&seq, 1);
+    published = s;
+    atomic_fetch_add(&seq, 1);
+}
+
+void fuel_gauge_update(const fuel_gauge_input_t * in)
+{
+    int32_t net_ma = in->discharge_ma - in->charge_ma;
+    int32_t ocv_mv = in->battery_mv + net_ma * FUEL_GAUGE_RESISTANCE_MOHM / 1000;
+    int32_t soc_ocv = ocv_permille(ocv_mv);
+    int32_t ocv_uah = (int64_t)soc_ocv * capacity_uah / 1000;
+
+    if (!started)
+    {
+        // Nothing better than the voltage to start from
+        started = true;
+        last_charge = in->coulomb_charge;
+        last_discharge = in->coulomb_discharge;
+        remaining_uah = ocv_uah;
+        avg_ma_q4 = net_ma * 16;
+        publish(net_ma < 0);
+        return;
+    }
+
+    // Unsigned differences, so counter wrap is harmless
+    int32_t counts = (int32_t)(in->coulomb_discharge - last_discharge) - (int32_t)(in->coulomb_charge - last_charge);
+    last_charge = in->coulomb_charge;
+    last_discharge = in->coulomb_discharge;
+    if (counts > MAX_SAMPLE_COUNTS || counts < -MAX_SAMPLE_COUNTS) counts = 0;
+
+    int64_t num = (int64_t)counts * COUNT_NUM + count_carry;
+    int32_t used_uah = num / COUNT_DEN;
+    count_carry = num % COUNT_DEN;
+
+    remaining_uah -= used_uah;
+    if (full_anchor) since_full_uah += used_uah;
+
+    // Pull towards the voltage estimate, harder when the voltage can be trusted
+    int32_t shift = (net_ma >= 0 && net_ma < REST_MA) ? REST_SHIFT : LOAD_SHIFT;
+    remaining_uah += (ocv_uah - remaining_uah) / (1 << shift);
+
+    if (in->battery_mv >= FULL_MV && in->discharge_ma == 0 && in->charge_ma <= FULL_TAPER_MA)
+    {
+        remaining_uah = capacity_uah;
+        full_anchor = true;
+        since_full_uah = 0;
+    }
+    else if (full_anchor && in->charge_ma > FULL_TAPER_MA)
+    {
+        // Topped up part way down; this run can't be measured
+        full_anchor = false;
+    }
+    else if (full_anchor && soc_ocv <= LEARN_LOW_PERMILLE)
+    {
+        learn_capacity(soc_ocv);
+    }
+
+    if (remaining_uah < 0) remaining_uah = 0;
+    if (remaining_uah > (int32_t)capacity_uah) remaining_uah = capacity_uah;
+
+    avg_ma_q4 += (net_ma * 16 - avg_ma_q4) / 8;
+
+    publish(net_ma < 0);
+}
+
+void fuel_gauge_get(fuel_gauge_status_t * status)
+{
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        unsigned int start_seq = atomic_load(&seq);
+        if (start_seq & 1) continue;
+
+        *status = published;
+        if (atomic_load(&seq) == start_seq) return;
+    }
+
+    memset(status, 0, sizeof(*status));
+}
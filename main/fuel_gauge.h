@@ -0,0 +1,53 @@
+#ifndef FUEL_GAUGE_H
+#define FUEL_GAUGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Battery state of charge from the AXP192 coulomb counter, pulled slowly
+// towards the cell's open circuit voltage curve so counter drift can't build
+// up. The terminal voltage is corrected for the drop across the cell's
+// internal resistance before it's looked up. Integer math only; it runs on
+// every telemetry sample.
+//
+// Capacity starts at the design value. It is re-learned whenever the battery
+// runs from a full charge down near empty, and kept in NVS.
+
+#define FUEL_GAUGE_DESIGN_CAPACITY_UAH  390000  // M5Core2 internal cell
+#define FUEL_GAUGE_RESISTANCE_MOHM      200     // Cell, protection and wiring
+#define FUEL_GAUGE_ADC_RATE_HZ          25      // AXP192 default; sets the size of a coulomb count
+
+typedef struct fuel_gauge_input_t
+{
+    int32_t battery_mv;
+    int32_t charge_ma;
+    int32_t discharge_ma;
+    uint32_t coulomb_charge;        // Raw AXP192 counters
+    uint32_t coulomb_discharge;
+} fuel_gauge_input_t;
+
+typedef struct fuel_gauge_status_t
+{
+    bool valid;                     // False until the first sample
+    uint16_t soc_permille;
+    int32_t time_to_empty_min;      // -1 while charging
+    uint32_t capacity_uah;
+    uint32_t learned_cycles;        // Full-to-empty runs the capacity was learned from
+} fuel_gauge_status_t;
+
+// Loads the learned capacity. Estimation starts over from the next sample.
+void fuel_gauge_init();
+// Not reentrant; call from one task (the telemetry task)
+void fuel_gauge_update(const fuel_gauge_input_t * in);
+// Safe from any task
+void fuel_gauge_get(fuel_gauge_status_t * status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
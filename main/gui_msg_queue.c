@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "gui_msg_queue.h"
+
+// Value slots hold the newest value with SLOT_PENDING set until the GUI
+// thread takes it. Swapping the whole word means a post can never be lost
+// between the drain reading a slot and clearing it.
+#define SLOT_PENDING    0x80000000u
+
+static atomic_uint value_slot[GUI_MSG_TYPE_COUNT];
+
+// List slots hold a malloc'd message, NULL when there's nothing new
+static _Atomic(gui_msg_t *) list_slot[GUI_MSG_TYPE_COUNT];
+
+static atomic_uint dropped_count = 0;
+static atomic_uint coalesced_count = 0;
+
+static bool is_list(gui_msg_type_t type)
+{
+	return (type == GUI_MSG_PATTERN_LIST || type == GUI_MSG_COLOR_LIST);
+}
+
+static void free_list(gui_msg_t * msg)
+{
+	if (msg == NULL) return;
+	free(msg->list.str);
+	free(msg);
+}
+
+bool gui_msg_post(const gui_msg_t * msg)
+{
+	if (msg->type >= GUI_MSG_TYPE_COUNT) return false;
+
+	if (is_list(msg->type))
+	{
+		gui_msg_t * copy = malloc(sizeof(*copy));
+		if (copy == NULL)
+		{
+			free(msg->list.str);
+			atomic_fetch_add_explicit(&dropped_count, 1, memory_order_relaxed);
+			return false;
+		}
+		*copy = *msg;
+
+		gui_msg_t * old = atomic_exchange_explicit(&list_slot[msg->type], copy, memory_order_acq_rel);
+		if (old != NULL)
+		{
+			free_list(old);
+			atomic_fetch_add_explicit(&coalesced_count, 1, memory_order_relaxed);
+		}
+		return true;
+	}
+
+	uint32_t value = (msg->type == GUI_MSG_CONNECTED) ? msg->connected : msg->value;
+	uint32_t old = atomic_exchange_explicit(&value_slot[msg->type], SLOT_PENDING | value, memory_order_acq_rel);
+	if (old & SLOT_PENDING) atomic_fetch_add_explicit(&coalesced_count, 1, memory_order_relaxed);
+	return true;
+}
+
+bool gui_msg_post_value(gui_msg_type_t type, uint8_t value)
+{
+	gui_msg_t msg = { .type = type, .value = value };
+	return gui_msg_post(&msg);
+}
+
+bool gui_msg_post_list(gui_msg_type_t type, char * str, uint16_t len)
+{
+	gui_msg_t msg = { .type = type };
+
+	msg.list.str = str;
+	msg.list.len = len;
+
+	return gui_msg_post(&msg);
+}
+
+uint32_t gui_msg_drain(gui_msg_handler_t handler)
+{
+	uint32_t applied = 0;
+
+	for (int type = 0; type < GUI_MSG_TYPE_COUNT; type++)
+	{
+		if (is_list(type))
+		{
+			gui_msg_t * msg = atomic_exchange_explicit(&list_slot[type], NULL, memory_order_acq_rel);
+			if (msg == NULL) continue;
+
+			if (handler != NULL) handler(msg);
+			free_list(msg);
+		}
+		else
+		{
+			uint32_t slot = atomic_exchange_explicit(&value_slot[type], 0, memory_order_acq_rel);
+			if (!(slot & SLOT_PENDING)) continue;
+
+			gui_msg_t msg = { .type = (gui_msg_type_t) type };
+			if (type == GUI_MSG_CONNECTED)
+				msg.connected = (slot & 1) != 0;
+			else
+				msg.value = slot & 0xFF;
+
+			if (handler != NULL) handler(&msg);
+		}
+		applied++;
+	}
+
+	return applied;
+}
+
+uint32_t gui_msg_dropped_count()
+{
+	return atomic_load_explicit(&dropped_count, memory_order_relaxed);
+}
+
+uint32_t gui_msg_coalesced_count()
+{
+	return atomic_load_explicit(&coalesced_count, memory_order_relaxed);
+}
@@ -0,0 +1,69 @@
+#ifndef GUI_MSG_QUEUE_H
+#define GUI_MSG_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// State updates passed from the BLE callbacks (Bluedroid BTC task, core 0) to
+// the GUI thread (core 1). Lock-free.
+//
+// The GUI only cares about the latest state, so each type has one slot that
+// a post overwrites. Nothing can fill up, and a burst of notifies can't push
+// out a connection change.
+//
+// The order of the enum is the order updates are applied in when the queue
+// is drained, so lists land before the indexes that refer into them.
+typedef enum
+{
+	GUI_MSG_CONNECTED,
+	GUI_MSG_LINKS,              // No payload, read GetLinkInfo()
+	GUI_MSG_PATTERN_LIST,
+	GUI_MSG_COLOR_LIST,
+	GUI_MSG_PATTERN,
+	GUI_MSG_COLOR,
+	GUI_MSG_BRIGHTNESS,
+	GUI_MSG_SPEED,
+
+	GUI_MSG_TYPE_COUNT,
+} gui_msg_type_t;
+
+typedef struct gui_msg_t
+{
+	gui_msg_type_t type;
+	union
+	{
+		uint8_t value;          // GUI_MSG_PATTERN .. GUI_MSG_SPEED
+		bool connected;         // GUI_MSG_CONNECTED
+		struct
+		{
+			char * str;         // malloc'd, owned by the queue once posted
+			uint16_t len;
+		} list;                 // GUI_MSG_*_LIST
+	};
+} gui_msg_t;
+
+// A handler may take ownership of a list payload by setting list.str to NULL
+typedef void (*gui_msg_handler_t)(gui_msg_t * msg);
+
+// Producer side. Returns false (and frees any list payload) only if a list
+// couldn't be allocated a slot entry.
+bool gui_msg_post(const gui_msg_t * msg);
+bool gui_msg_post_value(gui_msg_type_t type, uint8_t value);
+bool gui_msg_post_list(gui_msg_type_t type, char * str, uint16_t len);   // Takes ownership of str
+
+// Consumer side. Calls handler once with the newest message of each type
+// posted since the last drain. Returns the number of messages applied.
+uint32_t gui_msg_drain(gui_msg_handler_t handler);
+
+uint32_t gui_msg_dropped_count();
+uint32_t gui_msg_coalesced_count();
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
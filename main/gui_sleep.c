@@ -0,0 +1,21 @@
+#include "gui_sleep.h"
+
+static uint32_t min_u32(uint32_t a, uint32_t b)
+{
+	return (a < b) ? a : b;
+}
+
+uint32_t gui_ms_until(uint32_t deadline, uint32_t now)
+{
+	return (now >= deadline) ? 0 : (deadline - now);
+}
+
+uint32_t gui_sleep_ms(const gui_wake_sources_t * sources)
+{
+	uint32_t ms = GUI_MAX_SLEEP_MS;
+	ms = min_u32(ms, sources->lvgl_ms);
+	ms = min_u32(ms, sources->display_ms);
+	ms = min_u32(ms, sources->backlight_ms);
+	ms = min_u32(ms, sources->diag_ms);
+	return ms;
+}
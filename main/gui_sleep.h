@@ -0,0 +1,37 @@
+#ifndef GUI_SLEEP_H
+#define GUI_SLEEP_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DIAG_UPDATE_PERIOD_MS              500
+
+// Longest the GUI task sleeps even when nothing has a deadline
+#define GUI_MAX_SLEEP_MS                   1000
+
+// What the GUI task has to wake up for next, each in ms from now. UINT32_MAX
+// means that source has nothing scheduled.
+typedef struct gui_wake_sources_t
+{
+	uint32_t lvgl_ms;           // lv_task_handler(): next LVGL task (refresh, anims, indev)
+	uint32_t display_ms;        // display_buffer_poll(): 0 while a benchmark is stepping
+	uint32_t backlight_ms;      // backlight_update(): next dim/off stage or power off
+	uint32_t diag_ms;           // Next refresh of the diagnostic rows
+} gui_wake_sources_t;
+
+// ms from now until deadline, 0 once it has passed
+uint32_t gui_ms_until(uint32_t deadline, uint32_t now);
+
+// How long the GUI task can sleep: until the earliest source is due, capped at
+// GUI_MAX_SLEEP_MS. Touch interrupts and BLE updates cut the sleep short, so
+// they don't appear here.
+uint32_t gui_sleep_ms(const gui_wake_sources_t * sources);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GUI_SLEEP_H
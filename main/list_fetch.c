@@ -0,0 +1,312 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "list_fetch.h"
+
+#define LIST_TAG "LIST"
+
+static ListFetchProgressCb progressCallback = NULL;
+
+// The timeout runs on the esp_timer task while the BTC task carries on with
+// the fetch. Whichever of them switches a fetch to reading, or finishes it,
+// does so under this lock, so a late chunk and the timeout can't both act.
+static portMUX_TYPE fetch_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void list_fetch_set_progress_cb(ListFetchProgressCb fn) { progressCallback = fn; }
+
+static esp_err_t request_from(list_fetch_t * fetch, esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t offset)
+{
+    uint8_t req[2] = { offset & 0xFF, offset >> 8 };
+
+    return esp_ble_gattc_write_char(gattc_if, conn_id, fetch->handle, sizeof(req), req, ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+}
+
+// Switches a busy fetch over to a read. False if it isn't busy, or something
+// else already did.
+static bool claim_read(list_fetch_t * fetch, bool give_up_chunks)
+{
+    portENTER_CRITICAL(&fetch_lock);
+    bool claimed = fetch->busy && !fetch->reading;
+    if (claimed)
+    {
+        fetch->reading = true;
+        if (give_up_chunks) fetch->chunks_failed = true;
+    }
+    portEXIT_CRITICAL(&fetch_lock);
+
+    return claimed;
+}
+
+static esp_err_t read_whole(list_fetch_t * fetch)
+{
+    return esp_ble_gattc_read_char(fetch->gattc_if, fetch->conn_id, fetch->handle, ESP_GATT_AUTH_REQ_NONE);
+}
+
+// The controller doesn't seem to do the offset protocol; stop asking it to
+// for the rest of the connection
+static void fall_back(list_fetch_t * fetch)
+{
+    if (claim_read(fetch, true)) read_whole(fetch);
+}
+
+// esp_timer task. Only touches the fields under fetch_lock, and the ones
+// that are fixed while the fetch is busy; never the timer itself, which the
+// BTC task may be deleting.
+static void fetch_timeout(void * arg)
+{
+    list_fetch_t * fetch = (list_fetch_t *) arg;
+
+    // A chunk may have pushed the deadline out while this was on its way, or
+    // the fetch finished and another one started
+    portENTER_CRITICAL(&fetch_lock);
+    bool expired = fetch->busy && !fetch->reading && esp_timer_get_time() >= fetch->deadline_us;
+    if (expired)
+    {
+        fetch->reading = true;
+        fetch->chunks_failed = true;
+    }
+    portEXIT_CRITICAL(&fetch_lock);
+
+    if (!expired) return;
+
+    ESP_LOGW(LIST_TAG, "%s: no chunk for %u ms, reading instead", fetch->name, LIST_FETCH_TIMEOUT_MS);
+    read_whole(fetch);
+}
+
+// (Re)starts the timeout. Called at the start of a fetch and on every in-order chunk.
+static void arm_timeout(list_fetch_t * fetch)
+{
+    if (fetch->timer == NULL)
+    {
+        const esp_timer_create_args_t args = {
+            .callback = fetch_timeout,
+            .arg = fetch,
+            .name = "list_fetch"
+        };
+        if (esp_timer_create(&args, &fetch->timer) != ESP_OK)
+        {
+            fetch->timer = NULL;
+            return;
+        }
+    }
+
+    portENTER_CRITICAL(&fetch_lock);
+    fetch->deadline_us = esp_timer_get_time() + LIST_FETCH_TIMEOUT_MS * 1000;
+    portEXIT_CRITICAL(&fetch_lock);
+
+    esp_timer_stop(fetch->timer);
+    esp_timer_start_once(fetch->timer, LIST_FETCH_TIMEOUT_MS * 1000);
+}
+
+static void disarm_timeout(list_fetch_t * fetch)
+{
+    if (fetch->timer == NULL) return;
+
+    esp_timer_stop(fetch->timer);
+    esp_timer_delete(fetch->timer);
+    fetch->timer = NULL;
+}
+
+static void set_idle(list_fetch_t * fetch)
+{
+    portENTER_CRITICAL(&fetch_lock);
+    fetch->busy = false;
+    fetch->reading = false;
+    portEXIT_CRITICAL(&fetch_lock);
+}
+
+// Takes the fetch from busy to done. False if it has already been switched
+// to a read and this isn't it - the read answers the fetch instead.
+static bool claim_finish(list_fetch_t * fetch, bool by_read)
+{
+    portENTER_CRITICAL(&fetch_lock);
+    bool claimed = fetch->busy && fetch->reading == by_read;
+    if (claimed)
+    {
+        fetch->busy = false;
+        fetch->reading = false;
+    }
+    portEXIT_CRITICAL(&fetch_lock);
+
+    return claimed;
+}
+
+// Call once claim_finish() has succeeded
+static void finish(list_fetch_t * fetch, char * buf, uint16_t len)
+{
+    disarm_timeout(fetch);
+    fetch->buf = NULL;
+
+    if (fetch->done_cb != NULL)
+    {
+        fetch->done_cb(fetch, buf, len);
+    }
+    else
+    {
+        free(buf);
+    }
+}
+
+void list_fetch_reset(list_fetch_t * fetch)
+{
+    set_idle(fetch);
+    disarm_timeout(fetch);
+    free(fetch->buf);
+    fetch->buf = NULL;
+    fetch->total = 0;
+    fetch->received = 0;
+    fetch->resuming = false;
+}
+
+static void set_busy(list_fetch_t * fetch, esp_gatt_if_t gattc_if, uint16_t conn_id)
+{
+    fetch->gattc_if = gattc_if;
+    fetch->conn_id = conn_id;
+
+    portENTER_CRITICAL(&fetch_lock);
+    fetch->busy = true;
+    portEXIT_CRITICAL(&fetch_lock);
+}
+
+esp_err_t list_fetch_start(list_fetch_t * fetch, esp_gatt_if_t gattc_if, uint16_t conn_id)
+{
+    list_fetch_reset(fetch);
+
+    if (fetch->handle == 0) return ESP_ERR_INVALID_STATE;
+
+    set_busy(fetch, gattc_if, conn_id);
+    if (fetch->chunked && !fetch->chunks_failed)
+    {
+        arm_timeout(fetch);
+        esp_err_t ret = request_from(fetch, gattc_if, conn_id, 0);
+        if (ret == ESP_OK) return ESP_OK;
+
+        ESP_LOGW(LIST_TAG, "%s: couldn't request chunks, reading instead", fetch->name);
+        disarm_timeout(fetch);
+    }
+
+    claim_read(fetch, false);
+    return read_whole(fetch);
+}
+
+void list_fetch_on_write(list_fetch_t * fetch, esp_gatt_status_t status)
+{
+    if (!fetch->busy || fetch->reading || status == ESP_GATT_OK) return;
+
+    ESP_LOGW(LIST_TAG, "%s: offset write failed (0x%x), reading instead", fetch->name, status);
+    disarm_timeout(fetch);
+    fall_back(fetch);
+}
+
+void list_fetch_on_read(list_fetch_t * fetch, const uint8_t * value, uint16_t len)
+{
+    if (!fetch->busy || !fetch->reading || value == NULL || len == 0) return;
+
+    // Whatever chunks arrived before the fallback are superseded
+    free(fetch->buf);
+    fetch->buf = NULL;
+
+    // Make sure what's handed on is NUL-terminated
+    uint16_t out_len = (value[len - 1] == 0) ? len : len + 1;
+    char * buf = malloc(out_len);
+    if (buf == NULL)
+    {
+        ESP_LOGE(LIST_TAG, "%s: no mem for %u bytes", fetch->name, out_len);
+        list_fetch_reset(fetch);
+        return;
+    }
+    memcpy(buf, value, len);
+    buf[out_len - 1] = 0;
+
+    if (!claim_finish(fetch, true))
+    {
+        free(buf);
+        return;
+    }
+    if (progressCallback != NULL) progressCallback(fetch->name, len, len);
+    finish(fetch, buf, out_len);
+}
+
+void list_fetch_on_notify(list_fetch_t * fetch, esp_gatt_if_t gattc_if, uint16_t conn_id, const uint8_t * value, uint16_t len)
+{
+    if (len < LIST_FETCH_HDR_LEN) return;
+
+    uint16_t offset = value[0] | (value[1] << 8);
+    uint16_t total = value[2] | (value[3] << 8);
+    const uint8_t * data = value + LIST_FETCH_HDR_LEN;
+    uint16_t data_len = len - LIST_FETCH_HDR_LEN;
+
+    // The controller pushes the whole list unprompted when it changes
+    if (!fetch->busy)
+    {
+        if (offset != 0) return;
+        list_fetch_reset(fetch);
+        set_busy(fetch, gattc_if, conn_id);
+    }
+
+    // Gave up on chunks for this fetch; the read answers it
+    if (fetch->reading) return;
+
+    if (total == 0 || total > LIST_FETCH_MAX_LEN)
+    {
+        ESP_LOGE(LIST_TAG, "%s: bad list length %u", fetch->name, total);
+        list_fetch_reset(fetch);
+        return;
+    }
+
+    if (fetch->buf == NULL || total != fetch->total)
+    {
+        // First chunk, or the list changed under us - start over at this size
+        if (fetch->buf != NULL) ESP_LOGW(LIST_TAG, "%s: list length changed, restarting", fetch->name);
+
+        free(fetch->buf);
+        fetch->buf = malloc(total + 1);
+        if (fetch->buf == NULL)
+        {
+            ESP_LOGE(LIST_TAG, "%s: no mem for %u bytes", fetch->name, total);
+            list_fetch_reset(fetch);
+            return;
+        }
+        fetch->total = total;
+        fetch->received = 0;
+    }
+
+    if (offset != fetch->received)
+    {
+        // Missed a chunk (or a stale one from an earlier request). Resume
+        // from what we have rather than restarting the whole list, asking
+        // only once: the rest of the stream is still in flight behind it.
+        // If the resume never shows up, the timeout falls back to a read.
+        ESP_LOGD(LIST_TAG, "%s: expected offset %u, got %u", fetch->name, fetch->received, offset);
+        if (offset > fetch->received && !fetch->resuming)
+        {
+            ESP_LOGW(LIST_TAG, "%s: missed chunk at %u, resuming", fetch->name, fetch->received);
+            fetch->resuming = true;
+            if (request_from(fetch, gattc_if, conn_id, fetch->received) != ESP_OK)
+            {
+                disarm_timeout(fetch);
+                fall_back(fetch);
+            }
+        }
+        return;
+    }
+
+    if (data_len > total - offset) data_len = total - offset;
+    memcpy(fetch->buf + offset, data, data_len);
+    fetch->received += data_len;
+    fetch->resuming = false;
+    arm_timeout(fetch);
+
+    if (progressCallback != NULL) progressCallback(fetch->name, fetch->received, fetch->total);
+
+    if (fetch->received == fetch->total)
+    {
+        // The timeout may have given up on the chunks just now
+        if (!claim_finish(fetch, false)) return;
+
+        uint16_t out_len = (fetch->buf[total - 1] == 0) ? total : total + 1;
+        fetch->buf[out_len - 1] = 0;
+        finish(fetch, fetch->buf, out_len);
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef LIST_FETCH_H
+#define LIST_FETCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_gattc_api.h"
+#include "esp_timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest list accepted from the controller, to bound heap use
+#define LIST_FETCH_MAX_LEN      8192
+
+// Size of the chunk header: uint16 offset, uint16 total length (little endian)
+#define LIST_FETCH_HDR_LEN      4
+
+// A chunked fetch that goes this long without an in-order chunk falls back to a read
+#define LIST_FETCH_TIMEOUT_MS   2000
+
+typedef struct list_fetch_t list_fetch_t;
+
+// Called with a malloc'd, NUL-terminated list; strlen includes the NUL.
+// Ownership of str passes to the callee.
+typedef void (*ListFetchDoneCb)(list_fetch_t * fetch, char * str, int strlen);
+typedef void (*ListFetchProgressCb)(const char * name, uint16_t received, uint16_t total);
+
+// Fetches one newline-separated list characteristic.
+//
+// Controllers that mark the characteristic NOTIFY support a chunked transfer:
+// the client writes the uint16 offset to start from, and the controller
+// streams notifications of [offset, total, data...] until the whole list has
+// been sent. The controller may also push a changed list from offset 0
+// without being asked. Lists are reassembled into a buffer sized from the first chunk
+// and handed to done_cb without further copies. Anything else falls back to
+// a single read, which Bluedroid limits to one attribute value.
+//
+// A missed chunk is asked for again once, from the last good offset. If the
+// offset write fails, or LIST_FETCH_TIMEOUT_MS passes without the expected
+// chunk, the fetch falls back to a read, and so does every later fetch on
+// that connection.
+struct list_fetch_t
+{
+    const char * name;
+    uint16_t handle;
+    bool chunked;
+
+    char * buf;
+    uint16_t total;
+    uint16_t received;
+    bool resuming;              // Asked for a resume, waiting for its offset
+
+    esp_timer_handle_t timer;   // Only exists while busy
+    esp_gatt_if_t gattc_if;     // Fixed while busy, so the timeout can read them
+    uint16_t conn_id;
+
+    // Shared with the timeout, which runs on the esp_timer task. Changed
+    // under a lock in list_fetch.c; the BTC task may read them without it.
+    volatile bool busy;
+    volatile bool reading;      // A read is in flight, chunks are ignored
+    volatile bool chunks_failed;
+    int64_t deadline_us;        // When the timeout may fall back to a read
+
+    ListFetchDoneCb done_cb;
+    void * ctx;             // For done_cb
+};
+
+void list_fetch_set_progress_cb(ListFetchProgressCb fn);
+
+esp_err_t list_fetch_start(list_fetch_t * fetch, esp_gatt_if_t gattc_if, uint16_t conn_id);
+void list_fetch_reset(list_fetch_t * fetch);
+
+void list_fetch_on_read(list_fetch_t * fetch, const uint8_t * value, uint16_t len);
+// Result of the offset write
+void list_fetch_on_write(list_fetch_t * fetch, esp_gatt_status_t status);
+void list_fetch_on_notify(list_fetch_t * fetch, esp_gatt_if_t gattc_if, uint16_t conn_id, const uint8_t * value, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
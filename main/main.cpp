@@ -11,6 +11,7 @@
 #include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_spi_flash.h"
+#include "driver/gpio.h"
 #include <esp_log.h>
 
 #include "i2c_manager.h"
@@ -24,22 +25,46 @@
 #include "cmd_nvs.h"
 #include "cmd_ble.h"
 #include "cmd_axp192.h"
+#include "cmd_touch.h"
+#include "cmd_display.h"
 
 #include "example_ble_sec_gattc_demo.h"
 #include "gui_support.h"
+#include "gui_msg_queue.h"
+#include "string_list.h"
+#include "ble_metrics.h"
+#include "conn_profile.h"
+#include "power_telemetry.h"
+#include "backlight.h"
+#include "fuel_gauge.h"
+#include "touch_input.h"
+#include "display_buffer.h"
+#include "gui_sleep.h"
+
+// When set, the GUI task sleeps until something needs it (touch interrupt,
+// BLE update, LVGL task deadline or one of the timers in check_timers())
+// instead of polling every 10ms. gui_sleep_ms() picks how long.
+#define GUI_EVENT_DRIVEN                   1
+
+// LVGL reads its tick straight from esp_timer (CONFIG_LV_TICK_CUSTOM), so
+// nothing has to run every millisecond to keep it going
+#if !LV_TICK_CUSTOM
+#error "Set CONFIG_LV_TICK_CUSTOM so LVGL's tick comes from esp_timer"
+#endif
 
-#include <string>
-#include <vector>
+// LVGL parks its refresh task once nothing is left to draw, except when the
+// perf monitor is on: it redraws itself every refresh period
+#if GUI_EVENT_DRIVEN && LV_USE_PERF_MONITOR
+#warning "The perf monitor keeps the GUI task waking every LV_DISP_DEF_REFR_PERIOD"
+#endif
 
-#define LV_TICK_PERIOD_MS                  1
-#define DISCONNECTED_POWEROFF_TIMEOUT_MS   40000
-#define SCREEN_DIM_TIMEOUT_MS              20000
-#define DIAG_UPDATE_PERIOD_MS              500
+// Show RSSI and write queueing time in the diagnostic rows
+#define GUI_BLE_DIAG                       1
 
 #define MILLIS() (unsigned long) (esp_timer_get_time() / 1000ULL)
 
-std::vector<std::string> patternsList;
-std::vector<std::string> colorsList;
+StringList patternsList;
+StringList colorsList;
 
 lv_style_t container_style = {};
 message_row_t message_row = {};
@@ -48,20 +73,27 @@ selector_row_t selector_color = {};
 slider_row_t slider_brightness = {};
 slider_row_t slider_speed = {};
 
+diag_row_t diag_bat_level = {};
 diag_row_t diag_bat_power = {};
 diag_row_t diag_bat_voltage = {};
 diag_row_t diag_temp = {};
 diag_row_t diag_ac_voltage = {};
 diag_row_t diag_charge_current = {};
+diag_row_t diag_links = {};
+#if GUI_BLE_DIAG
+diag_row_t diag_ble_link = {};
+#endif
 // lv_obj_t * battery_bar = NULL;
 
 bool isConnected = false;
-bool screenDimmed = false;
-uint32_t disconnectTimestamp = DISCONNECTED_POWEROFF_TIMEOUT_MS;
-uint32_t lastUiInteractionTimestamp = SCREEN_DIM_TIMEOUT_MS;
 
 uint32_t lastDiagUpdateTimestamp = 3000;  // Give some settle time after startup before diagnostic updates start
 
+static TaskHandle_t gui_task = NULL;
+static lv_indev_t * touch_indev = NULL;
+
+static void apply_ble_update(gui_msg_t * msg);
+
 // static void toggle_event_cb(lv_obj_t *toggle, lv_event_t event)
 // {
 // 	if(event == LV_EVENT_VALUE_CHANGED) {
@@ -88,12 +120,9 @@ extern "C" {
   void app_main();
 }
 
-static void gui_timer_tick(void *arg)
+void gui_wake()
 {
-	// Unused
-	(void) arg;
-
-	lv_tick_inc(LV_TICK_PERIOD_MS);
+	if (gui_task != NULL) xTaskNotifyGive(gui_task);
 }
 
 void update_selector_label(selector_row_t * row, const char * text)
@@ -124,15 +153,22 @@ void hide_message_row()
 	lv_obj_set_hidden(message_row.container, true);
 }
 
-void dimScreen(bool dim)
+void powerOff()
 {
-	screenDimmed = dim;
-    m5core2_set_rail_mv(LCD_BACKLIGHT, dim ? 2500 : 2800);
+    m5core2_axp_twiddle(AXP192_SHUTDOWN_BATTERY_CHGLED_CONTROL, 0b10000000, 0b10000000);
 }
 
-void powerOff()
+// The backlight policy decides when; this does what each stage needs beyond the fade
+static void backlightStageCb(backlight_stage_t stage)
 {
-    m5core2_axp_twiddle(AXP192_SHUTDOWN_BATTERY_CHGLED_CONTROL, 0b10000000, 0b10000000);
+	printf("Screen %s.\n", backlight_stage_name(stage));
+	conn_profile_set_dimmed(stage != BACKLIGHT_BRIGHT);
+
+	if (stage == BACKLIGHT_POWEROFF)
+	{
+		printf("Disconnected too long.  Powering off...\n");
+		powerOff();
+	}
 }
 
 void btn_selector_event_cb(lv_obj_t * btn, lv_event_t event)
@@ -148,14 +184,14 @@ void btn_selector_event_cb(lv_obj_t * btn, lv_event_t event)
 				// printf("Adjust color - current: %u, size: %u, incr: %u\n", selector_color.current_index, colorsList.size(), ((btn == selector_color.left_button) ? -1 : 1));
 				selector_color.current_index = (selector_color.current_index + colorsList.size() + ((btn == selector_color.left_button) ? -1 : 1)) % colorsList.size();
 				update_selector_label(&selector_color, colorsList[selector_color.current_index].c_str());
-				SetColorIdx(selector_color.current_index);
+				SetValue(BLE_CHAR_COLOR, selector_color.current_index);
 			}
 			if (selector_pattern.container == btn->parent)
 			{
 				// printf("Adjust pattern - current: %u, size: %u, incr: %u\n", selector_pattern.current_index, patternsList.size(), ((btn == selector_pattern.left_button) ? -1 : 1));
 				selector_pattern.current_index = (selector_pattern.current_index + patternsList.size() + ((btn == selector_pattern.left_button) ? -1 : 1)) % patternsList.size();
 				update_selector_label(&selector_pattern, patternsList[selector_pattern.current_index].c_str());
-				SetPatternIdx(selector_pattern.current_index);
+				SetValue(BLE_CHAR_PATTERN, selector_pattern.current_index);
 			}
 			break;
 		default:
@@ -169,14 +205,16 @@ void slider_event_cb(lv_obj_t * slider, lv_event_t event)
 
 	switch (event)
 	{
+		// The write pipeline merges these, so the controller can track the finger
+		case LV_EVENT_VALUE_CHANGED:
 		case LV_EVENT_RELEASED:
 			if (slider_brightness.container == slider->parent)
 			{
-				SetBrightness(lv_slider_get_value(slider));
+				SetValue(BLE_CHAR_BRIGHTNESS, lv_slider_get_value(slider));
 			}
 			if (slider_speed.container == slider->parent)
 			{
-				SetSpeed(lv_slider_get_value(slider));
+				SetValue(BLE_CHAR_SPEED, lv_slider_get_value(slider));
 			}
 		break;
 		default:
@@ -262,7 +300,8 @@ bool local_touch_driver_read(lv_indev_drv_t *drv, lv_indev_data_t *data)
 {
 // enum { LV_INDEV_STATE_REL = 0, LV_INDEV_STATE_PR };
 	static lv_indev_state_t last_state = LV_INDEV_STATE_REL;
-	bool result = touch_driver_read(drv, data);
+	static bool swallow_press = false;
+	bool result = touch_input_read(drv, data);
 	// printf("touch_driver: (%d,%d), btn=%u, state=%u\n", data->point.x, data->point.y, data->btn_id, data->state);
 
 	if (data->state != last_state)
@@ -270,76 +309,196 @@ bool local_touch_driver_read(lv_indev_drv_t *drv, lv_indev_data_t *data)
 		// printf("touch_driver: state changed: %u\n", data->state);
 		last_state = data->state;
 
-		// Note the last screen interaction time
-		lastUiInteractionTimestamp = MILLIS();
+		conn_profile_ui_activity();
 
-		if (screenDimmed)
+		// A touch on a dark screen only wakes it
+		if (backlight_activity() && data->state == LV_INDEV_STATE_PR)
+		{
+			swallow_press = true;
+		}
+		else if (data->state == LV_INDEV_STATE_REL)
 		{
-			printf("Dimming screen.\n");
-			dimScreen(false);
+			swallow_press = false;
 		}
 	}
 
+	if (swallow_press) data->state = LV_INDEV_STATE_REL;
+
 	return result;
 }
 
-static void check_timers()
+// Two fingers dragged up or down the screen set the brightness, and left or
+// right the speed. A whole screen's travel covers the slider's range. LVGL
+// sees no touch while two fingers are down, so this can't fight with
+// scrolling or the sliders themselves.
+#define TWO_FINGER_LOCK_PX	12	// Travel before the drag commits to an axis
+
+typedef enum {
+	TWO_FINGER_NONE,
+	TWO_FINGER_WAKING,		// Started on a dark screen; only wakes it
+	TWO_FINGER_UNDECIDED,
+	TWO_FINGER_BRIGHTNESS,
+	TWO_FINGER_SPEED,
+} two_finger_mode_t;
+
+// Called from touch_input_read(), so on the GUI thread
+static void touchFrameCb(const ft6x36_touch_t * frame)
 {
-	if ((!isConnected && (MILLIS() >= (disconnectTimestamp + DISCONNECTED_POWEROFF_TIMEOUT_MS))))
+	static two_finger_mode_t mode = TWO_FINGER_NONE;
+	static lv_point_t start;
+	static int16_t start_value;
+
+	if (frame->count < 2)
 	{
-		printf("Disconnected too long.  Powering off...\n");
-		powerOff();
+		mode = TWO_FINGER_NONE;
+		return;
 	}
-	if ((!screenDimmed && (MILLIS() >= (lastUiInteractionTimestamp + SCREEN_DIM_TIMEOUT_MS))))
+
+	lv_point_t mid;
+	mid.x = (frame->points[0].x + frame->points[1].x) / 2;
+	mid.y = (frame->points[0].y + frame->points[1].y) / 2;
+
+	if (mode == TWO_FINGER_NONE)
 	{
-		printf("Dimming screen.\n");
-		dimScreen(true);
+		mode = backlight_activity() ? TWO_FINGER_WAKING : TWO_FINGER_UNDECIDED;
+		conn_profile_ui_activity();
+		start = mid;
+		return;
 	}
+	if (mode == TWO_FINGER_WAKING) return;
+
+	int dx = mid.x - start.x;
+	int dy = start.y - mid.y;	// Up is brighter
+	if (mode == TWO_FINGER_UNDECIDED)
+	{
+		if (LV_MATH_ABS(dx) < TWO_FINGER_LOCK_PX && LV_MATH_ABS(dy) < TWO_FINGER_LOCK_PX) return;
+
+		mode = (LV_MATH_ABS(dy) >= LV_MATH_ABS(dx)) ? TWO_FINGER_BRIGHTNESS : TWO_FINGER_SPEED;
+		start = mid;
+		start_value = lv_slider_get_value((mode == TWO_FINGER_BRIGHTNESS) ? slider_brightness.slider : slider_speed.slider);
+		return;
+	}
+
+	bool brightness = (mode == TWO_FINGER_BRIGHTNESS);
+	lv_obj_t * slider = brightness ? slider_brightness.slider : slider_speed.slider;
+	int16_t min = lv_slider_get_min_value(slider);
+	int16_t max = lv_slider_get_max_value(slider);
+
+	int value = start_value + (brightness ? dy * (max - min) / LV_VER_RES_MAX : dx * (max - min) / LV_HOR_RES_MAX);
+	value = LV_MATH_MAX(min, LV_MATH_MIN(max, value));
+	if (value == lv_slider_get_value(slider)) return;
+
+	lv_slider_set_value(slider, value, LV_ANIM_OFF);
+	SetValue(brightness ? BLE_CHAR_BRIGHTNESS : BLE_CHAR_SPEED, value);
+	backlight_activity();
+	conn_profile_ui_activity();
+}
+
+// Services the backlight and diag timers, and fills in when each is next due
+static void check_timers(gui_wake_sources_t * wake)
+{
+	wake->backlight_ms = backlight_update();
+
 	if (MILLIS() >= (lastDiagUpdateTimestamp + DIAG_UPDATE_PERIOD_MS))
 	{
 		char temp_str[128] = {};
-		float temp;
 
-		m5core2_axp_read(AXP192_BATTERY_POWER, &temp);
-		snprintf(temp_str, sizeof(temp_str), "%.2f mA", temp);
-		set_diag_value_text(&diag_bat_power, temp_str);
+		// Sampled on the telemetry task, so no I2C on this thread
+		power_sample_t sample;
+		if (power_telemetry_latest(&sample))
+		{
+			snprintf(temp_str, sizeof(temp_str), "%.2f mA", sample.battery_power);
+			set_diag_value_text(&diag_bat_power, temp_str);
 
-		m5core2_axp_read(AXP192_BATTERY_VOLTAGE, &temp);
-		snprintf(temp_str, sizeof(temp_str), "%.2f V", temp);
-		set_diag_value_text(&diag_bat_voltage, temp_str);
+			snprintf(temp_str, sizeof(temp_str), "%.2f V", sample.battery_voltage);
+			set_diag_value_text(&diag_bat_voltage, temp_str);
 
-		m5core2_axp_read(AXP192_TEMP, &temp);
-		snprintf(temp_str, sizeof(temp_str), "%.1f C", temp);
-		set_diag_value_text(&diag_temp, temp_str);
+			snprintf(temp_str, sizeof(temp_str), "%.1f C", sample.temp);
+			set_diag_value_text(&diag_temp, temp_str);
 
-		m5core2_axp_read(AXP192_ACIN_VOLTAGE, &temp);
-		snprintf(temp_str, sizeof(temp_str), "%.1f V", temp);
-		set_diag_value_text(&diag_ac_voltage, temp_str);
+			snprintf(temp_str, sizeof(temp_str), "%.1f V", sample.acin_voltage);
+			set_diag_value_text(&diag_ac_voltage, temp_str);
 
-		m5core2_axp_read(AXP192_CHARGE_CURRENT, &temp);
-		snprintf(temp_str, sizeof(temp_str), "%.1f mA", temp);
-		set_diag_value_text(&diag_charge_current, temp_str);
+			snprintf(temp_str, sizeof(temp_str), "%.1f mA", sample.charge_current);
+			set_diag_value_text(&diag_charge_current, temp_str);
+		}
+
+		fuel_gauge_status_t fuel;
+		fuel_gauge_get(&fuel);
+		if (fuel.valid)
+		{
+			if (fuel.time_to_empty_min >= 0)
+				snprintf(temp_str, sizeof(temp_str), "%u%%, %d:%02d left", (fuel.soc_permille + 5) / 10,
+						 fuel.time_to_empty_min / 60, fuel.time_to_empty_min % 60);
+			else
+				snprintf(temp_str, sizeof(temp_str), "%u%%, charging", (fuel.soc_permille + 5) / 10);
+			set_diag_value_text(&diag_bat_level, temp_str);
+		}
+
+#if GUI_BLE_DIAG
+		ble_link_info_t links[BLE_MAX_LINKS];
+		GetLinkInfo(links);
+		int primary = -1;
+		for (int i = 0; i < BLE_MAX_LINKS; i++)
+		{
+			if (links[i].primary && links[i].state != BLE_LINK_FREE) primary = i;
+		}
+
+		ble_metrics_t metrics;
+		ble_metrics_get(primary, &metrics);
+		if (primary >= 0 && metrics.rssi_count > 0)
+		{
+			snprintf(temp_str, sizeof(temp_str), "%d dBm, %u ms", metrics.rssi[metrics.rssi_count - 1],
+					 ble_metrics_percentile_us(&metrics.hist[BLE_HIST_WRITE_QUEUE], 90) / 1000);
+		}
+		else
+		{
+			snprintf(temp_str, sizeof(temp_str), "-");
+		}
+		set_diag_value_text(&diag_ble_link, temp_str);
+#endif
 
 		lastDiagUpdateTimestamp = MILLIS();
 	}
+
+	wake->diag_ms = gui_ms_until(lastDiagUpdateTimestamp + DIAG_UPDATE_PERIOD_MS, MILLIS());
+}
+
+#if GUI_EVENT_DRIVEN
+// Touch input only needs polling between press and the end of any drag/throw.
+// The rest of the time the touch interrupt stands in for the indev read task.
+static void update_touch_polling()
+{
+	lv_task_t * read_task = touch_indev->driver.read_task;
+
+	// No interrupt to wake the read task back up, so leave it polling
+	if (!touch_input_gated()) return;
+
+	if (touch_input_pending())
+	{
+		lv_task_set_prio(read_task, LV_TASK_PRIO_HIGH);
+		lv_task_ready(read_task);
+	}
+	else if (touch_indev->proc.state == LV_INDEV_STATE_REL &&
+	         !touch_indev->proc.types.pointer.drag_in_prog)
+	{
+		lv_task_set_prio(read_task, LV_TASK_PRIO_OFF);
+	}
 }
+#endif
 
 static void gui_thread(void *pvParameter)
 {
 	(void) pvParameter;
 
-	static lv_color_t bufs[2][DISP_BUF_SIZE];
-	static lv_disp_buf_t disp_buf;
-	uint32_t size_in_px = DISP_BUF_SIZE;
-
-	// Set up the frame buffers
-	lv_disp_buf_init(&disp_buf, &bufs[0], &bufs[1], size_in_px);
-
-	// Set up the display driver
+	// Set up the display driver, with buffers sized to the memory that's free
 	lv_disp_drv_t disp_drv;
 	lv_disp_drv_init(&disp_drv);
 	disp_drv.flush_cb = disp_driver_flush;
-	disp_drv.buffer = &disp_buf;
+
+	display_buf_cfg_t disp_cfg = {};
+	disp_cfg.strategy = DISPLAY_BUF_AUTO;
+	display_buffer_init(&disp_drv, &disp_cfg);
 	lv_disp_drv_register(&disp_drv);
 
 	// Register the touch screen. All of the properties of it
@@ -349,16 +508,7 @@ static void gui_thread(void *pvParameter)
 	// indev_drv.read_cb = touch_driver_read;
 	indev_drv.read_cb = local_touch_driver_read;
 	indev_drv.type = LV_INDEV_TYPE_POINTER;
-	lv_indev_drv_register(&indev_drv);
-
-	// Timer to drive the main lvgl tick
-	const esp_timer_create_args_t periodic_timer_args = {
-		.callback = &gui_timer_tick,
-		.name = "periodic_gui"
-	};
-	esp_timer_handle_t periodic_timer;
-	ESP_ERROR_CHECK(esp_timer_create(&periodic_timer_args, &periodic_timer));
-	ESP_ERROR_CHECK(esp_timer_start_periodic(periodic_timer, LV_TICK_PERIOD_MS * 1000));
+	touch_indev = lv_indev_drv_register(&indev_drv);
 
 	// Setup general styles
 	lv_style_set_border_width(&container_style, LV_STATE_DEFAULT, 0);
@@ -415,6 +565,11 @@ static void gui_thread(void *pvParameter)
 	create_diag_row(&diag_charge_current, "Charge Current:", root);
 	create_diag_row(&diag_bat_voltage, "Battery Voltage:", root);
 	create_diag_row(&diag_bat_power, "Battery Power:", root);
+	create_diag_row(&diag_bat_level, "Battery:", root);
+	create_diag_row(&diag_links, "Controllers:", root);
+#if GUI_BLE_DIAG
+	create_diag_row(&diag_ble_link, "Primary RSSI, Write queue p90:", root);
+#endif
 
 	// // Battery level indicator
 	// battery_bar = lv_bar_create(root, NULL);
@@ -422,12 +577,52 @@ static void gui_thread(void *pvParameter)
 	// Adjust the root coontainer to fit all the things added to it
 	lv_cont_set_fit2(root, LV_FIT_NONE, LV_FIT_TIGHT);
 
+	// Fades run as LVGL animations, so this has to wait for LVGL to be up
+	backlight_init(backlightStageCb);
+
+	touch_input_init();
+	touch_input_set_frame_cb(touchFrameCb);
+
+#if GUI_EVENT_DRIVEN
+	gui_task = xTaskGetCurrentTaskHandle();
+	touch_input_start_gating(gui_task);
+
+	uint32_t wakeups = 0;
+	uint32_t wakeup_count_start = MILLIS();
+
+	while (1) {
+		gui_wake_sources_t wake;
+		gui_msg_drain(apply_ble_update);
+		update_touch_polling();
+		wake.display_ms = display_buffer_poll();
+
+		wake.lvgl_ms = lv_task_handler();
+		check_timers(&wake);
+		uint32_t sleep_ms = gui_sleep_ms(&wake);
+
+		// Never sleep less than a tick, matching the old polling loop's worst case
+		TickType_t sleep_ticks = pdMS_TO_TICKS(sleep_ms);
+		ulTaskNotifyTake(pdTRUE, (sleep_ticks > 0) ? sleep_ticks : 1);
+
+		wakeups++;
+		if (MILLIS() - wakeup_count_start >= 60000)
+		{
+			ESP_LOGI("gui", "%u wakeups in the last minute", wakeups);
+			wakeups = 0;
+			wakeup_count_start = MILLIS();
+		}
+	}
+#else
 	while (1) {
 		vTaskDelay(10 / portTICK_PERIOD_MS);
 
+		gui_wake_sources_t wake;
+		gui_msg_drain(apply_ble_update);
+		display_buffer_poll();
 		lv_task_handler();
-		check_timers();
+		check_timers(&wake);
 	}
+#endif
 
 	// Never returns
 }
@@ -435,91 +630,63 @@ static void gui_thread(void *pvParameter)
 void patternChangedCb(uint8_t val)
 {
 	printf("%s - val: %u\n", __func__, val);
-	if (val < patternsList.size())
-	{
-		selector_pattern.current_index = val;
-		update_selector_label(&selector_pattern, patternsList[selector_pattern.current_index].c_str());
-	}
+	gui_msg_post_value(GUI_MSG_PATTERN, val);
+	gui_wake();
 }
 
 void colorChangedCb(uint8_t val)
 {
 	printf("%s - val: %u\n", __func__, val);
-	if (val < colorsList.size())
-	{
-		selector_color.current_index = val;
-		update_selector_label(&selector_color, colorsList[selector_color.current_index].c_str());
-	}
+	gui_msg_post_value(GUI_MSG_COLOR, val);
+	gui_wake();
 }
 
 void brightnessChangedCb(uint8_t val)
 {
 	printf("%s - val: %u\n", __func__, val);
-	lv_slider_set_value(slider_brightness.slider, val, LV_ANIM_OFF);
+	gui_msg_post_value(GUI_MSG_BRIGHTNESS, val);
+	gui_wake();
 }
 
 void speedChangedCb(uint8_t val)
 {
 	printf("%s - val: %u\n", __func__, val);
-	lv_slider_set_value(slider_speed.slider, val, LV_ANIM_OFF);
+	gui_msg_post_value(GUI_MSG_SPEED, val);
+	gui_wake();
 }
 
-void linesToList(const char * str, std::vector<std::string> * list)
-{
-	list->clear();
-
-	// Simple method, but statically allocates too much memory to fit on ESP32:
-	// std::istringstream sstream(str);
-	// std::string tmp;
-	// while( getline(sstream, tmp) ) list->push_back(tmp);
-
-	// Substring method:
-	const std::string strTemp(str);
-	uint32_t pos = 0;
-	uint32_t next = 0;
-	while ((next = strTemp.find_first_of('\n', pos)) != std::string::npos)
-	{
-		list->push_back(strTemp.substr(pos, next - pos));
-		pos = next + 1;
-	}
-	if (pos < strTemp.size())
-	{
-		list->push_back(strTemp.substr(pos, strTemp.size() - pos));
-	}
-}
-
-void patternListCb(const char * str, int strlen)
+void patternListCb(char * str, int strlen)
 {
 	printf("%s\n", __func__);
-	if (str != NULL && strlen > 0 && str[strlen - 1] == 0)
-	{
-		// printf("  str: %s\n", str);
-	}
-	else
+	if (str == NULL || strlen <= 0 || str[strlen - 1] != 0)
 	{
-		// printf("  str: %p, strlen: %d\n", (const void*)str, strlen);
+		free(str);
 		return;
 	}
 
-	linesToList(str, &patternsList);
-	BeginReadCurPattern();
+	gui_msg_post_list(GUI_MSG_PATTERN_LIST, str, strlen);
+	gui_wake();
+	BeginRead(BLE_CHAR_PATTERN);
 }
 
-void colorListCb(const char * str, int strlen)
+void colorListCb(char * str, int strlen)
 {
 	printf("%s\n", __func__);
-	if (str != NULL && strlen > 0 && str[strlen - 1] == 0)
+	if (str == NULL || strlen <= 0 || str[strlen - 1] != 0)
 	{
-		// printf("  str: %s\n", str);
-	}
-	else
-	{
-		// printf("  str: %p, strlen: %d\n", (const void*)str, strlen);
+		free(str);
 		return;
 	}
 
-	linesToList(str, &colorsList);
-	BeginReadCurColor();
+	gui_msg_post_list(GUI_MSG_COLOR_LIST, str, strlen);
+	gui_wake();
+	BeginRead(BLE_CHAR_COLOR);
+}
+
+void listProgressCb(const char * name, uint16_t received, uint16_t total)
+{
+	// Called for every chunk on the BTC task, so keep it out of the normal log
+	ESP_LOGD("ble", "%s: %u/%u bytes", name, received, total);
 }
 
 void connectChangeCb(bool connected)
@@ -527,32 +694,128 @@ void connectChangeCb(bool connected)
 	printf("%s - connected: %s\n", __func__, connected ? "TRUE" : "FALSE");
 	if (connected)
 	{
-		BeginReadPatterns();
-		BeginReadColors();
+		BeginRead(BLE_CHAR_PATTERN_LIST);
+		BeginRead(BLE_CHAR_COLOR_LIST);
 
-		BeginReadBrightness();
-		BeginReadSpeed();
+		BeginRead(BLE_CHAR_BRIGHTNESS);
+		BeginRead(BLE_CHAR_SPEED);
+	}
+
+	gui_msg_t msg = {};
+	msg.type = GUI_MSG_CONNECTED;
+	msg.connected = connected;
+	gui_msg_post(&msg);
+	gui_wake();
+}
 
-		hide_message_row();
+void linksChangeCb()
+{
+	gui_msg_t msg = {};
+	msg.type = GUI_MSG_LINKS;
+	gui_msg_post(&msg);
+	gui_wake();
+}
+
+// One entry per controller in use, e.g. "E41A live*, 7C02 conn" (* is the one the UI follows)
+static void update_links_row()
+{
+	ble_link_info_t links[BLE_MAX_LINKS];
+	GetLinkInfo(links);
+
+	char text[64] = {};
+	size_t len = 0;
+	for (int i = 0; i < BLE_MAX_LINKS && len < sizeof(text); i++)
+	{
+		if (links[i].state == BLE_LINK_FREE) continue;
+
+		const char * state = (links[i].state == BLE_LINK_LIVE) ? "live" : "conn";
+		len += snprintf(&text[len], sizeof(text) - len, "%s%02X%02X %s%s", (len > 0) ? ", " : "",
+						links[i].bda[4], links[i].bda[5], state, links[i].primary ? "*" : "");
 	}
-	else
+	set_diag_value_text(&diag_links, (len > 0) ? text : "-");
+}
+
+// Runs on the GUI thread with the newest pending update of each type
+static void apply_ble_update(gui_msg_t * msg)
+{
+	switch (msg->type)
 	{
-		update_message_row("Connecting...");
-		disconnectTimestamp = MILLIS();
+		case GUI_MSG_CONNECTED:
+			if (msg->connected)
+			{
+				hide_message_row();
+			}
+			else
+			{
+				update_message_row("Connecting...");
+			}
+			isConnected = msg->connected;
+			backlight_set_connected(isConnected);
+			break;
+		case GUI_MSG_LINKS:
+			update_links_row();
+			break;
+		case GUI_MSG_PATTERN_LIST:
+			patternsList.adopt(msg->list.str, msg->list.len);
+			msg->list.str = NULL;
+			break;
+		case GUI_MSG_COLOR_LIST:
+			colorsList.adopt(msg->list.str, msg->list.len);
+			msg->list.str = NULL;
+			break;
+		case GUI_MSG_PATTERN:
+			if (msg->value < patternsList.size())
+			{
+				selector_pattern.current_index = msg->value;
+				update_selector_label(&selector_pattern, patternsList[selector_pattern.current_index].c_str());
+			}
+			break;
+		case GUI_MSG_COLOR:
+			if (msg->value < colorsList.size())
+			{
+				selector_color.current_index = msg->value;
+				update_selector_label(&selector_color, colorsList[selector_color.current_index].c_str());
+			}
+			break;
+		// Don't fight the finger with echoes of our own writes
+		case GUI_MSG_BRIGHTNESS:
+			if (!lv_slider_is_dragged(slider_brightness.slider))
+				lv_slider_set_value(slider_brightness.slider, msg->value, LV_ANIM_OFF);
+			break;
+		case GUI_MSG_SPEED:
+			if (!lv_slider_is_dragged(slider_speed.slider))
+				lv_slider_set_value(slider_speed.slider, msg->value, LV_ANIM_OFF);
+			break;
+		default:
+			break;
 	}
-	
-	isConnected = connected;
+}
+
+// Lets the connection profiles report what they cost, and feeds the fuel gauge
+static void powerSampleCb(const power_sample_t * sample)
+{
+	conn_profile_sample_current(sample->discharge_current * 1000);
+
+	fuel_gauge_input_t in = {};
+	in.battery_mv = sample->battery_voltage * 1000;
+	in.charge_ma = sample->charge_current * 1000;
+	in.discharge_ma = sample->discharge_current * 1000;
+	in.coulomb_charge = sample->coulomb_charge;
+	in.coulomb_discharge = sample->coulomb_discharge;
+	fuel_gauge_update(&in);
 }
 
 void setupBle()
 {
-	SetPatternChangedCallback(patternChangedCb);
-	SetColorChangedCallback(colorChangedCb);
-	SetBrightnessChangedCallback(brightnessChangedCb);
-	SetSpeedChangedCallback(speedChangedCb);
-	SetPatternListCallback(patternListCb);
-	SetColorListCallback(colorListCb);
+	SetValueChangedCallback(BLE_CHAR_PATTERN, patternChangedCb);
+	SetValueChangedCallback(BLE_CHAR_COLOR, colorChangedCb);
+	SetValueChangedCallback(BLE_CHAR_BRIGHTNESS, brightnessChangedCb);
+	SetValueChangedCallback(BLE_CHAR_SPEED, speedChangedCb);
+	SetListCallback(BLE_CHAR_PATTERN_LIST, patternListCb);
+	SetListCallback(BLE_CHAR_COLOR_LIST, colorListCb);
+	SetListProgressCallback(listProgressCb);
 	SetConnectChangedCallback(connectChangeCb);
+	SetLinksChangedCallback(linksChangeCb);
 	
 	init_gatt_client();
 }
@@ -580,6 +843,8 @@ void app_main(void)
     register_nvs();
     register_ble_cmds();
     register_axp192_cmds();
+    register_touch_cmds();
+    register_display_cmds();
 
 	m5core2_init();
 
@@ -589,6 +854,11 @@ void app_main(void)
 	lvgl_driver_init();
 
 	setupBle();
+
+	// After setupBle(), which brings up NVS for the fuel gauge
+	fuel_gauge_init();
+	power_telemetry_set_sample_cb(powerSampleCb);
+	power_telemetry_start(POWER_TELEMETRY_DEFAULT_PERIOD_MS);
 	
 	// Needs to be pinned to a core
 	xTaskCreatePinnedToCore(gui_thread, "gui", 4096*2, NULL, 0, NULL, 1);
@@ -0,0 +1,123 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "m5core2_axp192.h"
+#include "power_telemetry.h"
+
+#define TELEMETRY_TAG       "TELEMETRY"
+#define TELEMETRY_STACK     3072
+#define TELEMETRY_PRIORITY  (tskIDLE_PRIORITY + 1)
+#define TELEMETRY_CORE      0       // Off the GUI's core
+
+static power_sample_t ring[POWER_TELEMETRY_HISTORY];
+static atomic_uint head;            // Samples ever stored
+static atomic_uint seq;             // Odd while the writer is updating ring
+
+static atomic_uint period_ms = POWER_TELEMETRY_DEFAULT_PERIOD_MS;
+static atomic_uint error_count;
+static PowerSampleCb sampleCallback = NULL;
+static TaskHandle_t task = NULL;
+
+static bool take_sample(power_sample_t * s)
+{
+    axp192_adc_block_t adc;
+    if (m5core2_axp_read_telemetry(&adc, &s->coulomb_charge, &s->coulomb_discharge) != ESP_OK) return false;
+
+    s->timestamp_us = esp_timer_get_time();
+    axp192_adc_value(&adc, AXP192_BATTERY_POWER, &s->battery_power);
+    axp192_adc_value(&adc, AXP192_BATTERY_VOLTAGE, &s->battery_voltage);
+    axp192_adc_value(&adc, AXP192_CHARGE_CURRENT, &s->charge_current);
+    axp192_adc_value(&adc, AXP192_DISCHARGE_CURRENT, &s->discharge_current);
+    axp192_adc_value(&adc, AXP192_ACIN_VOLTAGE, &s->acin_voltage);
+    axp192_adc_value(&adc, AXP192_TEMP, &s->temp);
+    return true;
+}
+
+static void store(const power_sample_t * s)
+{
+    unsigned int h = atomic_load(&head);
+
+    atomic_fetch_add(&seq, 1);
+    ring[h % POWER_TELEMETRY_HISTORY] = *s;
+    atomic_fetch_add(&seq, 1);
+
+    atomic_store(&head, h + 1);
+}
+
+static void telemetry_task(void *arg)
+{
+    (void) arg;
+    TickType_t last_wake = xTaskGetTickCount();
+
+    while (1)
+    {
+        power_sample_t s;
+        if (take_sample(&s))
+        {
+            store(&s);
+            if (sampleCallback != NULL) sampleCallback(&s);
+        }
+        else
+        {
+            atomic_fetch_add(&error_count, 1);
+        }
+
+        TickType_t period = pdMS_TO_TICKS(atomic_load(&period_ms));
+        vTaskDelayUntil(&last_wake, (period > 0) ? period : 1);
+    }
+}
+
+void power_telemetry_start(uint32_t period)
+{
+    power_telemetry_set_period(period);
+    if (task != NULL) return;
+
+    xTaskCreatePinnedToCore(telemetry_task, "telemetry", TELEMETRY_STACK, NULL, TELEMETRY_PRIORITY, &task, TELEMETRY_CORE);
+}
+
+void power_telemetry_set_period(uint32_t period)
+{
+    if (period < POWER_TELEMETRY_MIN_PERIOD_MS) period = POWER_TELEMETRY_MIN_PERIOD_MS;
+    atomic_store(&period_ms, period);
+}
+
+uint32_t power_telemetry_get_period() { return atomic_load(&period_ms); }
+
+void power_telemetry_set_sample_cb(PowerSampleCb fn) { sampleCallback = fn; }
+
+uint32_t power_telemetry_error_count() { return atomic_load(&error_count); }
+
+// Copy up to max samples ending at the newest, retrying if the writer got in the way
+static uint32_t copy_out(power_sample_t * samples, uint32_t max)
+{
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        unsigned int start_seq = atomic_load(&seq);
+        if (start_seq & 1) continue;
+
+        unsigned int h = atomic_load(&head);
+        uint32_t count = (h < POWER_TELEMETRY_HISTORY) ? h : POWER_TELEMETRY_HISTORY;
+        if (count > max) count = max;
+
+        for (uint32_t i = 0; i < count; i++)
+            samples[i] = ring[(h - count + i) % POWER_TELEMETRY_HISTORY];
+
+        if (atomic_load(&seq) == start_seq) return count;
+    }
+
+    // A sample every 100ms at most, so this only happens if the reader was preempted for a long time
+    return 0;
+}
+
+bool power_telemetry_latest(power_sample_t * sample)
+{
+    return copy_out(sample, 1) == 1;
+}
+
+uint32_t power_telemetry_history(power_sample_t * samples, uint32_t max)
+{
+    return copy_out(samples, max);
+}
@@ -0,0 +1,51 @@
+#ifndef POWER_TELEMETRY_H
+#define POWER_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// AXP192 readings, sampled by a low priority task on core 0 so an I2C stall
+// never holds up the GUI. Samples go into a fixed ring; readers copy out
+// under a sequence counter rather than taking a lock.
+
+#define POWER_TELEMETRY_HISTORY             120     // One minute at the default rate
+#define POWER_TELEMETRY_DEFAULT_PERIOD_MS   500
+#define POWER_TELEMETRY_MIN_PERIOD_MS       100
+
+// Values are scaled as axp192_adc_value() returns them
+typedef struct power_sample_t
+{
+    int64_t timestamp_us;       // esp_timer time the sample was taken
+    float battery_power;
+    float battery_voltage;
+    float charge_current;
+    float discharge_current;
+    float acin_voltage;
+    float temp;
+    uint32_t coulomb_charge;    // Raw counters, see axp192_read_coulomb()
+    uint32_t coulomb_discharge;
+} power_sample_t;
+
+// Called on the telemetry task after each sample is stored
+typedef void (*PowerSampleCb)(const power_sample_t * sample);
+
+void power_telemetry_start(uint32_t period_ms);
+void power_telemetry_set_period(uint32_t period_ms);
+uint32_t power_telemetry_get_period();
+void power_telemetry_set_sample_cb(PowerSampleCb fn);
+
+// False until the first sample has been taken
+bool power_telemetry_latest(power_sample_t * sample);
+// Copies up to max samples, oldest first. Returns how many were copied.
+uint32_t power_telemetry_history(power_sample_t * samples, uint32_t max);
+uint32_t power_telemetry_error_count();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "string_list.h"
+
+StringList::~StringList()
+{
+	free(buffer);
+	free(offsets);
+}
+
+void StringList::clear()
+{
+	free(buffer);
+	buffer = NULL;
+	count = 0;
+}
+
+bool StringList::reserve(uint16_t items)
+{
+	// Room for the end sentinel too
+	if (items < capacity) return true;
+
+	uint32_t new_capacity = (capacity == 0) ? 16 : (uint32_t)capacity * 2;
+	while (new_capacity <= items) new_capacity *= 2;
+	if (new_capacity > UINT16_MAX) new_capacity = UINT16_MAX;
+
+	uint16_t * new_offsets = (uint16_t *)realloc(offsets, new_capacity * sizeof(uint16_t));
+	if (new_offsets == NULL) return false;
+
+	offsets = new_offsets;
+	capacity = (uint16_t)new_capacity;
+	return true;
+}
+
+bool StringList::adopt(char * str, size_t len)
+{
+	clear();
+
+	if (str == NULL) return false;
+
+	if (len == 0 || len > UINT16_MAX || str[len - 1] != '\0' || !reserve(0))
+	{
+		free(str);
+		return false;
+	}
+
+	// Don't treat the NUL terminator as part of the text
+	len--;
+
+	uint16_t items = 0;
+	uint16_t start = 0;
+	for (uint16_t pos = 0; pos < len; pos++)
+	{
+		if (str[pos] != '\n') continue;
+
+		if (!reserve(items + 1))
+		{
+			free(str);
+			return false;
+		}
+		str[pos] = '\0';
+		offsets[items++] = start;
+		start = pos + 1;
+	}
+
+	// Trailing item without a newline
+	if (start < len)
+	{
+		if (!reserve(items + 1))
+		{
+			free(str);
+			return false;
+		}
+		offsets[items++] = start;
+		start = len + 1;
+	}
+
+	// Sentinel is where the item after the last one would start
+	offsets[items] = start;
+
+	buffer = str;
+	count = items;
+	return true;
+}
+
+StringSlice StringList::operator[](size_t idx) const
+{
+	StringSlice result = { "", 0 };
+
+	if (idx < count)
+	{
+		result.data = buffer + offsets[idx];
+		result.len = offsets[idx + 1] - offsets[idx] - 1;
+	}
+
+	return result;
+}
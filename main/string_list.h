@@ -0,0 +1,49 @@
+#ifndef STRING_LIST_H
+#define STRING_LIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A view of one item in a StringList. The text is always NUL-terminated, so
+// c_str() can be handed straight to LVGL.
+struct StringSlice
+{
+	const char * data;
+	uint16_t len;
+
+	const char * c_str() const { return data; }
+	size_t size() const { return len; }
+};
+
+// Newline-separated list of strings held in a single owned buffer plus a
+// uint16_t offset table, so the controller's pattern/color lists don't cost
+// a heap allocation per item. The offset table is kept between loads and
+// only grows, so re-sent lists of a similar size don't allocate for it.
+class StringList
+{
+public:
+	StringList() : buffer(NULL), offsets(NULL), count(0), capacity(0) {}
+	~StringList();
+
+	// Takes ownership of a malloc'd, NUL-terminated buffer of len bytes
+	// (including the NUL) and splits it in place in a single pass. The buffer
+	// is freed here even on failure. Lists are limited to 64KiB.
+	bool adopt(char * str, size_t len);
+	void clear();
+
+	size_t size() const { return count; }
+	StringSlice operator[](size_t idx) const;
+
+private:
+	StringList(const StringList &);
+	StringList & operator=(const StringList &);
+
+	bool reserve(uint16_t items);
+
+	char * buffer;
+	uint16_t * offsets;     // count + 1 entries, the last being the end sentinel
+	uint16_t count;
+	uint16_t capacity;
+};
+
+#endif
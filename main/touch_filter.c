@@ -0,0 +1,299 @@
+#include <string.h>
+#include "touch_filter.h"
+
+#ifdef ESP_PLATFORM
+#include "xtensa/hal.h"
+#define CYCLES()    xthal_get_ccount()
+#else
+#define CYCLES()    0
+#endif
+
+#define MAX_DT_MS           1000    // Longer gaps are treated as this, so a stale state can't overflow
+#define PREDICT_MAX_LEAD_MS 100
+
+typedef struct
+{
+    touch_filter_cfg_t cfg;
+    touch_filter_stage_stats_t stats;
+    uint8_t overrun_run;
+    bool primed;
+    uint32_t last_t;
+    union
+    {
+        struct
+        {
+            int16_t x[TOUCH_FILTER_MAX_MEDIAN];
+            int16_t y[TOUCH_FILTER_MAX_MEDIAN];
+            uint8_t count;
+            uint8_t next;
+        } median;
+        struct
+        {
+            int32_t x_q8;           // Pixels, 8 fractional bits
+            int32_t y_q8;
+            int32_t dx_q8;          // Pixels per second, 8 fractional bits
+            int32_t dy_q8;
+        } euro;
+        struct
+        {
+            int16_t last_x;
+            int16_t last_y;
+            int32_t vx_q8;
+            int32_t vy_q8;
+        } predict;
+    } state;
+} stage_t;
+
+// Only changed on the GUI thread (or the host replaying a trace). The console
+// reads the stats as they stand; a count a frame out of date does no harm.
+static stage_t chain[TOUCH_FILTER_MAX_STAGES];
+static size_t chain_len = 0;
+static touch_filter_sample_t last_out;
+
+static const char * kind_names[TOUCH_FILTER_KIND_COUNT] = { "median", "one-euro", "predict" };
+
+static int16_t median_of(const int16_t * values, uint8_t count)
+{
+    int16_t sorted[TOUCH_FILTER_MAX_MEDIAN];
+    memcpy(sorted, values, count * sizeof(sorted[0]));
+
+    for (uint8_t i = 1; i < count; i++)
+    {
+        int16_t v = sorted[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+
+    return sorted[count / 2];
+}
+
+static void median_process(stage_t * st, touch_filter_sample_t * s)
+{
+    st->state.median.x[st->state.median.next] = s->x;
+    st->state.median.y[st->state.median.next] = s->y;
+    st->state.median.next = (st->state.median.next + 1) % st->cfg.median.window;
+    if (st->state.median.count < st->cfg.median.window) st->state.median.count++;
+
+    // Order doesn't matter for a median, so the ring can be used as it is
+    s->x = median_of(st->state.median.x, st->state.median.count);
+    s->y = median_of(st->state.median.y, st->state.median.count);
+}
+
+// Smoothing factor of a first order low pass with this cutoff, sampled every
+// dt_ms, in Q16. alpha = r / (1 + r) with r = 2*pi*fc*dt; r is kept scaled by 1e9.
+static int32_t smoothing_q16(uint32_t cutoff_mhz, uint32_t dt_ms)
+{
+    uint64_t r = (uint64_t)6283 * cutoff_mhz * dt_ms;
+    return (int32_t)((r << 16) / (r + 1000000000ULL));
+}
+
+static void euro_axis(const stage_t * st, int32_t * x_q8, int32_t * dx_q8, int16_t raw, uint32_t dt_ms)
+{
+    int32_t raw_q8 = (int32_t)raw * 256;
+
+    int32_t speed_q8 = (int64_t)(raw_q8 - *x_q8) * 1000 / (int32_t)dt_ms;
+    *dx_q8 += (int64_t)(speed_q8 - *dx_q8) * smoothing_q16(st->cfg.one_euro.d_cutoff_mhz, dt_ms) / 65536;
+
+    uint32_t speed = (uint32_t)((*dx_q8 < 0) ? -*dx_q8 : *dx_q8) / 256;
+    uint32_t cutoff = st->cfg.one_euro.min_cutoff_mhz + st->cfg.one_euro.beta * speed;
+    *x_q8 += (int64_t)(raw_q8 - *x_q8) * smoothing_q16(cutoff, dt_ms) / 65536;
+}
+
+static void euro_process(stage_t * st, touch_filter_sample_t * s, uint32_t dt_ms)
+{
+    if (!st->primed)
+    {
+        st->state.euro.x_q8 = (int32_t)s->x * 256;
+        st->state.euro.y_q8 = (int32_t)s->y * 256;
+        st->state.euro.dx_q8 = 0;
+        st->state.euro.dy_q8 = 0;
+        return;
+    }
+
+    euro_axis(st, &st->state.euro.x_q8, &st->state.euro.dx_q8, s->x, dt_ms);
+    euro_axis(st, &st->state.euro.y_q8, &st->state.euro.dy_q8, s->y, dt_ms);
+    s->x = (st->state.euro.x_q8 + 128) / 256;
+    s->y = (st->state.euro.y_q8 + 128) / 256;
+}
+
+static int16_t clamp_coord(int32_t v, int16_t max)
+{
+    if (v < 0) return 0;
+    if (v > max) return max;
+    return v;
+}
+
+static void predict_process(stage_t * st, touch_filter_sample_t * s, uint32_t dt_ms)
+{
+    int16_t x = s->x;
+    int16_t y = s->y;
+
+    if (st->primed)
+    {
+        // Average over two samples; the median and one euro stages upstream do the real smoothing
+        int32_t vx_q8 = (int32_t)(x - st->state.predict.last_x) * 256 * 1000 / (int32_t)dt_ms;
+        int32_t vy_q8 = (int32_t)(y - st->state.predict.last_y) * 256 * 1000 / (int32_t)dt_ms;
+        st->state.predict.vx_q8 += (vx_q8 - st->state.predict.vx_q8) / 2;
+        st->state.predict.vy_q8 += (vy_q8 - st->state.predict.vy_q8) / 2;
+
+        int32_t lead = st->cfg.predict.lead_ms;
+        s->x = clamp_coord(x + (int64_t)st->state.predict.vx_q8 * lead / (1000 * 256), st->cfg.predict.max_x);
+        s->y = clamp_coord(y + (int64_t)st->state.predict.vy_q8 * lead / (1000 * 256), st->cfg.predict.max_y);
+    }
+    else
+    {
+        st->state.predict.vx_q8 = 0;
+        st->state.predict.vy_q8 = 0;
+    }
+
+    st->state.predict.last_x = x;
+    st->state.predict.last_y = y;
+}
+
+static void run_stage(stage_t * st, touch_filter_sample_t * s)
+{
+    uint32_t dt_ms = st->primed ? (s->t_ms - st->last_t) : 1;
+    if (dt_ms == 0) dt_ms = 1;
+    if (dt_ms > MAX_DT_MS) dt_ms = MAX_DT_MS;
+
+    switch (st->cfg.kind)
+    {
+        case TOUCH_FILTER_MEDIAN:   median_process(st, s);          break;
+        case TOUCH_FILTER_ONE_EURO: euro_process(st, s, dt_ms);     break;
+        case TOUCH_FILTER_PREDICT:  predict_process(st, s, dt_ms);  break;
+        default: break;
+    }
+
+    st->primed = true;
+    st->last_t = s->t_ms;
+}
+
+static void reset_stage(stage_t * st)
+{
+    st->primed = false;
+    st->overrun_run = 0;
+    memset(&st->state, 0, sizeof(st->state));
+}
+
+void touch_filter_reset()
+{
+    for (size_t i = 0; i < chain_len; i++) reset_stage(&chain[i]);
+}
+
+static bool valid_cfg(const touch_filter_cfg_t * cfg)
+{
+    switch (cfg->kind)
+    {
+        case TOUCH_FILTER_MEDIAN:
+            return cfg->median.window == 3 || cfg->median.window == 5;
+        case TOUCH_FILTER_ONE_EURO:
+            return cfg->one_euro.min_cutoff_mhz > 0 && cfg->one_euro.d_cutoff_mhz > 0;
+        case TOUCH_FILTER_PREDICT:
+            return cfg->predict.lead_ms <= PREDICT_MAX_LEAD_MS && cfg->predict.max_x > 0 && cfg->predict.max_y > 0;
+        default:
+            return false;
+    }
+}
+
+bool touch_filter_check_chain(const touch_filter_cfg_t * stages, size_t count)
+{
+    if (count > TOUCH_FILTER_MAX_STAGES) return false;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!valid_cfg(&stages[i])) return false;
+    }
+    return true;
+}
+
+bool touch_filter_set_chain(const touch_filter_cfg_t * stages, size_t count)
+{
+    if (!touch_filter_check_chain(stages, count)) return false;
+
+    memset(chain, 0, sizeof(chain));
+    for (size_t i = 0; i < count; i++)
+    {
+        chain[i].cfg = stages[i];
+        chain[i].stats.kind = stages[i].kind;
+        chain[i].stats.budget_cycles = stages[i].budget_cycles;
+    }
+    chain_len = count;
+
+    return true;
+}
+
+size_t touch_filter_get_chain(touch_filter_cfg_t * stages, size_t max)
+{
+    size_t n = (chain_len < max) ? chain_len : max;
+    for (size_t i = 0; i < n; i++) stages[i] = chain[i].cfg;
+    return n;
+}
+
+void touch_filter_process(touch_filter_sample_t * s)
+{
+    if (!s->pressed)
+    {
+        // Lift off where the finger was last shown, not where the raw point jumped to
+        touch_filter_reset();
+        if (last_out.pressed)
+        {
+            s->x = last_out.x;
+            s->y = last_out.y;
+        }
+        last_out = *s;
+        return;
+    }
+
+    for (size_t i = 0; i < chain_len; i++)
+    {
+        stage_t * st = &chain[i];
+        if (st->stats.bypassed) continue;
+
+        uint32_t start = CYCLES();
+        run_stage(st, s);
+        uint32_t cycles = CYCLES() - start;
+
+        st->stats.last_cycles = cycles;
+        if (cycles > st->stats.max_cycles) st->stats.max_cycles = cycles;
+
+        if (st->cfg.budget_cycles != 0 && cycles > st->cfg.budget_cycles)
+        {
+            st->stats.overruns++;
+            if (++st->overrun_run >= TOUCH_FILTER_OVERRUN_LIMIT) st->stats.bypassed = true;
+        }
+        else
+        {
+            st->overrun_run = 0;
+        }
+    }
+
+    last_out = *s;
+}
+
+void touch_filter_replay(const touch_filter_sample_t * in, touch_filter_sample_t * out, size_t count)
+{
+    touch_filter_reset();
+    memset(&last_out, 0, sizeof(last_out));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = in[i];
+        touch_filter_process(&out[i]);
+    }
+}
+
+size_t touch_filter_get_stats(touch_filter_stage_stats_t * stats, size_t max)
+{
+    size_t n = (chain_len < max) ? chain_len : max;
+    for (size_t i = 0; i < n; i++) stats[i] = chain[i].stats;
+    return n;
+}
+
+const char * touch_filter_kind_name(touch_filter_kind_t kind)
+{
+    return (kind < TOUCH_FILTER_KIND_COUNT) ? kind_names[kind] : "?";
+}
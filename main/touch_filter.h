@@ -0,0 +1,102 @@
+#ifndef TOUCH_FILTER_H
+#define TOUCH_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Smoothing for touch coordinates, run on each fresh report before LVGL sees
+// it. A chain of up to TOUCH_FILTER_MAX_STAGES stages, each one of:
+//   median    - median of the last 3 or 5 points, drops single-sample spikes
+//   one euro  - low pass whose cutoff rises with speed: steady when the
+//               finger rests on a shaking cart, little lag when it moves
+//   predict   - extrapolates along the current velocity to make up for the
+//               time between the touch and LVGL acting on it
+// All fixed point. Each stage has a cycle budget; one that keeps going over
+// it is bypassed rather than left to slow down the GUI.
+//
+// No ESP-IDF or LVGL dependencies, so a recorded trace (see the 'touch'
+// command) can be replayed through touch_filter_replay() on a host build.
+
+#define TOUCH_FILTER_MAX_STAGES         4
+#define TOUCH_FILTER_MAX_MEDIAN         5
+#define TOUCH_FILTER_OVERRUN_LIMIT      8       // Consecutive overruns before a stage is bypassed
+
+typedef enum
+{
+    TOUCH_FILTER_MEDIAN,
+    TOUCH_FILTER_ONE_EURO,
+    TOUCH_FILTER_PREDICT,
+    TOUCH_FILTER_KIND_COUNT
+} touch_filter_kind_t;
+
+typedef struct touch_filter_cfg_t
+{
+    touch_filter_kind_t kind;
+    uint32_t budget_cycles;             // 0 for no budget
+    union
+    {
+        struct
+        {
+            uint8_t window;             // 3 or 5
+        } median;
+        struct
+        {
+            uint32_t min_cutoff_mhz;    // Cutoff with the finger still
+            uint32_t beta;              // Added cutoff in mHz per px/s of speed
+            uint32_t d_cutoff_mhz;      // Cutoff for the speed estimate
+        } one_euro;
+        struct
+        {
+            uint16_t lead_ms;
+            int16_t max_x;              // Predictions are clamped to 0..max
+            int16_t max_y;
+        } predict;
+    };
+} touch_filter_cfg_t;
+
+typedef struct touch_filter_sample_t
+{
+    uint32_t t_ms;
+    int16_t x;
+    int16_t y;
+    bool pressed;                       // Released samples reset the chain and keep the last point
+} touch_filter_sample_t;
+
+typedef struct touch_filter_stage_stats_t
+{
+    touch_filter_kind_t kind;
+    uint32_t budget_cycles;
+    uint32_t last_cycles;
+    uint32_t max_cycles;
+    uint32_t overruns;
+    bool bypassed;
+} touch_filter_stage_stats_t;
+
+// Replaces the chain and resets its state. False (and the chain unchanged) if
+// any stage is invalid.
+bool touch_filter_set_chain(const touch_filter_cfg_t * stages, size_t count);
+// Whether touch_filter_set_chain() would take these stages
+bool touch_filter_check_chain(const touch_filter_cfg_t * stages, size_t count);
+size_t touch_filter_get_chain(touch_filter_cfg_t * stages, size_t max);
+
+// Filters s in place
+void touch_filter_process(touch_filter_sample_t * s);
+void touch_filter_reset();
+
+// Resets, then runs count samples through the chain
+void touch_filter_replay(const touch_filter_sample_t * in, touch_filter_sample_t * out, size_t count);
+
+// Returns how many stages were copied
+size_t touch_filter_get_stats(touch_filter_stage_stats_t * stats, size_t max);
+const char * touch_filter_kind_name(touch_filter_kind_t kind);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,363 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "ft6x36.h"
+#include "touch_input.h"
+
+#define TOUCH_TAG   "TOUCH"
+
+static TaskHandle_t notify = NULL;
+static bool gated = false;
+
+// Written by the ISR only
+static volatile uint32_t pulses;
+static volatile int64_t press_start_us;     // First pulse of a press, 0 once it's been timed
+
+// Written on the GUI thread only
+static volatile bool pressed = false;       // Also read by the ISR
+static uint32_t seen_pulses;
+static int64_t last_read_us;
+static lv_indev_data_t last_data;
+static bool multi_touch = false;            // Two fingers seen since the panel was last clear
+static uint8_t last_gesture = FT6X36_GEST_ID_NO_GESTURE;
+static bool hw_gestures_seen = false;
+static TouchFrameCb frameCallback = NULL;
+
+// The chain the console asked for, applied by the next read so the filters
+// are only ever touched on the GUI thread
+static portMUX_TYPE filter_lock = portMUX_INITIALIZER_UNLOCKED;
+static touch_filter_preset_t preset = TOUCH_FILTER_PRESET_MEDIAN_EURO;
+static uint16_t lead = 0;
+static touch_filter_cfg_t pending_stages[TOUCH_FILTER_MAX_STAGES];
+static size_t pending_count;
+static bool filter_pending = false;
+static const char * preset_names[TOUCH_FILTER_PRESET_COUNT] = { "off", "median", "euro", "median+euro" };
+
+// Written on the GUI thread, copied out by the console
+static touch_filter_sample_t trace[TOUCH_TRACE_LEN];
+static uint32_t trace_next;
+static uint32_t trace_count;
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static atomic_uint stat_interrupts;
+static atomic_uint stat_i2c_reads;
+static atomic_uint stat_skipped_reads;
+static atomic_uint stat_presses;
+static atomic_uint stat_latency_min_us = UINT32_MAX;
+static atomic_uint stat_latency_max_us;
+static atomic_uint stat_latency_last_us;
+static atomic_ullong stat_latency_total_us;
+static atomic_uint stat_multi_touch_frames;
+static atomic_uint stat_hw_gestures;
+
+static void IRAM_ATTR touch_isr(void *arg)
+{
+    (void) arg;
+    BaseType_t higher_prio_woken = pdFALSE;
+
+    if (!pressed && press_start_us == 0) press_start_us = esp_timer_get_time();
+    pulses++;
+
+    if (notify != NULL) vTaskNotifyGiveFromISR(notify, &higher_prio_woken);
+    if (higher_prio_woken) portYIELD_FROM_ISR();
+}
+
+bool touch_input_set_filter(touch_filter_preset_t p, uint16_t lead_ms)
+{
+    touch_filter_cfg_t stages[TOUCH_FILTER_MAX_STAGES];
+    size_t count = 0;
+
+    if (p >= TOUCH_FILTER_PRESET_COUNT) return false;
+
+    if (p == TOUCH_FILTER_PRESET_MEDIAN || p == TOUCH_FILTER_PRESET_MEDIAN_EURO)
+    {
+        touch_filter_cfg_t median = { .kind = TOUCH_FILTER_MEDIAN, .budget_cycles = TOUCH_FILTER_BUDGET };
+        median.median.window = 3;
+        stages[count++] = median;
+    }
+    if (p == TOUCH_FILTER_PRESET_EURO || p == TOUCH_FILTER_PRESET_MEDIAN_EURO)
+    {
+        // Still below ~1Hz of shake, opening up quickly once the finger moves
+        touch_filter_cfg_t euro = { .kind = TOUCH_FILTER_ONE_EURO, .budget_cycles = TOUCH_FILTER_BUDGET };
+        euro.one_euro.min_cutoff_mhz = 1000;
+        euro.one_euro.beta = 7;
+        euro.one_euro.d_cutoff_mhz = 1000;
+        stages[count++] = euro;
+    }
+    if (lead_ms > 0)
+    {
+        touch_filter_cfg_t predict = { .kind = TOUCH_FILTER_PREDICT, .budget_cycles = TOUCH_FILTER_BUDGET };
+        predict.predict.lead_ms = lead_ms;
+        predict.predict.max_x = LV_HOR_RES_MAX - 1;
+        predict.predict.max_y = LV_VER_RES_MAX - 1;
+        stages[count++] = predict;
+    }
+
+    if (!touch_filter_check_chain(stages, count)) return false;
+
+    portENTER_CRITICAL(&filter_lock);
+    memcpy(pending_stages, stages, sizeof(stages[0]) * count);
+    pending_count = count;
+    filter_pending = true;
+    preset = p;
+    lead = lead_ms;
+    portEXIT_CRITICAL(&filter_lock);
+
+    if (notify != NULL) xTaskNotifyGive(notify);
+    return true;
+}
+
+void touch_input_get_filter(touch_filter_preset_t * p, uint16_t * lead_ms)
+{
+    portENTER_CRITICAL(&filter_lock);
+    *p = preset;
+    *lead_ms = lead;
+    portEXIT_CRITICAL(&filter_lock);
+}
+
+static void apply_pending_filter()
+{
+    touch_filter_cfg_t stages[TOUCH_FILTER_MAX_STAGES];
+
+    portENTER_CRITICAL(&filter_lock);
+    bool have_request = filter_pending;
+    size_t count = pending_count;
+    memcpy(stages, pending_stages, sizeof(stages));
+    filter_pending = false;
+    portEXIT_CRITICAL(&filter_lock);
+
+    if (have_request) touch_filter_set_chain(stages, count);
+}
+
+const char * touch_input_preset_name(touch_filter_preset_t p)
+{
+    return (p < TOUCH_FILTER_PRESET_COUNT) ? preset_names[p] : "?";
+}
+
+static void trace_add(const touch_filter_sample_t * s)
+{
+    portENTER_CRITICAL(&trace_lock);
+    trace[trace_next] = *s;
+    trace_next = (trace_next + 1) % TOUCH_TRACE_LEN;
+    if (trace_count < TOUCH_TRACE_LEN) trace_count++;
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+uint32_t touch_input_get_trace(touch_filter_sample_t * samples, uint32_t max)
+{
+    portENTER_CRITICAL(&trace_lock);
+    uint32_t count = (trace_count < max) ? trace_count : max;
+    uint32_t start = (trace_next + TOUCH_TRACE_LEN - count) % TOUCH_TRACE_LEN;
+    for (uint32_t i = 0; i < count; i++) samples[i] = trace[(start + i) % TOUCH_TRACE_LEN];
+    portEXIT_CRITICAL(&trace_lock);
+
+    return count;
+}
+
+void touch_input_init()
+{
+    touch_input_set_filter(preset, lead);
+}
+
+void touch_input_start_gating(void * notify_task)
+{
+    notify = (TaskHandle_t) notify_task;
+
+    // One pulse per report, so a pulse always means fresh data
+    if (ft6x36_set_interrupt_mode(true) != ESP_OK)
+    {
+        ESP_LOGW(TOUCH_TAG, "Couldn't switch to trigger mode, polling the controller instead");
+        return;
+    }
+
+    gpio_config_t io_conf = {};
+    io_conf.pin_bit_mask = (1ULL << TOUCH_INT_GPIO);
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.intr_type = GPIO_INTR_NEGEDGE;
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
+
+    esp_err_t ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE)  // Already installed is fine
+    {
+        ESP_ERROR_CHECK(ret);
+    }
+    ESP_ERROR_CHECK(gpio_isr_handler_add(TOUCH_INT_GPIO, touch_isr, NULL));
+
+    seen_pulses = pulses;
+    gated = true;
+}
+
+bool touch_input_gated()
+{
+    return gated;
+}
+
+bool touch_input_pending()
+{
+    return pulses != seen_pulses || filter_pending;
+}
+
+static void record_latency(uint32_t us)
+{
+    atomic_fetch_add(&stat_presses, 1);
+    atomic_fetch_add(&stat_latency_total_us, us);
+    atomic_store(&stat_latency_last_us, us);
+    if (us < atomic_load(&stat_latency_min_us)) atomic_store(&stat_latency_min_us, us);
+    if (us > atomic_load(&stat_latency_max_us)) atomic_store(&stat_latency_max_us, us);
+}
+
+void touch_input_set_frame_cb(TouchFrameCb fn)
+{
+    frameCallback = fn;
+}
+
+// Hand a swipe the chip detected to whatever LVGL would have sent its own to
+static void send_gesture(lv_indev_t * indev, uint8_t gesture)
+{
+    lv_gesture_dir_t dir;
+    switch (gesture)
+    {
+        case FT6X36_GEST_ID_MOVE_UP:    dir = LV_GESTURE_DIR_TOP;    break;
+        case FT6X36_GEST_ID_MOVE_DOWN:  dir = LV_GESTURE_DIR_BOTTOM; break;
+        case FT6X36_GEST_ID_MOVE_LEFT:  dir = LV_GESTURE_DIR_LEFT;   break;
+        case FT6X36_GEST_ID_MOVE_RIGHT: dir = LV_GESTURE_DIR_RIGHT;  break;
+        default: return;
+    }
+
+    if (!hw_gestures_seen)
+    {
+        // The chip does its own, so stop LVGL from summing drag vectors. Under
+        // this velocity every movement resets LVGL's sum.
+        hw_gestures_seen = true;
+        indev->driver.gesture_min_velocity = UINT8_MAX;
+        indev->driver.gesture_limit = UINT8_MAX;
+    }
+
+    lv_obj_t * obj = indev->proc.types.pointer.act_obj;
+    while (obj != NULL && lv_obj_get_gesture_parent(obj)) obj = lv_obj_get_parent(obj);
+    if (obj == NULL || indev->proc.types.pointer.gesture_sent) return;
+
+    indev->proc.types.pointer.gesture_sent = 1;
+    indev->proc.types.pointer.gesture_dir = dir;
+    obj->signal_cb(obj, LV_SIGNAL_GESTURE, indev);
+    lv_event_send(obj, LV_EVENT_GESTURE, NULL);
+}
+
+bool touch_input_read(lv_indev_drv_t * drv, lv_indev_data_t * data)
+{
+    (void) drv;
+    int64_t now = esp_timer_get_time();
+    uint32_t p = pulses;
+
+    apply_pending_filter();
+
+    if (gated && p == seen_pulses)
+    {
+        // Nothing new, unless a lift-off pulse went missing
+        bool stuck = (last_data.state == LV_INDEV_STATE_PR) && (now - last_read_us >= TOUCH_STUCK_MS * 1000);
+        if (!stuck)
+        {
+            *data = last_data;
+            atomic_fetch_add(&stat_skipped_reads, 1);
+            return false;
+        }
+    }
+
+    atomic_fetch_add(&stat_interrupts, p - seen_pulses);
+    seen_pulses = p;
+    last_read_us = now;
+
+    ft6x36_touch_t frame;
+    ft6x36_read_touches(&frame);
+    atomic_fetch_add(&stat_i2c_reads, 1);
+
+    lv_indev_t * indev = lv_indev_get_act();
+
+    if (frame.count > 1)
+    {
+        atomic_fetch_add(&stat_multi_touch_frames, 1);
+        // Whatever the first finger was pressing must not get a click out of this
+        if (!multi_touch && pressed && indev != NULL) lv_indev_wait_release(indev);
+        multi_touch = true;
+    }
+    else if (frame.count == 0)
+    {
+        multi_touch = false;
+    }
+
+    data->point = last_data.point;
+    data->state = LV_INDEV_STATE_REL;
+    if (frame.count == 1 && !multi_touch)
+    {
+        data->point.x = frame.points[0].x;
+        data->point.y = frame.points[0].y;
+        data->state = LV_INDEV_STATE_PR;
+    }
+
+    touch_filter_sample_t sample;
+    sample.t_ms = now / 1000;
+    sample.x = data->point.x;
+    sample.y = data->point.y;
+    sample.pressed = (data->state == LV_INDEV_STATE_PR);
+    trace_add(&sample);
+
+    touch_filter_process(&sample);
+    data->point.x = sample.x;
+    data->point.y = sample.y;
+
+    if (frame.gesture != last_gesture && frame.gesture != FT6X36_GEST_ID_NO_GESTURE)
+    {
+        atomic_fetch_add(&stat_hw_gestures, 1);
+        if (indev != NULL && data->state == LV_INDEV_STATE_PR) send_gesture(indev, frame.gesture);
+    }
+    last_gesture = frame.gesture;
+
+    if (frameCallback != NULL) frameCallback(&frame);
+
+    if (data->state == LV_INDEV_STATE_PR && !pressed)
+    {
+        pressed = true;
+        int64_t start = press_start_us;
+        if (start != 0) record_latency(esp_timer_get_time() - start);
+    }
+    else if (data->state == LV_INDEV_STATE_REL && pressed)
+    {
+        pressed = false;
+        press_start_us = 0;
+    }
+
+    last_data = *data;
+    return false;
+}
+
+void touch_input_get_stats(touch_input_stats_t * stats)
+{
+    stats->interrupts = atomic_load(&stat_interrupts);
+    stats->i2c_reads = atomic_load(&stat_i2c_reads);
+    stats->skipped_reads = atomic_load(&stat_skipped_reads);
+    stats->presses = atomic_load(&stat_presses);
+    stats->latency_min_us = (stats->presses > 0) ? atomic_load(&stat_latency_min_us) : 0;
+    stats->latency_max_us = atomic_load(&stat_latency_max_us);
+    stats->latency_last_us = atomic_load(&stat_latency_last_us);
+    stats->latency_avg_us = (stats->presses > 0) ? atomic_load(&stat_latency_total_us) / stats->presses : 0;
+    stats->multi_touch_frames = atomic_load(&stat_multi_touch_frames);
+    stats->hw_gestures = atomic_load(&stat_hw_gestures);
+}
+
+void touch_input_reset_stats()
+{
+    atomic_store(&stat_interrupts, 0);
+    atomic_store(&stat_i2c_reads, 0);
+    atomic_store(&stat_skipped_reads, 0);
+    atomic_store(&stat_presses, 0);
+    atomic_store(&stat_latency_min_us, UINT32_MAX);
+    atomic_store(&stat_latency_max_us, 0);
+    atomic_store(&stat_latency_last_us, 0);
+    atomic_store(&stat_latency_total_us, 0);
+    atomic_store(&stat_multi_touch_frames, 0);
+    atomic_store(&stat_hw_gestures, 0);
+}
@@ -0,0 +1,101 @@
+#ifndef TOUCH_INPUT_H
+#define TOUCH_INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lvgl.h"
+#include "ft6x36.h"
+#include "touch_filter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// FT6336U touch, read over I2C only when its INT line says there is something
+// new. The controller is switched to trigger mode, so INT pulses once per
+// report while a finger is down (and at lift-off) instead of being held low;
+// with nothing touching the panel there is no I2C traffic at all.
+//
+// Also times each press from the interrupt to the read that hands it to LVGL.
+//
+// Each read fetches both touch points and the chip's gesture ID. LVGL still
+// sees a single pointer: a second finger cancels the press without a click,
+// and LVGL sees no touch until both fingers lift. The full report goes to the
+// frame callback. Swipes the chip detects are sent to LVGL as LV_EVENT_GESTURE.
+// LVGL's own swipe tracking is turned off after the first one, because not
+// every FT6336U firmware reports gestures.
+//
+// Single-touch points go through the touch_filter chain before LVGL gets them.
+// The raw points are also kept in a short trace to replay through the filters
+// off the device.
+
+#define TOUCH_INT_GPIO          GPIO_NUM_39     // FT6336U INT line on the M5Core2
+#define TOUCH_STUCK_MS          100             // Pressed with no pulse for this long: read anyway
+#define TOUCH_TRACE_LEN         256             // Raw reports kept for replaying
+#define TOUCH_FILTER_BUDGET     20000           // Cycles per filter stage, ~80us at 240MHz
+
+typedef struct touch_input_stats_t
+{
+    uint32_t interrupts;
+    uint32_t i2c_reads;
+    uint32_t skipped_reads;         // Served from the last report, no I2C
+    uint32_t presses;               // Timed presses
+    uint32_t latency_min_us;
+    uint32_t latency_avg_us;
+    uint32_t latency_max_us;
+    uint32_t latency_last_us;
+    uint32_t multi_touch_frames;    // Reads that saw two fingers
+    uint32_t hw_gestures;           // Gestures reported by the chip
+} touch_input_stats_t;
+
+// Called on the GUI thread with every report read from the controller
+typedef void (*TouchFrameCb)(const ft6x36_touch_t * frame);
+
+// Sets up the default filter chain
+void touch_input_init();
+
+// Installs the INT handler. notify_task (a TaskHandle_t) gets a task
+// notification from the ISR; pass NULL if nothing sleeps on touches.
+// Without this every read goes to the controller.
+void touch_input_start_gating(void * notify_task);
+
+// True once the INT handler is in. If the controller couldn't be switched to
+// trigger mode there are no pulses, and the indev read task has to keep polling.
+bool touch_input_gated();
+
+// An INT pulse (or a filter change) that no read has picked up yet
+bool touch_input_pending();
+
+// Drop-in for touch_driver_read. Must be called as the indev read_cb.
+bool touch_input_read(lv_indev_drv_t * drv, lv_indev_data_t * data);
+
+void touch_input_set_frame_cb(TouchFrameCb fn);
+
+// Filter presets for the console
+typedef enum
+{
+    TOUCH_FILTER_PRESET_OFF,
+    TOUCH_FILTER_PRESET_MEDIAN,
+    TOUCH_FILTER_PRESET_EURO,
+    TOUCH_FILTER_PRESET_MEDIAN_EURO,    // Default
+    TOUCH_FILTER_PRESET_COUNT
+} touch_filter_preset_t;
+
+// lead_ms of 0 leaves prediction out of the chain. Safe from any task: the
+// chain is swapped on the GUI thread by the next read.
+bool touch_input_set_filter(touch_filter_preset_t preset, uint16_t lead_ms);
+// The last preset set, whether or not a read has applied it yet
+void touch_input_get_filter(touch_filter_preset_t * preset, uint16_t * lead_ms);
+const char * touch_input_preset_name(touch_filter_preset_t preset);
+
+// Copies up to max raw reports, oldest first. Returns how many were copied.
+uint32_t touch_input_get_trace(touch_filter_sample_t * samples, uint32_t max);
+
+void touch_input_get_stats(touch_input_stats_t * stats);
+void touch_input_reset_stats();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
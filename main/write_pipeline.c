@@ -0,0 +1,192 @@
+#include <stdatomic.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "write_pipeline.h"
+#include "ble_metrics.h"
+
+#define PIPE_TAG "WRITE"
+
+// Used until the GAP reports the real connection interval
+#define DEFAULT_CONN_INTERVAL_US    30000
+
+// Each slot packs [handle:16][pending:1][value:8] so it can be swapped atomically
+#define SLOT_PENDING                (1 << 8)
+#define SLOT_PACK(handle, value)    (((uint32_t)(handle) << 16) | SLOT_PENDING | (value))
+#define SLOT_HANDLE(slot)           ((uint16_t)((slot) >> 16))
+#define SLOT_VALUE(slot)            ((uint8_t)((slot) & 0xFF))
+
+typedef struct
+{
+    atomic_uint_least32_t slots[WRITE_SLOT_COUNT];
+    atomic_bool connected;
+    atomic_bool congested;
+    esp_gatt_if_t gattc_if;
+    uint16_t conn_id;
+    uint32_t conn_interval_us;
+} pipe_link_t;
+
+static pipe_link_t links[WRITE_PIPELINE_MAX_LINKS];
+
+static esp_timer_handle_t flush_timer = NULL;
+static atomic_bool flush_armed = false;
+static int64_t last_flush_us = 0;
+
+static atomic_uint sent_count = 0;
+static atomic_uint merged_count = 0;
+static atomic_uint dropped_count = 0;
+static atomic_uint congested_count = 0;
+
+static void flush_link(uint8_t l)
+{
+    pipe_link_t * link = &links[l];
+
+    if (!atomic_load(&link->connected)) return;
+    if (atomic_load(&link->congested))
+    {
+        // Picked up again when the congestion clears
+        atomic_fetch_add(&congested_count, 1);
+        return;
+    }
+
+    for (int i = 0; i < WRITE_SLOT_COUNT; i++)
+    {
+        uint32_t slot = atomic_exchange(&link->slots[i], 0);
+        if (!(slot & SLOT_PENDING)) continue;
+
+        uint8_t value = SLOT_VALUE(slot);
+        esp_err_t ret = esp_ble_gattc_write_char(link->gattc_if, link->conn_id, SLOT_HANDLE(slot), 1, &value, ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
+        if (ret == ESP_OK)
+        {
+            atomic_fetch_add(&sent_count, 1);
+            ble_metrics_write_sent(l, i);
+        }
+        else
+        {
+            ESP_LOGW(PIPE_TAG, "write failed: %s", esp_err_to_name(ret));
+            atomic_fetch_add(&dropped_count, 1);
+        }
+    }
+}
+
+static void flush_pending(void *arg)
+{
+    (void) arg;
+
+    atomic_store(&flush_armed, false);
+
+    last_flush_us = esp_timer_get_time();
+
+    for (int l = 0; l < WRITE_PIPELINE_MAX_LINKS; l++)
+    {
+        flush_link(l);
+    }
+}
+
+// The shortest interval of the connected links, so no link waits longer than it has to
+static uint32_t flush_interval_us()
+{
+    uint32_t interval = UINT32_MAX;
+    for (int l = 0; l < WRITE_PIPELINE_MAX_LINKS; l++)
+    {
+        if (atomic_load(&links[l].connected) && links[l].conn_interval_us < interval)
+            interval = links[l].conn_interval_us;
+    }
+    return (interval == UINT32_MAX) ? DEFAULT_CONN_INTERVAL_US : interval;
+}
+
+static void schedule_flush()
+{
+    if (flush_timer == NULL || atomic_exchange(&flush_armed, true)) return;
+
+    // Never flush more often than once per connection interval
+    uint32_t interval_us = flush_interval_us();
+    int64_t since_last = esp_timer_get_time() - last_flush_us;
+    uint64_t delay_us = (since_last >= interval_us) ? 0 : (interval_us - since_last);
+
+    if (esp_timer_start_once(flush_timer, delay_us) != ESP_OK)
+    {
+        atomic_store(&flush_armed, false);
+    }
+}
+
+void write_pipeline_init()
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = &flush_pending,
+        .name = "write_flush"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &flush_timer));
+}
+
+void write_pipeline_connected(uint8_t link, esp_gatt_if_t gattc_if, uint16_t conn_id)
+{
+    if (link >= WRITE_PIPELINE_MAX_LINKS) return;
+
+    links[link].gattc_if = gattc_if;
+    links[link].conn_id = conn_id;
+    links[link].conn_interval_us = DEFAULT_CONN_INTERVAL_US;
+    atomic_store(&links[link].congested, false);
+    atomic_store(&links[link].connected, true);
+}
+
+void write_pipeline_disconnected(uint8_t link)
+{
+    if (link >= WRITE_PIPELINE_MAX_LINKS) return;
+
+    atomic_store(&links[link].connected, false);
+
+    for (int i = 0; i < WRITE_SLOT_COUNT; i++)
+    {
+        if (atomic_exchange(&links[link].slots[i], 0) & SLOT_PENDING) atomic_fetch_add(&dropped_count, 1);
+    }
+}
+
+void write_pipeline_set_conn_interval(uint8_t link, uint16_t conn_int)
+{
+    if (link >= WRITE_PIPELINE_MAX_LINKS) return;
+
+    links[link].conn_interval_us = (uint32_t)conn_int * 1250;
+}
+
+static bool any_pending(uint8_t link)
+{
+    for (int i = 0; i < WRITE_SLOT_COUNT; i++)
+    {
+        if (atomic_load(&links[link].slots[i]) & SLOT_PENDING) return true;
+    }
+    return false;
+}
+
+void write_pipeline_set_congested(uint8_t link, bool is_congested)
+{
+    if (link >= WRITE_PIPELINE_MAX_LINKS) return;
+
+    atomic_store(&links[link].congested, is_congested);
+    if (!is_congested && any_pending(link)) schedule_flush();
+}
+
+void write_pipeline_set(uint8_t link, uint8_t slot, uint16_t handle, uint8_t value)
+{
+    if (link >= WRITE_PIPELINE_MAX_LINKS || slot >= WRITE_SLOT_COUNT) return;
+
+    if (!atomic_load(&links[link].connected))
+    {
+        atomic_fetch_add(&dropped_count, 1);
+        return;
+    }
+
+    if (atomic_exchange(&links[link].slots[slot], SLOT_PACK(handle, value)) & SLOT_PENDING)
+    {
+        atomic_fetch_add(&merged_count, 1);
+    }
+
+    schedule_flush();
+}
+
+void write_pipeline_get_stats(write_pipeline_stats_t * stats)
+{
+    stats->sent = atomic_load(&sent_count);
+    stats->merged = atomic_load(&merged_count);
+    stats->dropped = atomic_load(&dropped_count);
+    stats->congested = atomic_load(&congested_count);
+}
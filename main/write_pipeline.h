@@ -0,0 +1,43 @@
+#ifndef WRITE_PIPELINE_H
+#define WRITE_PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_gattc_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Outgoing single-byte commands to the controllers. Only the newest value per
+// slot is kept, and pending values are flushed at most once per connection
+// interval, so sliders can send on every change without flooding the link.
+// Each link has its own slots, indexed by the caller's characteristic id, and
+// a flush sends what's pending on every link back to back.
+#define WRITE_SLOT_COUNT            8
+#define WRITE_PIPELINE_MAX_LINKS    4
+
+typedef struct write_pipeline_stats_t
+{
+    uint32_t sent;          // Writes handed to Bluedroid
+    uint32_t merged;        // Values replaced by a newer one before being sent
+    uint32_t dropped;       // Values discarded (not connected, or the write failed)
+    uint32_t congested;     // Flushes deferred because the link was congested
+} write_pipeline_stats_t;
+
+void write_pipeline_init();
+
+void write_pipeline_connected(uint8_t link, esp_gatt_if_t gattc_if, uint16_t conn_id);
+void write_pipeline_disconnected(uint8_t link);
+void write_pipeline_set_conn_interval(uint8_t link, uint16_t conn_int);   // In 1.25ms units, as reported by the GAP
+void write_pipeline_set_congested(uint8_t link, bool congested);
+
+void write_pipeline_set(uint8_t link, uint8_t slot, uint16_t handle, uint8_t value);
+
+void write_pipeline_get_stats(write_pipeline_stats_t * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif